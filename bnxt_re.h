@@ -53,6 +53,9 @@
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
 #include <linux/interrupt.h>
+#ifdef HAVE_IRQ_POLL
+#include <linux/irq_poll.h>
+#endif
 #include <linux/vmalloc.h>
 #if defined(HAVE_DISASSOCIATE_UCNTX) && defined(HAVE_SCHED_MM_H)
 #include <linux/sched/mm.h>
@@ -120,6 +123,16 @@
 #define BNXT_RE_MAX_GID_PER_VF		128
 
 #define BNXT_RE_RQ_WQE_THRESHOLD	32
+#define BNXT_RE_CQ_DB_THRESH_MAX	1024
+#define BNXT_RE_CQ_DB_THRESH_PCT_MAX	50
+#define BNXT_RE_SQ_DB_BATCH_MAX		64
+#define BNXT_RE_SQ_DB_BATCH_USEC_DEF	10
+#define BNXT_RE_SQ_DB_BATCH_USEC_MAX	100
+#define BNXT_RE_KQ_PUSH_BYTES_MAX	512
+/* WC/PPP pages kernel QPs may hold, the rest stays with user contexts */
+#define BNXT_RE_KQ_PUSH_DPI_MAX		(BNXT_QPLIB_MAX_EXTENDED_PPP_PAGES / 8)
+#define BNXT_RE_CQ_PREFETCH_MAX		16
+#define BNXT_RE_CQ_BUSY_POLL_USEC_MAX	10000
 #define BNXT_RE_UD_QP_HW_STALL		0x400000
 
 /*
@@ -158,6 +171,9 @@ struct bnxt_re_ring_attr {
 
 #define BNXT_RE_MAX_MSIX		64
 #define BNXT_RE_MIN_MSIX		2
+/* Extra CQs a preferred comp_vector NQ may carry over the balanced pick */
+#define BNXT_RE_NQ_LOAD_SLACK	4
+
 struct bnxt_re_nq_record {
 	struct bnxt_msix_entry	msix_entries[BNXT_RE_MAX_MSIX];
 	/* FP Notification Queue (CQ & SRQ) */
@@ -524,11 +540,29 @@ struct bnxt_re_dev {
 	struct bnxt_qplib_dpi		dpi_privileged;
 	struct bnxt_qplib_cc_param	cc_param;
 	struct bnxt_qplib_cq_coal_param cq_coalescing;
+	/* Hold kernel CQ arms back by a DIM chosen period */
+	u8				cq_dim;
+	/* Kernel CQ consumer doorbell deferral, count and % of depth */
+	u32				cq_db_thresh;
+	u32				cq_db_thresh_pct;
+	/* Kernel RC QP SQ doorbell batching, WR count and time bound */
+	u32				sq_db_batch;
+	u32				sq_db_batch_usec;
+	/* Largest kernel QP WQE pushed through WC, 0 disables push */
+	u32				kq_push_bytes;
+	atomic_t			kq_push_dpis;
+	/* Kernel CQ poll lookahead in CQEs, 0 disables prefetch */
+	u32				cq_prefetch;
+	/* Busy-poll idle timeout in usec for opted in kernel CQs, 0 = off */
+	u32				cq_busy_poll_usec;
 	/* serialize update of CC param */
 	struct mutex			cc_lock;
 	/* serialize access to active qp list */
 	struct mutex			qp_lock;
 	struct list_head		qp_list;
+	/* serialize access to the kernel CQ list */
+	struct mutex			kcq_lock;
+	struct list_head		kcq_list;
 
 	/* Start: QP for handling QP1 packets */
 	struct bnxt_re_gsi_context	gsi_ctx;
@@ -556,8 +590,19 @@ struct bnxt_re_dev {
 	struct dentry                   *info;
 	struct dentry                   *drv_dbg_stats;
 	struct dentry                   *sp_perf_stats;
+	struct dentry                   *vf_stats;
+	struct dentry                   *telemetry;
 	struct dentry                   *pdev_debug_dir;
-	struct dentry                   *pdev_qpinfo_dir;
+	struct dentry                   *pdev_qpinfo;
+	struct dentry                   *pdev_cqinfo;
+	/* qp_info filters, BNXT_RE_QP_INFO_ANY when unset. Under qp_lock */
+	u32				qp_info_qpn;
+	u32				qp_info_state;
+#ifdef CONFIG_BNXT_RE_SELFTEST
+	struct dentry			*selftest;
+	/* Report of the last selftest run */
+	char				*selftest_log;
+#endif
 	struct workqueue_struct		*resolve_wq;
 	struct list_head		mac_wq_list;
 	struct workqueue_struct		*dcb_wq;
@@ -707,7 +752,7 @@ int bnxt_re_get_slot_pf_count(struct bnxt_re_dev *rdev);
 struct bnxt_re_dev *bnxt_re_get_peer_pf(struct bnxt_re_dev *rdev);
 struct bnxt_re_dev *bnxt_re_from_netdev(struct net_device *netdev);
 u8 bnxt_re_get_priority_mask(struct bnxt_re_dev *rdev, u8 selector);
-struct bnxt_qplib_nq * bnxt_re_get_nq(struct bnxt_re_dev *rdev);
+struct bnxt_qplib_nq * bnxt_re_get_nq(struct bnxt_re_dev *rdev, int comp_vector);
 void bnxt_re_put_nq(struct bnxt_re_dev *rdev, struct bnxt_qplib_nq *nq);
 
 #define to_bnxt_re(ptr, type, member)	\
@@ -794,10 +839,6 @@ void bnxt_re_debugfs_add_port(struct bnxt_re_dev *rdev, char *dev_name);
 void bnxt_re_debugfs_rem_port(struct bnxt_re_dev *rdev);
 void bnxt_re_add_dbg_files(struct bnxt_re_dev *rdev);
 void bnxt_re_rem_dbg_files(struct bnxt_re_dev *rdev);
-void bnxt_re_qp_info_add_qpinfo(struct bnxt_re_dev *rdev,
-				struct bnxt_re_qp *qp);
-void bnxt_re_qp_info_rem_qpinfo(struct bnxt_re_dev *rdev,
-				struct bnxt_re_qp *qp);
 
 /* Default DCBx and CC values */
 #define BNXT_RE_DEFAULT_CNP_DSCP	48
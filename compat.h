@@ -38,6 +38,7 @@
 #define __BNXT_RE_COMPAT_H__
 
 #include <linux/interrupt.h>
+#include <linux/hrtimer.h>
 #include <linux/configfs.h>
 #include <linux/pci.h>
 #include <linux/version.h>
@@ -505,6 +506,19 @@ static inline void compat_tasklet_init(struct tasklet_struct *t,
 #endif
 }
 
+static inline void
+compat_hrtimer_init(struct hrtimer *timer,
+		    enum hrtimer_restart (*fn)(struct hrtimer *),
+		    clockid_t clock_id, enum hrtimer_mode mode)
+{
+#ifndef HAS_HRTIMER_SETUP
+	hrtimer_init(timer, clock_id, mode);
+	timer->function = fn;
+#else
+	hrtimer_setup(timer, fn, clock_id, mode);
+#endif
+}
+
 #ifndef fallthrough
 #if defined __has_attribute
 #ifndef __GCC4_has_attribute___fallthrough__
@@ -3364,6 +3364,46 @@ static ssize_t stats_query_sec_store(struct config_item *item, const char *buf,
 
 CONFIGFS_ATTR(, stats_query_sec);
 
+static ssize_t stats_max_stale_ms_show(struct config_item *item, char *buf)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+
+	if (!ccgrp)
+		return -EINVAL;
+
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	return sprintf(buf, "%u\n", rdev->stats.stats_max_stale_ms);
+}
+
+static ssize_t stats_max_stale_ms_store(struct config_item *item,
+					const char *buf, size_t count)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+	unsigned int val;
+
+	if (!ccgrp)
+		return -EINVAL;
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+
+	if (sscanf(buf, "%u\n", &val) != 1)
+		return -EINVAL;
+	/* 0 means every stats read queries FW */
+	if (val > BNXT_RE_STATS_MAX_STALE_MS_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(rdev->stats.stats_max_stale_ms, val);
+
+	return strnlen(buf, count);
+}
+
+CONFIGFS_ATTR(, stats_max_stale_ms);
+
 static ssize_t gsi_qp_mode_store(struct config_item *item,
 				 const char *buf, size_t count)
 {
@@ -4217,6 +4257,197 @@ static ssize_t cq_coal_en_ring_idle_mode_store(struct config_item *item, const c
 
 CONFIGFS_ATTR(, cq_coal_en_ring_idle_mode);
 
+static ssize_t cq_dim_show(struct config_item *item, char *buf)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+
+	if (!ccgrp)
+		return -EINVAL;
+
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	return sprintf(buf, "%#x\n", rdev->cq_dim);
+}
+
+static ssize_t cq_dim_store(struct config_item *item, const char *buf,
+			    size_t count)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+	unsigned int val = 0;
+
+	if (!ccgrp)
+		return -EINVAL;
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	if (sscanf(buf, "%x\n", &val) != 1)
+		return -EINVAL;
+	if (val > 1)
+		return -EINVAL;
+#ifndef HAVE_DIM
+	if (val)
+		return -EOPNOTSUPP;
+#endif
+	/* Applies to kernel CQs created from now on */
+	rdev->cq_dim = val;
+	return strnlen(buf, count);
+}
+
+CONFIGFS_ATTR(, cq_dim);
+
+/*
+ * Tunables that are a single u32 in bnxt_re_dev, bounded to [min, max].
+ * Unlike the hex attributes above, these read and write decimal.
+ */
+static ssize_t bnxt_re_cfg_u32_show(struct config_item *item, char *buf,
+				    size_t off)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+
+	if (!ccgrp)
+		return -EINVAL;
+
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	return sprintf(buf, "%u\n", READ_ONCE(*(u32 *)((void *)rdev + off)));
+}
+
+static ssize_t bnxt_re_cfg_u32_store(struct config_item *item, const char *buf,
+				     size_t count, size_t off, u32 min, u32 max,
+				     bool (*valid)(struct bnxt_re_dev *, u32))
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+	u32 val;
+
+	if (!ccgrp)
+		return -EINVAL;
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	if (kstrtou32(buf, 10, &val))
+		return -EINVAL;
+	if (val < min || val > max)
+		return -EINVAL;
+	if (valid && !valid(rdev, val))
+		return -EINVAL;
+	WRITE_ONCE(*(u32 *)((void *)rdev + off), val);
+	return strnlen(buf, count);
+}
+
+#define BNXT_RE_CFG_U32_ATTR(_name, _field, _min, _max, _valid)		\
+static ssize_t _name##_show(struct config_item *item, char *buf)	\
+{									\
+	return bnxt_re_cfg_u32_show(item, buf,				\
+				    offsetof(struct bnxt_re_dev, _field)); \
+}									\
+									\
+static ssize_t _name##_store(struct config_item *item, const char *buf,	\
+			     size_t count)				\
+{									\
+	return bnxt_re_cfg_u32_store(item, buf, count,			\
+				     offsetof(struct bnxt_re_dev, _field), \
+				     _min, _max, _valid);		\
+}									\
+									\
+CONFIGFS_ATTR(, _name)
+
+/* Apply to kernel CQs created from now on */
+BNXT_RE_CFG_U32_ATTR(cq_db_thresh, cq_db_thresh, 0,
+		     BNXT_RE_CQ_DB_THRESH_MAX, NULL);
+BNXT_RE_CFG_U32_ATTR(cq_db_thresh_pct, cq_db_thresh_pct, 0,
+		     BNXT_RE_CQ_DB_THRESH_PCT_MAX, NULL);
+
+/* Apply to kernel RC QPs created from now on */
+BNXT_RE_CFG_U32_ATTR(sq_db_batch, sq_db_batch, 0,
+		     BNXT_RE_SQ_DB_BATCH_MAX, NULL);
+BNXT_RE_CFG_U32_ATTR(sq_db_batch_usec, sq_db_batch_usec, 1,
+		     BNXT_RE_SQ_DB_BATCH_USEC_MAX, NULL);
+
+static bool bnxt_re_kq_push_bytes_valid(struct bnxt_re_dev *rdev, u32 val)
+{
+#ifdef BNXT_QPLIB_KQ_PUSH
+	return !val || BNXT_RE_PUSH_ENABLED(rdev->chip_ctx->modes.db_push_mode);
+#else
+	return !val;
+#endif
+}
+
+/* Applies to kernel RC QPs created from now on */
+BNXT_RE_CFG_U32_ATTR(kq_push_bytes, kq_push_bytes, 0,
+		     BNXT_RE_KQ_PUSH_BYTES_MAX, bnxt_re_kq_push_bytes_valid);
+
+/* Applies to kernel CQs created from now on */
+BNXT_RE_CFG_U32_ATTR(cq_prefetch, cq_prefetch, 0,
+		     BNXT_RE_CQ_PREFETCH_MAX, NULL);
+
+/* Taken by kernel CQs when they opt in to busy-poll */
+BNXT_RE_CFG_U32_ATTR(cq_busy_poll_usec, cq_busy_poll_usec, 0,
+		     BNXT_RE_CQ_BUSY_POLL_USEC_MAX, NULL);
+
+/* Lists the kernel CQs in busy-poll mode, one CQ id per line */
+static ssize_t cq_busy_poll_show(struct config_item *item, char *buf)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	struct bnxt_re_dev *rdev;
+	struct bnxt_re_cq *cq;
+	ssize_t len = 0;
+
+	if (!ccgrp)
+		return -EINVAL;
+
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	mutex_lock(&rdev->kcq_lock);
+	list_for_each_entry(cq, &rdev->kcq_list, kcq_list)
+		if (READ_ONCE(cq->bp_usec))
+			len += scnprintf(buf + len, PAGE_SIZE - len, "%#x\n",
+					 cq->qplib_cq.id);
+	mutex_unlock(&rdev->kcq_lock);
+	return len;
+}
+
+/*
+ * "<cqn> 1" opts kernel CQ <cqn> in to busy-poll mode with the current
+ * cq_busy_poll_usec idle timeout, "<cqn> 0" opts it out. Both in hex.
+ */
+static ssize_t cq_busy_poll_store(struct config_item *item, const char *buf,
+				  size_t count)
+{
+	struct bnxt_re_cfg_group *ccgrp = __get_cc_group(item);
+	unsigned int cqn = 0, val = 0;
+	struct bnxt_re_dev *rdev;
+	struct bnxt_re_cq *cq;
+	int rc = -ENOENT;
+
+	if (!ccgrp)
+		return -EINVAL;
+	rdev = bnxt_re_get_valid_rdev(ccgrp);
+	if (!rdev)
+		return -EINVAL;
+	if (sscanf(buf, "%x %x\n", &cqn, &val) != 2)
+		return -EINVAL;
+	if (val > 1)
+		return -EINVAL;
+	mutex_lock(&rdev->kcq_lock);
+	list_for_each_entry(cq, &rdev->kcq_list, kcq_list) {
+		if (cq->qplib_cq.id == cqn) {
+			rc = bnxt_re_cq_bp_set(cq, val);
+			break;
+		}
+	}
+	mutex_unlock(&rdev->kcq_lock);
+	return rc ? rc : strnlen(buf, count);
+}
+
+CONFIGFS_ATTR(, cq_busy_poll);
+
 #if defined(CONFIGFS_BIN_ATTR)
 static ssize_t
 config_read(struct config_item *item, void *data, size_t count)
@@ -4487,6 +4718,7 @@ static struct config_item_type bnxt_re_udccgrp_type = {
 static struct configfs_attribute *bnxt_re_tun_attrs[] = {
 	CONFIGFS_ATTR_ADD(attr_min_tx_depth),
 	CONFIGFS_ATTR_ADD(attr_stats_query_sec),
+	CONFIGFS_ATTR_ADD(attr_stats_max_stale_ms),
 	CONFIGFS_ATTR_ADD(attr_gsi_qp_mode),
 	CONFIGFS_ATTR_ADD(attr_wqe_mode),
 	CONFIGFS_ATTR_ADD(attr_acc_tx_path),
@@ -4504,12 +4736,22 @@ static struct configfs_attribute *bnxt_re_tun_attrs[] = {
 	CONFIGFS_ATTR_ADD(attr_cq_coal_normal_maxbuf),
 	CONFIGFS_ATTR_ADD(attr_cq_coal_during_maxbuf),
 	CONFIGFS_ATTR_ADD(attr_cq_coal_en_ring_idle_mode),
+	CONFIGFS_ATTR_ADD(attr_cq_dim),
+	CONFIGFS_ATTR_ADD(attr_cq_db_thresh),
+	CONFIGFS_ATTR_ADD(attr_cq_db_thresh_pct),
+	CONFIGFS_ATTR_ADD(attr_sq_db_batch),
+	CONFIGFS_ATTR_ADD(attr_sq_db_batch_usec),
+	CONFIGFS_ATTR_ADD(attr_kq_push_bytes),
+	CONFIGFS_ATTR_ADD(attr_cq_prefetch),
+	CONFIGFS_ATTR_ADD(attr_cq_busy_poll_usec),
+	CONFIGFS_ATTR_ADD(attr_cq_busy_poll),
 	NULL,
 };
 
 static struct configfs_attribute *bnxt_re_p7_tun_attrs[] = {
 	CONFIGFS_ATTR_ADD(attr_min_tx_depth),
 	CONFIGFS_ATTR_ADD(attr_stats_query_sec),
+	CONFIGFS_ATTR_ADD(attr_stats_max_stale_ms),
 	CONFIGFS_ATTR_ADD(attr_gsi_qp_mode),
 	CONFIGFS_ATTR_ADD(attr_acc_tx_path),
 	CONFIGFS_ATTR_ADD(attr_en_qp_dbg),
@@ -4523,6 +4765,15 @@ static struct configfs_attribute *bnxt_re_p7_tun_attrs[] = {
 	CONFIGFS_ATTR_ADD(attr_cq_coal_normal_maxbuf),
 	CONFIGFS_ATTR_ADD(attr_cq_coal_during_maxbuf),
 	CONFIGFS_ATTR_ADD(attr_cq_coal_en_ring_idle_mode),
+	CONFIGFS_ATTR_ADD(attr_cq_dim),
+	CONFIGFS_ATTR_ADD(attr_cq_db_thresh),
+	CONFIGFS_ATTR_ADD(attr_cq_db_thresh_pct),
+	CONFIGFS_ATTR_ADD(attr_sq_db_batch),
+	CONFIGFS_ATTR_ADD(attr_sq_db_batch_usec),
+	CONFIGFS_ATTR_ADD(attr_kq_push_bytes),
+	CONFIGFS_ATTR_ADD(attr_cq_prefetch),
+	CONFIGFS_ATTR_ADD(attr_cq_busy_poll_usec),
+	CONFIGFS_ATTR_ADD(attr_cq_busy_poll),
 	NULL,
 };
 
@@ -39,6 +39,7 @@
 #include "debugfs.h"
 #include "ib_verbs.h"
 #include "hdbr.h"
+#include "selftest.h"
 
 #ifdef ENABLE_DEBUGFS
 
@@ -75,19 +76,46 @@ static const char *qp_state_str[] = {
 	"IB_QPS_ERR"
 };
 
+/* Called with qp_lock held, which also guards the filter */
+static bool bnxt_re_qp_info_match(struct bnxt_re_dev *rdev,
+				  struct bnxt_re_qp *qp)
+{
+	if (rdev->qp_info_qpn != BNXT_RE_QP_INFO_ANY &&
+	    rdev->qp_info_qpn != qp->qplib_qp.id)
+		return false;
+	if (rdev->qp_info_state != BNXT_RE_QP_INFO_ANY &&
+	    rdev->qp_info_state != __to_ib_qp_state(qp->qplib_qp.state))
+		return false;
+	return true;
+}
+
+/* Busy-poll state and counters of @cq, true if it is opted in */
+static bool bnxt_re_cq_bp_read(struct bnxt_re_cq *cq, bool *irq,
+			       u64 *hits, u64 *fallbacks)
+{
+	unsigned long flags;
+	bool on;
+
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	on = !!cq->bp_usec;
+	*irq = cq->bp_irq;
+	*hits = cq->bp_hits;
+	*fallbacks = cq->bp_fallbacks;
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	return on;
+}
 
-static void bnxt_re_fill_qp_info(struct bnxt_re_qp *qp)
+/* Called with qp_lock held, so @qp and its CQs stay around */
+static void bnxt_re_fill_qp_info(struct seq_file *s, struct bnxt_re_dev *rdev,
+				 struct bnxt_re_qp *qp)
 {
-	struct bnxt_re_dev *rdev = qp->rdev;
+	struct bnxt_re_qp_info_entry *entry = &qp->qp_info_entry;
 	struct bnxt_qplib_qp *qplib_qp;
+	u64 hits, fallbacks;
 	u16 type, state;
-	u8 *cur_ptr;
+	bool srq, irq;
 	int rc;
 
-	cur_ptr = qp->qp_data;
-	if (!cur_ptr)
-		return;
-
 	qplib_qp = kcalloc(1, sizeof(*qplib_qp), GFP_KERNEL);
 	if (!qplib_qp)
 		return;
@@ -96,94 +124,222 @@ static void bnxt_re_fill_qp_info(struct bnxt_re_qp *qp)
 	rc = bnxt_qplib_query_qp(&rdev->qplib_res, qplib_qp);
 	if (rc)
 		goto bail;
+	seq_printf(s, "qpn 0x%x\n", qplib_qp->id);
 	type = __from_hw_to_ib_qp_type(qp->qplib_qp.type);
-	cur_ptr += sprintf(cur_ptr, "type \t = %s(%d)\n",
-			   (type > IB_QPT_MAX) ?
-			   "IB_QPT_UNKNOWN" : qp_type_str[type],
-			   type);
+	seq_printf(s, "type \t = %s(%d)\n",
+		   (type > IB_QPT_MAX) ?
+		   "IB_QPT_UNKNOWN" : qp_type_str[type],
+		   type);
 	state =  __to_ib_qp_state(qplib_qp->state);
-	cur_ptr += sprintf(cur_ptr, "state \t = %s(%d)\n",
-			   (state > IB_QPS_ERR) ?
-			   "IB_QPS_UNKNOWN" : qp_state_str[state],
-			   state);
-	cur_ptr += sprintf(cur_ptr, "source qpn \t = %d\n", qplib_qp->id);
+	seq_printf(s, "state \t = %s(%d)\n",
+		   (state > IB_QPS_ERR) ?
+		   "IB_QPS_UNKNOWN" : qp_state_str[state],
+		   state);
+	seq_printf(s, "source qpn \t = %d\n", qplib_qp->id);
 
 	if (type != IB_QPT_UD) {
-		cur_ptr += sprintf(cur_ptr, "dest qpn \t = %d\n", qplib_qp->dest_qpn);
-		cur_ptr += sprintf(cur_ptr, "source port \t = %d\n", qp->qp_info_entry.s_port);
+		seq_printf(s, "dest qpn \t = %d\n", qplib_qp->dest_qpn);
+		seq_printf(s, "source port \t = %d\n", entry->s_port);
 	}
 
-	cur_ptr += sprintf(cur_ptr, "dest port \t = %d\n", qp->qp_info_entry.d_port);
-	cur_ptr += sprintf(cur_ptr, "port \t = %d\n", qplib_qp->port_id);
+	seq_printf(s, "dest port \t = %d\n", entry->d_port);
+	seq_printf(s, "port \t = %d\n", qplib_qp->port_id);
 
 	if (type != IB_QPT_UD) {
-		if (qp->qplib_qp.nw_type == CMDQ_MODIFY_QP_NETWORK_TYPE_ROCEV2_IPV4) {
-			cur_ptr += sprintf(cur_ptr, "source_ipaddr \t = %pI4\n",
-				   &qp->qp_info_entry.s_ip.ipv4_addr);
-			cur_ptr += sprintf(cur_ptr, "destination_ipaddr \t = %pI4\n",
-				   &qp->qp_info_entry.d_ip.ipv4_addr);
+		if (qp->qplib_qp.nw_type ==
+		    CMDQ_MODIFY_QP_NETWORK_TYPE_ROCEV2_IPV4) {
+			seq_printf(s, "source_ipaddr \t = %pI4\n",
+				   &entry->s_ip.ipv4_addr);
+			seq_printf(s, "destination_ipaddr \t = %pI4\n",
+				   &entry->d_ip.ipv4_addr);
 		} else {
-			cur_ptr += sprintf(cur_ptr, "source_ipaddr \t = %pI6\n",
-					   qp->qp_info_entry.s_ip.ipv6_addr);
-			cur_ptr += sprintf(cur_ptr, "destination_ipaddr \t = %pI6\n",
-					   qp->qp_info_entry.d_ip.ipv6_addr);
+			seq_printf(s, "source_ipaddr \t = %pI6\n",
+				   entry->s_ip.ipv6_addr);
+			seq_printf(s, "destination_ipaddr \t = %pI6\n",
+				   entry->d_ip.ipv6_addr);
 		}
 	}
+	if (qp->qplib_qp.push.wc)
+		seq_printf(s, "push \t = %llu pushed %llu fallback\n",
+			   qp->qplib_qp.push.pushed, qp->qplib_qp.push.fallback);
+	srq = !!qp->qplib_qp.srq;
+	seq_printf(s, "hwq mode \t = sq %s %s %s scq %s rcq %s\n",
+		   bnxt_qplib_hwq_mode_str(&qp->qplib_qp.sq.hwq),
+		   srq ? "srq" : "rq",
+		   srq ? bnxt_qplib_hwq_mode_str(&qp->qplib_qp.srq->hwq) :
+			 bnxt_qplib_hwq_mode_str(&qp->qplib_qp.rq.hwq),
+		   qp->scq ? bnxt_qplib_hwq_mode_str(&qp->scq->qplib_cq.hwq) :
+			     "none",
+		   qp->rcq ? bnxt_qplib_hwq_mode_str(&qp->rcq->qplib_cq.hwq) :
+			     "none");
+	if (qp->scq && bnxt_re_cq_bp_read(qp->scq, &irq, &hits, &fallbacks))
+		seq_printf(s, "scq busy poll \t = %llu hits %llu fallbacks\n",
+			   hits, fallbacks);
+	if (qp->rcq && qp->rcq != qp->scq &&
+	    bnxt_re_cq_bp_read(qp->rcq, &irq, &hits, &fallbacks))
+		seq_printf(s, "rcq busy poll \t = %llu hits %llu fallbacks\n",
+			   hits, fallbacks);
+	seq_puts(s, "\n");
 bail:
 	kfree(qplib_qp);
 }
 
-static ssize_t bnxt_re_qp_info_qp_read(struct file *filp, char __user *buffer,
-				       size_t usr_buf_len, loff_t *ppos)
+/*
+ * qp_info walks rdev->qp_list lazily under qp_lock, which seq_file
+ * drops between buffer fills. Only QPs that pass the filter are queried
+ * from FW. *pos counts matching QPs, so a QP created or destroyed
+ * between two reads can shift the output by one record.
+ */
+static struct bnxt_re_qp *bnxt_re_qp_info_next_match(struct bnxt_re_dev *rdev,
+						     struct bnxt_re_qp *qp)
 {
-	struct bnxt_re_qp *qp = filp->private_data;
+	list_for_each_entry_continue(qp, &rdev->qp_list, list)
+		if (bnxt_re_qp_info_match(rdev, qp))
+			return qp;
+	return NULL;
+}
 
-	if (usr_buf_len < BNXT_RE_DEBUGFS_QP_INFO_MAX_SIZE)
-		return -ENOSPC;
+static void *bnxt_re_qp_info_seq_start(struct seq_file *s, loff_t *pos)
+{
+	struct bnxt_re_dev *rdev = s->private;
+	struct bnxt_re_qp *qp;
+	loff_t n = *pos;
+
+	mutex_lock(&rdev->qp_lock);
+	qp = list_entry(&rdev->qp_list, struct bnxt_re_qp, list);
+	do {
+		qp = bnxt_re_qp_info_next_match(rdev, qp);
+	} while (qp && n--);
+	return qp;
+}
 
-	if (!qp->qp_data)
-		return -ENOMEM;
+static void *bnxt_re_qp_info_seq_next(struct seq_file *s, void *v,
+				      loff_t *pos)
+{
+	++*pos;
+	return bnxt_re_qp_info_next_match(s->private, v);
+}
 
-	if (*ppos >= BNXT_RE_DEBUGFS_QP_INFO_MAX_SIZE)
-		return 0;
+static void bnxt_re_qp_info_seq_stop(struct seq_file *s, void *v)
+{
+	struct bnxt_re_dev *rdev = s->private;
 
-	bnxt_re_fill_qp_info(qp);
+	mutex_unlock(&rdev->qp_lock);
+}
 
-	return simple_read_from_buffer(buffer, usr_buf_len, ppos,
-				       (u8 *)(qp->qp_data),
-				       strlen((char *)qp->qp_data));
+static int bnxt_re_qp_info_seq_show(struct seq_file *s, void *v)
+{
+	bnxt_re_fill_qp_info(s, s->private, v);
+	return 0;
 }
 
-static const struct file_operations bnxt_re_qp_info_ops = {
-	.owner = THIS_MODULE,
-	.open = simple_open,
-	.read = bnxt_re_qp_info_qp_read,
+static const struct seq_operations bnxt_re_qp_info_seq_ops = {
+	.start	= bnxt_re_qp_info_seq_start,
+	.next	= bnxt_re_qp_info_seq_next,
+	.stop	= bnxt_re_qp_info_seq_stop,
+	.show	= bnxt_re_qp_info_seq_show,
 };
 
-void bnxt_re_qp_info_add_qpinfo(struct bnxt_re_dev *rdev, struct bnxt_re_qp *qp)
+static int bnxt_re_qp_info_open(struct inode *inode, struct file *file)
 {
-	char qp_name[32];
+	struct seq_file *s;
+	int rc;
 
-	qp->qp_data = kzalloc(BNXT_RE_DEBUGFS_QP_INFO_MAX_SIZE, GFP_KERNEL);
-	if (!qp->qp_data)
-		return;
+	rc = seq_open(file, &bnxt_re_qp_info_seq_ops);
+	if (rc)
+		return rc;
+	s = file->private_data;
+	s->private = inode->i_private;
+	return 0;
+}
 
-	sprintf(qp_name, "0x%x", qp->qplib_qp.id);
-	qp->qp_info_pdev_dentry = debugfs_create_file(qp_name, 0400,
-						      rdev->pdev_qpinfo_dir,
-						      qp,
-						      &bnxt_re_qp_info_ops);
+/*
+ * Set the qp_info filter, applied from the next read:
+ *	"qpn <hex qpn>"	only that QP
+ *	"state <n>"	only QPs in ib_qp_state n
+ *	"all"		no filter
+ */
+static ssize_t bnxt_re_qp_info_write(struct file *file,
+				     const char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct bnxt_re_dev *rdev = s->private;
+	char buf[32] = {};
+	unsigned int val;
+	int rc = count;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+
+	mutex_lock(&rdev->qp_lock);
+	if (sscanf(buf, "qpn %x", &val) == 1) {
+		rdev->qp_info_qpn = val;
+	} else if (sscanf(buf, "state %u", &val) == 1) {
+		if (val > IB_QPS_ERR)
+			rc = -EINVAL;
+		else
+			rdev->qp_info_state = val;
+	} else if (!strncmp(buf, "all", 3)) {
+		rdev->qp_info_qpn = BNXT_RE_QP_INFO_ANY;
+		rdev->qp_info_state = BNXT_RE_QP_INFO_ANY;
+	} else {
+		rc = -EINVAL;
+	}
+	mutex_unlock(&rdev->qp_lock);
+
+	return rc;
 }
 
-void bnxt_re_qp_info_rem_qpinfo(struct bnxt_re_dev *rdev, struct bnxt_re_qp *qp)
+static const struct file_operations bnxt_re_qp_info_ops = {
+	.owner		= THIS_MODULE,
+	.open		= bnxt_re_qp_info_open,
+	.read		= seq_read,
+	.write		= bnxt_re_qp_info_write,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+/*
+ * cq_info lists every kernel CQ, with or without QPs, and its busy-poll
+ * state: off, poll (never armed) or irq (fell back to interrupts). CQs
+ * opt in through the cq_busy_poll configfs knob.
+ */
+static int bnxt_re_cq_info_show(struct seq_file *s, void *unused)
 {
-	debugfs_remove(qp->qp_info_pdev_dentry);
-	qp->qp_info_pdev_dentry = NULL;
+	struct bnxt_re_dev *rdev = s->private;
+	u64 hits, fallbacks;
+	struct bnxt_re_cq *cq;
+	bool on, irq;
+
+	mutex_lock(&rdev->kcq_lock);
+	list_for_each_entry(cq, &rdev->kcq_list, kcq_list) {
+		on = bnxt_re_cq_bp_read(cq, &irq, &hits, &fallbacks);
+		seq_printf(s, "cqn 0x%x depth %u hwq %s busy poll %s %llu hits %llu fallbacks\n",
+			   cq->qplib_cq.id, cq->ib_cq.cqe,
+			   bnxt_qplib_hwq_mode_str(&cq->qplib_cq.hwq),
+			   !on ? "off" : irq ? "irq" : "poll",
+			   hits, fallbacks);
+	}
+	mutex_unlock(&rdev->kcq_lock);
+	return 0;
+}
 
-	kfree(qp->qp_data);
-	qp->qp_data = NULL;
+static int bnxt_re_cq_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bnxt_re_cq_info_show, inode->i_private);
 }
 
+static const struct file_operations bnxt_re_cq_info_ops = {
+	.owner		= THIS_MODULE,
+	.open		= bnxt_re_cq_info_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 /* Clear the driver statistics maintained in the info file */
 static ssize_t bnxt_re_info_debugfs_clear(struct file *fil, const char __user *u,
 					  size_t size, loff_t *off)
@@ -231,27 +387,8 @@ static ssize_t bnxt_re_perf_debugfs_clear(struct file *fil, const char __user *u
 {
 	struct seq_file *m = fil->private_data;
 	struct bnxt_re_dev *rdev = m->private;
-	int i;
-
-	if (!rdev->rcfw.sp_perf_stats_enabled)
-		return size;
-
-	for (i = 0; i < RCFW_MAX_STAT_INDEX; i++) {
-		rdev->rcfw.qp_create_stats[i] = 0;
-		rdev->rcfw.qp_destroy_stats[i] = 0;
-		rdev->rcfw.mr_create_stats[i] = 0;
-		rdev->rcfw.mr_destroy_stats[i] = 0;
-		rdev->rcfw.qp_modify_stats[i] = 0;
-	}
-
-	rdev->rcfw.qp_create_stats_id = 0;
-	rdev->rcfw.qp_destroy_stats_id = 0;
-	rdev->rcfw.mr_create_stats_id = 0;
-	rdev->rcfw.mr_destroy_stats_id = 0;
-	rdev->rcfw.qp_modify_stats_id = 0;
 
-	for (i = 0; i < RCFW_MAX_LATENCY_MSEC_SLAB_INDEX; i++)
-		rdev->rcfw.rcfw_lat_slab_msec[i] = 0;
+	bnxt_qplib_rcfw_lat_clear(&rdev->rcfw);
 
 	return size;
 }
@@ -592,6 +729,7 @@ static int bnxt_re_info_debugfs_show(struct seq_file *s, void *unused)
 	struct bnxt_re_rdata_counters *rstat;
 	struct bnxt_qplib_roce_stats *errs;
 	unsigned long tstamp_diff;
+	u64 nq_bytes;
 	struct pci_dev *pdev;
 	int sched_msec, i;
 	int rc = 0;
@@ -614,7 +752,7 @@ static int bnxt_re_info_debugfs_show(struct seq_file *s, void *unused)
 		if (restrict_stats && tstamp_diff <
 		    msecs_to_jiffies(sched_msec))
 			goto skip_query;
-		rc = bnxt_re_get_device_stats(rdev);
+		rc = bnxt_re_refresh_device_stats(rdev, true);
 		if (rc)
 			dev_err(rdev_to_dev(rdev),
 				"Failed to query device stats\n");
@@ -671,6 +809,8 @@ skip_query:
 		   atomic_read(&rdev->stats.rsors.max_pd_count));
 	seq_printf(s, "\tResize CQ count: %d\n",
 		   atomic_read(&rdev->stats.rsors.resize_count));
+	/* Keep a concurrent refresh from tearing the FW counters */
+	mutex_lock(&rdev->stats.refresh_lock);
 	seq_printf(s, "\tRecoverable Errors: %lld\n",
 		   rstat ? rstat->tx_bcast_pkts : 0);
 	if (rdev->binfo)
@@ -741,12 +881,58 @@ skip_query:
 			seq_printf(s, "\tres_oos_drop_count: %llu\n",
 					errs->res_oos_drop_count);
 	}
+	mutex_unlock(&rdev->stats.refresh_lock);
 
 	seq_printf(s, "\tnum_irq_started : %u\n", rdev->rcfw.num_irq_started);
 	seq_printf(s, "\tnum_irq_stopped : %u\n", rdev->rcfw.num_irq_stopped);
 	seq_printf(s, "\tpoll_in_intr_en : %u\n", rdev->rcfw.poll_in_intr_en);
 	seq_printf(s, "\tpoll_in_intr_dis : %u\n", rdev->rcfw.poll_in_intr_dis);
 	seq_printf(s, "\tcmdq_full_dbg_cnt : %u\n", rdev->rcfw.cmdq_full_dbg);
+	seq_printf(s, "\tcmdq_async_sent : %llu\n", rdev->rcfw.async_sent);
+	seq_printf(s, "\tcmdq_async_cancelled : %llu\n",
+		   rdev->rcfw.async_cancelled);
+	seq_printf(s, "\tcmdq_bulk_db : %llu cmds : %llu\n",
+		   rdev->rcfw.bulk_db_count, rdev->rcfw.bulk_cmd_count);
+	for (i = 0; i < BNXT_QPLIB_RCFW_LANE_MAX; i++) {
+		struct bnxt_qplib_rcfw_lane_stats *lane =
+			&rdev->rcfw.lane_stats[i];
+
+		seq_printf(s, "\tcmdq_lane[%s] sent: %lld waited: %lld deferred: %lld starved: %lld\n",
+			   i == BNXT_QPLIB_RCFW_LANE_CRIT ? "crit" : "bg",
+			   (s64)atomic64_read(&lane->sent),
+			   (s64)atomic64_read(&lane->waited),
+			   (s64)atomic64_read(&lane->deferred),
+			   (s64)atomic64_read(&lane->starved));
+	}
+	seq_printf(s, "\tcmdq_sbuf_pool hit: %llu miss: %llu\n",
+		   rdev->rcfw.sbuf_pool.hit, rdev->rcfw.sbuf_pool.miss);
+	seq_printf(s, "\tstats_cache hits: %llu refreshes: %llu max_stale_ms: %u\n",
+		   (u64)atomic64_read(&rdev->stats.cache_hits),
+		   rdev->stats.cache_refreshes,
+		   rdev->stats.stats_max_stale_ms);
+	nq_bytes = 0;
+	for (i = 0; i < rdev->nqr->max_init; i++) {
+		struct bnxt_qplib_nq_stats *nq_stats = &rdev->nqr->nq[i].stats;
+		struct bnxt_qplib_hwq *nq_hwq = &rdev->nqr->nq[i].hwq;
+		u64 bytes = 0;
+		int lvl;
+
+		for (lvl = PBL_LVL_0; lvl <= nq_hwq->level; lvl++)
+			bytes += (u64)nq_hwq->pbl[lvl].pg_count *
+				 nq_hwq->pbl[lvl].pg_size;
+		nq_bytes += bytes;
+		seq_printf(s, "\tnq[%d] mode %u tasklet_resched: %llu poll_resched: %llu budget_exhausted: %llu rearm: %llu\n",
+			   i, rdev->nqr->nq[i].poll_mode,
+			   nq_stats->num_tasklet_resched,
+			   nq_stats->num_poll_resched,
+			   nq_stats->num_budget_exhausted,
+			   nq_stats->num_nq_rearm);
+		seq_printf(s, "\tnq[%d] depth: %u max_cqs: %u load: %u bytes: %llu hwq: %s\n",
+			   i, nq_hwq->max_elements, rdev->nqr->nq[i].max_cqs,
+			   rdev->nqr->nq[i].load, bytes,
+			   bnxt_qplib_hwq_mode_str(nq_hwq));
+	}
+	seq_printf(s, "\tnq_total_bytes: %llu\n", nq_bytes);
 	if (!rdev->is_virtfn)
 		seq_printf(s, "\tfw_service_prof_type_sup : %u\n",
 			   is_qport_service_type_supported(rdev));
@@ -797,15 +983,10 @@ err:
 
 static int bnxt_re_perf_debugfs_show(struct seq_file *s, void *unused)
 {
-	u64 qp_create_total_msec = 0, qp_destroy_total_msec = 0;
-	u64 mr_create_total_msec = 0, mr_destroy_total_msec = 0;
-	int qp_create_total = 0, qp_destroy_total = 0;
-	int mr_create_total = 0, mr_destroy_total = 0;
-	u64 qp_modify_err_total_msec = 0;
-	int qp_modify_err_total = 0;
+	u64 bucket[RCFW_LAT_HIST_BUCKETS];
 	struct bnxt_re_dev *rdev;
-	bool add_entry = false;
-	int i;
+	u64 count, sum_us;
+	int row, i;
 
 	rdev = s->private;
 	seq_printf(s, "bnxt_re perf stats: %s shadow qd %d Driver Version - %s\n",
@@ -816,64 +997,33 @@ static int bnxt_re_perf_debugfs_show(struct seq_file *s, void *unused)
 	if (!rdev->rcfw.sp_perf_stats_enabled)
 		return -ENOMEM;
 
-	for (i = 0; i < RCFW_MAX_LATENCY_MSEC_SLAB_INDEX; i++) {
-		if (rdev->rcfw.rcfw_lat_slab_msec[i])
-			seq_printf(s, "\tlatency_slab [%d - %d] msec = %d\n",
-				i, i + 1, rdev->rcfw.rcfw_lat_slab_msec[i]);
-	}
-
 	if (!bnxt_re_is_rdev_valid(rdev))
 		return -ENODEV;
 
-	for (i = 0; i < RCFW_MAX_STAT_INDEX; i++) {
-		if (rdev->rcfw.qp_create_stats[i] > 0) {
-			qp_create_total++;
-			qp_create_total_msec += rdev->rcfw.qp_create_stats[i];
-			add_entry = true;
-		}
-		if (rdev->rcfw.qp_destroy_stats[i] > 0) {
-			qp_destroy_total++;
-			qp_destroy_total_msec += rdev->rcfw.qp_destroy_stats[i];
-			add_entry = true;
-		}
-		if (rdev->rcfw.mr_create_stats[i] > 0) {
-			mr_create_total++;
-			mr_create_total_msec += rdev->rcfw.mr_create_stats[i];
-			add_entry = true;
-		}
-		if (rdev->rcfw.mr_destroy_stats[i] > 0) {
-			mr_destroy_total++;
-			mr_destroy_total_msec += rdev->rcfw.mr_destroy_stats[i];
-			add_entry = true;
-		}
-		if (rdev->rcfw.qp_modify_stats[i] > 0) {
-			qp_modify_err_total++;
-			qp_modify_err_total_msec += rdev->rcfw.qp_modify_stats[i];
-			add_entry = true;
-		}
-
-		if (add_entry)
-			seq_printf(s, "<qp_create> %lld <qp_destroy> %lld <mr_create> %lld "
-				      "<mr_destroy> %lld <qp_modify_to_err> %lld\n",
-				      rdev->rcfw.qp_create_stats[i],
-				      rdev->rcfw.qp_destroy_stats[i],
-				      rdev->rcfw.mr_create_stats[i],
-				      rdev->rcfw.mr_destroy_stats[i],
-				      rdev->rcfw.qp_modify_stats[i]);
-
-		add_entry = false;
+	/* Percentiles are bucket upper bounds, a trailing '+' means the
+	 * sample landed in the last (open ended) bucket.
+	 */
+	for (row = 0; row < RCFW_LAT_HIST_ROWS; row++) {
+		count = bnxt_qplib_rcfw_lat_read(&rdev->rcfw, row, bucket,
+						 &sum_us);
+		if (!count)
+			continue;
+		if (row == RCFW_LAT_HIST_QP_MODIFY_ERR)
+			seq_puts(s, "qp_modify_to_err:");
+		else
+			seq_printf(s, "opcode 0x%02x:", row);
+		seq_printf(s, " count %llu avg_us %llu p50_us %llu p99_us %llu p999_us %llu%s\n",
+			   count, div64_u64(sum_us, count),
+			   bnxt_qplib_rcfw_lat_pct(bucket, count, 500),
+			   bnxt_qplib_rcfw_lat_pct(bucket, count, 990),
+			   bnxt_qplib_rcfw_lat_pct(bucket, count, 999),
+			   bucket[RCFW_LAT_HIST_BUCKETS - 1] ? "+" : "");
+		seq_puts(s, "\tlog2_us:");
+		for (i = 0; i < RCFW_LAT_HIST_BUCKETS; i++)
+			if (bucket[i])
+				seq_printf(s, " [%d]=%llu", i, bucket[i]);
+		seq_puts(s, "\n");
 	}
-
-	seq_printf(s, "Total qp_create %d in msec %lld\n",
-		   qp_create_total, qp_create_total_msec);
-	seq_printf(s, "Total qp_destroy %d in msec %lld\n",
-		   qp_destroy_total, qp_destroy_total_msec);
-	seq_printf(s, "Total mr_create %d in msec %lld\n",
-		   mr_create_total, mr_create_total_msec);
-	seq_printf(s, "Total mr_destroy %d in msec %lld\n",
-		   mr_destroy_total, mr_destroy_total_msec);
-	seq_printf(s, "Total qp_modify_err_total %d in msec %lld\n",
-		   qp_modify_err_total, qp_modify_err_total_msec);
 	seq_puts(s, "\n");
 
 	return 0;
@@ -932,6 +1082,266 @@ static int bnxt_re_drv_stats_debugfs_show(struct seq_file *s, void *unused)
 	return rc;
 }
 
+/* Returns where the @count records of the section go */
+static void *bnxt_re_tlm_add_sec(struct bnxt_re_tlm_hdr *hdr, void *pos,
+				 u16 type, u16 count, u32 rec_len)
+{
+	struct bnxt_re_tlm_sec_hdr *sec = pos;
+
+	sec->type = cpu_to_le16(type);
+	sec->count = cpu_to_le16(count);
+	sec->len = cpu_to_le32(count * rec_len);
+	le16_add_cpu(&hdr->num_sections, 1);
+	return pos + sizeof(*sec);
+}
+
+static void bnxt_re_tlm_fill_rdata(struct bnxt_re_tlm_rdata *rec,
+				   const struct bnxt_re_rdata_counters *src)
+{
+	rec->tx_ucast_pkts = cpu_to_le64(src->tx_ucast_pkts);
+	rec->tx_mcast_pkts = cpu_to_le64(src->tx_mcast_pkts);
+	rec->tx_bcast_pkts = cpu_to_le64(src->tx_bcast_pkts);
+	rec->tx_discard_pkts = cpu_to_le64(src->tx_discard_pkts);
+	rec->tx_error_pkts = cpu_to_le64(src->tx_error_pkts);
+	rec->tx_ucast_bytes = cpu_to_le64(src->tx_ucast_bytes);
+	rec->tx_mcast_bytes = cpu_to_le64(src->tx_mcast_bytes);
+	rec->tx_bcast_bytes = cpu_to_le64(src->tx_bcast_bytes);
+	rec->rx_ucast_pkts = cpu_to_le64(src->rx_ucast_pkts);
+	rec->rx_mcast_pkts = cpu_to_le64(src->rx_mcast_pkts);
+	rec->rx_bcast_pkts = cpu_to_le64(src->rx_bcast_pkts);
+	rec->rx_discard_pkts = cpu_to_le64(src->rx_discard_pkts);
+	rec->rx_error_pkts = cpu_to_le64(src->rx_error_pkts);
+	rec->rx_ucast_bytes = cpu_to_le64(src->rx_ucast_bytes);
+	rec->rx_mcast_bytes = cpu_to_le64(src->rx_mcast_bytes);
+	rec->rx_bcast_bytes = cpu_to_le64(src->rx_bcast_bytes);
+	rec->rx_agg_pkts = cpu_to_le64(src->rx_agg_pkts);
+	rec->rx_agg_bytes = cpu_to_le64(src->rx_agg_bytes);
+	rec->rx_agg_events = cpu_to_le64(src->rx_agg_events);
+	rec->rx_agg_aborts = cpu_to_le64(src->rx_agg_aborts);
+}
+
+static void bnxt_re_tlm_fill_roce_err(struct bnxt_re_tlm_roce_err *rec,
+				      const struct bnxt_qplib_roce_stats *src)
+{
+	rec->to_retransmits = cpu_to_le64(src->to_retransmits);
+	rec->seq_err_naks_rcvd = cpu_to_le64(src->seq_err_naks_rcvd);
+	rec->max_retry_exceeded = cpu_to_le64(src->max_retry_exceeded);
+	rec->rnr_naks_rcvd = cpu_to_le64(src->rnr_naks_rcvd);
+	rec->missing_resp = cpu_to_le64(src->missing_resp);
+	rec->unrecoverable_err = cpu_to_le64(src->unrecoverable_err);
+	rec->bad_resp_err = cpu_to_le64(src->bad_resp_err);
+	rec->local_qp_op_err = cpu_to_le64(src->local_qp_op_err);
+	rec->local_protection_err = cpu_to_le64(src->local_protection_err);
+	rec->mem_mgmt_op_err = cpu_to_le64(src->mem_mgmt_op_err);
+	rec->remote_invalid_req_err = cpu_to_le64(src->remote_invalid_req_err);
+	rec->remote_access_err = cpu_to_le64(src->remote_access_err);
+	rec->remote_op_err = cpu_to_le64(src->remote_op_err);
+	rec->dup_req = cpu_to_le64(src->dup_req);
+	rec->res_exceed_max = cpu_to_le64(src->res_exceed_max);
+	rec->res_length_mismatch = cpu_to_le64(src->res_length_mismatch);
+	rec->res_exceeds_wqe = cpu_to_le64(src->res_exceeds_wqe);
+	rec->res_opcode_err = cpu_to_le64(src->res_opcode_err);
+	rec->res_rx_invalid_rkey = cpu_to_le64(src->res_rx_invalid_rkey);
+	rec->res_rx_domain_err = cpu_to_le64(src->res_rx_domain_err);
+	rec->res_rx_no_perm = cpu_to_le64(src->res_rx_no_perm);
+	rec->res_rx_range_err = cpu_to_le64(src->res_rx_range_err);
+	rec->res_tx_invalid_rkey = cpu_to_le64(src->res_tx_invalid_rkey);
+	rec->res_tx_domain_err = cpu_to_le64(src->res_tx_domain_err);
+	rec->res_tx_no_perm = cpu_to_le64(src->res_tx_no_perm);
+	rec->res_tx_range_err = cpu_to_le64(src->res_tx_range_err);
+	rec->res_irrq_oflow = cpu_to_le64(src->res_irrq_oflow);
+	rec->res_unsup_opcode = cpu_to_le64(src->res_unsup_opcode);
+	rec->res_unaligned_atomic = cpu_to_le64(src->res_unaligned_atomic);
+	rec->res_rem_inv_err = cpu_to_le64(src->res_rem_inv_err);
+	rec->res_mem_error = cpu_to_le64(src->res_mem_error);
+	rec->res_srq_err = cpu_to_le64(src->res_srq_err);
+	rec->res_cmp_err = cpu_to_le64(src->res_cmp_err);
+	rec->res_invalid_dup_rkey = cpu_to_le64(src->res_invalid_dup_rkey);
+	rec->res_wqe_format_err = cpu_to_le64(src->res_wqe_format_err);
+	rec->res_cq_load_err = cpu_to_le64(src->res_cq_load_err);
+	rec->res_srq_load_err = cpu_to_le64(src->res_srq_load_err);
+	rec->res_tx_pci_err = cpu_to_le64(src->res_tx_pci_err);
+	rec->res_rx_pci_err = cpu_to_le64(src->res_rx_pci_err);
+	rec->res_oos_drop_count = cpu_to_le64(src->res_oos_drop_count);
+	rec->active_qp_count_p0 = cpu_to_le64(src->active_qp_count_p0);
+	rec->active_qp_count_p1 = cpu_to_le64(src->active_qp_count_p1);
+	rec->active_qp_count_p2 = cpu_to_le64(src->active_qp_count_p2);
+	rec->active_qp_count_p3 = cpu_to_le64(src->active_qp_count_p3);
+}
+
+/* The driver counters below are live, each one is read once */
+static void bnxt_re_tlm_fill_dbq(struct bnxt_re_tlm_dbq *rec,
+				 const struct bnxt_re_dbq_stats *src)
+{
+	rec->fifo_occup_slab_1 = cpu_to_le64(READ_ONCE(src->fifo_occup_slab_1));
+	rec->fifo_occup_slab_2 = cpu_to_le64(READ_ONCE(src->fifo_occup_slab_2));
+	rec->fifo_occup_slab_3 = cpu_to_le64(READ_ONCE(src->fifo_occup_slab_3));
+	rec->fifo_occup_slab_4 = cpu_to_le64(READ_ONCE(src->fifo_occup_slab_4));
+	rec->fifo_occup_water_mark = cpu_to_le64(READ_ONCE(src->fifo_occup_water_mark));
+	rec->do_pacing_slab_1 = cpu_to_le64(READ_ONCE(src->do_pacing_slab_1));
+	rec->do_pacing_slab_2 = cpu_to_le64(READ_ONCE(src->do_pacing_slab_2));
+	rec->do_pacing_slab_3 = cpu_to_le64(READ_ONCE(src->do_pacing_slab_3));
+	rec->do_pacing_slab_4 = cpu_to_le64(READ_ONCE(src->do_pacing_slab_4));
+	rec->do_pacing_slab_5 = cpu_to_le64(READ_ONCE(src->do_pacing_slab_5));
+	rec->do_pacing_water_mark = cpu_to_le64(READ_ONCE(src->do_pacing_water_mark));
+	rec->do_pacing_retry = cpu_to_le64(READ_ONCE(src->do_pacing_retry));
+}
+
+static void bnxt_re_tlm_fill_nq(struct bnxt_re_tlm_nq *rec,
+				const struct bnxt_qplib_nq_stats *src)
+{
+	rec->num_dbqne_processed = cpu_to_le64(READ_ONCE(src->num_dbqne_processed));
+	rec->num_srqne_processed = cpu_to_le64(READ_ONCE(src->num_srqne_processed));
+	rec->num_cqne_processed = cpu_to_le64(READ_ONCE(src->num_cqne_processed));
+	rec->num_tasklet_resched = cpu_to_le64(READ_ONCE(src->num_tasklet_resched));
+	rec->num_poll_resched = cpu_to_le64(READ_ONCE(src->num_poll_resched));
+	rec->num_nq_rearm = cpu_to_le64(READ_ONCE(src->num_nq_rearm));
+	rec->num_budget_exhausted = cpu_to_le64(READ_ONCE(src->num_budget_exhausted));
+}
+
+static void bnxt_re_tlm_fill_creq(struct bnxt_re_tlm_creq *rec,
+				  const struct bnxt_qplib_creq_stat *src)
+{
+	rec->creq_arm_count = cpu_to_le64(READ_ONCE(src->creq_arm_count));
+	rec->creq_tasklet_schedule_count = cpu_to_le64(READ_ONCE(src->creq_tasklet_schedule_count));
+	rec->creq_qp_event_processed = cpu_to_le64(READ_ONCE(src->creq_qp_event_processed));
+	rec->creq_func_event_processed = cpu_to_le64(READ_ONCE(src->creq_func_event_processed));
+}
+
+/*
+ * The blob is built once at open time so that every read() of one open
+ * file returns the same snapshot. The FW counters and the generation are
+ * copied from rdev->stats.snap in one seqlock read section, so they all
+ * come from the same refresh.
+ */
+static int bnxt_re_tlm_debugfs_open(struct inode *inode, struct file *file)
+{
+	struct bnxt_re_dev *rdev = inode->i_private;
+	struct bnxt_re_stats_snap *snap = &rdev->stats.snap;
+	struct bnxt_re_tlm_roce_err *err;
+	struct bnxt_re_tlm_rdata *rdata;
+	struct bnxt_re_tlm_hdr *hdr;
+	struct bnxt_re_tlm_nq *nq;
+	u32 len, num_nq, nports;
+	unsigned int seq;
+	void *buf, *pos;
+	u64 generation;
+	int i;
+
+	if (test_bit(BNXT_RE_FLAG_IBDEV_REGISTERED, &rdev->flags))
+		bnxt_re_refresh_device_stats(rdev, false);
+
+	nports = ARRAY_SIZE(snap->dstat.rstat);
+	num_nq = rdev->nqr->max_init;
+	len = sizeof(*hdr) + 5 * sizeof(struct bnxt_re_tlm_sec_hdr) +
+	      nports * sizeof(*rdata) + sizeof(*err) +
+	      sizeof(struct bnxt_re_tlm_dbq) +
+	      num_nq * sizeof(*nq) +
+	      sizeof(struct bnxt_re_tlm_creq);
+	buf = kvzalloc(len, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	hdr = buf;
+	hdr->magic = cpu_to_le32(BNXT_RE_TLM_MAGIC);
+	hdr->version = cpu_to_le16(BNXT_RE_TLM_VERSION);
+	hdr->hdr_len = cpu_to_le32(sizeof(*hdr));
+	hdr->tstamp_ns = cpu_to_le64(ktime_get_ns());
+	pos = buf + sizeof(*hdr);
+
+	pos = bnxt_re_tlm_add_sec(hdr, pos, BNXT_RE_TLM_SEC_RDATA, nports,
+				  sizeof(*rdata));
+	rdata = pos;
+	pos += nports * sizeof(*rdata);
+	pos = bnxt_re_tlm_add_sec(hdr, pos, BNXT_RE_TLM_SEC_ROCE_ERR, 1,
+				  sizeof(*err));
+	err = pos;
+	pos += sizeof(*err);
+	do {
+		seq = read_seqbegin(&rdev->stats.snap_lock);
+		generation = snap->generation;
+		for (i = 0; i < nports; i++)
+			bnxt_re_tlm_fill_rdata(&rdata[i],
+					       &snap->dstat.rstat[i]);
+		bnxt_re_tlm_fill_roce_err(err, &snap->dstat.errs);
+	} while (read_seqretry(&rdev->stats.snap_lock, seq));
+	hdr->generation = cpu_to_le64(generation);
+
+	if (rdev->dbg_stats) {
+		pos = bnxt_re_tlm_add_sec(hdr, pos, BNXT_RE_TLM_SEC_DBQ, 1,
+					  sizeof(struct bnxt_re_tlm_dbq));
+		bnxt_re_tlm_fill_dbq(pos, &rdev->dbg_stats->dbq);
+		pos += sizeof(struct bnxt_re_tlm_dbq);
+	}
+	pos = bnxt_re_tlm_add_sec(hdr, pos, BNXT_RE_TLM_SEC_NQ, num_nq,
+				  sizeof(*nq));
+	nq = pos;
+	for (i = 0; i < num_nq; i++)
+		bnxt_re_tlm_fill_nq(&nq[i], &rdev->nqr->nq[i].stats);
+	pos += num_nq * sizeof(*nq);
+	pos = bnxt_re_tlm_add_sec(hdr, pos, BNXT_RE_TLM_SEC_CREQ, 1,
+				  sizeof(struct bnxt_re_tlm_creq));
+	bnxt_re_tlm_fill_creq(pos, &rdev->rcfw.creq.stats);
+	pos += sizeof(struct bnxt_re_tlm_creq);
+	hdr->total_len = cpu_to_le32(pos - buf);
+
+	file->private_data = buf;
+	return 0;
+}
+
+static ssize_t bnxt_re_tlm_debugfs_read(struct file *file, char __user *ubuf,
+					size_t count, loff_t *ppos)
+{
+	struct bnxt_re_tlm_hdr *hdr = file->private_data;
+
+	return simple_read_from_buffer(ubuf, count, ppos, hdr,
+				       le32_to_cpu(hdr->total_len));
+}
+
+static int bnxt_re_tlm_debugfs_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+	return 0;
+}
+
+static int bnxt_re_vf_stats_debugfs_show(struct seq_file *s, void *unused)
+{
+	struct bnxt_re_dev *rdev = s->private;
+	struct bnxt_re_vf_stats *vfs = &rdev->stats.vfs;
+	struct bnxt_qplib_roce_stats *st;
+	int i, rc;
+
+	rc = bnxt_re_sweep_vf_stats(rdev, false);
+	if (rc && rc != -EOPNOTSUPP)
+		dev_err(rdev_to_dev(rdev), "VF stats sweep failed, rc = %d\n",
+			rc);
+
+	mutex_lock(&vfs->lock);
+	seq_printf(s, "=====[ IBDEV %s ]=============================\n",
+		   rdev->ibdev.name);
+	seq_printf(s, "\tnum_vfs : %u\n", vfs->num_vfs);
+	seq_printf(s, "\tfilled : %u\n", vfs->filled);
+	seq_printf(s, "\tsweeps : %llu\n", vfs->sweeps);
+	seq_printf(s, "\tlast_sweep_us : %llu\n", vfs->last_sweep_us);
+	seq_printf(s, "\tmax_sweep_us : %llu\n", vfs->max_sweep_us);
+	for (i = 0; i < vfs->num_vfs; i++) {
+		if (vfs->rcs[i]) {
+			seq_printf(s, "\tvf[%d] rc: %d\n", i, vfs->rcs[i]);
+			continue;
+		}
+		st = &vfs->tbl[i];
+		seq_printf(s, "\tvf[%d] active_qps: %llu to_retransmits: %llu seq_err_naks_rcvd: %llu rnr_naks_rcvd: %llu missing_resp: %llu dup_req: %llu oos_drop_count: %llu\n",
+			   i, st->active_qp_count_p0, st->to_retransmits,
+			   st->seq_err_naks_rcvd, st->rnr_naks_rcvd,
+			   st->missing_resp, st->dup_req,
+			   st->res_oos_drop_count);
+	}
+	mutex_unlock(&vfs->lock);
+	seq_puts(s, "\n");
+
+	return 0;
+}
+
 static int bnxt_re_info_debugfs_open(struct inode *inode, struct file *file)
 {
 	struct bnxt_re_dev *rdev = inode->i_private;
@@ -953,6 +1363,13 @@ static int bnxt_re_drv_stats_debugfs_open(struct inode *inode, struct file *file
 	return single_open(file, bnxt_re_drv_stats_debugfs_show, rdev);
 }
 
+static int bnxt_re_vf_stats_debugfs_open(struct inode *inode, struct file *file)
+{
+	struct bnxt_re_dev *rdev = inode->i_private;
+
+	return single_open(file, bnxt_re_vf_stats_debugfs_show, rdev);
+}
+
 static int bnxt_re_debugfs_release(struct inode *inode, struct file *file)
 {
 	return single_release(inode, file);
@@ -985,10 +1402,33 @@ static const struct file_operations bnxt_re_drv_stats_dbg_ops = {
 	.release	= bnxt_re_debugfs_release,
 };
 
+static const struct file_operations bnxt_re_tlm_dbg_ops = {
+	.owner		= THIS_MODULE,
+	.open		= bnxt_re_tlm_debugfs_open,
+	.read		= bnxt_re_tlm_debugfs_read,
+	.llseek		= default_llseek,
+	.release	= bnxt_re_tlm_debugfs_release,
+};
+
+static const struct file_operations bnxt_re_vf_stats_dbg_ops = {
+	.owner		= THIS_MODULE,
+	.open		= bnxt_re_vf_stats_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= bnxt_re_debugfs_release,
+};
+
 void bnxt_re_add_dbg_files(struct bnxt_re_dev *rdev)
 {
-	rdev->pdev_qpinfo_dir = debugfs_create_dir("qp_info",
-						   rdev->pdev_debug_dir);
+	rdev->qp_info_qpn = BNXT_RE_QP_INFO_ANY;
+	rdev->qp_info_state = BNXT_RE_QP_INFO_ANY;
+	rdev->pdev_qpinfo = debugfs_create_file("qp_info", 0600,
+						rdev->pdev_debug_dir, rdev,
+						&bnxt_re_qp_info_ops);
+	rdev->pdev_cqinfo = debugfs_create_file("cq_info", 0400,
+						rdev->pdev_debug_dir, rdev,
+						&bnxt_re_cq_info_ops);
+	bnxt_re_selftest_add_dbg(rdev);
 }
 
 static ssize_t bnxt_re_hdbr_dfs_read(struct file *filp, char __user *buffer,
@@ -1147,12 +1587,22 @@ void bnxt_re_debugfs_add_port(struct bnxt_re_dev *rdev, char *dev_name)
 	rdev->drv_dbg_stats = debugfs_create_file("drv_dbg_stats", 0644,
 						  rdev->port_debug_dir, rdev,
 						  &bnxt_re_drv_stats_dbg_ops);
+	rdev->telemetry = debugfs_create_file("telemetry", 0400,
+					      rdev->port_debug_dir, rdev,
+					      &bnxt_re_tlm_dbg_ops);
+	if (!rdev->is_virtfn)
+		rdev->vf_stats = debugfs_create_file("vf_stats", 0400,
+						     rdev->port_debug_dir, rdev,
+						     &bnxt_re_vf_stats_dbg_ops);
 }
 
 void bnxt_re_rem_dbg_files(struct bnxt_re_dev *rdev)
 {
-	debugfs_remove_recursive(rdev->pdev_qpinfo_dir);
-	rdev->pdev_qpinfo_dir = NULL;
+	bnxt_re_selftest_rem_dbg(rdev);
+	debugfs_remove(rdev->pdev_cqinfo);
+	rdev->pdev_cqinfo = NULL;
+	debugfs_remove(rdev->pdev_qpinfo);
+	rdev->pdev_qpinfo = NULL;
 }
 
 void bnxt_re_debugfs_rem_port(struct bnxt_re_dev *rdev)
@@ -37,7 +37,147 @@
 #ifndef __BNXT_RE_DEBUGFS__
 #define __BNXT_RE_DEBUGFS__
 
-#define BNXT_RE_DEBUGFS_QP_INFO_MAX_SIZE	512
+/* qp_info filter value matching every QP */
+#define BNXT_RE_QP_INFO_ANY	((u32)-1)
+
+/*
+ * Binary telemetry blob read from the per port "telemetry" debugfs file.
+ * It is a bnxt_re_tlm_hdr followed by hdr.num_sections sections, each a
+ * bnxt_re_tlm_sec_hdr and sec.count records of the bnxt_re_tlm_* type
+ * named by the section type. All fields are little endian. Records are
+ * only ever extended at their end, readers take the record size as
+ * sec.len / sec.count and ignore what they do not know. Any other change
+ * to the layout bumps BNXT_RE_TLM_VERSION.
+ */
+#define BNXT_RE_TLM_MAGIC	0x424e5452	/* "BNTR" */
+#define BNXT_RE_TLM_VERSION	1
+
+struct bnxt_re_tlm_hdr {
+	__le32	magic;
+	__le16	version;
+	__le16	num_sections;
+	__le32	hdr_len;
+	__le32	total_len;
+	/* Device stats refresh the FW counters were published by */
+	__le64	generation;
+	__le64	tstamp_ns;
+};
+
+enum bnxt_re_tlm_sec_type {
+	BNXT_RE_TLM_SEC_RDATA = 1,	/* bnxt_re_tlm_rdata, one per port */
+	BNXT_RE_TLM_SEC_ROCE_ERR,	/* bnxt_re_tlm_roce_err */
+	BNXT_RE_TLM_SEC_DBQ,		/* bnxt_re_tlm_dbq */
+	BNXT_RE_TLM_SEC_NQ,		/* bnxt_re_tlm_nq, one per NQ */
+	BNXT_RE_TLM_SEC_CREQ,		/* bnxt_re_tlm_creq */
+};
+
+struct bnxt_re_tlm_sec_hdr {
+	__le16	type;
+	__le16	count;
+	__le32	len;
+};
+
+struct bnxt_re_tlm_rdata {
+	__le64	tx_ucast_pkts;
+	__le64	tx_mcast_pkts;
+	__le64	tx_bcast_pkts;
+	__le64	tx_discard_pkts;
+	__le64	tx_error_pkts;
+	__le64	tx_ucast_bytes;
+	__le64	tx_mcast_bytes;
+	__le64	tx_bcast_bytes;
+	__le64	rx_ucast_pkts;
+	__le64	rx_mcast_pkts;
+	__le64	rx_bcast_pkts;
+	__le64	rx_discard_pkts;
+	__le64	rx_error_pkts;
+	__le64	rx_ucast_bytes;
+	__le64	rx_mcast_bytes;
+	__le64	rx_bcast_bytes;
+	__le64	rx_agg_pkts;
+	__le64	rx_agg_bytes;
+	__le64	rx_agg_events;
+	__le64	rx_agg_aborts;
+};
+
+struct bnxt_re_tlm_roce_err {
+	__le64	to_retransmits;
+	__le64	seq_err_naks_rcvd;
+	__le64	max_retry_exceeded;
+	__le64	rnr_naks_rcvd;
+	__le64	missing_resp;
+	__le64	unrecoverable_err;
+	__le64	bad_resp_err;
+	__le64	local_qp_op_err;
+	__le64	local_protection_err;
+	__le64	mem_mgmt_op_err;
+	__le64	remote_invalid_req_err;
+	__le64	remote_access_err;
+	__le64	remote_op_err;
+	__le64	dup_req;
+	__le64	res_exceed_max;
+	__le64	res_length_mismatch;
+	__le64	res_exceeds_wqe;
+	__le64	res_opcode_err;
+	__le64	res_rx_invalid_rkey;
+	__le64	res_rx_domain_err;
+	__le64	res_rx_no_perm;
+	__le64	res_rx_range_err;
+	__le64	res_tx_invalid_rkey;
+	__le64	res_tx_domain_err;
+	__le64	res_tx_no_perm;
+	__le64	res_tx_range_err;
+	__le64	res_irrq_oflow;
+	__le64	res_unsup_opcode;
+	__le64	res_unaligned_atomic;
+	__le64	res_rem_inv_err;
+	__le64	res_mem_error;
+	__le64	res_srq_err;
+	__le64	res_cmp_err;
+	__le64	res_invalid_dup_rkey;
+	__le64	res_wqe_format_err;
+	__le64	res_cq_load_err;
+	__le64	res_srq_load_err;
+	__le64	res_tx_pci_err;
+	__le64	res_rx_pci_err;
+	__le64	res_oos_drop_count;
+	__le64	active_qp_count_p0;
+	__le64	active_qp_count_p1;
+	__le64	active_qp_count_p2;
+	__le64	active_qp_count_p3;
+};
+
+struct bnxt_re_tlm_dbq {
+	__le64	fifo_occup_slab_1;
+	__le64	fifo_occup_slab_2;
+	__le64	fifo_occup_slab_3;
+	__le64	fifo_occup_slab_4;
+	__le64	fifo_occup_water_mark;
+	__le64	do_pacing_slab_1;
+	__le64	do_pacing_slab_2;
+	__le64	do_pacing_slab_3;
+	__le64	do_pacing_slab_4;
+	__le64	do_pacing_slab_5;
+	__le64	do_pacing_water_mark;
+	__le64	do_pacing_retry;
+};
+
+struct bnxt_re_tlm_nq {
+	__le64	num_dbqne_processed;
+	__le64	num_srqne_processed;
+	__le64	num_cqne_processed;
+	__le64	num_tasklet_resched;
+	__le64	num_poll_resched;
+	__le64	num_nq_rearm;
+	__le64	num_budget_exhausted;
+};
+
+struct bnxt_re_tlm_creq {
+	__le64	creq_arm_count;
+	__le64	creq_tasklet_schedule_count;
+	__le64	creq_qp_event_processed;
+	__le64	creq_func_event_processed;
+};
 
 extern struct list_head bnxt_re_dev_list;
 
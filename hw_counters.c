@@ -137,6 +137,10 @@ static const struct rdma_stat_desc bnxt_re_stat_descs[] = {
 	[BNXT_RE_PACING_CMPL].name		= "pacing_complete",
 	[BNXT_RE_PACING_ALERT].name		= "pacing_alerts",
 	[BNXT_RE_DB_FIFO_REG].name		= "db_fifo_register",
+	[BNXT_RE_VF_SWEEP_US].name		= "vf_stats_sweep_us",
+	[BNXT_RE_VF_SWEEP_FILLED].name		= "vf_stats_sweep_filled",
+	[BNXT_RE_SQ_DB_SAVED].name		= "sq_db_saved",
+	[BNXT_RE_SQ_DB_TIMER_FLUSH].name	= "sq_db_timer_flush",
 };
 #else
 static const char *const bnxt_re_stat_name[] = {
@@ -232,13 +236,17 @@ static const char *const bnxt_re_stat_name[] = {
 	[BNXT_RE_PACING_CMPL]			= "pacing_complete",
 	[BNXT_RE_PACING_ALERT]			= "pacing_alerts",
 	[BNXT_RE_DB_FIFO_REG]			= "db_fifo_register",
+	[BNXT_RE_VF_SWEEP_US]			= "vf_stats_sweep_us",
+	[BNXT_RE_VF_SWEEP_FILLED]		= "vf_stats_sweep_filled",
+	[BNXT_RE_SQ_DB_SAVED]			= "sq_db_saved",
+	[BNXT_RE_SQ_DB_TIMER_FLUSH]		= "sq_db_timer_flush",
 };
 #endif /* HAVE_RDMA_STAT_DESC */
 
 static void bnxt_re_copy_roce_only_stats(struct bnxt_re_dev *rdev,
 					 struct rdma_hw_stats *stats)
 {
-	struct bnxt_re_ro_counters *roce_only = &rdev->stats.dstat.cur[0];
+	struct bnxt_re_ro_counters *roce_only = &rdev->stats.snap.dstat.cur[0];
 
 	/* Do not polulate RoCE Only stats for VF from  Thor onwards */
 	if (_is_chip_gen_p5_p7(rdev->chip_ctx) && rdev->is_virtfn)
@@ -255,7 +263,7 @@ static void bnxt_re_copy_normal_total_stats(struct bnxt_re_dev *rdev,
 {
 
 	if (_is_chip_gen_p5_p7(rdev->chip_ctx) && rdev->is_virtfn) {
-		struct bnxt_re_rdata_counters *rstat = &rdev->stats.dstat.rstat[0];
+		struct bnxt_re_rdata_counters *rstat = &rdev->stats.snap.dstat.rstat[0];
 
 		/* Only for VF from Thor onwards */
 		stats->value[BNXT_RE_RX_PKTS] = rstat->rx_ucast_pkts;
@@ -266,8 +274,8 @@ static void bnxt_re_copy_normal_total_stats(struct bnxt_re_dev *rdev,
 		struct bnxt_re_ro_counters *roce_only;
 		struct bnxt_re_cc_stat *cnps;
 
-		cnps = &rdev->stats.cnps;
-		roce_only = &rdev->stats.dstat.cur[0];
+		cnps = &rdev->stats.snap.cnps;
+		roce_only = &rdev->stats.snap.dstat.cur[0];
 
 		stats->value[BNXT_RE_RX_PKTS] = cnps->cur[0].cnp_rx_pkts + roce_only->rx_pkts;
 		stats->value[BNXT_RE_RX_BYTES] = cnps->cur[0].cnp_rx_bytes + roce_only->rx_bytes;
@@ -285,7 +293,7 @@ static void bnxt_re_copy_ext_stats(struct bnxt_re_dev *rdev,
 {
 	struct bnxt_re_ext_rstat *ext_s;
 
-	ext_s = &rdev->stats.dstat.ext_rstat[0];
+	ext_s = &rdev->stats.snap.dstat.ext_rstat[0];
 
 	stats->value[BNXT_RE_TX_ATOMIC_REQ] = ext_s->tx.atomic_req;
 	stats->value[BNXT_RE_TX_READ_REQ]   = ext_s->tx.read_req;
@@ -299,7 +307,7 @@ static void bnxt_re_copy_ext_stats(struct bnxt_re_dev *rdev,
 	stats->value[BNXT_RE_RX_SEND_REQ]   = ext_s->rx.send_req;
 	stats->value[BNXT_RE_RX_GOOD_PKTS]  = ext_s->grx.rx_pkts;
 	stats->value[BNXT_RE_RX_GOOD_BYTES] = ext_s->grx.rx_bytes;
-	stats->value[BNXT_RE_OOB] = rdev->stats.dstat.e_errs.oob;
+	stats->value[BNXT_RE_OOB] = rdev->stats.snap.dstat.e_errs.oob;
 }
 
 static void bnxt_re_copy_err_stats(struct bnxt_re_dev *rdev,
@@ -408,15 +416,20 @@ int bnxt_re_get_hw_stats(struct ib_device *ibdev,
 	struct bnxt_re_res_cntrs *res_s = &rdev->stats.rsors;
 	struct bnxt_qplib_roce_stats *err_s = NULL;
 	struct bnxt_re_rdata_counters *hw_stats;
+	unsigned int seq;
+	bool ext_stats;
 	int rc;
 
 	if (!port || !stats)
 		return -EINVAL;
 
-	err_s = &rdev->stats.dstat.errs;
-	hw_stats = &rdev->stats.dstat.rstat[0];
+	err_s = &rdev->stats.snap.dstat.errs;
+	hw_stats = &rdev->stats.snap.dstat.rstat[0];
+	ext_stats = bnxt_ext_stats_supported(rdev->chip_ctx,
+					     rdev->dev_attr->dev_cap_flags,
+					     rdev->is_virtfn);
 
-	rc = bnxt_re_get_device_stats(rdev);
+	rc = bnxt_re_refresh_device_stats(rdev, false);
 	if (rc) {
 		dev_err(rdev_to_dev(rdev), "Failed to query device stats\n");
 		return rc;
@@ -441,25 +454,40 @@ int bnxt_re_get_hw_stats(struct ib_device *ibdev,
 	stats->value[BNXT_RE_WATERMARK_PD] = atomic_read(&res_s->max_pd_count);
 	stats->value[BNXT_RE_WATERMARK_AH] = atomic_read(&res_s->max_ah_count);
 	stats->value[BNXT_RE_RESIZE_CQ_CNT] = atomic_read(&res_s->resize_count);
-	stats->value[BNXT_RE_RECOVERABLE_ERRORS] = hw_stats->tx_bcast_pkts;
 
-	stats->value[BNXT_RE_TX_DISCARDS] = hw_stats->tx_discard_pkts;
-	stats->value[BNXT_RE_TX_ERRORS] = hw_stats->tx_error_pkts;
-	stats->value[BNXT_RE_RX_ERRORS] = hw_stats->rx_error_pkts;
-	stats->value[BNXT_RE_RX_DISCARDS] = hw_stats->rx_discard_pkts;
+	/* The FW counters must all come from the same refresh */
+	do {
+		seq = read_seqbegin(&rdev->stats.snap_lock);
+		stats->value[BNXT_RE_RECOVERABLE_ERRORS] = hw_stats->tx_bcast_pkts;
 
-	bnxt_re_copy_roce_only_stats(rdev, stats);
+		stats->value[BNXT_RE_TX_DISCARDS] = hw_stats->tx_discard_pkts;
+		stats->value[BNXT_RE_TX_ERRORS] = hw_stats->tx_error_pkts;
+		stats->value[BNXT_RE_RX_ERRORS] = hw_stats->rx_error_pkts;
+		stats->value[BNXT_RE_RX_DISCARDS] = hw_stats->rx_discard_pkts;
 
-	bnxt_re_copy_normal_total_stats(rdev, stats);
+		bnxt_re_copy_roce_only_stats(rdev, stats);
 
-	bnxt_re_copy_err_stats(rdev, stats, err_s);
+		bnxt_re_copy_normal_total_stats(rdev, stats);
+
+		bnxt_re_copy_err_stats(rdev, stats, err_s);
+
+		if (ext_stats)
+			bnxt_re_copy_ext_stats(rdev, stats);
+	} while (read_seqretry(&rdev->stats.snap_lock, seq));
 
 	if (rdev->dbr_pacing)
 		bnxt_re_copy_db_pacing_stats(rdev, stats);
 
-	if (bnxt_ext_stats_supported(rdev->chip_ctx, rdev->dev_attr->dev_cap_flags,
-				     rdev->is_virtfn))
-		bnxt_re_copy_ext_stats(rdev, stats);
+	if (_is_chip_gen_p5_p7(rdev->chip_ctx)) {
+		/* Last sweep only, reading hw stats does not trigger one */
+		stats->value[BNXT_RE_VF_SWEEP_US] =
+			rdev->stats.vfs.last_sweep_us;
+		stats->value[BNXT_RE_VF_SWEEP_FILLED] = rdev->stats.vfs.filled;
+		stats->value[BNXT_RE_SQ_DB_SAVED] =
+			atomic64_read(&rdev->stats.sq_db_saved);
+		stats->value[BNXT_RE_SQ_DB_TIMER_FLUSH] =
+			atomic64_read(&rdev->stats.sq_db_timer_flush);
+	}
 
 	return _is_chip_gen_p5_p7(rdev->chip_ctx) ?
 		BNXT_RE_NUM_EXT_COUNTERS : BNXT_RE_NUM_STD_COUNTERS;
@@ -131,6 +131,10 @@ enum bnxt_re_hw_stats {
 	BNXT_RE_PACING_CMPL,
 	BNXT_RE_PACING_ALERT,
 	BNXT_RE_DB_FIFO_REG,
+	BNXT_RE_VF_SWEEP_US,
+	BNXT_RE_VF_SWEEP_FILLED,
+	BNXT_RE_SQ_DB_SAVED,
+	BNXT_RE_SQ_DB_TIMER_FLUSH,
 	BNXT_RE_NUM_EXT_COUNTERS
 };
 
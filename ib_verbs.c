@@ -807,9 +807,7 @@ static int bnxt_re_legacy_bind_fence_mw(struct bnxt_qplib_qp *qplib_qp)
 	struct bnxt_qplib_swqe wqe;
 	int rc;
 
-	/* TODO: Need SQ locking here when Fence WQE
-	 * posting moves up into bnxt_re from bnxt_qplib.
-	 */
+	/* Caller holds qp->sq_lock */
 	memcpy(&wqe, fence_wqe, sizeof(wqe));
 	wqe.bind.r_key = fence->bind_rkey;
 	fence->bind_rkey = ib_inc_rkey(fence->bind_rkey);
@@ -1800,6 +1798,7 @@ int bnxt_re_modify_srq(struct ib_srq *ib_srq, struct ib_srq_attr *srq_attr,
 	struct bnxt_re_srq *srq = to_bnxt_re(ib_srq, struct bnxt_re_srq,
 					     ib_srq);
 	struct bnxt_re_dev *rdev = srq->rdev;
+	unsigned long flags;
 	int rc;
 
 	switch (srq_attr_mask) {
@@ -1811,8 +1810,11 @@ int bnxt_re_modify_srq(struct ib_srq *ib_srq, struct ib_srq_attr *srq_attr,
 		if (srq_attr->srq_limit > srq->qplib_srq.max_wqe)
 			return -EINVAL;
 
+		/* The arm doorbell shares the shadow key with post_srq_recv */
+		spin_lock_irqsave(&srq->lock, flags);
 		srq->qplib_srq.threshold = srq_attr->srq_limit;
 		rc = bnxt_qplib_modify_srq(&rdev->qplib_res, &srq->qplib_srq);
+		spin_unlock_irqrestore(&srq->lock, flags);
 		if (rc) {
 			dev_err(rdev_to_dev(rdev), "Modify HW SRQ failed!");
 			return rc;
@@ -1904,6 +1906,156 @@ void bnxt_re_unlock_cqs(struct bnxt_re_qp *qp,
 	spin_unlock_irqrestore(&qp->scq->cq_lock, flags);
 }
 
+/*
+ * SQ doorbell batching for kernel RC QPs. WRs posted by consecutive
+ * post_send calls share one doorbell, rung once sq_db_batch WRs are
+ * pending, sq_db_usec after the oldest unrung WR, or when the send CQ
+ * is polled, whichever comes first. Lock order is cq_lock -> sq_lock.
+ */
+static void __bnxt_re_sq_db_flush(struct bnxt_re_qp *qp)
+{
+	bool rang;
+
+	if (!qp->sq_db_pending)
+		return;
+	rang = bnxt_qplib_post_send_db(&qp->qplib_qp);
+	/* Every owed doorbell but the one rung here was skipped */
+	if (qp->sq_db_calls > rang)
+		atomic64_add(qp->sq_db_calls - rang,
+			     &qp->rdev->stats.sq_db_saved);
+	qp->sq_db_pending = 0;
+	qp->sq_db_calls = 0;
+}
+
+static enum hrtimer_restart bnxt_re_sq_db_timer_fn(struct hrtimer *timer)
+{
+	struct bnxt_re_qp *qp = container_of(timer, struct bnxt_re_qp,
+					     sq_db_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&qp->sq_lock, flags);
+	if (qp->sq_db_pending) {
+		__bnxt_re_sq_db_flush(qp);
+		atomic64_inc(&qp->rdev->stats.sq_db_timer_flush);
+	}
+	spin_unlock_irqrestore(&qp->sq_lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/* Called with sq_lock held, once per post_send call */
+static void bnxt_re_sq_db_defer(struct bnxt_re_qp *qp, u32 nposted)
+{
+	if (!nposted)
+		return;
+	/* A call whose WRs all went out with PUSH_END owes no doorbell */
+	if (!bnxt_qplib_sq_db_pushed(&qp->qplib_qp))
+		qp->sq_db_calls++;
+	qp->sq_db_pending += nposted;
+	if (qp->sq_db_pending >= qp->sq_db_batch) {
+		__bnxt_re_sq_db_flush(qp);
+		return;
+	}
+	/* The deadline runs from the oldest unrung WR and is never pushed */
+	if (qp->sq_db_pending == nposted)
+		hrtimer_start(&qp->sq_db_timer, us_to_ktime(qp->sq_db_usec),
+			      HRTIMER_MODE_REL);
+}
+
+/*
+ * Called with cq->cq_lock held, which guards cq->sq_db_list, and takes
+ * the sq_lock of each QP on it: cq_lock -> sq_lock. Nothing may take a
+ * cq_lock while holding an sq_lock.
+ */
+static void bnxt_re_sq_db_flush_cq(struct bnxt_re_cq *cq)
+{
+	struct bnxt_re_qp *qp;
+
+	lockdep_assert_held(&cq->cq_lock);
+
+	list_for_each_entry(qp, &cq->sq_db_list, sq_db_entry) {
+		if (!READ_ONCE(qp->sq_db_pending))
+			continue;
+		spin_lock(&qp->sq_lock);
+		__bnxt_re_sq_db_flush(qp);
+		spin_unlock(&qp->sq_lock);
+	}
+}
+
+static void bnxt_re_sq_db_batch_init(struct bnxt_re_qp *qp)
+{
+	struct bnxt_re_dev *rdev = qp->rdev;
+	unsigned long flags;
+
+	/* Never hold back more than half of the SQ */
+	qp->sq_db_batch = min_t(u32, rdev->sq_db_batch,
+				qp->qplib_qp.sq.max_wqe / 2);
+	if (qp->sq_db_batch < 2) {
+		qp->sq_db_batch = 0;
+		return;
+	}
+	qp->sq_db_usec = rdev->sq_db_batch_usec;
+	compat_hrtimer_init(&qp->sq_db_timer, bnxt_re_sq_db_timer_fn,
+			    CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	spin_lock_irqsave(&qp->scq->cq_lock, flags);
+	list_add_tail(&qp->sq_db_entry, &qp->scq->sq_db_list);
+	spin_unlock_irqrestore(&qp->scq->cq_lock, flags);
+}
+
+static void bnxt_re_sq_db_batch_cleanup(struct bnxt_re_qp *qp)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&qp->scq->cq_lock, flags);
+	list_del(&qp->sq_db_entry);
+	spin_unlock_irqrestore(&qp->scq->cq_lock, flags);
+	hrtimer_cancel(&qp->sq_db_timer);
+}
+
+#ifdef BNXT_QPLIB_KQ_PUSH
+/*
+ * WQE push for kernel QPs. Each QP takes its own WC DPI page, at most
+ * BNXT_RE_KQ_PUSH_DPI_MAX per device so user contexts keep their push
+ * pages; on PPP chips push is armed only once FW grants ping-pong push
+ * on the RESET->INIT transition.
+ */
+static void bnxt_re_kq_push_init(struct bnxt_re_qp *qp)
+{
+	struct bnxt_qplib_push *push = &qp->qplib_qp.push;
+	struct bnxt_re_dev *rdev = qp->rdev;
+
+	if (!BNXT_RE_PUSH_ENABLED(rdev->chip_ctx->modes.db_push_mode))
+		return;
+	if (atomic_inc_return(&rdev->kq_push_dpis) > BNXT_RE_KQ_PUSH_DPI_MAX)
+		goto no_push;
+	if (bnxt_qplib_alloc_dpi(&rdev->qplib_res, &qp->push_dpi, qp,
+				 BNXT_QPLIB_DPI_TYPE_WC)) {
+		memset(&qp->push_dpi, 0, sizeof(qp->push_dpi));
+		goto no_push;
+	}
+	push->slot_size = PAGE_SIZE / BNXT_QPLIB_PUSH_SLOTS;
+	push->max_bytes = min_t(u32, rdev->kq_push_bytes,
+				push->slot_size - BNXT_QPLIB_PUSH_HDR_SIZE);
+	if (!BNXT_RE_PPP_ENABLED(rdev->chip_ctx))
+		push->wc = qp->push_dpi.dbr;
+	return;
+no_push:
+	atomic_dec(&rdev->kq_push_dpis);
+	dev_dbg(rdev_to_dev(rdev), "QP 0x%x: no WC DPI left, push disabled\n",
+		qp->qplib_qp.id);
+}
+#endif
+
+static void bnxt_re_kq_push_cleanup(struct bnxt_re_qp *qp)
+{
+	qp->qplib_qp.push.wc = NULL;
+	if (!qp->push_dpi.dbr)
+		return;
+	bnxt_qplib_dealloc_dpi(&qp->rdev->qplib_res, &qp->push_dpi);
+	memset(&qp->push_dpi, 0, sizeof(qp->push_dpi));
+	atomic_dec(&qp->rdev->kq_push_dpis);
+}
+
 /* Queue Pairs */
 static int bnxt_re_destroy_gsi_sqp(struct bnxt_re_qp *qp)
 {
@@ -1956,9 +2108,8 @@ static int bnxt_re_destroy_gsi_sqp(struct bnxt_re_qp *qp)
 
 static void bnxt_re_dump_debug_stats(struct bnxt_re_dev *rdev, u32 active_qps)
 {
-	u32	total_qp = 0;
-	u64	avg_time = 0;
-	int	i;
+	u64	bucket[RCFW_LAT_HIST_BUCKETS];
+	u64	total_qp, total_us;
 
 	if (!rdev->rcfw.sp_perf_stats_enabled)
 		return;
@@ -1966,16 +2117,13 @@ static void bnxt_re_dump_debug_stats(struct bnxt_re_dev *rdev, u32 active_qps)
 	switch (active_qps) {
 	case 1:
 		/* Potential hint for Test Stop */
-		for (i = 0; i < RCFW_MAX_STAT_INDEX; i++) {
-			if (rdev->rcfw.qp_destroy_stats[i]) {
-				total_qp++;
-				avg_time += rdev->rcfw.qp_destroy_stats[i];
-			}
-		}
+		total_qp = bnxt_qplib_rcfw_lat_read(&rdev->rcfw,
+						    CMDQ_BASE_OPCODE_DESTROY_QP,
+						    bucket, &total_us);
 		dev_dbg(rdev_to_dev(rdev),
-			"Perf Debug: %ps Total (%d) QP destroyed in (%d) msec",
+			"Perf Debug: %ps Total (%llu) QP destroyed in (%llu) msec",
 			__builtin_return_address(0), total_qp,
-			jiffies_to_msecs(avg_time));
+			div_u64(total_us, USEC_PER_MSEC));
 		break;
 	case 2:
 		/* Potential hint for Test Start */
@@ -2023,11 +2171,12 @@ int bnxt_re_destroy_qp(struct ib_qp *ib_qp
 		rdev->ppp_stats.ppp_enabled_qps--;
 	mutex_unlock(&rdev->qp_lock);
 
+	if (qp->sq_db_batch)
+		bnxt_re_sq_db_batch_cleanup(qp);
+
 	if (rdev->hdbr_enabled)
 		bnxt_re_hdbr_db_unreg_qp(rdev, qp);
 
-	bnxt_re_qp_info_rem_qpinfo(rdev, qp);
-
 	if (!ib_qp->uobject)
 		bnxt_qplib_flush_cqn_wq(&qp->qplib_qp);
 
@@ -2036,6 +2185,7 @@ int bnxt_re_destroy_qp(struct ib_qp *ib_qp
 		dev_err_ratelimited(rdev_to_dev(rdev),
 				   "%s id = %d failed rc = %d",
 				    __func__, qp->qplib_qp.id, rc);
+	bnxt_re_kq_push_cleanup(qp);
 
 	if (!ib_qp->uobject) {
 		flags = bnxt_re_lock_cqs(qp);
@@ -2442,6 +2592,8 @@ static struct bnxt_re_qp *bnxt_re_create_shadow_qp(struct bnxt_re_pd *pd,
 	dev_dbg(rdev_to_dev(rdev), "Created shadow QP with ID = %d\n",
 		qp->qplib_qp.id);
 	spin_lock_init(&qp->sq_lock);
+	/* The shadow RQ is only replenished from the GSI CQ poll path */
+	qp->qplib_qp.sq.fp_lock = &qp->sq_lock;
 	INIT_LIST_HEAD(&qp->list);
 	mutex_lock(&rdev->qp_lock);
 	list_add_tail(&qp->list, &rdev->qp_list);
@@ -2945,7 +3097,16 @@ ALLOC_QP_RET bnxt_re_create_qp(ALLOC_QP_IN *qp_in,
 		rdev->gsi_ctx.gsi_qp = qp;
 	spin_lock_init(&qp->sq_lock);
 	spin_lock_init(&qp->rq_lock);
+	qp->qplib_qp.sq.fp_lock = &qp->sq_lock;
+	qp->qplib_qp.rq.fp_lock = &qp->rq_lock;
 	INIT_LIST_HEAD(&qp->list);
+	INIT_LIST_HEAD(&qp->sq_db_entry);
+	if (!udata && qp_init_attr->qp_type == IB_QPT_RC && rdev->sq_db_batch)
+		bnxt_re_sq_db_batch_init(qp);
+#ifdef BNXT_QPLIB_KQ_PUSH
+	if (!udata && qp_init_attr->qp_type == IB_QPT_RC && rdev->kq_push_bytes)
+		bnxt_re_kq_push_init(qp);
+#endif
 	mutex_lock(&rdev->qp_lock);
 	list_add_tail(&qp->list, &rdev->qp_list);
 	mutex_unlock(&rdev->qp_lock);
@@ -2953,7 +3114,6 @@ ALLOC_QP_RET bnxt_re_create_qp(ALLOC_QP_IN *qp_in,
 	active_qps = atomic_read(&rdev->stats.rsors.qp_count);
 	if (active_qps > atomic_read(&rdev->stats.rsors.max_qp_count))
 		atomic_set(&rdev->stats.rsors.max_qp_count, active_qps);
-	bnxt_re_qp_info_add_qpinfo(rdev, qp);
 	BNXT_RE_DBR_LIST_ADD(rdev, qp, BNXT_RE_RES_TYPE_QP);
 
 	bnxt_re_dump_debug_stats(rdev, active_qps);
@@ -3210,6 +3370,13 @@ int bnxt_re_modify_qp(struct ib_qp *ib_qp, struct ib_qp_attr *qp_attr,
 				}
 			}
 		}
+		if (!udata && qp->push_dpi.dbr &&
+		    BNXT_RE_PPP_ENABLED(rdev->chip_ctx) &&
+		    curr_qp_state == IB_QPS_RESET &&
+		    new_qp_state == IB_QPS_INIT) {
+			ppp->req = BNXT_QPLIB_PPP_REQ;
+			ppp->dpi = qp->push_dpi.dpi;
+		}
 	}
 	if (qp_attr_mask & IB_QP_EN_SQD_ASYNC_NOTIFY) {
 		qp->qplib_qp.modify_flags |=
@@ -3428,6 +3595,18 @@ int bnxt_re_modify_qp(struct ib_qp *ib_qp, struct ib_qp_attr *qp_attr,
 		is_copy_to_udata = true;
 		rdev->ppp_stats.ppp_enabled_qps++;
 	}
+	if (!udata && ppp->req && !qp->qplib_qp.push.wc && qp->push_dpi.dbr) {
+		if (ppp->st_idx_en & CREQ_MODIFY_QP_RESP_PINGPONG_PUSH_ENABLED) {
+			qp->qplib_qp.push.st_idx = (ppp->st_idx_en >>
+						    BNXT_QPLIB_PPP_ST_IDX_SHIFT) &
+						   (BNXT_QPLIB_PUSH_SLOTS - 1);
+			qp->qplib_qp.push.wc = qp->push_dpi.dbr;
+			rdev->ppp_stats.ppp_enabled_qps++;
+		} else {
+			/* Not granted, give the PPP page back */
+			bnxt_re_kq_push_cleanup(qp);
+		}
+	}
 
 	if (is_copy_to_udata) {
 		rc = bnxt_re_copy_to_udata(rdev, &resp,
@@ -4381,6 +4560,7 @@ int bnxt_re_post_send(struct ib_qp *ib_qp, CONST_STRUCT ib_send_wr *wr,
 	struct bnxt_qplib_swqe wqe;
 	struct bnxt_re_dev *rdev;
 	unsigned long flags;
+	u32 nposted = 0;
 	int rc = 0;
 
 	rdev = qp->rdev;
@@ -4468,9 +4648,13 @@ bad:
 			*bad_wr = wr;
 			break;
 		}
+		nposted++;
 		wr = wr->next;
 	}
-	bnxt_qplib_post_send_db(&qp->qplib_qp);
+	if (qp->sq_db_batch)
+		bnxt_re_sq_db_defer(qp, nposted);
+	else
+		bnxt_qplib_post_send_db(&qp->qplib_qp);
 	if (!_is_chip_gen_p5_p7(rdev->chip_ctx))
 		bnxt_ud_qp_hw_stall_workaround(qp);
 	spin_unlock_irqrestore(&qp->sq_lock, flags);
@@ -4581,6 +4765,304 @@ bad:
 }
 
 /* Completion Queues */
+#ifdef HAVE_DIM
+/*
+ * Adaptive moderation in software. MODIFY_CQ cannot change the HW
+ * coalescing of a live CQ, so the period net_dim picks is applied to
+ * the arm instead: an arm requested less than dim_usec after the last
+ * notification is held back and rung by dim_timer once the period is
+ * over. The arm doorbell carries the consumer index, so completions
+ * that landed meanwhile raise the notification as soon as it is rung.
+ */
+static enum hrtimer_restart bnxt_re_cq_dim_timer_fn(struct hrtimer *timer)
+{
+	struct bnxt_re_cq *cq = container_of(timer, struct bnxt_re_cq,
+					     dim_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	if (cq->dim_arm_type) {
+		bnxt_qplib_req_notify_cq(&cq->qplib_cq, cq->dim_arm_type);
+		cq->dim_arm_type = 0;
+	}
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	return HRTIMER_NORESTART;
+}
+
+/* Called with cq_lock held; true if the HW arm was held back */
+static bool bnxt_re_cq_dim_defer_arm(struct bnxt_re_cq *cq, u32 type)
+{
+	s64 wait;
+
+	if (!cq->dim_en || !cq->dim_usec || !type)
+		return false;
+	/* An arm already in the HW is left alone */
+	if (atomic_read(&cq->qplib_cq.arm_state) && !cq->dim_arm_type)
+		return false;
+	wait = (s64)cq->dim_usec * NSEC_PER_USEC -
+	       (s64)(ktime_get_ns() - READ_ONCE(cq->dim_last_ns));
+	if (wait <= 0 && !cq->dim_arm_type)
+		return false;
+	/* A pending ARMALL already covers a solicited arm */
+	if (cq->dim_arm_type != DBC_DBC_TYPE_CQ_ARMALL)
+		cq->dim_arm_type = type;
+	if (!hrtimer_active(&cq->dim_timer))
+		hrtimer_start(&cq->dim_timer, ns_to_ktime(max_t(s64, wait, 0)),
+			      HRTIMER_MODE_REL);
+	return true;
+}
+
+static void bnxt_re_cq_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct bnxt_re_cq *cq = container_of(dim, struct bnxt_re_cq, dim);
+	struct dim_cq_moder moder;
+	unsigned long flags;
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	cq->dim_usec = moder.usec;
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	dim->state = DIM_START_MEASURE;
+}
+
+/* Called from the NQ handler for every CQ notification */
+void bnxt_re_cq_dim_sample(struct bnxt_re_cq *cq)
+{
+	struct dim_sample sample = {};
+
+	if (!cq->dim_en)
+		return;
+	WRITE_ONCE(cq->dim_last_ns, ktime_get_ns());
+	dim_update_sample(++cq->dim_events, READ_ONCE(cq->dim_cqes),
+			  READ_ONCE(cq->dim_bytes), &sample);
+	net_dim(&cq->dim, sample);
+}
+
+/* Called with cq_lock held, once per poll_cq call */
+static void bnxt_re_cq_dim_account(struct bnxt_re_cq *cq, struct ib_wc *wc,
+				   int npolled)
+{
+	u64 bytes = 0;
+	int i;
+
+	if (!cq->dim_en || !npolled)
+		return;
+	for (i = 0; i < npolled; i++)
+		bytes += wc[i].byte_len;
+	WRITE_ONCE(cq->dim_cqes, cq->dim_cqes + npolled);
+	WRITE_ONCE(cq->dim_bytes, cq->dim_bytes + bytes);
+}
+
+static void bnxt_re_cq_dim_init(struct bnxt_re_cq *cq)
+{
+	memset(&cq->dim, 0, sizeof(cq->dim));
+	INIT_WORK(&cq->dim.work, bnxt_re_cq_dim_work);
+	cq->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	compat_hrtimer_init(&cq->dim_timer, bnxt_re_cq_dim_timer_fn,
+			    CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cq->dim_en = true;
+}
+
+/* Before the HW CQ goes away; the timer rings its arm doorbell */
+static void bnxt_re_cq_dim_stop(struct bnxt_re_cq *cq)
+{
+	if (cq->dim_en)
+		hrtimer_cancel(&cq->dim_timer);
+}
+
+/* After the HW CQ is gone, so no NQ sample can queue the work again */
+static void bnxt_re_cq_dim_cleanup(struct bnxt_re_cq *cq)
+{
+	if (!cq->dim_en)
+		return;
+	cancel_work_sync(&cq->dim.work);
+	cq->dim_en = false;
+}
+#endif
+
+
+/*
+ * Busy-poll mode for kernel CQs, opted in per CQ through the cq_busy_poll
+ * configfs knob. While the ULP keeps polling, the CQ is never armed: an
+ * arm request is only recorded, and a CQN left over from an arm rung
+ * before the CQ went back to polling is not passed to the ULP. Once no
+ * completion has been reaped for bp_usec, the recorded arm is rung, any
+ * swallowed CQN is delivered and the CQ falls back to interrupts, until
+ * the ULP again polls ahead of an armed CQ. CQs that are not opted in,
+ * and opted-in CQs that fell back, arm without any timer in between.
+ */
+static enum hrtimer_restart bnxt_re_cq_bp_timer_fn(struct hrtimer *timer)
+{
+	struct bnxt_re_cq *cq = container_of(timer, struct bnxt_re_cq,
+					     bp_timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+	bool owed = false;
+	s64 idle;
+
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	if (!cq->bp_usec || cq->bp_irq ||
+	    (!cq->bp_arm_type && !cq->bp_owed))
+		goto out;
+	idle = ktime_us_delta(ktime_get(), cq->bp_last);
+	if (idle < cq->bp_usec) {
+		hrtimer_forward_now(timer, us_to_ktime(cq->bp_usec - idle));
+		ret = HRTIMER_RESTART;
+		goto out;
+	}
+	if (cq->bp_arm_type)
+		bnxt_qplib_req_notify_cq(&cq->qplib_cq, cq->bp_arm_type);
+	cq->bp_arm_type = 0;
+	owed = cq->bp_owed;
+	cq->bp_owed = false;
+	cq->bp_irq = true;
+	cq->bp_fallbacks++;
+out:
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	if (owed && cq->ib_cq.comp_handler)
+		(*cq->ib_cq.comp_handler)(&cq->ib_cq, cq->ib_cq.cq_context);
+	return ret;
+}
+
+/* Called with cq_lock held, for a CQ that is polling */
+static void bnxt_re_cq_bp_start_timer(struct bnxt_re_cq *cq)
+{
+	if (!hrtimer_active(&cq->bp_timer))
+		hrtimer_start(&cq->bp_timer, us_to_ktime(cq->bp_usec),
+			      HRTIMER_MODE_REL);
+}
+
+/* Called with cq_lock held; true if the arm was recorded, not rung */
+static bool bnxt_re_cq_bp_defer_arm(struct bnxt_re_cq *cq, u32 type)
+{
+	if (!cq->bp_usec || cq->bp_irq || !type)
+		return false;
+	/* A recorded ARMALL already covers a solicited arm */
+	if (cq->bp_arm_type != DBC_DBC_TYPE_CQ_ARMALL)
+		cq->bp_arm_type = type;
+	bnxt_re_cq_bp_start_timer(cq);
+	return true;
+}
+
+/*
+ * Called from the CQN handler. True if @cq is polling, in which case the
+ * notification is held until the CQ falls back to interrupts.
+ */
+bool bnxt_re_cq_bp_skip_cqn(struct bnxt_re_cq *cq)
+{
+	unsigned long flags;
+	bool skip;
+
+	/* CQs that never opted in do not take cq_lock here */
+	if (!READ_ONCE(cq->bp_usec))
+		return false;
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	skip = cq->bp_usec && !cq->bp_irq;
+	if (skip) {
+		cq->bp_owed = true;
+		bnxt_re_cq_bp_start_timer(cq);
+	}
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	return skip;
+}
+
+/* Called with cq_lock held, once per poll_cq call */
+static void bnxt_re_cq_bp_update(struct bnxt_re_cq *cq, int npolled)
+{
+	if (!cq->bp_usec || !npolled)
+		return;
+	cq->bp_last = ktime_get();
+	if (!cq->bp_irq) {
+		cq->bp_hits++;
+		return;
+	}
+	/*
+	 * Completions reaped while the CQ is still armed mean the ULP is
+	 * polling ahead of the interrupt. Go back to polling; the CQN of
+	 * the arm still in the HW is held by bnxt_re_cq_bp_skip_cqn().
+	 */
+	if (atomic_read(&cq->qplib_cq.arm_state))
+		cq->bp_irq = false;
+}
+
+/*
+ * Opt a kernel CQ in or out of busy-poll mode with the current
+ * cq_busy_poll_usec. Leaving rings the recorded arm and delivers any
+ * held CQN.
+ */
+int bnxt_re_cq_bp_set(struct bnxt_re_cq *cq, bool enable)
+{
+	u32 usec = cq->rdev->cq_busy_poll_usec;
+	unsigned long flags;
+	bool owed = false;
+
+	if (enable && !usec)
+		return -EINVAL;
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	if (enable) {
+		if (!cq->bp_usec) {
+			cq->bp_irq = false;
+			cq->bp_last = ktime_get();
+		}
+		WRITE_ONCE(cq->bp_usec, usec);
+	} else {
+		if (cq->bp_arm_type)
+			bnxt_qplib_req_notify_cq(&cq->qplib_cq,
+						 cq->bp_arm_type);
+		cq->bp_arm_type = 0;
+		owed = cq->bp_owed;
+		cq->bp_owed = false;
+		WRITE_ONCE(cq->bp_usec, 0);
+	}
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	if (!enable)
+		hrtimer_cancel(&cq->bp_timer);
+	if (owed && cq->ib_cq.comp_handler)
+		(*cq->ib_cq.comp_handler)(&cq->ib_cq, cq->ib_cq.cq_context);
+	return 0;
+}
+
+/* Called with cq_lock held; true if busy-poll or DIM holds the arm */
+static bool bnxt_re_cq_defer_arm(struct bnxt_re_cq *cq, u32 type)
+{
+	if (bnxt_re_cq_bp_defer_arm(cq, type))
+		return true;
+#ifdef HAVE_DIM
+	return bnxt_re_cq_dim_defer_arm(cq, type);
+#else
+	return false;
+#endif
+}
+
+static void bnxt_re_cq_bp_init(struct bnxt_re_cq *cq)
+{
+	struct bnxt_re_dev *rdev = cq->rdev;
+
+	compat_hrtimer_init(&cq->bp_timer, bnxt_re_cq_bp_timer_fn,
+			    CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	mutex_lock(&rdev->kcq_lock);
+	list_add_tail(&cq->kcq_list, &rdev->kcq_list);
+	mutex_unlock(&rdev->kcq_lock);
+}
+
+static void bnxt_re_cq_bp_cleanup(struct bnxt_re_cq *cq)
+{
+	struct bnxt_re_dev *rdev = cq->rdev;
+	unsigned long flags;
+
+	if (list_empty(&cq->kcq_list))
+		return;
+	mutex_lock(&rdev->kcq_lock);
+	list_del(&cq->kcq_list);
+	mutex_unlock(&rdev->kcq_lock);
+	/* A CQN still in flight must not restart the timer */
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	WRITE_ONCE(cq->bp_usec, 0);
+	spin_unlock_irqrestore(&cq->cq_lock, flags);
+	hrtimer_cancel(&cq->bp_timer);
+}
+
 DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *ib_cq
 #ifdef HAVE_DESTROY_CQ_UDATA
 	       , struct ib_udata *udata
@@ -4625,6 +5107,10 @@ DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *ib_cq
 
 	BNXT_RE_DBR_LIST_DEL(rdev, cq, BNXT_RE_RES_TYPE_CQ);
 
+	bnxt_re_cq_bp_cleanup(cq);
+#ifdef HAVE_DIM
+	bnxt_re_cq_dim_stop(cq);
+#endif
 	if (rdev->hdbr_enabled)
 		bnxt_re_hdbr_db_unreg_cq(rdev, cq);
 
@@ -4633,6 +5119,9 @@ DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *ib_cq
 		dev_err_ratelimited(rdev_to_dev(rdev),
 				   "%s id = %d failed rc = %d",
 				   __func__, cq->qplib_cq.id, rc);
+#ifdef HAVE_DIM
+	bnxt_re_cq_dim_cleanup(cq);
+#endif
 
 	bnxt_re_put_nq(rdev, cq->qplib_cq.nq);
 	if (cq->umem && !IS_ERR(cq->umem))
@@ -4651,6 +5140,22 @@ DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *ib_cq
 #endif
 }
 
+/*
+ * Number of polled CQEs a kernel CQ may hold back before the consumer
+ * index is published. The smaller of the count and percentage knobs wins.
+ */
+static u32 bnxt_re_cq_db_thresh(struct bnxt_re_dev *rdev, u32 depth)
+{
+	u32 thresh = rdev->cq_db_thresh;
+	u32 pct_thresh;
+
+	if (rdev->cq_db_thresh_pct) {
+		pct_thresh = depth * rdev->cq_db_thresh_pct / 100;
+		thresh = thresh ? min(thresh, pct_thresh) : pct_thresh;
+	}
+	return thresh;
+}
+
 #ifdef HAVE_IB_CQ_INIT_ATTR
 ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in,
 			       const struct ib_cq_init_attr *attr,
@@ -4678,8 +5183,10 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 	int rc, entries;
 	struct bnxt_re_cq *cq;
 	u32 max_active_cqs;
+	u32 db_thresh = 0;
 #ifdef HAVE_IB_CQ_INIT_ATTR
 	int cqe = attr->cqe;
+	int comp_vector = attr->comp_vector;
 
 #ifdef HAVE_CQ_ALLOC_IN_IB_CORE
 	if (attr->flags)
@@ -4740,6 +5247,14 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 	}
 
 	entries = bnxt_re_init_depth(cqe + 1, uctx);
+	/*
+	 * A deferred consumer doorbell leaves polled CQEs owned by HW;
+	 * pad kernel CQs by the threshold so they can never overflow.
+	 */
+	if (!udata) {
+		db_thresh = bnxt_re_cq_db_thresh(rdev, entries);
+		entries += db_thresh;
+	}
 	if (entries > dev_attr->max_cq_wqes + 1)
 		entries = dev_attr->max_cq_wqes + 1;
 
@@ -4826,23 +5341,29 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 		}
 		/* TODO: DPI is for privilege app for now */
 		qplcq->dpi = &rdev->dpi_privileged;
+		qplcq->db_thresh = entries > cqe + 1 ?
+				   min_t(u32, db_thresh, entries - cqe - 1) : 0;
+		qplcq->prefetch = min_t(u32, rdev->cq_prefetch, entries - 1);
 	}
 	/*
-	 * Allocating the NQ in a round robin fashion. nq_alloc_cnt is a
-	 * used for getting the NQ index.
+	 * NQ placement honors comp_vector, then NUMA locality of the
+	 * creating CPU, with NQ load as the tie-breaker.
 	 */
 	qplcq->max_wqe = entries;
-	qplcq->nq = bnxt_re_get_nq(rdev);
+	qplcq->nq = bnxt_re_get_nq(rdev, comp_vector);
 	qplcq->cnq_hw_ring_id = qplcq->nq->ring_id;
 	qplcq->coalescing = &rdev->cq_coalescing;
 	rc = bnxt_qplib_create_cq(&rdev->qplib_res, qplcq);
 	if (rc) {
 		dev_err(rdev_to_dev(rdev), "Create HW CQ failed!");
-		goto fail;
+		goto put_nq;
 	}
 
 	INIT_LIST_HEAD(&cq->cq_list);
-	cq->ib_cq.cqe = entries;
+	INIT_LIST_HEAD(&cq->kcq_list);
+	INIT_LIST_HEAD(&cq->sq_db_list);
+	/* The doorbell pad is not the consumer's to fill */
+	cq->ib_cq.cqe = entries - qplcq->db_thresh;
 	cq->cq_period = qplcq->period;
 
 	atomic_inc(&rdev->stats.rsors.cq_count);
@@ -4850,6 +5371,7 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 	if (max_active_cqs > atomic_read(&rdev->stats.rsors.max_cq_count))
 		atomic_set(&rdev->stats.rsors.max_cq_count, max_active_cqs);
 	spin_lock_init(&cq->cq_lock);
+	qplcq->fp_lock = &cq->cq_lock;
 
 	if (udata) {
 		struct bnxt_re_cq_resp resp = {};
@@ -4882,9 +5404,8 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 			if (!cq->uctx_cq_page) {
 				dev_err(rdev_to_dev(rdev),
 					"CQ page allocation failed!");
-				(void)bnxt_qplib_destroy_cq(&rdev->qplib_res, qplcq);
 				rc = -ENOMEM;
-				goto c2fail;
+				goto destroy_cq;
 			}
 
 			resp.uctx_cq_page = (u64)cq->uctx_cq_page;
@@ -4904,6 +5425,11 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 			if (rc)
 				goto destroy_cq;
 		}
+		bnxt_re_cq_bp_init(cq);
+#ifdef HAVE_DIM
+		if (rdev->cq_dim)
+			bnxt_re_cq_dim_init(cq);
+#endif
 	}
 	BNXT_RE_DBR_LIST_ADD(rdev, cq, BNXT_RE_RES_TYPE_CQ);
 
@@ -4923,6 +5449,8 @@ unreg_db_cq:
 		bnxt_re_hdbr_db_unreg_cq(rdev, cq);
 destroy_cq:
 	(void)bnxt_qplib_destroy_cq(&rdev->qplib_res, qplcq);
+put_nq:
+	bnxt_re_put_nq(rdev, qplcq->nq);
 c2fail:
 	if (udata && cq->umem && !IS_ERR(cq->umem))
 		ib_umem_release(cq->umem);
@@ -4989,6 +5517,8 @@ int bnxt_re_resize_cq(struct ib_cq *ib_cq, int cqe, struct ib_udata *udata)
 	struct ib_ucontext *context = NULL;
 	struct bnxt_re_dev *rdev;
 	struct bnxt_re_cq *cq;
+	unsigned long flags;
+	u32 db_thresh = 0;
 	int rc, entries;
 
 	/* Don't allow more than one resize request at the same time.
@@ -5023,12 +5553,19 @@ int bnxt_re_resize_cq(struct ib_cq *ib_cq, int cqe, struct ib_udata *udata)
 	}
 
 	entries = bnxt_re_init_depth(cqe + 1, uctx);
+	/* Kernel CQs keep the deferred doorbell pad, as in create */
+	if (!ib_cq->uobject) {
+		db_thresh = bnxt_re_cq_db_thresh(rdev, entries);
+		entries += db_thresh;
+	}
 	entries = min_t(u32, (u32)entries, dev_attr->max_cq_wqes + 1);
+	db_thresh = entries > cqe + 1 ?
+		    min_t(u32, db_thresh, entries - cqe - 1) : 0;
 
 	/* Check to see if the new requested size can be handled by already
 	 * existing CQ
 	 */
-	if (entries == cq->ib_cq.cqe) {
+	if (entries - db_thresh == cq->ib_cq.cqe) {
 		dev_info(rdev_to_dev(rdev), "CQ is already at size %d", cqe);
 		return 0;
 	}
@@ -5077,6 +5614,7 @@ int bnxt_re_resize_cq(struct ib_cq *ib_cq, int cqe, struct ib_udata *udata)
 		cq->qplib_cq.dpi = &uctx->dpi;
 	} else {
 		/* TODO: kernel consumer */
+		cq->resize_cqe = entries - db_thresh;
 	}
 
 	rc = bnxt_qplib_resize_cq(&rdev->qplib_res, &cq->qplib_cq, entries);
@@ -5087,11 +5625,16 @@ int bnxt_re_resize_cq(struct ib_cq *ib_cq, int cqe, struct ib_udata *udata)
 	}
 
 	cq->ib_cq.cqe = cq->resize_cqe;
-	/* For kernel consumers complete resize here. For uverbs consumers,
-	 * we complete it in the context of ibv_poll_cq().
+	/* For kernel consumers bnxt_qplib_resize_cq() has already switched
+	 * the CQ over. For uverbs consumers, we complete it in the context
+	 * of ibv_poll_cq().
 	 */
-	if (!cq->resize_umem)
-		bnxt_qplib_resize_cq_complete(&rdev->qplib_res, &cq->qplib_cq);
+	if (!cq->resize_umem) {
+		spin_lock_irqsave(&cq->cq_lock, flags);
+		cq->qplib_cq.db_thresh = db_thresh;
+		cq->qplib_cq.db_pending = 0;
+		spin_unlock_irqrestore(&cq->cq_lock, flags);
+	}
 
 	atomic_inc(&rdev->stats.rsors.resize_count);
 	return 0;
@@ -5190,9 +5733,9 @@ static enum ib_wc_status __rc_to_ib_wc_status(u8 qstatus)
 	}
 }
 
-static void bnxt_re_process_req_wc(struct ib_wc *wc, struct bnxt_qplib_cqe *cqe)
+static void bnxt_re_process_req_wc(struct ib_wc *wc, u8 type, u8 status)
 {
-	switch (cqe->type) {
+	switch (type) {
 	case BNXT_QPLIB_SWQE_TYPE_SEND:
 		wc->opcode = IB_WC_SEND;
 		break;
@@ -5233,7 +5776,7 @@ static void bnxt_re_process_req_wc(struct ib_wc *wc, struct bnxt_qplib_cqe *cqe)
 		break;
 	}
 
-	wc->status = __req_to_ib_wc_status(cqe->status);
+	wc->status = __req_to_ib_wc_status(status);
 }
 
 static int bnxt_re_check_packet_type(u16 raweth_qp1_flags, u16 raweth_qp1_flags2)
@@ -5491,17 +6034,16 @@ static void bnxt_re_process_res_rawqp1_wc(struct ib_wc *wc,
 	wc->wc_flags |= IB_WC_GRH;
 }
 
-static void bnxt_re_process_res_rc_wc(struct ib_wc *wc,
-				      struct bnxt_qplib_cqe *cqe)
+static void bnxt_re_process_res_rc_wc(struct ib_wc *wc, u16 flags, u8 status)
 {
 	wc->opcode = IB_WC_RECV;
-	wc->status = __rc_to_ib_wc_status(cqe->status);
+	wc->status = __rc_to_ib_wc_status(status);
 
-	if (cqe->flags & CQ_RES_RC_FLAGS_IMM)
+	if (flags & CQ_RES_RC_FLAGS_IMM)
 		wc->wc_flags |= IB_WC_WITH_IMM;
-	if (cqe->flags & CQ_RES_RC_FLAGS_INV)
+	if (flags & CQ_RES_RC_FLAGS_INV)
 		wc->wc_flags |= IB_WC_WITH_INVALIDATE;
-	if ((cqe->flags & (CQ_RES_RC_FLAGS_RDMA | CQ_RES_RC_FLAGS_IMM)) ==
+	if ((flags & (CQ_RES_RC_FLAGS_RDMA | CQ_RES_RC_FLAGS_IMM)) ==
 	    (CQ_RES_RC_FLAGS_RDMA | CQ_RES_RC_FLAGS_IMM))
 		wc->opcode = IB_WC_RECV_RDMA_WITH_IMM;
 }
@@ -5588,9 +6130,10 @@ static void bnxt_re_process_res_shadow_qp_wc(struct bnxt_re_qp *gsi_sqp,
 #endif
 }
 
+/* wc->smac is expected to be filled in already */
 static void bnxt_re_process_res_ud_wc(struct bnxt_re_dev *rdev,
 				      struct bnxt_re_qp *qp, struct ib_wc *wc,
-				      struct bnxt_qplib_cqe *cqe)
+				      u16 flags, u8 status, u32 cfa_meta)
 {
 #ifdef ENABLE_ROCEV2_QP1
 	u8 nw_type;
@@ -5598,27 +6141,26 @@ static void bnxt_re_process_res_ud_wc(struct bnxt_re_dev *rdev,
 	u16 vlan_id = 0;
 
 	wc->opcode = IB_WC_RECV;
-	wc->status = __rc_to_ib_wc_status(cqe->status);
-	if (cqe->flags & CQ_RES_UD_FLAGS_IMM)
+	wc->status = __rc_to_ib_wc_status(status);
+	if (flags & CQ_RES_UD_FLAGS_IMM)
 		wc->wc_flags |= IB_WC_WITH_IMM;
-	if (cqe->flags & CQ_RES_RC_FLAGS_INV)
+	if (flags & CQ_RES_RC_FLAGS_INV)
 		wc->wc_flags |= IB_WC_WITH_INVALIDATE;
 	/* report only on GSI QP for Thor */
 	if (rdev->gsi_ctx.gsi_qp->qplib_qp.id == qp->qplib_qp.id &&
 	    rdev->gsi_ctx.gsi_qp_mode == BNXT_RE_GSI_MODE_UD) {
 		wc->wc_flags |= IB_WC_GRH;
 #ifdef HAVE_IB_WC_SMAC
-		memcpy(wc->smac, cqe->smac, ETH_ALEN);
 		wc->wc_flags |= IB_WC_WITH_SMAC;
 #endif
 		if (_is_cqe_v2_supported(rdev->dev_attr->dev_cap_flags)) {
-			if (cqe->flags & CQ_RES_UD_V2_FLAGS_META_FORMAT_MASK) {
-				if (cqe->cfa_meta &
+			if (flags & CQ_RES_UD_V2_FLAGS_META_FORMAT_MASK) {
+				if (cfa_meta &
 				    BNXT_QPLIB_CQE_CFA_META1_VALID)
-					vlan_id = (cqe->cfa_meta & 0xFFF);
+					vlan_id = (cfa_meta & 0xFFF);
 			}
-		} else if (cqe->flags & CQ_RES_UD_FLAGS_META_FORMAT_VLAN) {
-			vlan_id = (cqe->cfa_meta & 0xFFF);
+		} else if (flags & CQ_RES_UD_FLAGS_META_FORMAT_VLAN) {
+			vlan_id = (cfa_meta & 0xFFF);
 		}
 #ifdef HAVE_IB_WC_VLAN_ID
 		/* Mark only if vlan_id is non zero */
@@ -5628,7 +6170,7 @@ static void bnxt_re_process_res_ud_wc(struct bnxt_re_dev *rdev,
 		}
 #endif
 #ifdef	ENABLE_ROCEV2_QP1
-		nw_type = (cqe->flags >> 4) & 0x3;
+		nw_type = (flags >> 4) & 0x3;
 		wc->network_hdr_type = bnxt_re_to_ib_nw_type(nw_type);
 		wc->wc_flags |= IB_WC_WITH_NETWORK_HDR_TYPE;
 #endif
@@ -5657,62 +6199,231 @@ static int bnxt_re_legacy_send_phantom_wqe(struct bnxt_re_qp *qp)
 	return rc;
 }
 
-int bnxt_re_poll_cq(struct ib_cq *ib_cq, int num_entries, struct ib_wc *wc)
+/* Transcribe one qplib CQE into @wc; returns 1 if @wc was filled */
+static int bnxt_re_process_cqe_wc(struct bnxt_re_cq *cq, struct ib_wc *wc,
+				  struct bnxt_qplib_cqe *cqe)
 {
-	struct bnxt_re_cq *cq = to_bnxt_re(ib_cq, struct bnxt_re_cq, ib_cq);
 	struct bnxt_re_dev *rdev = cq->rdev;
+	struct bnxt_re_sqp_entries *sqp_entry = NULL;
 	struct bnxt_re_qp *qp;
-	struct bnxt_qplib_cqe *cqe;
-	int i, ncqe, budget, init_budget;
-	struct bnxt_qplib_q *sq;
-	struct bnxt_qplib_qp *lib_qp;
-	u32 tbl_idx;
-        struct bnxt_re_sqp_entries *sqp_entry = NULL;
-	unsigned long flags;
 	u8 gsi_mode;
+	u32 tbl_idx;
 
-	/*
-	 * DB software CQ; only process the door bell pacing alert from
-	 * the user lib
-	 */
-	if (cq->is_dbr_soft_cq) {
-		bnxt_re_pacing_alert(rdev);
+	memset(wc, 0, sizeof(*wc));
+
+	wc->wr_id = cqe->wr_id;
+	wc->byte_len = cqe->length;
+	qp = to_bnxt_re((struct bnxt_qplib_qp *)cqe->qp_handle,
+			struct bnxt_re_qp, qplib_qp);
+	if (!qp) {
+		dev_err(rdev_to_dev(rdev), "POLL CQ bad QP handle");
 		return 0;
 	}
+	wc->qp = &qp->ib_qp;
+	wc->ex.imm_data = cqe->immdata;
+	wc->src_qp = cqe->src_qp;
+#ifdef HAVE_IB_WC_SMAC
+	memcpy(wc->smac, cqe->smac, ETH_ALEN);
+#endif
+	wc->port_num = 1;
+	wc->vendor_err = cqe->status;
 
-	/* User CQ; the only processing we do is to
-	 * complete any pending CQ resize operation.
-	 */
-	if (cq->umem) {
-		if (cq->resize_umem)
-			bnxt_re_resize_cq_complete(cq);
+	gsi_mode = rdev->gsi_ctx.gsi_qp_mode;
+	switch(cqe->opcode) {
+	case CQ_BASE_CQE_TYPE_REQ:
+		if (gsi_mode == BNXT_RE_GSI_MODE_ALL &&
+		    qp->qplib_qp.id ==
+		    rdev->gsi_ctx.gsi_sqp->qplib_qp.id) {
+			/* Handle this completion with
+			 * the stored completion */
+			 dev_dbg(rdev_to_dev(rdev),
+				 "Skipping this UD Send CQ\n");
+			memset(wc, 0, sizeof(*wc));
+			return 0;
+		}
+		bnxt_re_process_req_wc(wc, cqe->type, cqe->status);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RAWETH_QP1:
+		if (gsi_mode == BNXT_RE_GSI_MODE_ALL) {
+			if (!cqe->status) {
+				int rc = 0;
+				rc = bnxt_re_process_raw_qp_packet_receive(qp, cqe);
+				if (!rc) {
+					memset(wc, 0, sizeof(*wc));
+					return 0;
+				}
+				/* TODO Respond with error to the stack */
+				cqe->status = -1;
+			}
+			/* Errors need not be looped back.
+			 * But change the wr_id to the one
+			 * stored in the table
+			 */
+			tbl_idx = cqe->wr_id;
+			sqp_entry = &rdev->gsi_ctx.sqp_tbl[tbl_idx];
+			wc->wr_id = sqp_entry->wrid;
+		}
+
+		bnxt_re_process_res_rawqp1_wc(wc, cqe);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RC:
+		bnxt_re_process_res_rc_wc(wc, cqe->flags, cqe->status);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_UD:
+		if (gsi_mode == BNXT_RE_GSI_MODE_ALL &&
+		    qp->qplib_qp.id ==
+		    rdev->gsi_ctx.gsi_sqp->qplib_qp.id) {
+			/* Handle this completion with
+			 * the stored completion
+			 */
+			dev_dbg(rdev_to_dev(rdev),
+				"Handling the UD receive CQ\n");
+			if (cqe->status) {
+				/* TODO handle this completion  as a failure in
+				 * loopback porocedure
+				 */
+				return 0;
+			}
+			bnxt_re_process_res_shadow_qp_wc(qp, wc, cqe);
+			break;
+		}
+		bnxt_re_process_res_ud_wc(rdev, qp, wc, cqe->flags,
+					  cqe->status, cqe->cfa_meta);
+		break;
+	default:
+		dev_err(rdev_to_dev(cq->rdev),
+			"POLL CQ type 0x%x not handled, skip!",
+			cqe->opcode);
 		return 0;
 	}
+	return 1;
+}
 
-	spin_lock_irqsave(&cq->cq_lock, flags);
+struct bnxt_re_poll_ctx {
+	struct bnxt_re_cq	*cq;
+	struct ib_wc		*wc;
+};
+
+/* Direct poll consumer: fill the next ib_wc straight from the HW CQE */
+static int bnxt_re_poll_xlate_wc(void *ctx, struct bnxt_qplib_qp *lib_qp,
+				 struct cq_base *hw_cqe, u64 wr_id,
+				 u8 type, u8 status)
+{
+	struct bnxt_re_poll_ctx *pctx = ctx;
+	struct ib_wc *wc = pctx->wc;
+	struct cq_res_ud_v2 *ud;
+	struct cq_res_rc *rc;
+	struct bnxt_re_qp *qp;
+
+	qp = container_of(lib_qp, struct bnxt_re_qp, qplib_qp);
+	memset(wc, 0, sizeof(*wc));
+	wc->wr_id = wr_id;
+	wc->qp = &qp->ib_qp;
+	wc->port_num = 1;
+	wc->vendor_err = status;
+
+	switch (hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK) {
+	case CQ_BASE_CQE_TYPE_REQ:
+		wc->src_qp = lib_qp->id;
+		bnxt_re_process_req_wc(wc, type, status);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RC:
+		rc = (struct cq_res_rc *)hw_cqe;
+		wc->byte_len = le32_to_cpu(rc->length);
+		wc->ex.invalidate_rkey = le32_to_cpu(rc->imm_data_or_inv_r_key);
+		bnxt_re_process_res_rc_wc(wc, le16_to_cpu(rc->flags), status);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_UD:
+		ud = (struct cq_res_ud_v2 *)hw_cqe;
+		wc->byte_len = bnxt_qplib_cqe_ud_length(ud);
+		wc->ex.invalidate_rkey = le32_to_cpu(ud->imm_data);
+		wc->src_qp = bnxt_qplib_cqe_ud_src_qp(ud);
+#ifdef HAVE_IB_WC_SMAC
+		bnxt_qplib_cqe_ud_smac(ud, wc->smac);
+#endif
+		bnxt_re_process_res_ud_wc(pctx->cq->rdev, qp, wc,
+					  le16_to_cpu(ud->flags), status,
+					  bnxt_qplib_cqe_ud_cfa_meta(ud));
+		break;
+	default:
+		return 0;
+	}
+	pctx->wc++;
+	return 1;
+}
+
+/*
+ * CQs carrying the QP1 raw/shadow QP pair in GSI_MODE_ALL loop received
+ * MADs back through the shadow QP; keep those on the staged CQL path.
+ */
+static bool bnxt_re_cq_needs_cql(struct bnxt_re_cq *cq)
+{
+	struct bnxt_re_gsi_context *gsi_ctx = &cq->rdev->gsi_ctx;
+
+	if (gsi_ctx->gsi_qp_mode != BNXT_RE_GSI_MODE_ALL)
+		return false;
+	if (gsi_ctx->gsi_qp &&
+	    (gsi_ctx->gsi_qp->scq == cq || gsi_ctx->gsi_qp->rcq == cq))
+		return true;
+	if (gsi_ctx->gsi_sqp &&
+	    (gsi_ctx->gsi_sqp->scq == cq || gsi_ctx->gsi_sqp->rcq == cq))
+		return true;
+	return false;
+}
+
+static void bnxt_re_poll_legacy_phantom(struct bnxt_re_dev *rdev,
+					struct bnxt_qplib_qp *lib_qp)
+{
+	struct bnxt_qplib_q *sq;
+	struct bnxt_re_qp *qp;
+
+	if (!lib_qp)
+		return;
+	sq = &lib_qp->sq;
+	if (sq->legacy_send_phantom == true) {
+		qp = container_of(lib_qp, struct bnxt_re_qp, qplib_qp);
+		if (bnxt_re_legacy_send_phantom_wqe(qp) == -ENOMEM)
+			dev_err(rdev_to_dev(rdev),
+				"Phantom failed! Scheduled to send again\n");
+		else
+			sq->legacy_send_phantom = false;
+	}
+}
+
+/*
+ * Drain up to @budget completions into @wc; called with cq_lock held.
+ * With @direct the HW CQEs are translated in place and only the rare
+ * raw QP1, terminal and flush completions go through the CQL.
+ */
+int __bnxt_re_poll_cq(struct bnxt_re_cq *cq, int budget, struct ib_wc *wc,
+		      bool direct)
+{
+	struct bnxt_re_dev *rdev = cq->rdev;
+	struct bnxt_re_poll_ctx pctx;
+	struct bnxt_qplib_cqe *cqe;
+	struct bnxt_qplib_qp *lib_qp;
+	int i, ncqe, init_budget;
 
-	budget = min_t(u32, num_entries, cq->max_cql);
 	init_budget = budget;
-	if (!cq->cql) {
-		dev_err(rdev_to_dev(rdev), "POLL CQ no CQL to use");
-		goto exit;
+	if (direct) {
+		pctx.cq = cq;
+		pctx.wc = wc;
+		lib_qp = NULL;
+		ncqe = bnxt_qplib_poll_cq_direct(&cq->qplib_cq, budget, &lib_qp,
+						 bnxt_re_poll_xlate_wc, &pctx);
+		bnxt_re_poll_legacy_phantom(rdev, lib_qp);
+		budget -= ncqe;
+		wc = pctx.wc;
+		if (!budget || (bnxt_qplib_is_cq_empty(&cq->qplib_cq) &&
+				!bnxt_qplib_cq_has_flush(&cq->qplib_cq)))
+			return init_budget - budget;
 	}
+
 	cqe = &cq->cql[0];
-	gsi_mode = rdev->gsi_ctx.gsi_qp_mode;
 	while (budget) {
 		lib_qp = NULL;
 		ncqe = bnxt_qplib_poll_cq(&cq->qplib_cq, cqe, budget, &lib_qp);
-		if (lib_qp) {
-			sq = &lib_qp->sq;
-			if (sq->legacy_send_phantom == true) {
-				qp = container_of(lib_qp, struct bnxt_re_qp, qplib_qp);
-				if (bnxt_re_legacy_send_phantom_wqe(qp) == -ENOMEM)
-					dev_err(rdev_to_dev(rdev),
-						"Phantom failed! Scheduled to send again\n");
-				else
-					sq->legacy_send_phantom = false;
-			}
-		}
+		bnxt_re_poll_legacy_phantom(rdev, lib_qp);
 		if (ncqe < budget)
 			ncqe += bnxt_qplib_process_flush_list(&cq->qplib_cq,
 							      cqe + ncqe,
@@ -5723,101 +6434,57 @@ int bnxt_re_poll_cq(struct ib_cq *ib_cq, int num_entries, struct ib_wc *wc)
 
 		for (i = 0; i < ncqe; i++, cqe++) {
 			/* Transcribe each qplib_wqe back to ib_wc */
-			memset(wc, 0, sizeof(*wc));
-
-			wc->wr_id = cqe->wr_id;
-			wc->byte_len = cqe->length;
-			qp = to_bnxt_re((struct bnxt_qplib_qp *)cqe->qp_handle,
-					struct bnxt_re_qp, qplib_qp);
-			if (!qp) {
-				dev_err(rdev_to_dev(rdev),
-					"POLL CQ bad QP handle");
+			if (!bnxt_re_process_cqe_wc(cq, wc, cqe))
 				continue;
-			}
-			wc->qp = &qp->ib_qp;
-			wc->ex.imm_data = cqe->immdata;
-			wc->src_qp = cqe->src_qp;
-#ifdef HAVE_IB_WC_SMAC
-			memcpy(wc->smac, cqe->smac, ETH_ALEN);
-#endif
-			wc->port_num = 1;
-			wc->vendor_err = cqe->status;
-
-			switch(cqe->opcode) {
-			case CQ_BASE_CQE_TYPE_REQ:
-				if (gsi_mode == BNXT_RE_GSI_MODE_ALL &&
-				    qp->qplib_qp.id ==
-				    rdev->gsi_ctx.gsi_sqp->qplib_qp.id) {
-					/* Handle this completion with
-					 * the stored completion */
-					 dev_dbg(rdev_to_dev(rdev),
-						 "Skipping this UD Send CQ\n");
-					memset(wc, 0, sizeof(*wc));
-					continue;
-				}
-				bnxt_re_process_req_wc(wc, cqe);
-				break;
-			case CQ_BASE_CQE_TYPE_RES_RAWETH_QP1:
-				if (gsi_mode == BNXT_RE_GSI_MODE_ALL) {
-					if (!cqe->status) {
-						int rc = 0;
-						rc = bnxt_re_process_raw_qp_packet_receive(qp, cqe);
-						if (!rc) {
-							memset(wc, 0,
-							       sizeof(*wc));
-							continue;
-						}
-						/* TODO Respond with error to the stack */
-						cqe->status = -1;
-					}
-					/* Errors need not be looped back.
-					 * But change the wr_id to the one
-					 * stored in the table
-					 */
-					tbl_idx = cqe->wr_id;
-					sqp_entry = &rdev->gsi_ctx.sqp_tbl[tbl_idx];
-					wc->wr_id = sqp_entry->wrid;
-				}
-
-				bnxt_re_process_res_rawqp1_wc(wc, cqe);
-				break;
-			case CQ_BASE_CQE_TYPE_RES_RC:
-				bnxt_re_process_res_rc_wc(wc, cqe);
-				break;
-			case CQ_BASE_CQE_TYPE_RES_UD:
-				if (gsi_mode == BNXT_RE_GSI_MODE_ALL &&
-				    qp->qplib_qp.id ==
-				    rdev->gsi_ctx.gsi_sqp->qplib_qp.id) {
-					/* Handle this completion with
-					 * the stored completion
-					 */
-					dev_dbg(rdev_to_dev(rdev),
-						"Handling the UD receive CQ\n");
-					if (cqe->status) {
-						/* TODO handle this completion  as a failure in
-						 * loopback porocedure
-						 */
-						continue;
-					} else {
-						bnxt_re_process_res_shadow_qp_wc(qp, wc, cqe);
-						break;
-					}
-				}
-				bnxt_re_process_res_ud_wc(rdev, qp, wc, cqe);
-				break;
-			default:
-				dev_err(rdev_to_dev(cq->rdev),
-					"POLL CQ type 0x%x not handled, skip!",
-					cqe->opcode);
-				continue;
-			}
 			wc++;
 			budget--;
 		}
 	}
+	return init_budget - budget;
+}
+
+int bnxt_re_poll_cq(struct ib_cq *ib_cq, int num_entries, struct ib_wc *wc)
+{
+	struct bnxt_re_cq *cq = to_bnxt_re(ib_cq, struct bnxt_re_cq, ib_cq);
+	struct bnxt_re_dev *rdev = cq->rdev;
+	unsigned long flags;
+	int budget, polled = 0;
+
+	/*
+	 * DB software CQ; only process the door bell pacing alert from
+	 * the user lib
+	 */
+	if (cq->is_dbr_soft_cq) {
+		bnxt_re_pacing_alert(rdev);
+		return 0;
+	}
+
+	/* User CQ; the only processing we do is to
+	 * complete any pending CQ resize operation.
+	 */
+	if (cq->umem) {
+		if (cq->resize_umem)
+			bnxt_re_resize_cq_complete(cq);
+		return 0;
+	}
+
+	spin_lock_irqsave(&cq->cq_lock, flags);
+	/* Whoever polls for completions wants the batched WRs on the wire */
+	bnxt_re_sq_db_flush_cq(cq);
+
+	budget = min_t(u32, num_entries, cq->max_cql);
+	if (!cq->cql) {
+		dev_err(rdev_to_dev(rdev), "POLL CQ no CQL to use");
+		goto exit;
+	}
+	polled = __bnxt_re_poll_cq(cq, budget, wc, !bnxt_re_cq_needs_cql(cq));
 exit:
+	bnxt_re_cq_bp_update(cq, polled);
+#ifdef HAVE_DIM
+	bnxt_re_cq_dim_account(cq, wc, polled);
+#endif
 	spin_unlock_irqrestore(&cq->cq_lock, flags);
-	return init_budget - budget;
+	return polled;
 }
 
 int bnxt_re_req_notify_cq(struct ib_cq *ib_cq,
@@ -5839,7 +6506,7 @@ int bnxt_re_req_notify_cq(struct ib_cq *ib_cq,
 	if ((ib_cqn_flags & IB_CQ_REPORT_MISSED_EVENTS) &&
 	    !(bnxt_qplib_is_cq_empty(&cq->qplib_cq)))
                 rc = 1;
-	else
+	else if (!bnxt_re_cq_defer_arm(cq, type))
 		bnxt_qplib_req_notify_cq(&cq->qplib_cq, type);
 
 	spin_unlock_irqrestore(&cq->cq_lock, flags);
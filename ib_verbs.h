@@ -38,6 +38,9 @@
 #define __BNXT_RE_IB_VERBS_H__
 
 #include <linux/mm.h>
+#ifdef HAVE_DIM
+#include <linux/dim.h>
+#endif
 #include <rdma/ib_verbs.h>
 
 #include "bnxt_re-abi.h"
@@ -135,9 +138,17 @@ struct bnxt_re_qp {
 	struct ib_ud_header	qp1_hdr;
 	struct bnxt_re_cq	*scq;
 	struct bnxt_re_cq	*rcq;
-	struct dentry		*qp_info_pdev_dentry;
 	struct bnxt_re_qp_info_entry qp_info_entry;
-	void			*qp_data;
+	/* SQ doorbell batching, all but sq_db_entry under sq_lock */
+	struct hrtimer		sq_db_timer;
+	struct list_head	sq_db_entry;
+	u32			sq_db_batch;
+	u32			sq_db_usec;
+	u32			sq_db_pending;
+	/* post_send calls whose doorbell is still owed */
+	u32			sq_db_calls;
+	/* WC page for WQE push on kernel QPs */
+	struct bnxt_qplib_dpi	push_dpi;
 };
 
 struct bnxt_re_cq {
@@ -161,6 +172,36 @@ struct bnxt_re_cq {
 	void			*uctx_cq_page;
 	void			*dbr_recov_cq_page;
 	bool			is_dbr_soft_cq;
+	/* Batching QPs sending on this CQ, flushed on poll */
+	struct list_head	sq_db_list;
+#ifdef HAVE_DIM
+	/* Adaptive moderation; samples fed from cqn handler and poll_cq */
+	struct dim		dim;
+	u64			dim_cqes;
+	u64			dim_bytes;
+	u16			dim_events;
+	bool			dim_en;
+	/* Arm hold-off picked by DIM, under cq_lock but dim_last_ns */
+	struct hrtimer		dim_timer;
+	u32			dim_usec;
+	u32			dim_arm_type;
+	u64			dim_last_ns;
+#endif
+	/* On rdev->kcq_list, kernel CQs only */
+	struct list_head	kcq_list;
+	/*
+	 * Busy-poll mode, opted in per CQ through the cq_busy_poll configfs
+	 * knob; under cq_lock
+	 */
+	struct hrtimer		bp_timer;
+	u32			bp_usec;
+	u32			bp_arm_type;
+	ktime_t			bp_last;
+	bool			bp_irq;
+	/* A CQN arrived while polling and was not passed on yet */
+	bool			bp_owed;
+	u64			bp_hits;
+	u64			bp_fallbacks;
 };
 
 struct bnxt_re_mr {
@@ -379,6 +420,11 @@ ALLOC_CQ_RET bnxt_re_create_cq(ALLOC_CQ_IN *cq_in, int cqe,
 				struct ib_udata *udata);
 #endif
 int bnxt_re_modify_cq(struct ib_cq *cq, u16 cq_count, u16 cq_period);
+#ifdef HAVE_DIM
+void bnxt_re_cq_dim_sample(struct bnxt_re_cq *cq);
+#endif
+int bnxt_re_cq_bp_set(struct bnxt_re_cq *cq, bool enable);
+bool bnxt_re_cq_bp_skip_cqn(struct bnxt_re_cq *cq);
 DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *cq
 #ifdef HAVE_DESTROY_CQ_UDATA
 	       , struct ib_udata *udata
@@ -386,6 +432,8 @@ DESTROY_CQ_RET bnxt_re_destroy_cq(struct ib_cq *cq
 		);
 int bnxt_re_resize_cq(struct ib_cq *cq, int cqe, struct ib_udata *udata);
 int bnxt_re_poll_cq(struct ib_cq *cq, int num_entries, struct ib_wc *wc);
+int __bnxt_re_poll_cq(struct bnxt_re_cq *cq, int budget, struct ib_wc *wc,
+		      bool direct);
 int bnxt_re_req_notify_cq(struct ib_cq *cq, enum ib_cq_notify_flags flags);
 struct ib_mr *bnxt_re_get_dma_mr(struct ib_pd *pd, int mr_access_flags);
 #ifdef HAVE_IB_MAP_MR_SG
@@ -81,6 +81,10 @@ unsigned int cmdq_shadow_qd = RCFW_CMD_NON_BLOCKING_SHADOW_QD;
 module_param_named(cmdq_shadow_qd, cmdq_shadow_qd, uint, 0644);
 MODULE_PARM_DESC(cmdq_shadow_qd, "Perf Stat Debug: Shadow QD Range (1-64) - Default is 64");
 
+unsigned int nq_poll_mode = BNXT_QPLIB_NQ_POLL_TASKLET;
+module_param(nq_poll_mode, uint, 0444);
+MODULE_PARM_DESC(nq_poll_mode, "NQ servicing: 0 - tasklet (default), 1 - irq_poll, 2 - threaded IRQ");
+
 /* globals */
 struct list_head bnxt_re_dev_list = LIST_HEAD_INIT(bnxt_re_dev_list);
 
@@ -887,6 +891,25 @@ static bool bnxt_re_is_qp1_or_shadow_qp(struct bnxt_re_dev *rdev,
 		return (qp->ib_qp.qp_type == IB_QPT_GSI);
 }
 
+/* Account the QPs moved to error by the last stop batch */
+static void bnxt_re_stop_user_qps_done(struct bnxt_re_dev *rdev)
+{
+	struct bnxt_qplib_qp *qpl_qp;
+	struct bnxt_re_qp *qp;
+
+	list_for_each_entry(qp, &rdev->qp_list, list) {
+		qpl_qp = &qp->qplib_qp;
+		if (!qpl_qp->is_user || bnxt_re_is_qp1_or_shadow_qp(rdev, qp))
+			continue;
+		if (qpl_qp->state != CMDQ_MODIFY_QP_NEW_STATE_ERR ||
+		    qpl_qp->cur_qp_state == CMDQ_MODIFY_QP_NEW_STATE_ERR)
+			continue;
+		/* Same as bnxt_qplib_modify_qp(), ERR is best effort */
+		qpl_qp->cur_qp_state = qpl_qp->state;
+		bnxt_re_dispatch_event(&rdev->ibdev, &qp->ib_qp, 1, IB_EVENT_QP_FATAL);
+	}
+}
+
 /* bnxt_re_stop_user_qps_nonfatal -	Move all kernel qps to flush list
  * @rdev     -   rdma device instance
  *
@@ -898,11 +921,13 @@ static bool bnxt_re_is_qp1_or_shadow_qp(struct bnxt_re_dev *rdev,
  */
 static void bnxt_re_stop_user_qps_nonfatal(struct bnxt_re_dev *rdev)
 {
+	struct bnxt_qplib_rcfw_batch batch;
 	struct bnxt_qplib_qp *qpl_qp;
 	struct ib_qp_attr qp_attr;
 	int num_qps_stopped = 0;
 	int mask = IB_QP_STATE;
 	struct bnxt_re_qp *qp;
+	int rc;
 
 	if (!rdev)
 		return;
@@ -914,6 +939,8 @@ restart:
 	dev_dbg(rdev_to_dev(rdev), "from %s %d num_qps_stopped %d\n",
 		__func__, __LINE__, num_qps_stopped);
 
+	/* Post the MODIFY_QPs of a budget back to back and wait once */
+	bnxt_qplib_rcfw_batch_init(&batch);
 	mutex_lock(&rdev->qp_lock);
 	list_for_each_entry(qp, &rdev->qp_list, list) {
 		qpl_qp = &qp->qplib_qp;
@@ -927,10 +954,19 @@ restart:
 		    qpl_qp->state == CMDQ_MODIFY_QP_NEW_STATE_ERR)
 			continue;
 
-		qp_attr.qp_state = IB_QPS_ERR;
-		bnxt_re_modify_qp(&qp->ib_qp, &qp_attr, mask, NULL);
+		rc = bnxt_qplib_modify_qp_err_async(&rdev->qplib_res, qpl_qp,
+						    &batch);
+		if (!rc) {
+			qpl_qp->state = CMDQ_MODIFY_QP_NEW_STATE_ERR;
+		} else {
+			qp_attr.qp_state = IB_QPS_ERR;
+			bnxt_re_modify_qp(&qp->ib_qp, &qp_attr, mask, NULL);
+			/* Otherwise left to bnxt_re_stop_user_qps_done() */
+			if (qpl_qp->cur_qp_state == CMDQ_MODIFY_QP_NEW_STATE_ERR)
+				bnxt_re_dispatch_event(&rdev->ibdev, &qp->ib_qp,
+						       1, IB_EVENT_QP_FATAL);
+		}
 
-		bnxt_re_dispatch_event(&rdev->ibdev, &qp->ib_qp, 1, IB_EVENT_QP_FATAL);
 		/*
 		 * 1. Release qp_lock after a budget to unblock other verb
 		 *    requests (like qp_destroy) from stack.
@@ -938,11 +974,15 @@ restart:
 		 *    might have happened since qp_lock is getting released here.
 		 */
 		if (++num_qps_stopped % BNXT_RE_STOP_QPS_BUDGET == 0) {
+			bnxt_qplib_rcfw_batch_wait(&rdev->rcfw, &batch);
+			bnxt_re_stop_user_qps_done(rdev);
 			mutex_unlock(&rdev->qp_lock);
 			schedule();
 			goto restart;
 		}
 	}
+	bnxt_qplib_rcfw_batch_wait(&rdev->rcfw, &batch);
+	bnxt_re_stop_user_qps_done(rdev);
 	mutex_unlock(&rdev->qp_lock);
 	dev_dbg(rdev_to_dev(rdev), "from %s %d num_qps_stopped %d\n",
 		__func__, __LINE__, num_qps_stopped);
@@ -1072,7 +1112,7 @@ static void bnxt_re_async_notifier(void *handle, struct hwrm_async_event_cmpl *c
 			set_bit(ERR_DEVICE_DETACHED, &rdev->rcfw.cmdq.flags);
 			/* Set bnxt_re flag to control commands send via L2 driver */
 			set_bit(BNXT_RE_FLAG_ERR_DEVICE_DETACHED, &rdev->flags);
-			wake_up_all(&rdev->rcfw.cmdq.waitq);
+			bnxt_qplib_rcfw_wake_waiters(&rdev->rcfw);
 		}
 		if (!rdev->aer_wq)
 			break;
@@ -1388,7 +1428,7 @@ static void bnxt_re_stop(struct auxiliary_device *adev)
 		set_bit(ERR_DEVICE_DETACHED, &rdev->rcfw.cmdq.flags);
 		/* Set bnxt_re flag to control commands send via L2 driver */
 		set_bit(BNXT_RE_FLAG_ERR_DEVICE_DETACHED, &rdev->flags);
-		wake_up_all(&rdev->rcfw.cmdq.waitq);
+		bnxt_qplib_rcfw_wake_waiters(&rdev->rcfw);
 		bnxt_re_dispatch_event(&rdev->ibdev, NULL, 1,
 				       IB_EVENT_DEVICE_FATAL);
 	}
@@ -1498,7 +1538,7 @@ static void bnxt_re_stop_irq(void *handle, bool reset)
 	if (reset) {
 		set_bit(ERR_DEVICE_DETACHED, &rdev->rcfw.cmdq.flags);
 		set_bit(BNXT_RE_FLAG_ERR_DEVICE_DETACHED, &rdev->flags);
-		wake_up_all(&rdev->rcfw.cmdq.waitq);
+		bnxt_qplib_rcfw_wake_waiters(&rdev->rcfw);
 		bnxt_re_dispatch_event(&rdev->ibdev, NULL, 1,
 				       IB_EVENT_DEVICE_FATAL);
 	}
@@ -2876,12 +2916,19 @@ static struct bnxt_re_dev *bnxt_re_dev_alloc(struct net_device *netdev,
 	rdev->en_dev = en_dev;
 	INIT_LIST_HEAD(&rdev->qp_list);
 	mutex_init(&rdev->qp_lock);
+	INIT_LIST_HEAD(&rdev->kcq_list);
+	mutex_init(&rdev->kcq_lock);
 	mutex_init(&rdev->cc_lock);
 	mutex_init(&rdev->dbq_lock);
 	bnxt_re_clear_rsors_stat(&rdev->stats.rsors);
 	rdev->cosq[0] = rdev->cosq[1] = 0xFFFF;
 	rdev->min_tx_depth = 1;
 	rdev->stats.stats_query_sec = 1;
+	rdev->stats.stats_max_stale_ms = BNXT_RE_STATS_MAX_STALE_MS_DEF;
+	rdev->sq_db_batch_usec = BNXT_RE_SQ_DB_BATCH_USEC_DEF;
+	mutex_init(&rdev->stats.refresh_lock);
+	seqlock_init(&rdev->stats.snap_lock);
+	mutex_init(&rdev->stats.vfs.lock);
 	/* Disable priority vlan as the default mode is DSCP based PFC */
 	rdev->cc_param.disable_prio_vlan_tx = 1;
 
@@ -3210,6 +3257,12 @@ static int bnxt_re_cqn_handler(struct bnxt_qplib_nq *nq,
 		return -EINVAL;
 	}
 
+	/* A busy-polled CQ gets its notification when it falls back */
+	if (bnxt_re_cq_bp_skip_cqn(cq))
+		return 0;
+#ifdef HAVE_DIM
+	bnxt_re_cq_dim_sample(cq);
+#endif
 	if (cq->ib_cq.comp_handler) {
 		/* Lock comp_handler? */
 		(*cq->ib_cq.comp_handler)(&cq->ib_cq, cq->ib_cq.cq_context);
@@ -3218,19 +3271,47 @@ static int bnxt_re_cqn_handler(struct bnxt_qplib_nq *nq,
 	return 0;
 }
 
-struct bnxt_qplib_nq *bnxt_re_get_nq(struct bnxt_re_dev *rdev)
+/*
+ * Pick the NQ for a new CQ: the least loaded NQ whose IRQ affinity is on
+ * the NUMA node of the creating CPU, or the least loaded NQ overall when
+ * none is local. A comp_vector other than 0 only names a preference; its
+ * NQ is taken when it is local and carries at most BNXT_RE_NQ_LOAD_SLACK
+ * CQs more than the balanced pick. 0, the ib_alloc_cq() default, leaves
+ * the choice to balancing. Every NQ is sized for all of the function's
+ * CQs, so any NQ can take the CQ.
+ */
+struct bnxt_qplib_nq *bnxt_re_get_nq(struct bnxt_re_dev *rdev, int comp_vector)
 {
-	int min, indx;
+	const struct cpumask *node_mask;
+	int min, min_local, indx, num_nq;
+	struct bnxt_qplib_nq *nq;
+
+	num_nq = rdev->nqr->num_msix - 1;
+	node_mask = cpumask_of_node(cpu_to_node(raw_smp_processor_id()));
 
 	mutex_lock(&rdev->nqr->load_lock);
-	for (indx = 0, min = 0; indx < (rdev->nqr->num_msix - 1); indx++) {
-		if (rdev->nqr->nq[min].load > rdev->nqr->nq[indx].load)
+	for (indx = 0, min = -1, min_local = -1; indx < num_nq; indx++) {
+		nq = &rdev->nqr->nq[indx];
+		if (min < 0 || rdev->nqr->nq[min].load > nq->load)
 			min = indx;
-	}
-	rdev->nqr->nq[min].load++;
+		if (!cpumask_intersects(&nq->mask, node_mask))
+			continue;
+		if (min_local < 0 || rdev->nqr->nq[min_local].load > nq->load)
+			min_local = indx;
+	}
+	if (min_local >= 0)
+		min = min_local;
+	if (comp_vector > 0 && comp_vector < num_nq) {
+		nq = &rdev->nqr->nq[comp_vector];
+		if (cpumask_intersects(&nq->mask, node_mask) &&
+		    nq->load <= rdev->nqr->nq[min].load + BNXT_RE_NQ_LOAD_SLACK)
+			min = comp_vector;
+	}
+	nq = &rdev->nqr->nq[min];
+	nq->load++;
 	mutex_unlock(&rdev->nqr->load_lock);
 
-	return &rdev->nqr->nq[min];
+	return nq;
 }
 
 void bnxt_re_put_nq(struct bnxt_re_dev *rdev, struct bnxt_qplib_nq *nq)
@@ -3963,27 +4044,55 @@ static void bnxt_re_clean_nqs(struct bnxt_re_dev *rdev)
 	rdev->nqr->max_init = 0;
 }
 
+/*
+ * Size an NQ for the function's CQs. A CQ has at most one outstanding
+ * notification per arm, so BNXT_QPLIB_NQE_PER_CQ slots per CQ leave
+ * headroom. Placement follows comp_vector and NUMA locality, so a single
+ * NQ may end up with every CQ; each NQ is sized for dev_attr->max_cq
+ * rather than for an even share, and CQ creation never has to fail for
+ * lack of NQ room. SRQ events and DBQ pacing events only go to the first
+ * NQ. The memory saving over BNXT_QPLIB_NQE_MAX_CNT comes from functions,
+ * VFs mostly, whose max_cq is well below it.
+ */
+static u32 bnxt_re_get_nq_depth(struct bnxt_re_dev *rdev, int nq_idx,
+				u32 *max_cqs)
+{
+	struct bnxt_qplib_dev_attr *attr = rdev->dev_attr;
+	u32 depth, extra = 0;
+
+	*max_cqs = attr->max_cq;
+	if (!nq_idx)
+		extra = attr->max_srq * BNXT_QPLIB_NQE_PER_CQ +
+			BNXT_QPLIB_NQE_DBQ_RSVD;
+	depth = *max_cqs * BNXT_QPLIB_NQE_PER_CQ + extra;
+	depth = roundup_pow_of_two(depth);
+	depth = clamp_t(u32, depth, BNXT_QPLIB_NQE_MIN_CNT,
+			BNXT_QPLIB_NQE_MAX_CNT);
+	/* Re-derive the CQ budget from what actually fits */
+	*max_cqs = depth > extra ? (depth - extra) / BNXT_QPLIB_NQE_PER_CQ : 0;
+	return depth;
+}
+
 static int bnxt_re_setup_nqs(struct bnxt_re_dev *rdev)
 {
 	struct bnxt_re_ring_attr rattr = {};
 	struct bnxt_qplib_nq *nq;
-	int rc, i;
+	int rc, i, num_nq;
+	u32 max_cqs;
 	int depth;
 	u32 offt;
 	u16 vec;
 
 	mutex_init(&rdev->nqr->load_lock);
 
-	/*
-	 * TODO: Optimize the depth based on the
-	 * number of NQs.
-	 */
-	depth = BNXT_QPLIB_NQE_MAX_CNT;
-	for (i = 0; i < rdev->nqr->num_msix - 1; i++) {
+	num_nq = rdev->nqr->num_msix - 1;
+	for (i = 0; i < num_nq; i++) {
 		nq = &rdev->nqr->nq[i];
 		vec = rdev->nqr->msix_entries[i + 1].vector;
 		offt = rdev->nqr->msix_entries[i + 1].db_offset;
+		depth = bnxt_re_get_nq_depth(rdev, i, &max_cqs);
 		nq->hwq.max_elements = depth;
+		nq->max_cqs = max_cqs;
 		rc = bnxt_qplib_alloc_nq_mem(&rdev->qplib_res, nq);
 		if (rc) {
 			dev_err(rdev_to_dev(rdev),
@@ -4123,17 +4232,12 @@ static void bnxt_re_worker(struct work_struct *work)
 	if (!rdev->stats.stats_query_sec)
 		goto resched;
 
-	if (test_bit(BNXT_RE_FLAG_ISSUE_CFA_FLOW_STATS, &rdev->flags) &&
-	    (rdev->is_virtfn ||
-	    !_is_ext_stats_supported(rdev->dev_attr->dev_cap_flags))) {
-		if (!(rdev->stats.stats_query_counter++ %
-		      rdev->stats.stats_query_sec)) {
-			rc = bnxt_re_get_qos_stats(rdev);
-			if (rc && rc != -ENOMEM)
-				clear_bit(BNXT_RE_FLAG_ISSUE_CFA_FLOW_STATS,
-					  &rdev->flags);
-			}
-	}
+	if (rdev->stats.stats_query_counter++ % rdev->stats.stats_query_sec)
+		goto resched;
+
+	/* Keep the snapshot served to stat readers warm, QoS stats included */
+	if (test_bit(BNXT_RE_FLAG_IBDEV_REGISTERED, &rdev->flags))
+		bnxt_re_refresh_device_stats(rdev, true);
 
 resched:
 	schedule_delayed_work(&rdev->worker, msecs_to_jiffies(1000));
@@ -4408,6 +4512,7 @@ static void bnxt_re_dev_uninit(struct bnxt_re_dev *rdev, u8 op_type)
 	rtnl_unlock();
 
 	bnxt_re_free_dbr_sw_stats_mem(rdev);
+	bnxt_re_free_vf_stats(rdev);
 
 	if (test_and_clear_bit(BNXT_RE_FLAG_ALLOC_RCFW, &rdev->flags))
 		bnxt_qplib_free_rcfw_channel(&rdev->qplib_res);
@@ -5964,7 +6069,7 @@ static void bnxt_re_ib_init_2(struct bnxt_re_dev *rdev)
 {
 	int rc;
 
-	rc = bnxt_re_get_device_stats(rdev);
+	rc = bnxt_re_refresh_device_stats(rdev, true);
 	if (rc)
 		dev_err(rdev_to_dev(rdev),
 			"Failed initial device stat query");
@@ -6077,6 +6182,12 @@ static int __init bnxt_re_mod_init(void)
 
 	pr_info("%s: %s", ROCE_DRV_MODULE_NAME, version);
 
+	if (nq_poll_mode > BNXT_QPLIB_NQ_POLL_THREADED) {
+		pr_err("%s: nq_poll_mode %u is out of range (0-2)\n",
+		       ROCE_DRV_MODULE_NAME, nq_poll_mode);
+		return -EINVAL;
+	}
+
 	bnxt_re_wq = create_singlethread_workqueue("bnxt_re");
 	if (!bnxt_re_wq)
 		return -ENOMEM;
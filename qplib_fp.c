@@ -41,6 +41,10 @@
 #include <linux/pci.h>
 #include <linux/delay.h>
 #include <linux/if_ether.h>
+#include <linux/prefetch.h>
+#ifdef HAVE_IRQ_POLL
+#include <linux/irq_poll.h>
+#endif
 #include <rdma/ib_mad.h>
 
 #include "roce_hsi.h"
@@ -53,6 +57,9 @@
 #include "compat.h"
 #include "bnxt_re.h"
 
+#define CREATE_TRACE_POINTS
+#include "qplib_trace.h"
+
 static void __clean_cq(struct bnxt_qplib_cq *cq, u64 qp);
 
 /* Flush list */
@@ -142,6 +149,8 @@ void bnxt_qplib_clean_qp(struct bnxt_qplib_qp *qp)
 	qp->sq.hwq.cons = 0;
 	qp->sq.swq_start = 0;
 	qp->sq.swq_last = 0;
+	qp->push.busy = 0;
+	qp->push.db_key = 0;
 	__clean_cq(qp->rcq, (u64)(unsigned long)qp);
 	qp->rq.hwq.prod = 0;
 	qp->rq.hwq.cons = 0;
@@ -365,21 +374,15 @@ static void __wait_for_all_nqes(struct bnxt_qplib_cq *cq, u16 cnq_events)
 	}
 }
 
-static void bnxt_qplib_service_nq(
-#ifdef HAS_TASKLET_SETUP
-		struct tasklet_struct *t
-#else
-		unsigned long data
-#endif
-		)
+/*
+ * Reap up to @budget NQEs. With @arm the NQ is re-armed when it was
+ * drained; otherwise only the consumer index is updated. *more is set
+ * when valid NQEs are left so the caller can reschedule itself.
+ */
+static int __bnxt_qplib_service_nq(struct bnxt_qplib_nq *nq, int budget,
+				   bool arm, bool *more)
 {
-#ifdef HAS_TASKLET_SETUP
-	struct bnxt_qplib_nq *nq = from_tasklet(nq, t, nq_tasklet);
-#else
-	struct bnxt_qplib_nq *nq = (struct bnxt_qplib_nq *)data;
-#endif
 	struct bnxt_qplib_hwq *nq_hwq = &nq->hwq;
-	int rc, budget = nq->budget;
 	struct bnxt_qplib_res *res;
 	struct bnxt_qplib_cq *cq;
 	struct pci_dev *pdev;
@@ -387,13 +390,14 @@ static void bnxt_qplib_service_nq(
 	u32 hw_polled = 0;
 	u64 q_handle;
 	u32 type;
+	int rc;
 
 	res = nq->res;
 	pdev = res->pdev;
 
 	spin_lock_bh(&nq_hwq->lock);
 	/* Service the NQ until empty or budget expired */
-	while (budget--) {
+	while (hw_polled < budget) {
 		nqe = bnxt_qplib_get_qe(nq_hwq, nq_hwq->cons, NULL);
 		if (!NQE_CMP_VALID(nqe, nq->nq_db.dbinfo.flags))
 			break;
@@ -410,6 +414,7 @@ static void bnxt_qplib_service_nq(
 
 			q_handle = le32_to_cpu(nqcne->cq_handle_low);
 			q_handle |= (u64)le32_to_cpu(nqcne->cq_handle_high) << 32;
+			trace_bnxt_qplib_nq_event(nq, type, q_handle);
 			cq = (struct bnxt_qplib_cq *)q_handle;
 			if (!cq)
 				break;
@@ -441,6 +446,7 @@ static void bnxt_qplib_service_nq(
 
 			q_handle = le32_to_cpu(nqsrqe->srq_handle_low);
 			q_handle |= (u64)le32_to_cpu(nqsrqe->srq_handle_high) << 32;
+			trace_bnxt_qplib_nq_event(nq, type, q_handle);
 			srq = (struct bnxt_qplib_srq *)q_handle;
 			srq->toggle = (le16_to_cpu(nqe->info10_type) & NQ_CN_TOGGLE_MASK)
 				      >> NQ_CN_TOGGLE_SFT;
@@ -463,6 +469,7 @@ static void bnxt_qplib_service_nq(
 			break;
 		}
 		case NQ_BASE_TYPE_DBQ_EVENT:
+			trace_bnxt_qplib_nq_event(nq, type, 0);
 			rc = bnxt_qplib_process_dbqn(nq,
 						(struct nq_dbq_event *)nqe);
 			nq->stats.num_dbqne_processed++;
@@ -477,25 +484,90 @@ static void bnxt_qplib_service_nq(
 		bnxt_qplib_hwq_incr_cons(nq_hwq->max_elements, &nq_hwq->cons,
 					 1, &nq->nq_db.dbinfo.flags);
 	}
+	if (hw_polled >= budget)
+		nq->stats.num_budget_exhausted++;
 	nqe = bnxt_qplib_get_qe(nq_hwq, nq_hwq->cons, NULL);
-	if (!NQE_CMP_VALID(nqe, nq->nq_db.dbinfo.flags)) {
+	*more = NQE_CMP_VALID(nqe, nq->nq_db.dbinfo.flags);
+	if (!*more && arm) {
 		nq->stats.num_nq_rearm++;
 		bnxt_qplib_ring_nq_db(&nq->nq_db.dbinfo, res->cctx, true);
 	} else if (nq->requested) {
 		/* Update the consumer index only and dont enable arm */
 		bnxt_qplib_ring_nq_db(&nq->nq_db.dbinfo, res->cctx, false);
+	}
+	trace_bnxt_qplib_nq_service(nq, budget, hw_polled, *more);
+	spin_unlock_bh(&nq_hwq->lock);
+
+	return hw_polled;
+}
+
+static void bnxt_qplib_service_nq(
+#ifdef HAS_TASKLET_SETUP
+		struct tasklet_struct *t
+#else
+		unsigned long data
+#endif
+		)
+{
+#ifdef HAS_TASKLET_SETUP
+	struct bnxt_qplib_nq *nq = from_tasklet(nq, t, nq_tasklet);
+#else
+	struct bnxt_qplib_nq *nq = (struct bnxt_qplib_nq *)data;
+#endif
+	bool more;
+
+	__bnxt_qplib_service_nq(nq, nq->budget, true, &more);
+	if (more && nq->requested) {
 		nq->stats.num_tasklet_resched++;
 		tasklet_schedule(&nq->nq_tasklet);
 	}
-	dev_dbg(&pdev->dev, "QPLIB: cqn/srqn/dbqn ");
-	dev_dbg(&pdev->dev,
-		"QPLIB: serviced %llu/%llu/%llu budget 0x%x reaped 0x%x",
-		nq->stats.num_cqne_processed, nq->stats.num_srqne_processed,
-		nq->stats.num_dbqne_processed, budget, hw_polled);
-	dev_dbg(&pdev->dev,
-		"QPLIB: resched_cnt  = %llu arm_count = %llu\n",
-		nq->stats.num_tasklet_resched, nq->stats.num_nq_rearm);
-	spin_unlock_bh(&nq_hwq->lock);
+}
+
+#ifdef HAVE_IRQ_POLL
+/*
+ * irq_poll keeps every scheduled NQ of a CPU on one list and gives each
+ * of them at most @budget NQEs per round, so NQs sharing a CPU are
+ * serviced round robin and the softirq yields once the global irq_poll
+ * budget is spent. The NQ is re-armed only after irq_poll_complete(),
+ * once we return less than @budget and irq_poll stops calling us.
+ */
+static int bnxt_qplib_nq_irq_poll(struct irq_poll *iop, int budget)
+{
+	struct bnxt_qplib_nq *nq = container_of(iop, struct bnxt_qplib_nq,
+						iopoll);
+	bool more;
+	int done;
+
+	done = __bnxt_qplib_service_nq(nq, budget, false, &more);
+	if (more || done >= budget) {
+		nq->stats.num_poll_resched++;
+		return budget;
+	}
+	irq_poll_complete(iop);
+	if (nq->requested) {
+		spin_lock_bh(&nq->hwq.lock);
+		nq->stats.num_nq_rearm++;
+		bnxt_qplib_ring_nq_db(&nq->nq_db.dbinfo, nq->res->cctx, true);
+		spin_unlock_bh(&nq->hwq.lock);
+	}
+	return done;
+}
+#endif
+
+static irqreturn_t bnxt_qplib_nq_thread(int irq, void *dev_instance)
+{
+	struct bnxt_qplib_nq *nq = dev_instance;
+	bool more;
+
+	do {
+		__bnxt_qplib_service_nq(nq, nq->budget, true, &more);
+		if (!more || !nq->requested)
+			break;
+		nq->stats.num_poll_resched++;
+		cond_resched();
+	} while (true);
+
+	return IRQ_HANDLED;
 }
 
 /* bnxt_re_synchronize_nq - self polling notification queue.
@@ -512,14 +584,9 @@ static void bnxt_qplib_service_nq(
  */
 void bnxt_re_synchronize_nq(struct bnxt_qplib_nq *nq)
 {
-	nq->budget = nq->hwq.max_elements;
-	bnxt_qplib_service_nq(
-#ifdef HAS_TASKLET_SETUP
-		(struct tasklet_struct *)&nq->nq_tasklet
-#else
-		(unsigned long)nq
-#endif
-		);
+	bool more;
+
+	__bnxt_qplib_service_nq(nq, nq->hwq.max_elements, true, &more);
 }
 
 static irqreturn_t bnxt_qplib_nq_irq(int irq, void *dev_instance)
@@ -532,8 +599,19 @@ static irqreturn_t bnxt_qplib_nq_irq(int irq, void *dev_instance)
 	sw_cons = HWQ_CMP(nq_hwq->cons, nq_hwq);
 	prefetch(bnxt_qplib_get_qe(nq_hwq, sw_cons, NULL));
 
-	/* Fan out to CPU affinitized kthreads? */
-	tasklet_schedule(&nq->nq_tasklet);
+	switch (nq->poll_mode) {
+#ifdef HAVE_IRQ_POLL
+	case BNXT_QPLIB_NQ_POLL_IRQ_POLL:
+		irq_poll_sched(&nq->iopoll);
+		break;
+#endif
+	case BNXT_QPLIB_NQ_POLL_THREADED:
+		return IRQ_WAKE_THREAD;
+	default:
+		/* Fan out to CPU affinitized kthreads? */
+		tasklet_schedule(&nq->nq_tasklet);
+		break;
+	}
 
 	return IRQ_HANDLED;
 }
@@ -556,10 +634,22 @@ void bnxt_qplib_nq_stop_irq(struct bnxt_qplib_nq *nq, bool kill)
 	kfree(nq->name);
 	nq->name = NULL;
 
-	/* Cleanup Tasklet */
-	if (kill)
-		tasklet_kill(&nq->nq_tasklet);
-	tasklet_disable(&nq->nq_tasklet);
+	switch (nq->poll_mode) {
+#ifdef HAVE_IRQ_POLL
+	case BNXT_QPLIB_NQ_POLL_IRQ_POLL:
+		irq_poll_disable(&nq->iopoll);
+		break;
+#endif
+	case BNXT_QPLIB_NQ_POLL_THREADED:
+		/* free_irq() already stopped the IRQ thread */
+		break;
+	default:
+		/* Cleanup Tasklet */
+		if (kill)
+			tasklet_kill(&nq->nq_tasklet);
+		tasklet_disable(&nq->nq_tasklet);
+		break;
+	}
 }
 
 void bnxt_qplib_disable_nq(struct bnxt_qplib_nq *nq)
@@ -579,6 +669,47 @@ void bnxt_qplib_disable_nq(struct bnxt_qplib_nq *nq)
 	nq->msix_vec = 0;
 }
 
+static void bnxt_qplib_nq_poll_enable(struct bnxt_qplib_nq *nq, bool need_init)
+{
+	switch (nq->poll_mode) {
+#ifdef HAVE_IRQ_POLL
+	case BNXT_QPLIB_NQ_POLL_IRQ_POLL:
+		if (need_init)
+			irq_poll_init(&nq->iopoll, BNXT_QPLIB_NQ_IRQ_POLL_WEIGHT,
+				      bnxt_qplib_nq_irq_poll);
+		else
+			irq_poll_enable(&nq->iopoll);
+		break;
+#endif
+	case BNXT_QPLIB_NQ_POLL_THREADED:
+		break;
+	default:
+		if (need_init)
+			compat_tasklet_init(&nq->nq_tasklet,
+					    bnxt_qplib_service_nq,
+					    (unsigned long)nq);
+		else
+			tasklet_enable(&nq->nq_tasklet);
+		break;
+	}
+}
+
+static void bnxt_qplib_nq_poll_disable(struct bnxt_qplib_nq *nq)
+{
+	switch (nq->poll_mode) {
+#ifdef HAVE_IRQ_POLL
+	case BNXT_QPLIB_NQ_POLL_IRQ_POLL:
+		irq_poll_disable(&nq->iopoll);
+		break;
+#endif
+	case BNXT_QPLIB_NQ_POLL_THREADED:
+		break;
+	default:
+		tasklet_disable(&nq->nq_tasklet);
+		break;
+	}
+}
+
 int bnxt_qplib_nq_start_irq(struct bnxt_qplib_nq *nq, int nq_indx,
 			    int msix_vector, bool need_init)
 {
@@ -590,21 +721,31 @@ int bnxt_qplib_nq_start_irq(struct bnxt_qplib_nq *nq, int nq_indx,
 		return -EFAULT;
 
 	nq->msix_vec = msix_vector;
-	if (need_init)
-		compat_tasklet_init(&nq->nq_tasklet, bnxt_qplib_service_nq,
-				    (unsigned long)nq);
-	else
-		tasklet_enable(&nq->nq_tasklet);
+	if (need_init) {
+		nq->poll_mode = nq_poll_mode;
+#ifndef HAVE_IRQ_POLL
+		if (nq->poll_mode == BNXT_QPLIB_NQ_POLL_IRQ_POLL)
+			nq->poll_mode = BNXT_QPLIB_NQ_POLL_TASKLET;
+#endif
+	}
+	bnxt_qplib_nq_poll_enable(nq, need_init);
 
 	nq->name = kasprintf(GFP_KERNEL, "bnxt_re-nq-%d@pci:%s",
 			     nq_indx, pci_name(res->pdev));
 	if (!nq->name)
 		return -ENOMEM;
-	rc = request_irq(nq->msix_vec, bnxt_qplib_nq_irq, 0, nq->name, nq);
+	/* ONESHOT keeps the vector masked until the thread has run */
+	if (nq->poll_mode == BNXT_QPLIB_NQ_POLL_THREADED)
+		rc = request_threaded_irq(nq->msix_vec, bnxt_qplib_nq_irq,
+					  bnxt_qplib_nq_thread, IRQF_ONESHOT,
+					  nq->name, nq);
+	else
+		rc = request_irq(nq->msix_vec, bnxt_qplib_nq_irq, 0, nq->name,
+				 nq);
 	if (rc) {
 		kfree(nq->name);
 		nq->name = NULL;
-		tasklet_disable(&nq->nq_tasklet);
+		bnxt_qplib_nq_poll_disable(nq);
 		return rc;
 	}
 
@@ -642,8 +783,7 @@ static void bnxt_qplib_map_nq_db(struct bnxt_qplib_nq *nq,  u32 reg_offt)
         nq_db->dbinfo.xid = nq->ring_id;
 	nq_db->dbinfo.seed = nq->ring_id;
 	nq_db->dbinfo.flags = 0;
-	spin_lock_init(&nq_db->dbinfo.lock);
-	nq_db->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&nq_db->dbinfo);
 	nq_db->dbinfo.res = nq->res;
 
 	return;
@@ -810,9 +950,7 @@ int bnxt_qplib_create_srq(struct bnxt_qplib_res *res,
 	srq->dbinfo.max_slot = 1;
 	srq->dbinfo.priv_db = res->dpi_tbl.priv_db;
 	srq->dbinfo.flags = 0;
-	spin_lock_init(&srq->dbinfo.lock);
-	srq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
-	srq->dbinfo.shadow_key_arm_ena = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&srq->dbinfo);
 	srq->dbinfo.res = res;
 	srq->dbinfo.seed = srq->id;
 	if (srq->threshold)
@@ -833,9 +971,6 @@ int bnxt_qplib_modify_srq(struct bnxt_qplib_res *res,
 	struct bnxt_qplib_hwq *srq_hwq = &srq->hwq;
 	u32 avail = 0;
 
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&srq_hwq->lock, flags);
-#endif
 	avail = __bnxt_qplib_get_avail(srq_hwq);
 	if (avail <= srq->threshold) {
 		srq->arm_req = false;
@@ -844,9 +979,6 @@ int bnxt_qplib_modify_srq(struct bnxt_qplib_res *res,
 		/* Deferred arming */
 		srq->arm_req = true;
 	}
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&srq_hwq->lock, flags);
-#endif
 	return 0;
 }
 
@@ -857,27 +989,24 @@ int bnxt_qplib_query_srq(struct bnxt_qplib_res *res,
 	struct creq_query_srq_resp resp = {};
 	struct bnxt_qplib_cmdqmsg msg = {};
 	struct creq_query_srq_resp_sb *sb;
-	struct bnxt_qplib_rcfw_sbuf sbuf;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
 	struct cmdq_query_srq req = {};
 	int rc = 0;
 
 	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_QUERY_SRQ,
 				 sizeof(req));
-	sbuf.size = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb)
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, sizeof(*sb));
+	if (!sbuf)
 		return -ENOMEM;
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
 	req.srq_cid = cpu_to_le32(srq->id);
-	sb = sbuf.sb;
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
+	sb = sbuf->sb;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
 				sizeof(resp), 0);
 	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
 	if (!rc)
 		srq->threshold = le16_to_cpu(sb->srq_limit);
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 
 	return rc;
 }
@@ -921,13 +1050,13 @@ int bnxt_qplib_post_srq_recv(struct bnxt_qplib_srq *srq,
 	srqe->wr_id[0] = cpu_to_le32((u32)next);
 	srq->swq[next].wr_id = wqe->wr_id;
 	bnxt_qplib_hwq_incr_prod(&srq->dbinfo, srq_hwq, srq->dbinfo.max_slot);
-	/* retaining srq_hwq->cons for this logic actually the lock is only
-	 * required to read srq_hwq->cons.
- 	 */
-	spin_lock(&srq_hwq->lock);
+	/* The poller advances cons under srq_hwq->lock, which is not held
+	 * here. Read it once; a stale value only delays the limit arm to
+	 * the next post.
+	 */
 	avail = __bnxt_qplib_get_avail(srq_hwq);
-	spin_unlock(&srq_hwq->lock);
 	/* Ring DB */
+	trace_bnxt_qplib_ring_db(&srq->dbinfo, DBC_DBC_TYPE_SRQ);
 	bnxt_qplib_ring_prod_db(&srq->dbinfo, DBC_DBC_TYPE_SRQ);
 	if (srq->arm_req && avail <= srq->threshold) {
 		srq->arm_req = false;
@@ -1040,6 +1169,7 @@ int bnxt_qplib_create_qp1(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	u32 qp_flags = 0;
 	int rc;
 
+	bnxt_qplib_set_post_send(qp);
 	/* General */
 	req.type = qp->type;
 	req.dpi = cpu_to_le32(qp->dpi->dpi);
@@ -1129,8 +1259,7 @@ int bnxt_qplib_create_qp1(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	sq->dbinfo.db = qp->dpi->dbr;
 	sq->dbinfo.max_slot = _set_sq_max_slot(qp->wqe_mode);
 	sq->dbinfo.flags = 0;
-	spin_lock_init(&sq->dbinfo.lock);
-	sq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&sq->dbinfo);
 	sq->dbinfo.res = res;
 	if (rq->max_wqe) {
 		rq->dbinfo.hwq = &rq->hwq;
@@ -1138,8 +1267,7 @@ int bnxt_qplib_create_qp1(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 		rq->dbinfo.db = qp->dpi->dbr;
 		rq->dbinfo.max_slot = _set_rq_max_slot(rq);
 		rq->dbinfo.flags = 0;
-		spin_lock_init(&rq->dbinfo.lock);
-		rq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+		bnxt_qplib_init_db_keys(&rq->dbinfo);
 		rq->dbinfo.res = res;
 	}
 
@@ -1171,7 +1299,7 @@ static void bnxt_qplib_init_psn_ptr(struct bnxt_qplib_qp *qp, int size)
 
 	sq = &qp->sq;
 	sq_hwq = &sq->hwq;
-	/* First psn entry */
+	/* First psn entry, once per QP so the PBL walk for the page is fine */
 	fpsne = (u64)bnxt_qplib_get_qe(sq_hwq, sq_hwq->depth, &psn_pg);
 	if (!IS_ALIGNED(fpsne, PAGE_SIZE))
 		indx_pad = (fpsne & ~PAGE_MASK) / size;
@@ -1203,6 +1331,7 @@ int bnxt_qplib_create_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	qp->cctx = res->cctx;
 	if (res->dattr)
 		qp->dev_cap_flags = res->dattr->dev_cap_flags;
+	bnxt_qplib_set_post_send(qp);
 	/* General */
 	req.type = qp->type;
 	req.dpi = cpu_to_le32(qp->dpi->dpi);
@@ -1380,8 +1509,7 @@ int bnxt_qplib_create_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	sq->dbinfo.db = qp->dpi->dbr;
 	sq->dbinfo.max_slot = _set_sq_max_slot(qp->wqe_mode);
 	sq->dbinfo.flags = 0;
-	spin_lock_init(&sq->dbinfo.lock);
-	sq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&sq->dbinfo);
 	sq->dbinfo.res = res;
 	sq->dbinfo.seed = qp->id;
 	if (rq->max_wqe) {
@@ -1390,8 +1518,7 @@ int bnxt_qplib_create_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 		rq->dbinfo.db = qp->dpi->dbr;
 		rq->dbinfo.max_slot = _set_rq_max_slot(rq);
 		rq->dbinfo.flags = 0;
-		spin_lock_init(&rq->dbinfo.lock);
-		rq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+		bnxt_qplib_init_db_keys(&rq->dbinfo);
 		rq->dbinfo.res = res;
 		rq->dbinfo.seed = qp->id;
 	}
@@ -1675,29 +1802,51 @@ int bnxt_qplib_modify_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	return 0;
 }
 
+/*
+ * Post a MODIFY_QP to the error state as part of @batch. Only for bulk
+ * teardown: the caller owns the state bookkeeping and must wait for the
+ * batch before relying on the transition.
+ */
+int bnxt_qplib_modify_qp_err_async(struct bnxt_qplib_res *res,
+				   struct bnxt_qplib_qp *qp,
+				   struct bnxt_qplib_rcfw_batch *batch)
+{
+	struct bnxt_qplib_cmdqmsg msg = {};
+	struct cmdq_modify_qp req = {};
+
+	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_MODIFY_QP,
+				 sizeof(req));
+	req.modify_mask = cpu_to_le32(CMDQ_MODIFY_QP_MODIFY_MASK_STATE);
+	req.qp_cid = cpu_to_le32(qp->id);
+	req.network_type_en_sqd_async_notify_new_state =
+			CMDQ_MODIFY_QP_NEW_STATE_ERR | qp->nw_type;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, NULL, NULL, sizeof(req), 0, 0);
+	msg.qp_state = CMDQ_MODIFY_QP_NEW_STATE_ERR;
+
+	return bnxt_qplib_rcfw_batch_submit(res->rcfw, batch, &msg);
+}
+
 int bnxt_qplib_query_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 {
 	struct bnxt_qplib_rcfw *rcfw = res->rcfw;
 	struct creq_query_qp_resp resp = {};
 	struct bnxt_qplib_cmdqmsg msg = {};
-	struct bnxt_qplib_rcfw_sbuf sbuf;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
 	struct creq_query_qp_resp_sb *sb;
 	struct cmdq_query_qp req = {};
 	u32 temp32[4];
 	int i, rc;
 
-	sbuf.size = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb)
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, sizeof(*sb));
+	if (!sbuf)
 		return -ENOMEM;
-	sb = sbuf.sb;
+	sb = sbuf->sb;
 
 	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_QUERY_QP,
 				 sizeof(req));
 	req.qp_cid = cpu_to_le32(qp->id);
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
 				sizeof(resp), 0);
 	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
 	if (rc)
@@ -1761,8 +1910,7 @@ int bnxt_qplib_query_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp)
 	qp->vlan_id = le16_to_cpu(sb->vlan_pcp_vlan_dei_vlan_id);
 	qp->port_id = le16_to_cpu(sb->port_id);
 bail:
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 	return rc;
 }
 
@@ -1808,27 +1956,6 @@ static void __clean_cq(struct bnxt_qplib_cq *cq, u64 qp)
 	}
 }
 
-#ifdef ENABLE_FP_SPINLOCK
-static unsigned long bnxt_qplib_lock_cqs(struct bnxt_qplib_qp *qp)
-{
-	unsigned long flags;
-
-	spin_lock_irqsave(&qp->scq->hwq.lock, flags);
-	if (qp->rcq && qp->rcq != qp->scq)
-		spin_lock(&qp->rcq->hwq.lock);
-
-	return flags;
-}
-
-static void bnxt_qplib_unlock_cqs(struct bnxt_qplib_qp *qp,
-				  unsigned long flags)
-{
-	if (qp->rcq && qp->rcq != qp->scq)
-		spin_unlock(&qp->rcq->hwq.lock);
-	spin_unlock_irqrestore(&qp->scq->hwq.lock, flags);
-}
-#endif
-
 int bnxt_qplib_destroy_qp(struct bnxt_qplib_res *res,
 			  struct bnxt_qplib_qp *qp)
 {
@@ -2114,25 +2241,205 @@ static void bnxt_qplib_pull_psn_buff(struct bnxt_qplib_qp *qp, struct bnxt_qplib
 	swq->psn_search = buff;
 }
 
-void bnxt_qplib_post_send_db(struct bnxt_qplib_qp *qp)
+#ifdef BNXT_QPLIB_KQ_PUSH
+/*
+ * Push the WQE just queued at @swq through the next ping-pong slot of
+ * the QP's WC page: a PUSH_START header for the new producer index, the
+ * WQE, then PUSH_END on the SQ doorbell in place of the plain doorbell.
+ * An oversized WQE or a busy slot is left to the plain SQ doorbell and
+ * only costs the device a DMA read of the host copy.
+ */
+static void bnxt_qplib_push_wqe(struct bnxt_qplib_qp *qp,
+				struct bnxt_qplib_swq *swq, u8 wqe_slots)
+{
+	struct bnxt_qplib_push *push = &qp->push;
+	struct bnxt_qplib_hwq *sq_hwq = &qp->sq.hwq;
+	u32 len = wqe_slots * sizeof(struct sq_sge);
+	u8 slot = push->st_idx;
+	void __iomem *dst;
+	u64 hdr[2];
+	void *src;
+	u32 i;
+
+	if (len > push->max_bytes || test_and_set_bit(slot, &push->busy)) {
+		push->fallback++;
+		return;
+	}
+	dst = push->wc + slot * push->slot_size;
+	hdr[0] = bnxt_qplib_prod_db_key(&qp->sq.dbinfo,
+					DBC_DBC_TYPE_PUSH_START);
+	hdr[1] = (slot & BNXT_QPLIB_PUSH_PIDX_MASK) |
+		 ((DIV_ROUND_UP(BNXT_QPLIB_PUSH_HDR_SIZE + len, 8) &
+		   BNXT_QPLIB_PUSH_PSZ_MASK) << BNXT_QPLIB_PUSH_PSZ_SFT);
+	__iowrite64_copy(dst, hdr, ARRAY_SIZE(hdr));
+	dst += BNXT_QPLIB_PUSH_HDR_SIZE;
+	for (i = 0; i < wqe_slots; i++) {
+		src = bnxt_qplib_get_qe(sq_hwq,
+					(swq->slot_idx + i) % sq_hwq->depth,
+					NULL);
+		__iowrite64_copy(dst, src, sizeof(struct sq_sge) / sizeof(u64));
+		dst += sizeof(struct sq_sge);
+	}
+	/* Drain the WC buffer ahead of PUSH_END */
+	wmb();
+	push->db_key = bnxt_qplib_ring_push_end_db(&qp->sq.dbinfo);
+	swq->push_slot = slot;
+	push->st_idx ^= 1;
+	push->pushed++;
+}
+#endif
+
+static void bnxt_qplib_put_push_slot(struct bnxt_qplib_qp *qp,
+				     struct bnxt_qplib_swq *swq)
+{
+	if (swq->push_slot == BNXT_QPLIB_PUSH_SLOT_NONE)
+		return;
+	clear_bit(swq->push_slot, &qp->push.busy);
+	swq->push_slot = BNXT_QPLIB_PUSH_SLOT_NONE;
+}
+
+/*
+ * Steps shared by bnxt_qplib_post_send_generic() and the fast paths.
+ * The SQ full report stays out of line, the rest is inlined so the fast
+ * paths keep their constant-folded branches.
+ */
+static void bnxt_qplib_sq_full_err(struct bnxt_qplib_qp *qp, u16 qfd_slots,
+				   u16 slots_needed)
+{
+	struct bnxt_qplib_q *sq = &qp->sq;
+	struct bnxt_qplib_hwq *sq_hwq = &sq->hwq;
+
+	dev_err(&sq_hwq->pdev->dev,
+		"QPLIB: FP: QP (0x%x) SQ is full!", qp->id);
+	dev_err(&sq_hwq->pdev->dev,
+		"QPLIB: prod = %#x cons = %#x qdepth = %#x delta = %#x slots = %#x",
+		HWQ_CMP(sq_hwq->prod, sq_hwq),
+		HWQ_CMP(sq_hwq->cons, sq_hwq),
+		sq_hwq->max_elements, qfd_slots, slots_needed);
+	dev_err(&sq_hwq->pdev->dev,
+		"QPLIB: phantom_wqe_cnt: %d phantom_cqe_cnt: %d\n",
+		sq->phantom_wqe_cnt, sq->phantom_cqe_cnt);
+}
+
+/* Claim the SWQE for @wqe at the current SQ producer */
+static __always_inline struct bnxt_qplib_swq *
+bnxt_qplib_sq_start_swqe(struct bnxt_qplib_qp *qp,
+			 struct bnxt_qplib_swqe *wqe, u16 slots, u32 *wqe_idx)
+{
+	struct bnxt_qplib_q *sq = &qp->sq;
+	struct bnxt_qplib_swq *swq;
+
+	swq = bnxt_qplib_get_swqe(sq, wqe_idx);
+	swq->slot_idx = sq->hwq.prod;
+	bnxt_qplib_pull_psn_buff(qp, sq, swq, BNXT_RE_HW_RETX(qp->dev_cap_flags));
+	swq->wr_id = wqe->wr_id;
+	swq->type = wqe->type;
+	swq->flags = wqe->flags;
+	swq->slots = slots;
+	swq->push_slot = BNXT_QPLIB_PUSH_SLOT_NONE;
+	swq->start_psn = sq->psn & BTH_PSN_MASK;
+	if (qp->sig_type || wqe->flags & BNXT_QPLIB_SWQE_FLAGS_SIGNAL_COMP)
+		swq->flags |= SQ_SEND_FLAGS_SIGNAL_COMP;
+	return swq;
+}
+
+/*
+ * Clear the base and extended header slots at the producer and write
+ * the inline data or SGEs after them. Returns the data length.
+ */
+static __always_inline int
+bnxt_qplib_sq_put_data(struct bnxt_qplib_qp *qp, struct bnxt_qplib_swqe *wqe,
+		       void **base_hdr, void **ext_hdr)
+{
+	struct bnxt_qplib_hwq *sq_hwq = &qp->sq.hwq;
+	u32 sw_prod = sq_hwq->prod;
+
+	*base_hdr = bnxt_qplib_get_qe(sq_hwq, sw_prod, NULL);
+	sw_prod++;
+	*ext_hdr = bnxt_qplib_get_qe(sq_hwq, (sw_prod % sq_hwq->depth), NULL);
+	sw_prod++;
+	memset(*base_hdr, 0, sizeof(struct sq_sge));
+	memset(*ext_hdr, 0, sizeof(struct sq_sge));
+
+	if (wqe->flags & BNXT_QPLIB_SWQE_FLAGS_INLINE)
+		return bnxt_qplib_put_inline(qp, wqe, &sw_prod);
+	return bnxt_qplib_put_sges(sq_hwq, wqe->sg_list, wqe->num_sge,
+				   &sw_prod);
+}
+
+/* Advance the SQ PSN by the packets a @data_len byte message takes */
+static __always_inline void bnxt_qplib_sq_adv_psn(struct bnxt_qplib_qp *qp,
+						  int data_len)
+{
+	int pkt_num = 0;
+
+	if (qp->mtu)
+		pkt_num = DIV_ROUND_UP(data_len, qp->mtu);
+	if (!pkt_num)
+		pkt_num = 1;
+	qp->sq.psn = (qp->sq.psn + pkt_num) & BTH_PSN_MASK;
+}
+
+/*
+ * Record the WQE's PSN range in the PSN search area. With HW
+ * retransmission that area is the MSN table, which only takes wired
+ * WQEs (@msn_update).
+ */
+static __always_inline void
+bnxt_qplib_sq_fill_psn(struct bnxt_qplib_qp *qp, struct bnxt_qplib_swqe *wqe,
+		       struct bnxt_qplib_swq *swq, bool msn_update)
+{
+	if (!BNXT_RE_HW_RETX(qp->dev_cap_flags) || msn_update) {
+		swq->next_psn = qp->sq.psn & BTH_PSN_MASK;
+		bnxt_qplib_fill_psn_search(qp, wqe, swq);
+	}
+}
+
+/* Hand the SWQE to the SQ and push it if the QP pushes */
+static __always_inline void
+bnxt_qplib_sq_queue_swqe(struct bnxt_qplib_qp *qp, struct bnxt_qplib_swq *swq,
+			 u32 wqe_idx, u8 wqe_slots, bool push)
+{
+	struct bnxt_qplib_q *sq = &qp->sq;
+
+	bnxt_qplib_swq_mod_start(sq, wqe_idx);
+	bnxt_qplib_hwq_incr_prod(&sq->dbinfo, &sq->hwq, swq->slots);
+	trace_bnxt_qplib_post_send(qp, swq, wqe_idx);
+	qp->wqe_cnt++;
+#ifdef BNXT_QPLIB_KQ_PUSH
+	if (push && qp->push.wc)
+		bnxt_qplib_push_wqe(qp, swq, wqe_slots);
+#endif
+}
+
+/* True if a PUSH_END already delivered the current SQ producer index */
+bool bnxt_qplib_sq_db_pushed(struct bnxt_qplib_qp *qp)
+{
+	return qp->push.wc && qp->push.db_key ==
+	       bnxt_qplib_prod_db_key(&qp->sq.dbinfo, DBC_DBC_TYPE_SQ);
+}
+
+/* Returns false if there was nothing left to ring */
+bool bnxt_qplib_post_send_db(struct bnxt_qplib_qp *qp)
 {
 	struct bnxt_qplib_q *sq = &qp->sq;
 
+	if (bnxt_qplib_sq_db_pushed(qp))
+		return false;
+	trace_bnxt_qplib_ring_db(&sq->dbinfo, DBC_DBC_TYPE_SQ);
 	bnxt_qplib_ring_prod_db(&sq->dbinfo, DBC_DBC_TYPE_SQ);
+	return true;
 }
 
-int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
-			 struct bnxt_qplib_swqe *wqe)
+int bnxt_qplib_post_send_generic(struct bnxt_qplib_qp *qp,
+				 struct bnxt_qplib_swqe *wqe)
 {
 	struct bnxt_qplib_nq_work *nq_work = NULL;
-	int i, rc = 0, data_len = 0, pkt_num = 0;
+	int i, rc = 0, data_len = 0;
 	struct bnxt_qplib_q *sq = &qp->sq;
 	struct bnxt_qplib_hwq *sq_hwq;
 	struct bnxt_qplib_swq *swq;
 	bool sch_handler = false;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	u16 slots_needed;
 	void *base_hdr;
 	bool msn_update;
@@ -2141,13 +2448,10 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 	u16 qfd_slots;
 	u8 wqe_slots;
 	u16 wqe_size;
-	u32 sw_prod;
 	u32 wqe_idx;
 
 	sq_hwq = &sq->hwq;
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&sq_hwq->lock, flags);
-#endif
+	bnxt_qplib_assert_fp_lock(sq->fp_lock);
 
 	if (qp->state != CMDQ_MODIFY_QP_NEW_STATE_RTS &&
 	    qp->state != CMDQ_MODIFY_QP_NEW_STATE_ERR) {
@@ -2163,36 +2467,12 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 			sq->dbinfo.max_slot : wqe_slots;
 	qfd_slots = _translate_q_full_delta(sq, wqe_size);
 	if (bnxt_qplib_queue_full(sq_hwq, (slots_needed + qfd_slots))) {
-		dev_err(&sq_hwq->pdev->dev,
-			"QPLIB: FP: QP (0x%x) SQ is full!", qp->id);
-		dev_err(&sq_hwq->pdev->dev,
-			"QPLIB: prod = %#x cons = %#x qdepth = %#x delta = %#x slots = %#x",
-			HWQ_CMP(sq_hwq->prod, sq_hwq),
-			HWQ_CMP(sq_hwq->cons, sq_hwq),
-			sq_hwq->max_elements, qfd_slots, slots_needed);
-		dev_err(&sq_hwq->pdev->dev,
-			"QPLIB: phantom_wqe_cnt: %d phantom_cqe_cnt: %d\n",
-			sq->phantom_wqe_cnt, sq->phantom_cqe_cnt);
+		bnxt_qplib_sq_full_err(qp, qfd_slots, slots_needed);
 		rc = -ENOMEM;
 		goto done;
 	}
 
-	sw_prod = sq_hwq->prod;
-	swq = bnxt_qplib_get_swqe(sq, &wqe_idx);
-	swq->slot_idx = sw_prod;
-	bnxt_qplib_pull_psn_buff(qp, sq, swq, BNXT_RE_HW_RETX(qp->dev_cap_flags));
-
-	swq->wr_id = wqe->wr_id;
-	swq->type = wqe->type;
-	swq->flags = wqe->flags;
-	swq->slots = slots_needed;
-	swq->start_psn = sq->psn & BTH_PSN_MASK;
-	if (qp->sig_type || wqe->flags & BNXT_QPLIB_SWQE_FLAGS_SIGNAL_COMP)
-		swq->flags |= SQ_SEND_FLAGS_SIGNAL_COMP;
-
-	dev_dbg(&sq_hwq->pdev->dev,
-		"QPLIB: FP: QP(0x%x) post SQ wr_id[%d] = 0x%llx",
-		qp->id, wqe_idx, swq->wr_id);
+	swq = bnxt_qplib_sq_start_swqe(qp, wqe, slots_needed, &wqe_idx);
 	if (qp->cur_qp_state == CMDQ_MODIFY_QP_NEW_STATE_ERR) {
 		sch_handler = true;
 		dev_dbg(&sq_hwq->pdev->dev,
@@ -2200,18 +2480,7 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		goto queue_err;
 	}
 
-	base_hdr = bnxt_qplib_get_qe(sq_hwq, sw_prod, NULL);
-	sw_prod++;
-	ext_hdr = bnxt_qplib_get_qe(sq_hwq, (sw_prod % sq_hwq->depth), NULL);
-	sw_prod++;
-	memset(base_hdr, 0, sizeof(struct sq_sge));
-	memset(ext_hdr, 0, sizeof(struct sq_sge));
-
-	if (wqe->flags & BNXT_QPLIB_SWQE_FLAGS_INLINE)
-		data_len = bnxt_qplib_put_inline(qp, wqe, &sw_prod);
-	else
-		data_len = bnxt_qplib_put_sges(sq_hwq, wqe->sg_list,
-					       wqe->num_sge, &sw_prod);
+	data_len = bnxt_qplib_sq_put_data(qp, wqe, &base_hdr, &ext_hdr);
 	if (data_len < 0)
 		goto queue_err;
 	/* Make sure we update MSN table only for wired wqes */
@@ -2234,19 +2503,6 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 			ext_sqe->cfa_meta = cpu_to_le32((wqe->rawqp1.cfa_meta &
 				SQ_SEND_RAWETH_QP1_CFA_META_VLAN_VID_MASK) <<
 				SQ_SEND_RAWETH_QP1_CFA_META_VLAN_VID_SFT);
-
-			dev_dbg(&sq_hwq->pdev->dev,
-				"QPLIB: FP: RAW/QP1 Send WQE:\n"
-				"\twqe_type = 0x%x\n"
-				"\tflags = 0x%x\n"
-				"\twqe_size = 0x%x\n"
-				"\tlflags = 0x%x\n"
-				"\tcfa_action = 0x%x\n"
-				"\tlength = 0x%x\n"
-				"\tcfa_meta = 0x%x",
-				sqe->wqe_type, sqe->flags, sqe->wqe_size,
-				sqe->lflags, sqe->cfa_action,
-				sqe->length, ext_sqe->cfa_meta);
 			break;
 		}
 		fallthrough;
@@ -2273,25 +2529,8 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 			msn_update = false;
 		} else {
 			sqe->length = cpu_to_le32(data_len);
-			if (qp->mtu)
-				pkt_num = (data_len + qp->mtu - 1) / qp->mtu;
-			if (!pkt_num)
-				pkt_num = 1;
-			sq->psn = (sq->psn + pkt_num) & BTH_PSN_MASK;
+			bnxt_qplib_sq_adv_psn(qp, data_len);
 		}
-		dev_dbg(&sq_hwq->pdev->dev,
-			"QPLIB: FP: Send WQE:\n"
-			"\twqe_type = 0x%x\n"
-			"\tflags = 0x%x\n"
-			"\twqe_size = 0x%x\n"
-			"\tinv_key/immdata = 0x%x\n"
-			"\tq_key = 0x%x\n"
-			"\tdst_qp = 0x%x\n"
-			"\tlength = 0x%x\n"
-			"\tavid = 0x%x",
-			sqe->wqe_type, sqe->flags, sqe->wqe_size,
-			sqe->inv_key_or_imm_data, sqe->q_key, ext_sqe->dst_qp,
-			sqe->length, ext_sqe->avid);
 		break;
 	}
 	case BNXT_QPLIB_SWQE_TYPE_RDMA_WRITE:
@@ -2310,24 +2549,7 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		sqe->length = cpu_to_le32((u32)data_len);
 		ext_sqe->remote_va = cpu_to_le64(wqe->rdma.remote_va);
 		ext_sqe->remote_key = cpu_to_le32(wqe->rdma.r_key);
-		if (qp->mtu)
-			pkt_num = (data_len + qp->mtu - 1) / qp->mtu;
-		if (!pkt_num)
-			pkt_num = 1;
-		sq->psn = (sq->psn + pkt_num) & BTH_PSN_MASK;
-
-		dev_dbg(&sq_hwq->pdev->dev,
-			"QPLIB: FP: RDMA WQE:\n"
-			"\twqe_type = 0x%x\n"
-			"\tflags = 0x%x\n"
-			"\twqe_size = 0x%x\n"
-			"\timmdata = 0x%x\n"
-			"\tlength = 0x%x\n"
-			"\tremote_va = 0x%llx\n"
-			"\tremote_key = 0x%x",
-			sqe->wqe_type, sqe->flags, sqe->wqe_size,
-			sqe->imm_data, sqe->length, ext_sqe->remote_va,
-			ext_sqe->remote_key);
+		bnxt_qplib_sq_adv_psn(qp, data_len);
 		break;
 	}
 	case BNXT_QPLIB_SWQE_TYPE_ATOMIC_CMP_AND_SWP:
@@ -2343,11 +2565,7 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		sqe->remote_va = cpu_to_le64(wqe->atomic.remote_va);
 		ext_sqe->swap_data = cpu_to_le64(wqe->atomic.swap_data);
 		ext_sqe->cmp_data = cpu_to_le64(wqe->atomic.cmp_data);
-		if (qp->mtu)
-			pkt_num = (data_len + qp->mtu - 1) / qp->mtu;
-		if (!pkt_num)
-			pkt_num = 1;
-		sq->psn = (sq->psn + pkt_num) & BTH_PSN_MASK;
+		bnxt_qplib_sq_adv_psn(qp, data_len);
 		break;
 	}
 	case BNXT_QPLIB_SWQE_TYPE_LOCAL_INV:
@@ -2357,13 +2575,6 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		sqe->wqe_type = wqe->type;
 		sqe->flags = wqe->flags;
 		sqe->inv_l_key = cpu_to_le32(wqe->local_inv.inv_l_key);
-
-		dev_dbg(&sq_hwq->pdev->dev,
-			"QPLIB: FP: LOCAL INV WQE:\n"
-			"\twqe_type = 0x%x\n"
-			"\tflags = 0x%x\n"
-			"\tinv_l_key = 0x%x",
-			sqe->wqe_type, sqe->flags, sqe->inv_l_key);
 		msn_update = false;
 		break;
 	}
@@ -2400,21 +2611,6 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 			ext_sqe->pblptr = cpu_to_le64(wqe->frmr.pbl_dma_ptr);
 		}
 		ext_sqe->va = cpu_to_le64(wqe->frmr.va);
-		dev_dbg(&sq_hwq->pdev->dev,
-			"QPLIB: FP: FRMR WQE:\n"
-			"\twqe_type = 0x%x\n"
-			"\tflags = 0x%x\n"
-			"\taccess_cntl = 0x%x\n"
-			"\tzero_based_page_size_log = 0x%x\n"
-			"\tl_key = 0x%x\n"
-			"\tlength = 0x%x\n"
-			"\tnumlevels_pbl_page_size_log = 0x%x\n"
-			"\tpblptr = 0x%llx\n"
-			"\tva = 0x%llx",
-			sqe->wqe_type, sqe->flags, sqe->access_cntl,
-			sqe->zero_based_page_size_log, sqe->l_key,
-			*(u32 *)sqe->length, sqe->numlevels_pbl_page_size_log,
-			ext_sqe->pblptr, ext_sqe->va);
 		msn_update = false;
 		break;
 	}
@@ -2432,19 +2628,6 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		sqe->l_key = cpu_to_le32(wqe->bind.r_key);
 		ext_sqe->va = cpu_to_le64(wqe->bind.va);
 		ext_sqe->length_lo = cpu_to_le32(wqe->bind.length);
-		dev_dbg(&sq_hwq->pdev->dev,
-			"QPLIB: FP: BIND WQE:\n"
-			"\twqe_type = 0x%x\n"
-			"\tflags = 0x%x\n"
-			"\taccess_cntl = 0x%x\n"
-			"\tmw_type_zero_based = 0x%x\n"
-			"\tparent_l_key = 0x%x\n"
-			"\tl_key = 0x%x\n"
-			"\tva = 0x%llx\n"
-			"\tlength = 0x%x",
-			sqe->wqe_type, sqe->flags, sqe->access_cntl,
-			sqe->mw_type_zero_based, sqe->parent_l_key,
-			sqe->l_key, sqe->va, ext_sqe->length_lo);
 		msn_update = false;
 		break;
 	}
@@ -2453,14 +2636,7 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 		rc = -EINVAL;
 		goto done;
 	}
-	/*
-	 * Ensure we update MSN table only for wired WQEs only.
-	 * Free entry for all other NICS psn, psn_ext
-	 */
-	if (!BNXT_RE_HW_RETX(qp->dev_cap_flags) || msn_update) {
-		swq->next_psn = sq->psn & BTH_PSN_MASK;
-		bnxt_qplib_fill_psn_search(qp, wqe, swq);
-	}
+	bnxt_qplib_sq_fill_psn(qp, wqe, swq, msn_update);
 
 #ifdef ENABLE_DEBUG_SGE
 	for (i = 0, hw_sge = (struct sq_sge *)hw_sq_send_hdr->data;
@@ -2470,13 +2646,8 @@ int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
 			hw_sge->va_or_pa, hw_sge->l_key, hw_sge->size);
 #endif
 queue_err:
-	bnxt_qplib_swq_mod_start(sq, wqe_idx);
-	bnxt_qplib_hwq_incr_prod(&sq->dbinfo, sq_hwq, swq->slots);
-	qp->wqe_cnt++;
+	bnxt_qplib_sq_queue_swqe(qp, swq, wqe_idx, wqe_slots, !sch_handler);
 done:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&sq_hwq->lock, flags);
-#endif
 
 	if (sch_handler) {
 		nq_work = kzalloc(sizeof(*nq_work), GFP_ATOMIC);
@@ -2494,16 +2665,164 @@ done:
 	return rc;
 }
 
-void bnxt_qplib_post_recv_db(struct bnxt_qplib_qp *qp)
+/*
+ * Fast paths for the WQEs kernel ULPs post most: sends and RDMA on RC,
+ * sends on UD, on a QP in RTS. is_ud and var_wqe are constant in each
+ * caller so the compiler drops the unused branches. Anything else is
+ * handed to bnxt_qplib_post_send_generic().
+ */
+static __always_inline int
+__bnxt_qplib_post_send_fast(struct bnxt_qplib_qp *qp,
+			    struct bnxt_qplib_swqe *wqe,
+			    bool is_ud, bool var_wqe)
 {
-	struct bnxt_qplib_q *rq = &qp->rq;
+	struct bnxt_qplib_q *sq = &qp->sq;
+	struct bnxt_qplib_hwq *sq_hwq = &sq->hwq;
+	struct bnxt_qplib_swq *swq;
+	void *base_hdr, *ext_hdr;
+	u16 slots_needed;
+	u16 qfd_slots;
+	int data_len;
+	u32 wqe_idx;
+	u16 wqe_size;
+	u8 wqe_slots;
 
-	bnxt_qplib_ring_prod_db(&rq->dbinfo, DBC_DBC_TYPE_RQ);
-}
+	bnxt_qplib_assert_fp_lock(sq->fp_lock);
+	if (unlikely(qp->state != CMDQ_MODIFY_QP_NEW_STATE_RTS ||
+		     qp->cur_qp_state == CMDQ_MODIFY_QP_NEW_STATE_ERR))
+		return bnxt_qplib_post_send_generic(qp, wqe);
+	switch (wqe->type) {
+	case BNXT_QPLIB_SWQE_TYPE_SEND:
+	case BNXT_QPLIB_SWQE_TYPE_SEND_WITH_IMM:
+		break;
+	case BNXT_QPLIB_SWQE_TYPE_SEND_WITH_INV:
+	case BNXT_QPLIB_SWQE_TYPE_RDMA_WRITE:
+	case BNXT_QPLIB_SWQE_TYPE_RDMA_WRITE_WITH_IMM:
+	case BNXT_QPLIB_SWQE_TYPE_RDMA_READ:
+		if (!is_ud)
+			break;
+		fallthrough;
+	default:
+		return bnxt_qplib_post_send_generic(qp, wqe);
+	}
 
-void bnxt_re_handle_cqn(struct bnxt_qplib_cq *cq)
-{
-	struct bnxt_qplib_nq *nq;
+	wqe_slots = _calculate_wqe_byte(qp, wqe, &wqe_size);
+	slots_needed = var_wqe ? wqe_slots : sq->dbinfo.max_slot;
+	qfd_slots = _translate_q_full_delta(sq, wqe_size);
+	if (unlikely(bnxt_qplib_queue_full(sq_hwq, slots_needed + qfd_slots))) {
+		bnxt_qplib_sq_full_err(qp, qfd_slots, slots_needed);
+		return -ENOMEM;
+	}
+
+	swq = bnxt_qplib_sq_start_swqe(qp, wqe, slots_needed, &wqe_idx);
+	data_len = bnxt_qplib_sq_put_data(qp, wqe, &base_hdr, &ext_hdr);
+	if (unlikely(data_len < 0))
+		goto queue_err;
+
+	if (is_ud) {
+		struct sq_send_hdr *sqe = base_hdr;
+		struct sq_ud_ext_hdr *ext_sqe = ext_hdr;
+
+		sqe->wqe_type = wqe->type;
+		sqe->flags = wqe->flags;
+		sqe->wqe_size = wqe_slots;
+		sqe->inv_key_or_imm_data = cpu_to_le32(wqe->send.inv_key);
+		sqe->q_key = cpu_to_le32(wqe->send.q_key);
+		sqe->length = cpu_to_le32(data_len);
+		ext_sqe->dst_qp = cpu_to_le32(wqe->send.dst_qp &
+					      SQ_SEND_DST_QP_MASK);
+		ext_sqe->avid = cpu_to_le32(wqe->send.avid & SQ_SEND_AVID_MASK);
+		sq->psn = (sq->psn + 1) & BTH_PSN_MASK;
+		/* UD sends are never wired into the MSN table */
+		bnxt_qplib_sq_fill_psn(qp, wqe, swq, false);
+		goto queue_err;
+	}
+
+	if (wqe->type == BNXT_QPLIB_SWQE_TYPE_SEND ||
+	    wqe->type == BNXT_QPLIB_SWQE_TYPE_SEND_WITH_IMM ||
+	    wqe->type == BNXT_QPLIB_SWQE_TYPE_SEND_WITH_INV) {
+		struct sq_send_hdr *sqe = base_hdr;
+
+		sqe->wqe_type = wqe->type;
+		sqe->flags = wqe->flags;
+		sqe->wqe_size = wqe_slots;
+		sqe->inv_key_or_imm_data = cpu_to_le32(wqe->send.inv_key);
+		sqe->length = cpu_to_le32(data_len);
+	} else {
+		struct sq_rdma_hdr *sqe = base_hdr;
+		struct sq_rdma_ext_hdr *ext_sqe = ext_hdr;
+
+		sqe->wqe_type = wqe->type;
+		sqe->flags = wqe->flags;
+		sqe->wqe_size = wqe_slots;
+		sqe->imm_data = cpu_to_le32(wqe->rdma.inv_key);
+		sqe->length = cpu_to_le32((u32)data_len);
+		ext_sqe->remote_va = cpu_to_le64(wqe->rdma.remote_va);
+		ext_sqe->remote_key = cpu_to_le32(wqe->rdma.r_key);
+	}
+	bnxt_qplib_sq_adv_psn(qp, data_len);
+	bnxt_qplib_sq_fill_psn(qp, wqe, swq, true);
+
+queue_err:
+	bnxt_qplib_sq_queue_swqe(qp, swq, wqe_idx, wqe_slots, true);
+	return 0;
+}
+
+static int bnxt_qplib_post_send_rc_static(struct bnxt_qplib_qp *qp,
+					  struct bnxt_qplib_swqe *wqe)
+{
+	return __bnxt_qplib_post_send_fast(qp, wqe, false, false);
+}
+
+static int bnxt_qplib_post_send_rc_var(struct bnxt_qplib_qp *qp,
+				       struct bnxt_qplib_swqe *wqe)
+{
+	return __bnxt_qplib_post_send_fast(qp, wqe, false, true);
+}
+
+static int bnxt_qplib_post_send_ud_static(struct bnxt_qplib_qp *qp,
+					  struct bnxt_qplib_swqe *wqe)
+{
+	return __bnxt_qplib_post_send_fast(qp, wqe, true, false);
+}
+
+static int bnxt_qplib_post_send_ud_var(struct bnxt_qplib_qp *qp,
+				       struct bnxt_qplib_swqe *wqe)
+{
+	return __bnxt_qplib_post_send_fast(qp, wqe, true, true);
+}
+
+/* Picked once per QP, QP type and WQE mode never change afterwards */
+void bnxt_qplib_set_post_send(struct bnxt_qplib_qp *qp)
+{
+	bool var_wqe = qp->wqe_mode == BNXT_QPLIB_WQE_MODE_VARIABLE;
+
+	switch (qp->type) {
+	case CMDQ_CREATE_QP_TYPE_RC:
+		qp->post_send = var_wqe ? bnxt_qplib_post_send_rc_var :
+					  bnxt_qplib_post_send_rc_static;
+		break;
+	case CMDQ_CREATE_QP_TYPE_UD:
+		qp->post_send = var_wqe ? bnxt_qplib_post_send_ud_var :
+					  bnxt_qplib_post_send_ud_static;
+		break;
+	default:
+		qp->post_send = bnxt_qplib_post_send_generic;
+		break;
+	}
+}
+
+void bnxt_qplib_post_recv_db(struct bnxt_qplib_qp *qp)
+{
+	struct bnxt_qplib_q *rq = &qp->rq;
+
+	trace_bnxt_qplib_ring_db(&rq->dbinfo, DBC_DBC_TYPE_RQ);
+	bnxt_qplib_ring_prod_db(&rq->dbinfo, DBC_DBC_TYPE_RQ);
+}
+
+void bnxt_re_handle_cqn(struct bnxt_qplib_cq *cq)
+{
+	struct bnxt_qplib_nq *nq;
 
 	if (!(cq && cq->nq))
 		return;
@@ -2530,18 +2849,13 @@ int bnxt_qplib_post_recv(struct bnxt_qplib_qp *qp,
 	struct rq_wqe_hdr *base_hdr;
 	struct rq_ext_hdr *ext_hdr;
 	struct sq_sge *dsge;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	u8 wqe_slots;
 	u32 wqe_idx;
 	u32 sw_prod;
 	int rc = 0;
 
 	rq_hwq = &rq->hwq;
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&rq_hwq->lock, flags);
-#endif
+	bnxt_qplib_assert_fp_lock(rq->fp_lock);
 	if (qp->state == CMDQ_MODIFY_QP_NEW_STATE_RESET) {
 		dev_err(&rq_hwq->pdev->dev,
 			"QPLIB: FP: QP (0x%x) is in the 0x%x state",
@@ -2561,9 +2875,6 @@ int bnxt_qplib_post_recv(struct bnxt_qplib_qp *qp,
 	swq = bnxt_qplib_get_swqe(rq, &wqe_idx);
 	swq->wr_id = wqe->wr_id;
 	swq->slots = rq->dbinfo.max_slot;
-	dev_dbg(&rq_hwq->pdev->dev,
-		"QPLIB: FP: post RQ wr_id[%d] = 0x%llx",
-		wqe_idx, swq->wr_id);
 	if (qp->cur_qp_state == CMDQ_MODIFY_QP_NEW_STATE_ERR) {
 		sch_handler = true;
 		dev_dbg(&rq_hwq->pdev->dev, "%s Error QP. Sched a flushed cmpl\n",
@@ -2593,10 +2904,8 @@ int bnxt_qplib_post_recv(struct bnxt_qplib_qp *qp,
 queue_err:
 	bnxt_qplib_swq_mod_start(rq, wqe_idx);
 	bnxt_qplib_hwq_incr_prod(&rq->dbinfo, &rq->hwq, swq->slots);
+	trace_bnxt_qplib_post_recv(qp, swq, wqe_idx);
 done:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&rq->hwq.lock, flags);
-#endif
 	if (sch_handler) {
 		nq_work = kzalloc(sizeof(*nq_work), GFP_ATOMIC);
 		if (nq_work) {
@@ -2700,9 +3009,7 @@ int bnxt_qplib_create_cq(struct bnxt_qplib_res *res, struct bnxt_qplib_cq *cq)
 	cq->dbinfo.toggle = 0;
 	cq->dbinfo.res = res;
 	cq->dbinfo.seed = cq->id;
-	spin_lock_init(&cq->dbinfo.lock);
-	cq->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
-	cq->dbinfo.shadow_key_arm_ena = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&cq->dbinfo);
 
 	tbl = &res->reftbl.cqref;
 	spin_lock_irqsave(&tbl->lock, flag);
@@ -2906,6 +3213,7 @@ static int __flush_sq(struct bnxt_qplib_q *sq, struct bnxt_qplib_qp *qp,
 		cqe++;
 		(*budget)--;
 skip_compl:
+		bnxt_qplib_put_push_slot(qp, &sq->swq[last]);
 		bnxt_qplib_hwq_incr_cons(sq->hwq.depth,
 					 &sq->hwq.cons,
 					 sq->swq[last].slots,
@@ -3140,24 +3448,63 @@ static int bnxt_qplib_get_cqe_sq_cons(struct bnxt_qplib_q *sq, u32 cqe_slot)
 	return cqe_sq_cons;
 }
 
+/*
+ * Where the CQ handlers deliver completions. The staged poll fills the
+ * bnxt_qplib_cqe array at @cqe; a direct poll hands every completion to
+ * @xlate together with the HW CQE it came from.
+ */
+struct bnxt_qplib_cq_out {
+	struct bnxt_qplib_cqe		*cqe;
+	bnxt_qplib_cqe_xlate_t		xlate;
+	void				*ctx;
+	int				budget;
+};
+
+/*
+ * Deliver one completion. A direct consumer is done with it here; for a
+ * staged poll the next bnxt_qplib_cqe is returned cleared, with the
+ * fields common to all CQE types set, for the caller to complete.
+ */
+static struct bnxt_qplib_cqe *bnxt_qplib_cq_emit(struct bnxt_qplib_cq *cq,
+						 struct bnxt_qplib_cq_out *out,
+						 struct bnxt_qplib_qp *qp,
+						 struct cq_base *hw_cqe,
+						 u64 wr_id, u8 type, u8 status)
+{
+	u8 opcode = hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
+	struct bnxt_qplib_cqe *cqe;
+
+	trace_bnxt_qplib_poll_cqe(cq, qp, wr_id, type, opcode, status);
+	if (out->xlate) {
+		out->budget -= out->xlate(out->ctx, qp, hw_cqe, wr_id, type,
+					  status);
+		return NULL;
+	}
+	cqe = out->cqe++;
+	out->budget--;
+	memset(cqe, 0, sizeof(*cqe));
+	cqe->opcode = opcode;
+	cqe->type = type;
+	cqe->status = status;
+	cqe->wr_id = wr_id;
+	cqe->qp_handle = (u64)(unsigned long)qp;
+	return cqe;
+}
+
 static int bnxt_qplib_cq_process_req(struct bnxt_qplib_cq *cq,
 				     struct cq_req *hwcqe,
-				     struct bnxt_qplib_cqe **pcqe, int *budget,
+				     struct bnxt_qplib_cq_out *out,
 				     u32 cq_cons, struct bnxt_qplib_qp **lib_qp)
 {
+	struct bnxt_qplib_cqe *cqe;
 	struct bnxt_qplib_qp *qp;
 	struct bnxt_qplib_q *sq;
-	struct bnxt_qplib_cqe *cqe;
 	u32 cqe_sq_cons;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	struct bnxt_qplib_swq *swq;
 	int cqe_cons;
 	int rc = 0;
 
 	qp = (struct bnxt_qplib_qp *)le64_to_cpu(hwcqe->qp_handle);
-	dev_dbg(&cq->hwq.pdev->dev, "FP: Process Req qp=0x%p", qp);
 	if (!qp) {
 		dev_err(&cq->hwq.pdev->dev,
 			"QPLIB: FP: Process Req qp is NULL");
@@ -3166,9 +3513,6 @@ static int bnxt_qplib_cq_process_req(struct bnxt_qplib_cq *cq,
 	sq = &qp->sq;
 
 	cqe_sq_cons = le16_to_cpu(hwcqe->sq_cons_idx) % sq->max_sw_wqe;
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&sq->hwq.lock, flags);
-#endif
 	if (qp->sq.flushed) {
 		dev_dbg(&cq->hwq.pdev->dev,
 			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
@@ -3190,38 +3534,33 @@ static int bnxt_qplib_cq_process_req(struct bnxt_qplib_cq *cq,
 	 * signaled SWQEs due to CQE aggregation from the current sq cons
 	 * to the cqe_sq_cons
 	 */
-	cqe = *pcqe;
-	while (*budget) {
+	while (out->budget) {
 		if (sq->swq_last == cqe_sq_cons)
 			/* Done */
 			break;
 
 		swq = &sq->swq[sq->swq_last];
-		memset(cqe, 0, sizeof(*cqe));
-		cqe->opcode = CQ_BASE_CQE_TYPE_REQ;
-		cqe->qp_handle = (u64)qp;
-		cqe->src_qp = qp->id;
-		cqe->wr_id = swq->wr_id;
-
-		if (cqe->wr_id == BNXT_QPLIB_FENCE_WRID)
+		if (swq->wr_id == BNXT_QPLIB_FENCE_WRID)
 			goto skip;
 
-		cqe->type = swq->type;
-
 		/* For the last CQE, check for status.  For errors, regardless
 		 * of the request being signaled or not, it must complete with
 		 * the hwcqe error status
 		 */
 		if (swq->next_idx == cqe_sq_cons &&
 		    hwcqe->status != CQ_REQ_STATUS_OK) {
-			cqe->status = hwcqe->status;
 			dev_err(&cq->hwq.pdev->dev,
 				"QPLIB: FP: CQ Processed Req ");
 			dev_err(&cq->hwq.pdev->dev,
 				"QPLIB: QP 0x%x wr_id[%d] = 0x%llx vendor type 0x%x with vendor status 0x%x",
-				cqe->src_qp, sq->swq_last, cqe->wr_id, cqe->type, cqe->status);
-			cqe++;
-			(*budget)--;
+				qp->id, sq->swq_last, swq->wr_id, swq->type,
+				hwcqe->status);
+			cqe = bnxt_qplib_cq_emit(cq, out, qp,
+						 (struct cq_base *)hwcqe,
+						 swq->wr_id, swq->type,
+						 hwcqe->status);
+			if (cqe)
+				cqe->src_qp = qp->id;
 			bnxt_qplib_mark_qp_error(qp);
 		} else {
 			/* Before we complete, do WA 9060 */
@@ -3234,20 +3573,16 @@ static int bnxt_qplib_cq_process_req(struct bnxt_qplib_cq *cq,
 				}
 			}
 			if (swq->flags & SQ_SEND_FLAGS_SIGNAL_COMP) {
-
-				dev_dbg(&cq->hwq.pdev->dev,
-					"QPLIB: FP: CQ Processed Req ");
-				dev_dbg(&cq->hwq.pdev->dev,
-					"QPLIB: wr_id[%d] = 0x%llx ",
-					sq->swq_last, cqe->wr_id);
-				dev_dbg(&cq->hwq.pdev->dev,
-					"QPLIB: with status 0x%x", cqe->status);
-				cqe->status = CQ_REQ_STATUS_OK;
-				cqe++;
-				(*budget)--;
+				cqe = bnxt_qplib_cq_emit(cq, out, qp,
+							 (struct cq_base *)hwcqe,
+							 swq->wr_id, swq->type,
+							 CQ_REQ_STATUS_OK);
+				if (cqe)
+					cqe->src_qp = qp->id;
 			}
 		}
 skip:
+		bnxt_qplib_put_push_slot(qp, swq);
 		bnxt_qplib_hwq_incr_cons(sq->hwq.depth, &sq->hwq.cons,
 					 swq->slots, &sq->dbinfo.flags);
 		sq->swq_last = swq->next_idx;
@@ -3255,7 +3590,6 @@ skip:
 			break;
 	}
 out:
-	*pcqe = cqe;
 	if (sq->swq_last != cqe_sq_cons) {
 		/* Out of budget */
 		rc = -EAGAIN;
@@ -3265,61 +3599,37 @@ out:
 	   the WC for this CQE */
 	sq->single = false;
 done:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&sq->hwq.lock, flags);
-#endif
 	return rc;
 }
 
 static void bnxt_qplib_release_srqe(struct bnxt_qplib_srq *srq, u32 tag)
 {
+	u32 cons;
+
 	spin_lock(&srq->hwq.lock);
 	srq->swq[srq->last_idx].next_idx = (int)tag;
 	srq->last_idx = (int)tag;
 	srq->swq[srq->last_idx].next_idx = -1;
-	bnxt_qplib_hwq_incr_cons(srq->hwq.depth, &srq->hwq.cons,
+	/* Publish the wrapped value in one store, posters read it unlocked */
+	cons = srq->hwq.cons;
+	bnxt_qplib_hwq_incr_cons(srq->hwq.depth, &cons,
 				 srq->dbinfo.max_slot, &srq->dbinfo.flags);
+	WRITE_ONCE(srq->hwq.cons, cons);
 	spin_unlock(&srq->hwq.lock);
 }
 
-static int bnxt_qplib_cq_process_res_rc(struct bnxt_qplib_cq *cq,
-					struct cq_res_rc *hwcqe,
-					struct bnxt_qplib_cqe **pcqe,
-					int *budget)
+/*
+ * Look up the wr_id of an RC/UD receive completion and retire its RQ or
+ * SRQ entry. Returns -EINVAL for an index the queue cannot have produced.
+ */
+static int bnxt_qplib_cq_res_wr_id(struct bnxt_qplib_cq *cq,
+				   struct bnxt_qplib_qp *qp, u32 wr_id_idx,
+				   bool srq_cqe, u64 *wr_id)
 {
 	struct bnxt_qplib_srq *srq;
-	struct bnxt_qplib_cqe *cqe;
-	struct bnxt_qplib_qp *qp;
 	struct bnxt_qplib_q *rq;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
-	u32 wr_id_idx;
-	int rc = 0;
 
-	qp = (struct bnxt_qplib_qp *)le64_to_cpu(hwcqe->qp_handle);
-	if (!qp) {
-		dev_err(&cq->hwq.pdev->dev, "QPLIB: process_cq RC qp is NULL");
-		return -EINVAL;
-	}
-	if (qp->rq.flushed) {
-		dev_dbg(&cq->hwq.pdev->dev,
-			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
-		goto done;
-	}
-
-	cqe = *pcqe;
-	cqe->opcode = hwcqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
-	cqe->length = le32_to_cpu(hwcqe->length);
-	cqe->invrkey = le32_to_cpu(hwcqe->imm_data_or_inv_r_key);
-	cqe->mr_handle = le64_to_cpu(hwcqe->mr_handle);
-	cqe->flags = le16_to_cpu(hwcqe->flags);
-	cqe->status = hwcqe->status;
-	cqe->qp_handle = (u64)(unsigned long)qp;
-
-	wr_id_idx = le32_to_cpu(hwcqe->srq_or_rq_wr_id) &
-				CQ_RES_RC_SRQ_OR_RQ_WR_ID_MASK;
-	if (cqe->flags & CQ_RES_RC_FLAGS_SRQ_SRQ) {
+	if (srq_cqe) {
 		srq = qp->srq;
 		if (!srq) {
 			dev_err(&cq->hwq.pdev->dev,
@@ -3328,74 +3638,89 @@ static int bnxt_qplib_cq_process_res_rc(struct bnxt_qplib_cq *cq,
 		}
 		if (wr_id_idx > srq->hwq.depth - 1) {
 			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: FP: CQ Process RC ");
+				"QPLIB: FP: CQ Process Res ");
 			dev_err(&cq->hwq.pdev->dev,
 				"QPLIB: wr_id idx 0x%x exceeded SRQ max 0x%x",
 				wr_id_idx, srq->hwq.depth);
 			return -EINVAL;
 		}
-		cqe->wr_id = srq->swq[wr_id_idx].wr_id;
+		*wr_id = srq->swq[wr_id_idx].wr_id;
 		bnxt_qplib_release_srqe(srq, wr_id_idx);
-		dev_dbg(&srq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed RC SRQ wr_id[%d] = 0x%llx",
-			wr_id_idx, cqe->wr_id);
-		cqe++;
-		(*budget)--;
-		*pcqe = cqe;
-	} else {
-		rq = &qp->rq;
-		if (wr_id_idx > (rq->max_wqe - 1)) {
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: FP: CQ Process RC ");
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: wr_id idx 0x%x exceeded RQ max 0x%x",
-				wr_id_idx, rq->hwq.depth);
-			return -EINVAL;
-		}
-		if (wr_id_idx != rq->swq_last)
-			return -EINVAL;
-#ifdef ENABLE_FP_SPINLOCK
-		spin_lock_irqsave(&rq->hwq.lock, flags);
-#endif
+		return 0;
+	}
 
-		cqe->wr_id = rq->swq[rq->swq_last].wr_id;
+	rq = &qp->rq;
+	if (wr_id_idx > (rq->max_wqe - 1)) {
+		dev_err(&cq->hwq.pdev->dev,
+			"QPLIB: FP: CQ Process Res ");
+		dev_err(&cq->hwq.pdev->dev,
+			"QPLIB: wr_id idx 0x%x exceeded RQ max 0x%x",
+			wr_id_idx, rq->hwq.depth);
+		return -EINVAL;
+	}
+	if (wr_id_idx != rq->swq_last)
+		return -EINVAL;
+
+	*wr_id = rq->swq[rq->swq_last].wr_id;
+	bnxt_qplib_hwq_incr_cons(rq->hwq.depth, &rq->hwq.cons,
+				 rq->swq[rq->swq_last].slots,
+				 &rq->dbinfo.flags);
+	rq->swq_last = rq->swq[rq->swq_last].next_idx;
+	return 0;
+}
+
+static int bnxt_qplib_cq_process_res_rc(struct bnxt_qplib_cq *cq,
+					struct cq_res_rc *hwcqe,
+					struct bnxt_qplib_cq_out *out)
+{
+	struct bnxt_qplib_cqe *cqe;
+	struct bnxt_qplib_qp *qp;
+	u32 wr_id_idx;
+	bool srq_cqe;
+	u64 wr_id;
+	int rc;
+
+	qp = (struct bnxt_qplib_qp *)le64_to_cpu(hwcqe->qp_handle);
+	if (!qp) {
+		dev_err(&cq->hwq.pdev->dev, "QPLIB: process_cq RC qp is NULL");
+		return -EINVAL;
+	}
+	if (qp->rq.flushed) {
 		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed RC RQ wr_id[%d] = 0x%llx",
-			rq->swq_last, cqe->wr_id);
-		cqe++;
-		(*budget)--;
-		bnxt_qplib_hwq_incr_cons(rq->hwq.depth, &rq->hwq.cons,
-					 rq->swq[rq->swq_last].slots,
-					 &rq->dbinfo.flags);
-		rq->swq_last = rq->swq[rq->swq_last].next_idx;
-		*pcqe = cqe;
+			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
+		return 0;
+	}
 
-		if (hwcqe->status != CQ_RES_RC_STATUS_OK)
-			bnxt_qplib_mark_qp_error(qp);
+	wr_id_idx = le32_to_cpu(hwcqe->srq_or_rq_wr_id) &
+				CQ_RES_RC_SRQ_OR_RQ_WR_ID_MASK;
+	srq_cqe = !!(le16_to_cpu(hwcqe->flags) & CQ_RES_RC_FLAGS_SRQ_SRQ);
+	rc = bnxt_qplib_cq_res_wr_id(cq, qp, wr_id_idx, srq_cqe, &wr_id);
+	if (rc)
+		return rc;
 
-#ifdef ENABLE_FP_SPINLOCK
-		spin_unlock_irqrestore(&rq->hwq.lock, flags);
-#endif
+	cqe = bnxt_qplib_cq_emit(cq, out, qp, (struct cq_base *)hwcqe,
+				 wr_id, 0, hwcqe->status);
+	if (cqe) {
+		cqe->length = le32_to_cpu(hwcqe->length);
+		cqe->invrkey = le32_to_cpu(hwcqe->imm_data_or_inv_r_key);
+		cqe->mr_handle = le64_to_cpu(hwcqe->mr_handle);
+		cqe->flags = le16_to_cpu(hwcqe->flags);
 	}
-done:
-	return rc;
+	if (!srq_cqe && hwcqe->status != CQ_RES_RC_STATUS_OK)
+		bnxt_qplib_mark_qp_error(qp);
+	return 0;
 }
 
 static int bnxt_qplib_cq_process_res_ud(struct bnxt_qplib_cq *cq,
 					struct cq_res_ud_v2 *hwcqe,
-					struct bnxt_qplib_cqe **pcqe,
-					int *budget)
+					struct bnxt_qplib_cq_out *out)
 {
-	struct bnxt_qplib_srq *srq;
 	struct bnxt_qplib_cqe *cqe;
 	struct bnxt_qplib_qp *qp;
-	struct bnxt_qplib_q *rq;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	u32 wr_id_idx;
-	int rc = 0;
-	u16 *smac;
+	bool srq_cqe;
+	u64 wr_id;
+	int rc;
 
 	qp = (struct bnxt_qplib_qp *)le64_to_cpu(hwcqe->qp_handle);
 	if (!qp) {
@@ -3405,107 +3730,41 @@ static int bnxt_qplib_cq_process_res_ud(struct bnxt_qplib_cq *cq,
 	if (qp->rq.flushed) {
 		dev_dbg(&cq->hwq.pdev->dev,
 			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
-		goto done;
+		return 0;
 	}
-	cqe = *pcqe;
-	cqe->opcode = hwcqe->cqe_type_toggle & CQ_RES_UD_V2_CQE_TYPE_MASK;
-	cqe->length = le32_to_cpu((hwcqe->length & CQ_RES_UD_V2_LENGTH_MASK));
-	cqe->cfa_meta = le16_to_cpu(hwcqe->cfa_metadata0);
-	/* V2 format has metadata1 */
-	cqe->cfa_meta |= (((le32_to_cpu(hwcqe->src_qp_high_srq_or_rq_wr_id) &
-			   CQ_RES_UD_V2_CFA_METADATA1_MASK) >>
-			  CQ_RES_UD_V2_CFA_METADATA1_SFT) <<
-			 BNXT_QPLIB_META1_SHIFT);
-	cqe->invrkey = le32_to_cpu(hwcqe->imm_data);
-	cqe->flags = le16_to_cpu(hwcqe->flags);
-	cqe->status = hwcqe->status;
-	cqe->qp_handle = (u64)(unsigned long)qp;
-	smac = (u16 *)cqe->smac;
-	smac[2] = ntohs(le16_to_cpu(hwcqe->src_mac[0]));
-	smac[1] = ntohs(le16_to_cpu(hwcqe->src_mac[1]));
-	smac[0] = ntohs(le16_to_cpu(hwcqe->src_mac[2]));
+
 	wr_id_idx = le32_to_cpu(hwcqe->src_qp_high_srq_or_rq_wr_id)
 				& CQ_RES_UD_V2_SRQ_OR_RQ_WR_ID_MASK;
-	cqe->src_qp = le16_to_cpu(hwcqe->src_qp_low) |
-				  ((le32_to_cpu(
-				    hwcqe->src_qp_high_srq_or_rq_wr_id) &
-				    CQ_RES_UD_V2_SRC_QP_HIGH_MASK) >> 8);
-
-	if (cqe->flags & CQ_RES_UD_V2_FLAGS_SRQ) {
-		srq = qp->srq;
-		if (!srq) {
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: FP: SRQ used but not defined??");
-			return -EINVAL;
-		}
-		if (wr_id_idx > srq->hwq.depth - 1) {
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: FP: CQ Process UD ");
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: wr_id idx 0x%x exceeded SRQ max 0x%x",
-				wr_id_idx, srq->hwq.depth);
-			return -EINVAL;
-		}
-		cqe->wr_id = srq->swq[wr_id_idx].wr_id;
-		bnxt_qplib_release_srqe(srq, wr_id_idx);
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed UD SRQ wr_id[%d] = 0x%llx",
-			wr_id_idx, cqe->wr_id);
-		cqe++;
-		(*budget)--;
-		*pcqe = cqe;
-	} else {
-		rq = &qp->rq;
-		if (wr_id_idx > (rq->max_wqe - 1)) {
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: FP: CQ Process UD ");
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: wr_id idx 0x%x exceeded RQ max 0x%x",
-				wr_id_idx, rq->hwq.depth);
-			return -EINVAL;
-		}
-		if (rq->swq_last != wr_id_idx)
-			return -EINVAL;
-
-#ifdef ENABLE_FP_SPINLOCK
-		spin_lock_irqsave(&rq->hwq.lock, flags);
-#endif
-		cqe->wr_id = rq->swq[rq->swq_last].wr_id;
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed UD RQ wr_id[%d] = 0x%llx",
-			 rq->swq_last, cqe->wr_id);
-		cqe++;
-		(*budget)--;
-		bnxt_qplib_hwq_incr_cons(rq->hwq.depth, &rq->hwq.cons,
-					 rq->swq[rq->swq_last].slots,
-					 &rq->dbinfo.flags);
-		rq->swq_last = rq->swq[rq->swq_last].next_idx;
-		*pcqe = cqe;
-
-		if (hwcqe->status != CQ_RES_UD_V2_STATUS_OK)
-			bnxt_qplib_mark_qp_error(qp);
+	srq_cqe = !!(le16_to_cpu(hwcqe->flags) & CQ_RES_UD_V2_FLAGS_SRQ);
+	rc = bnxt_qplib_cq_res_wr_id(cq, qp, wr_id_idx, srq_cqe, &wr_id);
+	if (rc)
+		return rc;
 
-#ifdef ENABLE_FP_SPINLOCK
-		spin_unlock_irqrestore(&rq->hwq.lock, flags);
-#endif
+	cqe = bnxt_qplib_cq_emit(cq, out, qp, (struct cq_base *)hwcqe,
+				 wr_id, 0, hwcqe->status);
+	if (cqe) {
+		cqe->length = bnxt_qplib_cqe_ud_length(hwcqe);
+		cqe->cfa_meta = bnxt_qplib_cqe_ud_cfa_meta(hwcqe);
+		cqe->invrkey = le32_to_cpu(hwcqe->imm_data);
+		cqe->flags = le16_to_cpu(hwcqe->flags);
+		cqe->src_qp = bnxt_qplib_cqe_ud_src_qp(hwcqe);
+		bnxt_qplib_cqe_ud_smac(hwcqe, cqe->smac);
 	}
-done:
-	return rc;
+	if (!srq_cqe && hwcqe->status != CQ_RES_UD_V2_STATUS_OK)
+		bnxt_qplib_mark_qp_error(qp);
+	return 0;
 }
 
 bool bnxt_qplib_is_cq_empty(struct bnxt_qplib_cq *cq)
 {
-
 	struct cq_base *hw_cqe;
-	unsigned long flags;
 	bool rc = true;
 
-	spin_lock_irqsave(&cq->hwq.lock, flags);
+	bnxt_qplib_assert_fp_lock(cq->fp_lock);
 	hw_cqe = bnxt_qplib_get_qe(&cq->hwq, cq->hwq.cons, NULL);
 
 	 /* Check for Valid bit. If the CQE is valid, return false */
 	rc = !CQE_CMP_VALID(hw_cqe, cq->dbinfo.flags);
-	spin_unlock_irqrestore(&cq->hwq.lock, flags);
 	return rc;
 }
 
@@ -3519,9 +3778,6 @@ static int bnxt_qplib_cq_process_res_raweth_qp1(struct bnxt_qplib_cq *cq,
 	struct bnxt_qplib_srq *srq;
 	struct bnxt_qplib_cqe *cqe;
 	u32 wr_id_idx;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	int rc = 0;
 
 	qp = (struct bnxt_qplib_qp *)le64_to_cpu(hwcqe->qp_handle);
@@ -3556,10 +3812,6 @@ static int bnxt_qplib_cq_process_res_raweth_qp1(struct bnxt_qplib_cq *cq,
 	cqe->raweth_qp1_flags2 = le32_to_cpu(hwcqe->raweth_qp1_flags2);
 	cqe->raweth_qp1_metadata = le32_to_cpu(hwcqe->raweth_qp1_metadata);
 
-	dev_dbg(&cq->hwq.pdev->dev,
-		 "QPLIB: raweth_qp1_flags = 0x%x raweth_qp1_flags2 = 0x%x\n",
-		 cqe->raweth_qp1_flags, cqe->raweth_qp1_flags2);
-
 	if (cqe->flags & CQ_RES_RAWETH_QP1_FLAGS_SRQ_SRQ) {
 		srq = qp->srq;
 		if (!srq) {
@@ -3575,22 +3827,13 @@ static int bnxt_qplib_cq_process_res_raweth_qp1(struct bnxt_qplib_cq *cq,
 				wr_id_idx, srq->hwq.depth);
 			return -EINVAL;
 		}
-#ifdef ENABLE_FP_SPINLOCK
-		spin_lock_irqsave(&srq->hwq.lock, flags);
-#endif
 		cqe->wr_id = srq->swq[wr_id_idx].wr_id;
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed Raw/QP1 SRQ ");
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: wr_id[%d] = 0x%llx with status = 0x%x",
-			wr_id_idx, cqe->wr_id, hwcqe->status);
+		trace_bnxt_qplib_poll_cqe(cq, qp, cqe->wr_id, cqe->type,
+					  cqe->opcode, cqe->status);
 		cqe++;
 		(*budget)--;
 		srq->hwq.cons++;
 		*pcqe = cqe;
-#ifdef ENABLE_FP_SPINLOCK
-		spin_unlock_irqrestore(&srq->hwq.lock, flags);
-#endif
 	} else {
 		rq = &qp->rq;
 		if (wr_id_idx > (rq->max_wqe - 1)) {
@@ -3603,15 +3846,9 @@ static int bnxt_qplib_cq_process_res_raweth_qp1(struct bnxt_qplib_cq *cq,
 		}
 		if (wr_id_idx != rq->swq_last)
 			return -EINVAL;
-#ifdef ENABLE_FP_SPINLOCK
-		spin_lock_irqsave(&rq->hwq.lock, flags);
-#endif
 		cqe->wr_id = rq->swq[rq->swq_last].wr_id;
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: FP: CQ Processed Raw/QP1 RQ ");
-		dev_dbg(&cq->hwq.pdev->dev,
-			"QPLIB: wr_id[%d] = 0x%llx with status = 0x%x",
-			wr_id_idx, cqe->wr_id, hwcqe->status);
+		trace_bnxt_qplib_poll_cqe(cq, qp, cqe->wr_id, cqe->type,
+					  cqe->opcode, cqe->status);
 		cqe++;
 		(*budget)--;
 		bnxt_qplib_hwq_incr_cons(rq->hwq.depth, &rq->hwq.cons,
@@ -3623,9 +3860,6 @@ static int bnxt_qplib_cq_process_res_raweth_qp1(struct bnxt_qplib_cq *cq,
 		if (hwcqe->status != CQ_RES_RC_STATUS_OK)
 			bnxt_qplib_mark_qp_error(qp);
 
-#ifdef ENABLE_FP_SPINLOCK
-		spin_unlock_irqrestore(&rq->hwq.lock, flags);
-#endif
 	}
 done:
 	return rc;
@@ -3639,9 +3873,6 @@ static int bnxt_qplib_cq_process_terminal(struct bnxt_qplib_cq *cq,
 	struct bnxt_qplib_q *sq, *rq;
 	struct bnxt_qplib_cqe *cqe;
 	struct bnxt_qplib_qp *qp;
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-#endif
 	u32 cqe_cons;
 	int rc = 0;
 
@@ -3671,9 +3902,6 @@ static int bnxt_qplib_cq_process_terminal(struct bnxt_qplib_cq *cq,
 		goto do_rq;
 
 	cqe_cons %= sq->max_wqe;
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&sq->hwq.lock, flags);
-#endif
 	if (qp->sq.flushed) {
 		dev_dbg(&cq->hwq.pdev->dev,
 			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
@@ -3696,14 +3924,12 @@ static int bnxt_qplib_cq_process_terminal(struct bnxt_qplib_cq *cq,
 			cqe->src_qp = qp->id;
 			cqe->wr_id = sq->swq[sq->swq_last].wr_id;
 			cqe->type = sq->swq[sq->swq_last].type;
-			dev_dbg(&cq->hwq.pdev->dev,
-				"QPLIB: FP: CQ Processed terminal Req ");
-			dev_dbg(&cq->hwq.pdev->dev,
-				"QPLIB: wr_id[%d] = 0x%llx with status 0x%x",
-				sq->swq_last, cqe->wr_id, cqe->status);
+			trace_bnxt_qplib_poll_cqe(cq, qp, cqe->wr_id, cqe->type,
+						  cqe->opcode, cqe->status);
 			cqe++;
 			(*budget)--;
 		}
+		bnxt_qplib_put_push_slot(qp, &sq->swq[sq->swq_last]);
 		bnxt_qplib_hwq_incr_cons(sq->hwq.depth, &sq->hwq.cons,
 					 sq->swq[sq->swq_last].slots,
 					 &sq->dbinfo.flags);
@@ -3716,9 +3942,6 @@ static int bnxt_qplib_cq_process_terminal(struct bnxt_qplib_cq *cq,
 		goto sq_done;
 	}
 sq_done:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&sq->hwq.lock, flags);
-#endif
 	if (rc)
 		return rc;
 do_rq:
@@ -3733,9 +3956,6 @@ do_rq:
 			cqe_cons, rq->hwq.depth);
 		goto done;
 	}
-#ifdef ENABLE_FP_SPINLOCK
-	spin_lock_irqsave(&rq->hwq.lock, flags);
-#endif
 	if (qp->rq.flushed) {
 		dev_dbg(&cq->hwq.pdev->dev,
 			"%s: QPLIB: QP in Flush QP = %p\n", __func__, qp);
@@ -3744,9 +3964,6 @@ do_rq:
 	}
 
 rq_done:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&rq->hwq.lock, flags);
-#endif
 done:
 	return rc;
 }
@@ -3795,21 +4012,218 @@ int bnxt_qplib_process_flush_list(struct bnxt_qplib_cq *cq,
 	return num_cqes - budget;
 }
 
-int bnxt_qplib_poll_cq(struct bnxt_qplib_cq *cq, struct bnxt_qplib_cqe *cqe,
-		       int num_cqes, struct bnxt_qplib_qp **lib_qp)
+/* Deliver the completions of one HW CQE to @out.
+ * Returns 1 if the CQE was a CUT_OFF and polling of this CQ must stop.
+ */
+static int __bnxt_qplib_process_cqe(struct bnxt_qplib_cq *cq,
+				    struct cq_base *hw_cqe,
+				    struct bnxt_qplib_cq_out *out,
+				    struct bnxt_qplib_qp **lib_qp, int *prc)
+{
+	int rc = 0;
+	u8 type;
+
+	/* From the device's respective CQE format to qplib_wc*/
+	type = hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
+	switch (type) {
+	case CQ_BASE_CQE_TYPE_REQ:
+		rc = bnxt_qplib_cq_process_req(cq,
+				(struct cq_req *)hw_cqe, out,
+				cq->hwq.cons, lib_qp);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RC:
+		rc = bnxt_qplib_cq_process_res_rc(cq,
+					(struct cq_res_rc *)hw_cqe, out);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_UD:
+		rc = bnxt_qplib_cq_process_res_ud(cq,
+					(struct cq_res_ud_v2 *)hw_cqe, out);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RAWETH_QP1:
+		/* Raw QP1 and terminal CQEs are left to the staged poll */
+		if (out->xlate) {
+			rc = -EAGAIN;
+			break;
+		}
+		rc = bnxt_qplib_cq_process_res_raweth_qp1(cq,
+					(struct cq_res_raweth_qp1 *)
+					hw_cqe, &out->cqe, &out->budget);
+		break;
+	case CQ_BASE_CQE_TYPE_TERMINAL:
+		if (out->xlate) {
+			rc = -EAGAIN;
+			break;
+		}
+		rc = bnxt_qplib_cq_process_terminal(cq,
+					(struct cq_terminal *)hw_cqe,
+					&out->cqe, &out->budget);
+		break;
+	case CQ_BASE_CQE_TYPE_CUT_OFF:
+		bnxt_qplib_cq_process_cutoff(cq,
+					(struct cq_cutoff *)hw_cqe);
+		/* Done processing this CQ */
+		return 1;
+	default:
+		dev_err(&cq->hwq.pdev->dev,
+			"QPLIB: process_cq unknown type 0x%lx",
+			hw_cqe->cqe_type_toggle &
+			CQ_BASE_CQE_TYPE_MASK);
+		rc = -EINVAL;
+		break;
+	}
+	if (rc < 0 && rc != -EAGAIN) {
+		dev_dbg(&cq->hwq.pdev->dev,
+			"QPLIB: process_cqe rc = 0x%x", rc);
+		/* Error while processing the CQE, just skip to the
+		   next one */
+		if (type != CQ_BASE_CQE_TYPE_TERMINAL)
+			dev_err(&cq->hwq.pdev->dev,
+				"QPLIB: process_cqe error rc = 0x%x",
+				rc);
+	}
+	*prc = rc;
+	return 0;
+}
+
+static struct bnxt_qplib_qp *bnxt_qplib_cqe_qp(struct cq_base *hw_cqe)
+{
+	u64 handle;
+
+	switch (hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK) {
+	case CQ_BASE_CQE_TYPE_REQ:
+		handle = le64_to_cpu(((struct cq_req *)hw_cqe)->qp_handle);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RC:
+		handle = le64_to_cpu(((struct cq_res_rc *)hw_cqe)->qp_handle);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_UD:
+		handle = le64_to_cpu(((struct cq_res_ud_v2 *)hw_cqe)->qp_handle);
+		break;
+	case CQ_BASE_CQE_TYPE_RES_RAWETH_QP1:
+		handle = le64_to_cpu(((struct cq_res_raweth_qp1 *)
+				      hw_cqe)->qp_handle);
+		break;
+	default:
+		return NULL;
+	}
+	return (struct bnxt_qplib_qp *)(unsigned long)handle;
+}
+
+/*
+ * Slot and epoch of the CQE @ahead slots past the consumer, @ahead is
+ * below the depth. Kernel CQ depths need not be powers of two (the DB
+ * threshold pads them), so the wrap is a compare and subtract.
+ */
+static u32 bnxt_qplib_cq_peek_idx(struct bnxt_qplib_cq *cq, u32 ahead,
+				  u32 *flags)
+{
+	u32 idx = cq->hwq.cons + ahead;
+
+	*flags = cq->dbinfo.flags;
+	if (idx >= cq->hwq.depth) {
+		idx -= cq->hwq.depth;
+		*flags ^= 1UL << BNXT_QPLIB_FLAG_EPOCH_CONS_SHIFT;
+	}
+	return idx;
+}
+
+/* The CQE @ahead slots past the consumer if HW has written it */
+static struct cq_base *bnxt_qplib_cq_peek(struct bnxt_qplib_cq *cq, u32 ahead)
 {
 	struct cq_base *hw_cqe;
-	u32 hw_polled = 0;
-	int budget, rc = 0;
+	u32 flags, idx;
+
+	idx = bnxt_qplib_cq_peek_idx(cq, ahead, &flags);
+	hw_cqe = bnxt_qplib_get_qe(&cq->hwq, idx, NULL);
+	if (!CQE_CMP_VALID(hw_cqe, flags))
+		return NULL;
+	/* Valid bit before the rest of the CQE */
+	dma_rmb();
+	return hw_cqe;
+}
+
+/*
+ * Poll lookahead of K = cq->prefetch CQEs, run while the CQE at
+ * cq->hwq.cons is processed. Each stage reads only lines an earlier
+ * stage requested polls ago:
+ *  - the CQE line K slots ahead is requested,
+ *  - from K >= 2, the QP of the CQE K/2 slots ahead and the lines with
+ *    its swq/swq_last are requested,
+ *  - from K >= 4, the SWQ entry of the next CQE is requested. Its QP was
+ *    requested K/2 - 1 polls earlier; SRQ use comes from the CQE.
+ */
+static void bnxt_qplib_cq_prefetch(struct bnxt_qplib_cq *cq)
+{
+	u32 k = cq->prefetch, flags, idx;
+	struct bnxt_qplib_qp *qp;
+	struct bnxt_qplib_q *q;
+	struct cq_base *hw_cqe;
+	u16 res_flags;
 	u8 type;
 
-#ifdef ENABLE_FP_SPINLOCK
-	unsigned long flags;
-	spin_lock_irqsave(&cq->hwq.lock, flags);
-#endif
-	budget = num_cqes;
+	idx = bnxt_qplib_cq_peek_idx(cq, k, &flags);
+	prefetch(bnxt_qplib_get_qe(&cq->hwq, idx, NULL));
+	if (k < 2)
+		return;
+
+	hw_cqe = bnxt_qplib_cq_peek(cq, k / 2);
+	qp = hw_cqe ? bnxt_qplib_cqe_qp(hw_cqe) : NULL;
+	if (qp) {
+		type = hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
+		q = type == CQ_BASE_CQE_TYPE_REQ ? &qp->sq : &qp->rq;
+		prefetch(qp);
+		prefetch(&q->swq);
+		prefetch(&q->swq_last);
+	}
+	if (k < 4)
+		return;
+
+	hw_cqe = bnxt_qplib_cq_peek(cq, 1);
+	qp = hw_cqe ? bnxt_qplib_cqe_qp(hw_cqe) : NULL;
+	if (!qp)
+		return;
+	type = hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
+	if (type == CQ_BASE_CQE_TYPE_REQ) {
+		prefetch(&qp->sq.swq[qp->sq.swq_last]);
+		return;
+	}
+	/* Responder CQEs all keep flags where cq_res_rc does */
+	res_flags = le16_to_cpu(((struct cq_res_rc *)hw_cqe)->flags);
+	if (!(res_flags & CQ_RES_RC_FLAGS_SRQ))
+		prefetch(&qp->rq.swq[qp->rq.swq_last]);
+}
 
-	while (budget) {
+/*
+ * Publish the consumer index after @hw_polled CQEs were consumed. With
+ * db_thresh set the doorbell is held back until that many CQEs are
+ * pending. Kernel CQs using it are created db_thresh entries deeper, so
+ * HW never sees the CQ full because of the lag. Re-arming publishes the
+ * index as well.
+ */
+static void bnxt_qplib_cq_publish_cons(struct bnxt_qplib_cq *cq,
+				       u32 hw_polled)
+{
+	if (!hw_polled)
+		return;
+	cq->db_pending += hw_polled;
+	if (cq->db_pending < cq->db_thresh)
+		return;
+	trace_bnxt_qplib_ring_db(&cq->dbinfo, DBC_DBC_TYPE_CQ);
+	bnxt_qplib_ring_db(&cq->dbinfo, DBC_DBC_TYPE_CQ);
+	cq->db_pending = 0;
+}
+
+static int __bnxt_qplib_poll_cq(struct bnxt_qplib_cq *cq,
+				struct bnxt_qplib_cq_out *out,
+				struct bnxt_qplib_qp **lib_qp)
+{
+	int num_entries = out->budget;
+	struct cq_base *hw_cqe;
+	u32 hw_polled = 0;
+	int rc = 0;
+
+	bnxt_qplib_assert_fp_lock(cq->fp_lock);
+	while (out->budget) {
 		hw_cqe = bnxt_qplib_get_qe(&cq->hwq, cq->hwq.cons, NULL);
 
 		/* Check for Valid bit */
@@ -3820,87 +4234,76 @@ int bnxt_qplib_poll_cq(struct bnxt_qplib_cq *cq, struct bnxt_qplib_cqe *cqe,
 		 * reading any further.
 		 */
 		dma_rmb();
-		/* From the device's respective CQE format to qplib_wc*/
-		type = hw_cqe->cqe_type_toggle & CQ_BASE_CQE_TYPE_MASK;
-		switch (type) {
-		case CQ_BASE_CQE_TYPE_REQ:
-			rc = bnxt_qplib_cq_process_req(cq,
-					(struct cq_req *)hw_cqe, &cqe, &budget,
-					cq->hwq.cons, lib_qp);
-			break;
-		case CQ_BASE_CQE_TYPE_RES_RC:
-			rc = bnxt_qplib_cq_process_res_rc(cq,
-						(struct cq_res_rc *)hw_cqe, &cqe,
-						&budget);
-			break;
-		case CQ_BASE_CQE_TYPE_RES_UD:
-			rc = bnxt_qplib_cq_process_res_ud(cq,
-						(struct cq_res_ud_v2 *)hw_cqe,
-						&cqe, &budget);
-			break;
-		case CQ_BASE_CQE_TYPE_RES_RAWETH_QP1:
-			rc = bnxt_qplib_cq_process_res_raweth_qp1(cq,
-						(struct cq_res_raweth_qp1 *)
-						hw_cqe, &cqe, &budget);
-			break;
-		case CQ_BASE_CQE_TYPE_TERMINAL:
-			rc = bnxt_qplib_cq_process_terminal(cq,
-						(struct cq_terminal *)hw_cqe,
-						&cqe, &budget);
-			break;
-		case CQ_BASE_CQE_TYPE_CUT_OFF:
-			bnxt_qplib_cq_process_cutoff(cq,
-						(struct cq_cutoff *)hw_cqe);
-			/* Done processing this CQ */
+		if (cq->prefetch)
+			bnxt_qplib_cq_prefetch(cq);
+		if (__bnxt_qplib_process_cqe(cq, hw_cqe, out, lib_qp, &rc))
 			goto exit;
-		default:
-			dev_err(&cq->hwq.pdev->dev,
-				"QPLIB: process_cq unknown type 0x%lx",
-				hw_cqe->cqe_type_toggle &
-				CQ_BASE_CQE_TYPE_MASK);
-			rc = -EINVAL;
+		if (rc == -EAGAIN)
 			break;
-		}
-		if (rc < 0) {
-			dev_dbg(&cq->hwq.pdev->dev,
-				"QPLIB: process_cqe rc = 0x%x", rc);
-			if (rc == -EAGAIN)
-				break;
-			/* Error while processing the CQE, just skip to the
-			   next one */
-			if (type != CQ_BASE_CQE_TYPE_TERMINAL)
-				dev_err(&cq->hwq.pdev->dev,
-					"QPLIB: process_cqe error rc = 0x%x",
-					rc);
-		}
 		hw_polled++;
 		bnxt_qplib_hwq_incr_cons(cq->hwq.depth, &cq->hwq.cons,
 					 1, &cq->dbinfo.flags);
 	}
-	if (hw_polled)
-		bnxt_qplib_ring_db(&cq->dbinfo, DBC_DBC_TYPE_CQ);
+	bnxt_qplib_cq_publish_cons(cq, hw_polled);
 exit:
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&cq->hwq.lock, flags);
-#endif
-	return num_cqes - budget;
+	return num_entries - out->budget;
 }
 
-void bnxt_qplib_req_notify_cq(struct bnxt_qplib_cq *cq, u32 arm_type)
+int bnxt_qplib_poll_cq(struct bnxt_qplib_cq *cq, struct bnxt_qplib_cqe *cqe,
+		       int num_cqes, struct bnxt_qplib_qp **lib_qp)
+{
+	struct bnxt_qplib_cq_out out = {
+		.cqe = cqe,
+		.budget = num_cqes,
+	};
+
+	return __bnxt_qplib_poll_cq(cq, &out, lib_qp);
+}
+
+/*
+ * Direct poll: same HW CQE walk as bnxt_qplib_poll_cq(), but nothing is
+ * staged. Every REQ/RC/UD completion is handed to @xlate along with its
+ * HW CQE, and @xlate fills the consumer's entry from it. Polling stops
+ * at a raw QP1 or terminal CQE, which only the staged poll handles.
+ * Returns the number of entries filled by @xlate.
+ */
+int bnxt_qplib_poll_cq_direct(struct bnxt_qplib_cq *cq, int num_entries,
+			      struct bnxt_qplib_qp **lib_qp,
+			      bnxt_qplib_cqe_xlate_t xlate, void *ctx)
+{
+	struct bnxt_qplib_cq_out out = {
+		.xlate = xlate,
+		.ctx = ctx,
+		.budget = num_entries,
+	};
+
+	return __bnxt_qplib_poll_cq(cq, &out, lib_qp);
+}
+
+/* True if QPs moved to error still have SQ/RQ entries to flush here */
+bool bnxt_qplib_cq_has_flush(struct bnxt_qplib_cq *cq)
 {
-#ifdef ENABLE_FP_SPINLOCK
 	unsigned long flags;
+	bool rc;
 
-	spin_lock_irqsave(&cq->hwq.lock, flags);
-#endif
+	spin_lock_irqsave(&cq->flush_lock, flags);
+	rc = !list_empty(&cq->sqf_head) || !list_empty(&cq->rqf_head);
+	spin_unlock_irqrestore(&cq->flush_lock, flags);
+	return rc;
+}
+
+void bnxt_qplib_req_notify_cq(struct bnxt_qplib_cq *cq, u32 arm_type)
+{
+	bnxt_qplib_assert_fp_lock(cq->fp_lock);
 	cq->dbinfo.toggle = cq->toggle;
-	if (arm_type)
+	if (arm_type) {
+		/* The arm doorbell carries the consumer index too */
+		trace_bnxt_qplib_ring_db(&cq->dbinfo, arm_type);
 		bnxt_qplib_ring_db(&cq->dbinfo, arm_type);
+		cq->db_pending = 0;
+	}
 	/* Using cq->arm_state variable to track whether to issue cq handler */
 	atomic_set(&cq->arm_state, 1);
-#ifdef ENABLE_FP_SPINLOCK
-	spin_unlock_irqrestore(&cq->hwq.lock, flags);
-#endif
 }
 
 void bnxt_qplib_flush_cqn_wq(struct bnxt_qplib_qp *qp)
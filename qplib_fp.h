@@ -182,6 +182,7 @@ struct bnxt_qplib_swq {
 	u32				next_psn;
 	u32				slot_idx;
 	u8				slots;
+	u8				push_slot;
 	/* WIP: make it void * to handle legacy also */
 	struct sq_psn_search		*psn_search;
 	void				*inline_data;
@@ -322,6 +323,8 @@ struct bnxt_qplib_q {
 	bool				flushed;
 	u32				swq_start;
 	u32				swq_last;
+	/* Caller-owned lock serializing posts, NULL if unasserted */
+	spinlock_t			*fp_lock;
 };
 
 #define BNXT_QPLIB_PPP_REQ		0x1
@@ -333,6 +336,30 @@ struct bnxt_qplib_ppp {
 	u8 st_idx_en;
 };
 
+#define BNXT_QPLIB_PUSH_SLOTS		2
+#define BNXT_QPLIB_PUSH_SLOT_NONE	0xff
+#define BNXT_QPLIB_PUSH_HDR_SIZE	16
+/* Second word of the push header: ping-pong index and size in 8B units */
+#define BNXT_QPLIB_PUSH_PIDX_MASK	0xffffffUL
+#define BNXT_QPLIB_PUSH_PSZ_MASK	0xffUL
+#define BNXT_QPLIB_PUSH_PSZ_SFT		24
+
+/*
+ * Kernel QP WQE push. The WC page is split in two ping-pong slots, a
+ * slot stays busy until the WQE pushed through it is retired. db_key
+ * is the SQ doorbell the last PUSH_END already delivered.
+ */
+struct bnxt_qplib_push {
+	void __iomem			*wc;
+	unsigned long			busy;
+	u64				db_key;
+	u16				slot_size;
+	u16				max_bytes;
+	u8				st_idx;
+	u64				pushed;
+	u64				fallback;
+};
+
 struct bnxt_qplib_qp {
 	struct bnxt_qplib_pd		*pd;
 	struct bnxt_qplib_dpi		*dpi;
@@ -370,6 +397,10 @@ struct bnxt_qplib_qp {
 	u16				port_id;
 	struct bnxt_qplib_ah		ah;
 	struct bnxt_qplib_ppp		ppp;
+	struct bnxt_qplib_push		push;
+	/* Set by create_qp from the QP type and WQE mode */
+	int (*post_send)(struct bnxt_qplib_qp *qp,
+			 struct bnxt_qplib_swqe *wqe);
 
 #define BTH_PSN_MASK			((1 << 24) - 1)
 	/* SQ */
@@ -411,7 +442,7 @@ static inline u32 __bnxt_qplib_get_avail(struct bnxt_qplib_hwq *hwq)
 	int cons, prod, avail;
 
 	/* False full is possible retrying post-send makes sense */
-	cons = hwq->cons;
+	cons = READ_ONCE(hwq->cons);
 	prod = hwq->prod;
 	avail = cons - prod;
 	if (cons <= prod)
@@ -471,6 +502,52 @@ struct bnxt_qplib_cqe {
 	u16				pkey_index;
 };
 
+/*
+ * Direct poll consumer, called once per completion with the QP and the
+ * HW CQE it belongs to. A REQ CQE can complete several SWQEs, so the
+ * SWQE type and the status of each completion are passed separately.
+ * Returns the number of consumer entries filled.
+ */
+typedef int (*bnxt_qplib_cqe_xlate_t)(void *ctx, struct bnxt_qplib_qp *qp,
+				      struct cq_base *hw_cqe, u64 wr_id,
+				      u8 type, u8 status);
+
+/* UD receive CQE fields shared by the staged and direct poll */
+static inline u32 bnxt_qplib_cqe_ud_length(struct cq_res_ud_v2 *hwcqe)
+{
+	return le32_to_cpu((hwcqe->length & CQ_RES_UD_V2_LENGTH_MASK));
+}
+
+static inline u32 bnxt_qplib_cqe_ud_cfa_meta(struct cq_res_ud_v2 *hwcqe)
+{
+	u32 meta;
+
+	meta = le16_to_cpu(hwcqe->cfa_metadata0);
+	/* V2 format has metadata1 */
+	meta |= (((le32_to_cpu(hwcqe->src_qp_high_srq_or_rq_wr_id) &
+		   CQ_RES_UD_V2_CFA_METADATA1_MASK) >>
+		  CQ_RES_UD_V2_CFA_METADATA1_SFT) <<
+		 BNXT_QPLIB_META1_SHIFT);
+	return meta;
+}
+
+static inline u32 bnxt_qplib_cqe_ud_src_qp(struct cq_res_ud_v2 *hwcqe)
+{
+	return le16_to_cpu(hwcqe->src_qp_low) |
+	       ((le32_to_cpu(hwcqe->src_qp_high_srq_or_rq_wr_id) &
+		 CQ_RES_UD_V2_SRC_QP_HIGH_MASK) >> 8);
+}
+
+static inline void bnxt_qplib_cqe_ud_smac(struct cq_res_ud_v2 *hwcqe,
+					  u8 *mac)
+{
+	u16 *smac = (u16 *)mac;
+
+	smac[2] = ntohs(le16_to_cpu(hwcqe->src_mac[0]));
+	smac[1] = ntohs(le16_to_cpu(hwcqe->src_mac[1]));
+	smac[0] = ntohs(le16_to_cpu(hwcqe->src_mac[2]));
+}
+
 #define BNXT_QPLIB_QUEUE_START_PERIOD		0x01
 struct bnxt_qplib_cq {
 	struct bnxt_qplib_dpi		*dpi;
@@ -499,8 +576,26 @@ struct bnxt_qplib_cq {
 	bool				is_cq_err_event;
 	u8				toggle;
 	struct bnxt_qplib_cq_coal_param	*coalescing;
+	/* Consumer doorbell deferral, see bnxt_qplib_cq_publish_cons() */
+	u32				db_thresh;
+	u32				db_pending;
+	/* Poll lookahead, see bnxt_qplib_cq_prefetch() */
+	u32				prefetch;
+	/* Caller-owned lock serializing poll and arm, NULL if unasserted */
+	spinlock_t			*fp_lock;
 };
 
+/*
+ * Fast path routines take no locks of their own. The verbs layer holds
+ * exactly one lock per operation (QP sq/rq lock, CQ lock) and hands a
+ * pointer to it down so that qplib can check ownership under lockdep.
+ */
+#define bnxt_qplib_assert_fp_lock(lock)			\
+	do {						\
+		if (lock)				\
+			lockdep_assert_held(lock);	\
+	} while (0)
+
 #define BNXT_QPLIB_MAX_IRRQE_ENTRY_SIZE	sizeof(struct xrrq_irrq)
 #define BNXT_QPLIB_MAX_ORRQE_ENTRY_SIZE	sizeof(struct xrrq_orrq)
 #define IRD_LIMIT_TO_IRRQ_SLOTS(x)	(2 * x + 2)
@@ -513,6 +608,11 @@ struct bnxt_qplib_cq {
 	   !(pass & BNXT_QPLIB_FLAG_EPOCH_CONS_MASK))
 
 #define BNXT_QPLIB_NQE_MAX_CNT		(128 * 1024)
+#define BNXT_QPLIB_NQE_MIN_CNT		(4 * 1024)
+/* NQ slots reserved per CQ/SRQ attached to an NQ */
+#define BNXT_QPLIB_NQE_PER_CQ		2
+/* NQ slots reserved for DBQ pacing events on the first NQ */
+#define BNXT_QPLIB_NQE_DBQ_RSVD		256
 
 /* MSN table print macros for debugging */
 #define BNXT_RE_MSN_IDX(m) (((m) & SQ_MSN_SEARCH_START_IDX_MASK) >> \
@@ -528,7 +628,10 @@ struct bnxt_qplib_nq_stats {
 	u64	num_srqne_processed;
 	u64	num_cqne_processed;
 	u64	num_tasklet_resched;
+	/* irq_poll and IRQ thread rounds that ran out of budget */
+	u64	num_poll_resched;
 	u64	num_nq_rearm;
+	u64	num_budget_exhausted;
 };
 
 struct bnxt_qplib_nq_db {
@@ -542,6 +645,13 @@ typedef int (*cqn_handler_t)(struct bnxt_qplib_nq *nq,
 typedef int (*srqn_handler_t)(struct bnxt_qplib_nq *nq,
 			      struct bnxt_qplib_srq *srq, u8 event);
 
+/* NQ servicing engines, selected with the nq_poll_mode module parameter */
+#define BNXT_QPLIB_NQ_POLL_TASKLET	0
+#define BNXT_QPLIB_NQ_POLL_IRQ_POLL	1
+#define BNXT_QPLIB_NQ_POLL_THREADED	2
+#define BNXT_QPLIB_NQ_IRQ_POLL_WEIGHT	64
+extern unsigned int nq_poll_mode;
+
 struct bnxt_qplib_nq {
 	struct bnxt_qplib_res		*res;
 	struct bnxt_qplib_hwq		hwq;
@@ -552,9 +662,15 @@ struct bnxt_qplib_nq {
 	int				msix_vec;
 	cpumask_t			mask;
 	struct tasklet_struct		nq_tasklet;
+#ifdef HAVE_IRQ_POLL
+	struct irq_poll			iopoll;
+#endif
+	u8				poll_mode;
 	bool				requested;
 	int				budget;
 	u32				load;
+	/* Max CQs that fit this NQ's depth */
+	u32				max_cqs;
 	struct mutex			lock;
 
 	cqn_handler_t			cqn_handler;
@@ -599,6 +715,10 @@ int bnxt_qplib_post_srq_recv(struct bnxt_qplib_srq *srq,
 int bnxt_qplib_create_qp1(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp);
 int bnxt_qplib_create_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp);
 int bnxt_qplib_modify_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp);
+struct bnxt_qplib_rcfw_batch;
+int bnxt_qplib_modify_qp_err_async(struct bnxt_qplib_res *res,
+				   struct bnxt_qplib_qp *qp,
+				   struct bnxt_qplib_rcfw_batch *batch);
 int bnxt_qplib_query_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp);
 int bnxt_qplib_destroy_qp(struct bnxt_qplib_res *res, struct bnxt_qplib_qp *qp);
 void bnxt_qplib_clean_qp(struct bnxt_qplib_qp *qp);
@@ -608,9 +728,18 @@ void *bnxt_qplib_get_qp1_sq_buf(struct bnxt_qplib_qp *qp,
 void *bnxt_qplib_get_qp1_rq_buf(struct bnxt_qplib_qp *qp,
 				struct bnxt_qplib_sge *sge);
 u32 bnxt_qplib_get_rq_prod_index(struct bnxt_qplib_qp *qp);
-void bnxt_qplib_post_send_db(struct bnxt_qplib_qp *qp);
-int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
-			 struct bnxt_qplib_swqe *wqe);
+bool bnxt_qplib_sq_db_pushed(struct bnxt_qplib_qp *qp);
+bool bnxt_qplib_post_send_db(struct bnxt_qplib_qp *qp);
+int bnxt_qplib_post_send_generic(struct bnxt_qplib_qp *qp,
+				 struct bnxt_qplib_swqe *wqe);
+void bnxt_qplib_set_post_send(struct bnxt_qplib_qp *qp);
+
+static inline int bnxt_qplib_post_send(struct bnxt_qplib_qp *qp,
+				       struct bnxt_qplib_swqe *wqe)
+{
+	return qp->post_send(qp, wqe);
+}
+
 void bnxt_qplib_post_recv_db(struct bnxt_qplib_qp *qp);
 int bnxt_qplib_post_recv(struct bnxt_qplib_qp *qp,
 			 struct bnxt_qplib_swqe *wqe);
@@ -624,6 +753,10 @@ int bnxt_qplib_destroy_cq(struct bnxt_qplib_res *res, struct bnxt_qplib_cq *cq);
 void bnxt_qplib_free_cq(struct bnxt_qplib_res *res, struct bnxt_qplib_cq *cq);
 int bnxt_qplib_poll_cq(struct bnxt_qplib_cq *cq, struct bnxt_qplib_cqe *cqe,
 		       int num, struct bnxt_qplib_qp **qp);
+int bnxt_qplib_poll_cq_direct(struct bnxt_qplib_cq *cq, int num_entries,
+			      struct bnxt_qplib_qp **lib_qp,
+			      bnxt_qplib_cqe_xlate_t xlate, void *ctx);
+bool bnxt_qplib_cq_has_flush(struct bnxt_qplib_cq *cq);
 bool bnxt_qplib_is_cq_empty(struct bnxt_qplib_cq *cq);
 void bnxt_qplib_req_notify_cq(struct bnxt_qplib_cq *cq, u32 arm_type);
 void bnxt_qplib_free_nq_mem(struct bnxt_qplib_nq *nq);
@@ -40,6 +40,9 @@
 #include <linux/sched.h>
 #include <linux/pci.h>
 #include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
 
 #include "roce_hsi.h"
 
@@ -49,6 +52,7 @@
 #include "qplib_rcfw.h"
 #include "compat.h"
 #include "bnxt_re.h"
+#include "qplib_trace.h"
 
 static void bnxt_qplib_service_creq(
 #ifdef HAS_TASKLET_SETUP
@@ -156,11 +160,9 @@ static int __wait_for_resp(struct bnxt_qplib_rcfw *rcfw, u16 cookie)
 		if (test_bit(FIRMWARE_STALL_DETECTED, &cmdq->flags))
 			return -ETIMEDOUT;
 
-		/* Non zero means command completed */
-		ret = wait_event_timeout(cmdq->waitq,
-					 !crsqe->is_in_used ||
-					 RCFW_NO_FW_ACCESS(rcfw),
-					 msecs_to_jiffies(rcfw->max_timeout * 1000));
+		/* Signalled by this cookie's completion or a device detach */
+		ret = wait_for_completion_timeout(&crsqe->done,
+						  msecs_to_jiffies(rcfw->max_timeout * 1000));
 
 		if (!crsqe->is_in_used)
 			return 0;
@@ -278,8 +280,12 @@ static  void __send_message_no_waiter(struct bnxt_qplib_rcfw *rcfw,
 	 * and non-tlv commands after call to bnxt_qplib_set_cmd_slots()
 	 */
 	crsqe->send_timestamp = jiffies;
+	crsqe->send_ts_ns = ktime_get_ns();
 	crsqe->is_internal_cmd = true;
 	crsqe->is_waiter_alive = false;
+	crsqe->is_async = false;
+	crsqe->cb = NULL;
+	crsqe->cb_ctx = NULL;
 	crsqe->is_in_used = true;
 	crsqe->req_size = __get_cmdq_base_cmd_size(msg->req, msg->req_sz);
 
@@ -305,7 +311,11 @@ static  void __send_message_no_waiter(struct bnxt_qplib_rcfw *rcfw,
 	writel(RCFW_CMDQ_TRIG_VAL, cmdq->cmdq_mbox.db);
 }
 
-static int __send_message(struct bnxt_qplib_rcfw *rcfw,
+/*
+ * Copy @msg into the CMDQ and arm its crsqe without ringing the
+ * doorbell. Called with cmdq hwq lock held.
+ */
+static int __post_message(struct bnxt_qplib_rcfw *rcfw,
 			  struct bnxt_qplib_cmdqmsg *msg)
 {
 	u32 bsize, free_slots, required_slots;
@@ -313,9 +323,8 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 	struct bnxt_qplib_crsqe *crsqe;
 	struct bnxt_qplib_cmdqe *cmdqe;
 	struct bnxt_qplib_hwq *cmdq_hwq;
-	u32 sw_prod, cmdq_prod;
 	struct pci_dev *pdev;
-	unsigned long flags;
+	u32 sw_prod;
 	u16 cookie;
 	u8 opcode;
 	u8 *preq;
@@ -327,7 +336,6 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 
 	/* Cmdq are in 16-byte units, each request can consume 1 or more
 	   cmdqe */
-	spin_lock_irqsave(&cmdq_hwq->lock, flags);
 	required_slots = bnxt_qplib_get_cmd_slots(msg->req);
 	free_slots = HWQ_FREE_SLOTS(cmdq_hwq);
 	cookie = cmdq->seq_num & RCFW_MAX_COOKIE_VALUE;
@@ -338,7 +346,6 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 				"QPLIB: RCFW: CMDQ is full req/free %d/%d!",
 				required_slots, free_slots);
 		rcfw->cmdq_full_dbg++;
-		spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
 		return -EAGAIN;
 	}
 
@@ -356,11 +363,19 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 	 * and non-tlv commands after call to bnxt_qplib_set_cmd_slots()
 	 */
 	crsqe->send_timestamp = jiffies;
+	crsqe->send_ts_ns = ktime_get_ns();
 	crsqe->free_slots = free_slots;
 	crsqe->resp = (struct creq_qp_event *)msg->resp;
-	crsqe->resp->cookie = cpu_to_le16(cookie);
+	if (crsqe->resp)
+		crsqe->resp->cookie = cpu_to_le16(cookie);
+	crsqe->cb = msg->cb;
+	crsqe->cb_ctx = msg->cb_ctx;
+	crsqe->is_async = !!msg->cb;
+	if (crsqe->is_async)
+		rcfw->async_sent++;
 	crsqe->is_internal_cmd = false;
 	crsqe->is_waiter_alive = true;
+	reinit_completion(&crsqe->done);
 	crsqe->is_in_used = true;
 	crsqe->opcode = opcode;
 	crsqe->requested_qp_state = msg->qp_state;
@@ -390,7 +405,23 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 	} while (bsize > 0);
 	cmdq->seq_num++;
 
-	cmdq_prod = cmdq_hwq->prod & 0xFFFF;
+	dev_dbg(&pdev->dev, "QPLIB: RCFW posted request with 0x%x 0x%x",
+			cmdq_hwq->prod, crsqe->req_size);
+	dev_dbg(&pdev->dev,
+		"QPLIB: opcode 0x%x with cookie 0x%x at cmdq/crsq 0x%p/0x%p",
+		opcode,
+		__get_cmdq_base_cookie(msg->req, msg->req_sz),
+		cmdqe, crsqe);
+	return 0;
+}
+
+/* Hand everything posted so far to firmware. Called with cmdq hwq lock held. */
+static void __ring_cmdq_db(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_cmdq_ctx *cmdq = &rcfw->cmdq;
+	u32 cmdq_prod;
+
+	cmdq_prod = cmdq->hwq.prod & 0xFFFF;
 	if (test_bit(FIRMWARE_FIRST_FLAG, &cmdq->flags)) {
 		/* The very first doorbell write
 		 * is required to set this flag
@@ -404,19 +435,202 @@ static int __send_message(struct bnxt_qplib_rcfw *rcfw,
 	wmb();
 	writel(cmdq_prod, cmdq->cmdq_mbox.prod);
 	writel(RCFW_CMDQ_TRIG_VAL, cmdq->cmdq_mbox.db);
+	cmdq->db_deferred = 0;
+}
 
-	dev_dbg(&pdev->dev, "QPLIB: RCFW sent request with 0x%x 0x%x 0x%x",
-			cmdq_prod, cmdq_hwq->prod, crsqe->req_size);
-	dev_dbg(&pdev->dev,
-		"QPLIB: opcode 0x%x with cookie 0x%x at cmdq/crsq 0x%p/0x%p",
-		opcode,
-		__get_cmdq_base_cookie(msg->req, msg->req_sz),
-		cmdqe, crsqe);
+static int __send_message(struct bnxt_qplib_rcfw *rcfw,
+			  struct bnxt_qplib_cmdqmsg *msg)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	unsigned long flags;
+	int rc;
+
+	spin_lock_irqsave(&cmdq_hwq->lock, flags);
+	rc = __post_message(rcfw, msg);
+	if (!rc) {
+		/* Synchronous senders wait on the reply, always ring */
+		if (msg->defer_db && msg->cb)
+			rcfw->cmdq.db_deferred++;
+		else
+			__ring_cmdq_db(rcfw);
+	}
+	spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+
+	return rc;
+}
+
+/**
+ * bnxt_qplib_rcfw_flush_db   -	publish deferred CMDQ commands
+ * @rcfw:         rcfw channel instance of rdev
+ *
+ * Rings the CMDQ doorbell once for every command posted with
+ * msg->defer_db since the last doorbell. Any other doorbell publishes
+ * them as well, so this is a no-op if one was rung meanwhile.
+ */
+void bnxt_qplib_rcfw_flush_db(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cmdq_hwq->lock, flags);
+	if (rcfw->cmdq.db_deferred) {
+		rcfw->bulk_db_count++;
+		rcfw->bulk_cmd_count += rcfw->cmdq.db_deferred;
+		__ring_cmdq_db(rcfw);
+	}
 	spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
-	/* Return the CREQ response pointer */
+}
+
+/*
+ * One round of waiting for a shadow queue slot. Returns 0 to keep
+ * waiting or a negative errno once no slot can come back in time.
+ */
+static int __wait_slot_released(struct bnxt_qplib_rcfw *rcfw,
+				unsigned long issue_time)
+{
+	if (RCFW_NO_FW_ACCESS(rcfw))
+		return -ENXIO;
+	if (test_bit(FIRMWARE_STALL_DETECTED, &rcfw->cmdq.flags))
+		return -ETIMEDOUT;
+	/* Deferred commands may hold the slots we are waiting for */
+	bnxt_qplib_rcfw_flush_db(rcfw);
+	/* Slots are only returned by completions; reap them here
+	 * in case the CREQ interrupt is off.
+	 */
+#ifdef HAS_TASKLET_SETUP
+	bnxt_qplib_service_creq(&rcfw->creq.creq_tasklet);
+#else
+	bnxt_qplib_service_creq((unsigned long)rcfw);
+#endif
+	if (time_after(jiffies, issue_time + rcfw->max_timeout * HZ))
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
+static int __reserve_inflight_slot(struct bnxt_qplib_rcfw *rcfw)
+{
+	unsigned long issue_time = jiffies;
+	int rc;
+
+	while (down_timeout(&rcfw->rcfw_inflight, msecs_to_jiffies(1))) {
+		rc = __wait_slot_released(rcfw, issue_time);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Periodic queries from bnxt_re_worker, hw_counters and debugfs go to
+ * the background lane so they never hold up connection setup.
+ */
+static int bnxt_qplib_rcfw_get_lane(u8 opcode)
+{
+	switch (opcode) {
+	case CMDQ_BASE_OPCODE_QUERY_FUNC:
+	case CMDQ_BASE_OPCODE_QUERY_ROCE_CC:
+	case CMDQ_BASE_OPCODE_QUERY_ROCE_STATS:
+	case CMDQ_BASE_OPCODE_QUERY_ROCE_STATS_EXT:
+	case CMDQ_BASE_OPCODE_QUERY_ROCE_STATS_EXT_V2:
+	case CMDQ_BASE_OPCODE_QUERY_QP_EXTEND:
+		return BNXT_QPLIB_RCFW_LANE_BG;
+	default:
+		return BNXT_QPLIB_RCFW_LANE_CRIT;
+	}
+}
+
+static int __msg_lane(struct bnxt_qplib_cmdqmsg *msg)
+{
+	return bnxt_qplib_rcfw_get_lane(__get_cmdq_base_opcode(msg->req,
+							       msg->req_sz));
+}
+
+/*
+ * Take one of the curr_shadow_qd slots for a non-blocking command.
+ * Background commands may hold at most bg_shadow_qd of them, so the
+ * rest is always left to critical commands, and yield to critical
+ * senders that are waiting before taking anything.
+ */
+static int __acquire_lane(struct bnxt_qplib_rcfw *rcfw, int lane)
+{
+	struct bnxt_qplib_rcfw_lane_stats *stats = &rcfw->lane_stats[lane];
+	unsigned long start = jiffies;
+	int rc;
+
+	if (lane == BNXT_QPLIB_RCFW_LANE_CRIT) {
+		if (down_trylock(&rcfw->rcfw_inflight)) {
+			atomic64_inc(&stats->waited);
+			atomic_inc(&rcfw->crit_waiters);
+			rc = __reserve_inflight_slot(rcfw);
+			atomic_dec(&rcfw->crit_waiters);
+			if (rc)
+				return rc;
+		}
+		atomic64_inc(&stats->sent);
+		return 0;
+	}
+
+	/* Strict priority, but never defer longer than the starvation bound */
+	if (atomic_read(&rcfw->crit_waiters)) {
+		atomic64_inc(&stats->deferred);
+		while (atomic_read(&rcfw->crit_waiters)) {
+			if (time_after(jiffies, start +
+				       msecs_to_jiffies(RCFW_BG_MAX_DEFER_MS))) {
+				atomic64_inc(&stats->starved);
+				break;
+			}
+			usleep_range(100, 200);
+		}
+	}
+
+	if (!atomic_add_unless(&rcfw->bg_inflight, 1, rcfw->bg_shadow_qd)) {
+		atomic64_inc(&stats->waited);
+		do {
+			usleep_range(100, 200);
+			rc = __wait_slot_released(rcfw, start);
+			if (rc)
+				return rc;
+		} while (!atomic_add_unless(&rcfw->bg_inflight, 1,
+					    rcfw->bg_shadow_qd));
+	}
+	rc = __reserve_inflight_slot(rcfw);
+	if (rc) {
+		atomic_dec(&rcfw->bg_inflight);
+		return rc;
+	}
+	atomic64_inc(&stats->sent);
+
 	return 0;
 }
 
+/* Non sleeping __acquire_lane(), for the extra slots of a bulk post */
+static bool __try_acquire_lane(struct bnxt_qplib_rcfw *rcfw, int lane)
+{
+	bool bg = lane == BNXT_QPLIB_RCFW_LANE_BG;
+
+	if (bg && (atomic_read(&rcfw->crit_waiters) ||
+		   !atomic_add_unless(&rcfw->bg_inflight, 1,
+				      rcfw->bg_shadow_qd)))
+		return false;
+	if (down_trylock(&rcfw->rcfw_inflight)) {
+		if (bg)
+			atomic_dec(&rcfw->bg_inflight);
+		return false;
+	}
+	atomic64_inc(&rcfw->lane_stats[lane].sent);
+
+	return true;
+}
+
+static void __release_lane(struct bnxt_qplib_rcfw *rcfw, int lane)
+{
+	up(&rcfw->rcfw_inflight);
+	if (lane == BNXT_QPLIB_RCFW_LANE_BG)
+		atomic_dec(&rcfw->bg_inflight);
+}
+
 /**
  * __poll_for_resp   -	self poll completion for rcfw command
  * @rcfw:         rcfw channel instance of rdev
@@ -522,6 +736,48 @@ static  void __destroy_timedout_ah(struct bnxt_qplib_rcfw *rcfw,
 		atomic_read(&rcfw->timeout_send));
 }
 
+/*
+ * Run the callback of an async command and drop its async state.
+ * Called under cmdq lock so bnxt_qplib_rcfw_cancel_async() cannot
+ * return while the callback still runs. Returns true if the caller
+ * must release the lane slot of crsqe->opcode.
+ */
+static bool __complete_async(struct bnxt_qplib_rcfw *rcfw,
+			     struct bnxt_qplib_crsqe *crsqe,
+			     struct creq_qp_event *event, int status)
+{
+	bool is_async = crsqe->is_async;
+
+	if (crsqe->cb)
+		crsqe->cb(rcfw, crsqe->cb_ctx, event, status);
+	crsqe->cb = NULL;
+	crsqe->cb_ctx = NULL;
+	crsqe->is_async = false;
+
+	return is_async;
+}
+
+/*
+ * Firmware stopped answering: no completion is coming for the async
+ * commands still outstanding, so fail them now and give back their
+ * slots. Called with cmdq lock held.
+ */
+static void __fail_pending_async(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	struct bnxt_qplib_crsqe *crsqe;
+	int i;
+
+	for (i = 0; i < cmdq_hwq->max_elements; i++) {
+		crsqe = &rcfw->crsqe_tbl[i];
+		if (!crsqe->is_in_used || !crsqe->is_async)
+			continue;
+		if (__complete_async(rcfw, crsqe, NULL, -ETIMEDOUT))
+			__release_lane(rcfw,
+				       bnxt_qplib_rcfw_get_lane(crsqe->opcode));
+	}
+}
+
 /**
  * __bnxt_qplib_rcfw_send_message   -	qplib interface to send
  * and complete rcfw command.
@@ -575,9 +831,14 @@ int __bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
 		spin_lock_irqsave(&rcfw->cmdq.hwq.lock, flags);
 		crsqe = &rcfw->crsqe_tbl[cookie];
 		crsqe->is_waiter_alive = false;
-		if (rc == -ENODEV)
-			set_bit(FIRMWARE_STALL_DETECTED, &rcfw->cmdq.flags);
+		if (rc == -ENODEV &&
+		    !test_and_set_bit(FIRMWARE_STALL_DETECTED,
+				      &rcfw->cmdq.flags))
+			__fail_pending_async(rcfw);
 		spin_unlock_irqrestore(&rcfw->cmdq.hwq.lock, flags);
+		/* Still outstanding, firmware may write the response later */
+		if (msg->sb)
+			((struct bnxt_qplib_rcfw_sbuf *)msg->sb)->fw_owned = true;
 
 		return -ETIMEDOUT;
 	}
@@ -615,6 +876,11 @@ int __bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
  * Do not allow more than 64 non-blocking command to the Firmware.
  * Allow all blocking commands until there is no queue full.
  *
+ * Non-blocking commands are further split in two lanes, see
+ * bnxt_qplib_rcfw_get_lane(). Background commands may hold at most
+ * bg_shadow_qd of the shadow queue slots and yield to waiting critical
+ * commands.
+ *
  * Returns:
  * 0 if command completed by firmware.
  * Non zero if the command is not completed by firmware.
@@ -622,12 +888,19 @@ int __bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
 int bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
 				 struct bnxt_qplib_cmdqmsg *msg)
 {
+	int lane;
 	int ret;
 
 	if (!msg->block) {
-		down(&rcfw->rcfw_inflight);
+		lane = __msg_lane(msg);
+		ret = __acquire_lane(rcfw, lane);
+		if (ret == -ENXIO)
+			return bnxt_qplib_map_rc(__get_cmdq_base_opcode(msg->req,
+									msg->req_sz));
+		if (ret)
+			return ret;
 		ret = __bnxt_qplib_rcfw_send_message(rcfw, msg);
-		up(&rcfw->rcfw_inflight);
+		__release_lane(rcfw, lane);
 	} else {
 		ret = __bnxt_qplib_rcfw_send_message(rcfw, msg);
 	}
@@ -635,65 +908,392 @@ int bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
 	return ret;
 }
 
+/**
+ * bnxt_qplib_rcfw_wake_waiters   -	kick every sleeping rcfw sender
+ * @rcfw:         rcfw channel instance of rdev
+ *
+ * Completions signal only the sender of their cookie. Once the device is
+ * marked detached, no completion will come, so wake every sender still
+ * waiting and let it notice RCFW_NO_FW_ACCESS.
+ */
+void bnxt_qplib_rcfw_wake_waiters(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	struct bnxt_qplib_crsqe *crsqe;
+	unsigned long flags;
+	int i;
+
+	if (!rcfw->crsqe_tbl)
+		return;
+
+	/* May run from the aeq handler with the creq hwq lock held */
+	spin_lock_irqsave_nested(&cmdq_hwq->lock, flags, SINGLE_DEPTH_NESTING);
+	for (i = 0; i < cmdq_hwq->max_elements; i++) {
+		crsqe = &rcfw->crsqe_tbl[i];
+		if (crsqe->is_in_used && crsqe->is_waiter_alive &&
+		    !crsqe->is_async)
+			complete(&crsqe->done);
+	}
+	spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+}
+
+/**
+ * bnxt_qplib_rcfw_send_message_async   -	qplib interface to post
+ * an rcfw command without waiting for its completion.
+ * @rcfw:         rcfw channel instance of rdev
+ * @msg:          qplib message internal, msg->cb must be set
+ *
+ * The request is copied into the CMDQ before returning, so it can live
+ * on the caller's stack. msg->resp may be NULL; the callback gets the
+ * CREQ event either way. The command holds one of the curr_shadow_qd
+ * non-blocking slots until firmware completes it, so back to back async
+ * commands are pipelined up to the shadow queue depth.
+ *
+ * msg->cb is called exactly once from bnxt_qplib_process_qp_event(),
+ * unless bnxt_qplib_rcfw_cancel_async() detaches it first.
+ *
+ * Returns:
+ * 0 if the command was posted. Negative errno otherwise, in which
+ * case msg->cb is not called.
+ */
+int bnxt_qplib_rcfw_send_message_async(struct bnxt_qplib_rcfw *rcfw,
+				       struct bnxt_qplib_cmdqmsg *msg)
+{
+	int lane, rc;
+	u8 opcode;
+
+	if (!msg->cb || msg->block)
+		return -EINVAL;
+
+	opcode = __get_cmdq_base_opcode(msg->req, msg->req_sz);
+	rc = __send_message_basic_sanity(rcfw, msg, opcode);
+	if (rc)
+		return rc;
+
+	lane = bnxt_qplib_rcfw_get_lane(opcode);
+	rc = __acquire_lane(rcfw, lane);
+	if (rc)
+		return rc;
+
+	rc = __send_message(rcfw, msg);
+	if (rc)
+		__release_lane(rcfw, lane);
+
+	return rc;
+}
+
+/**
+ * bnxt_qplib_rcfw_send_message_bulk   -	post several async commands
+ * with one CMDQ doorbell.
+ * @rcfw:         rcfw channel instance of rdev
+ * @msgs:         array of qplib messages, each with msgs[i].cb set
+ * @num:          number of messages
+ *
+ * Same contract as bnxt_qplib_rcfw_send_message_async() for every
+ * message. As many messages as there are free shadow queue slots are
+ * copied into the CMDQ under one cmdq lock hold and published with a
+ * single doorbell; this repeats until all of @msgs is posted.
+ *
+ * Returns:
+ * Number of messages posted, in array order. Callbacks of the rest are
+ * not called. Negative errno if nothing was posted.
+ */
+int bnxt_qplib_rcfw_send_message_bulk(struct bnxt_qplib_rcfw *rcfw,
+				      struct bnxt_qplib_cmdqmsg *msgs, int num)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	int posted = 0, rsvd, lane, i, rc = 0;
+	unsigned long flags;
+	u8 opcode;
+
+	for (i = 0; i < num; i++) {
+		if (!msgs[i].cb || msgs[i].block)
+			return -EINVAL;
+		opcode = __get_cmdq_base_opcode(msgs[i].req, msgs[i].req_sz);
+		rc = __send_message_basic_sanity(rcfw, &msgs[i], opcode);
+		if (rc)
+			return rc;
+	}
+
+	while (posted < num) {
+		lane = __msg_lane(&msgs[posted]);
+		rc = __acquire_lane(rcfw, lane);
+		if (rc)
+			break;
+		rsvd = 1;
+		while (posted + rsvd < num &&
+		       __msg_lane(&msgs[posted + rsvd]) == lane &&
+		       __try_acquire_lane(rcfw, lane))
+			rsvd++;
+
+		spin_lock_irqsave(&cmdq_hwq->lock, flags);
+		for (i = 0; i < rsvd; i++) {
+			rc = __post_message(rcfw, &msgs[posted + i]);
+			if (rc)
+				break;
+		}
+		if (i) {
+			__ring_cmdq_db(rcfw);
+			rcfw->bulk_db_count++;
+			rcfw->bulk_cmd_count += i;
+		}
+		spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+
+		posted += i;
+		/* Give back the slots of what did not fit in the CMDQ */
+		for (; i < rsvd; i++)
+			__release_lane(rcfw, lane);
+		if (rc)
+			break;
+	}
+
+	return posted ? posted : rc;
+}
+
+/**
+ * bnxt_qplib_rcfw_cancel_async   -	detach pending async completions
+ * @rcfw:         rcfw channel instance of rdev
+ * @ctx:          cb_ctx the commands were posted with
+ *
+ * After this returns, no callback registered with @ctx will run, so
+ * the caller may free @ctx. The commands stay outstanding in firmware
+ * and release their shadow queue slot when they complete.
+ *
+ * Returns: number of commands that were detached.
+ */
+int bnxt_qplib_rcfw_cancel_async(struct bnxt_qplib_rcfw *rcfw, void *ctx)
+{
+	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
+	struct bnxt_qplib_crsqe *crsqe;
+	unsigned long flags;
+	int i, cnt = 0;
+
+	spin_lock_irqsave(&cmdq_hwq->lock, flags);
+	for (i = 0; i < cmdq_hwq->max_elements; i++) {
+		crsqe = &rcfw->crsqe_tbl[i];
+		if (!crsqe->is_in_used || !crsqe->cb || crsqe->cb_ctx != ctx)
+			continue;
+		crsqe->cb = NULL;
+		crsqe->cb_ctx = NULL;
+		crsqe->resp = NULL;
+		crsqe->is_waiter_alive = false;
+		cnt++;
+	}
+	rcfw->async_cancelled += cnt;
+	spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+
+	return cnt;
+}
+
+static void bnxt_qplib_rcfw_batch_cb(struct bnxt_qplib_rcfw *rcfw, void *ctx,
+				     struct creq_qp_event *event, int status)
+{
+	struct bnxt_qplib_rcfw_batch *batch = ctx;
+
+	if (status)
+		atomic_inc(&batch->failed);
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+void bnxt_qplib_rcfw_batch_init(struct bnxt_qplib_rcfw_batch *batch)
+{
+	/* Biased by one until bnxt_qplib_rcfw_batch_wait() */
+	atomic_set(&batch->pending, 1);
+	atomic_set(&batch->failed, 0);
+	init_completion(&batch->done);
+}
+
+/*
+ * Post @msg asynchronously and account it in @batch. The doorbell is
+ * deferred, so commands submitted back to back share one; it is rung at
+ * the latest by bnxt_qplib_rcfw_batch_wait().
+ */
+int bnxt_qplib_rcfw_batch_submit(struct bnxt_qplib_rcfw *rcfw,
+				 struct bnxt_qplib_rcfw_batch *batch,
+				 struct bnxt_qplib_cmdqmsg *msg)
+{
+	int rc;
+
+	msg->cb = bnxt_qplib_rcfw_batch_cb;
+	msg->cb_ctx = batch;
+	msg->defer_db = true;
+	atomic_inc(&batch->pending);
+	rc = bnxt_qplib_rcfw_send_message_async(rcfw, msg);
+	if (rc)
+		atomic_dec(&batch->pending);
+
+	return rc;
+}
+
+/*
+ * Bulk variant of bnxt_qplib_rcfw_batch_submit(). Returns the number of
+ * messages posted or a negative errno, as
+ * bnxt_qplib_rcfw_send_message_bulk() does.
+ */
+int bnxt_qplib_rcfw_batch_submit_bulk(struct bnxt_qplib_rcfw *rcfw,
+				      struct bnxt_qplib_rcfw_batch *batch,
+				      struct bnxt_qplib_cmdqmsg *msgs, int num)
+{
+	int i, rc;
+
+	for (i = 0; i < num; i++) {
+		msgs[i].cb = bnxt_qplib_rcfw_batch_cb;
+		msgs[i].cb_ctx = batch;
+	}
+	atomic_add(num, &batch->pending);
+	rc = bnxt_qplib_rcfw_send_message_bulk(rcfw, msgs, num);
+	atomic_sub(num - max(rc, 0), &batch->pending);
+
+	return rc;
+}
+
+/**
+ * bnxt_qplib_rcfw_batch_wait   -	wait for all commands of a batch
+ * @rcfw:         rcfw channel instance of rdev
+ * @batch:        batch the commands were submitted with
+ *
+ * Waits up to rcfw->max_timeout seconds for the whole batch, self
+ * polling the CREQ if its interrupt is off. Commands still pending
+ * after that are cancelled, so @batch may be freed on return.
+ *
+ * Returns:
+ * 0 if every command completed successfully.
+ * -EIO if firmware failed any of them.
+ * -ETIMEDOUT if the batch did not complete.
+ */
+int bnxt_qplib_rcfw_batch_wait(struct bnxt_qplib_rcfw *rcfw,
+			       struct bnxt_qplib_rcfw_batch *batch)
+{
+	unsigned long issue_time = jiffies;
+	u32 tmo;
+
+	bnxt_qplib_rcfw_flush_db(rcfw);
+	if (atomic_dec_and_test(&batch->pending))
+		goto done;
+
+	do {
+		if (RCFW_NO_FW_ACCESS(rcfw) ||
+		    test_bit(FIRMWARE_STALL_DETECTED, &rcfw->cmdq.flags))
+			break;
+		tmo = atomic_read(&rcfw->rcfw_intr_enabled) ?
+		      RCFW_CMD_DEV_ERR_CHECK_TIME_MS : 1;
+		if (wait_for_completion_timeout(&batch->done,
+						msecs_to_jiffies(tmo)))
+			goto done;
+#ifdef HAS_TASKLET_SETUP
+		bnxt_qplib_service_creq(&rcfw->creq.creq_tasklet);
+#else
+		bnxt_qplib_service_creq((unsigned long)rcfw);
+#endif
+		if (completion_done(&batch->done))
+			goto done;
+	} while (time_before(jiffies, issue_time + rcfw->max_timeout * HZ));
+
+	bnxt_qplib_rcfw_cancel_async(rcfw, batch);
+	/* The last completion may have run before the cancel */
+	if (completion_done(&batch->done))
+		goto done;
+	dev_info_ratelimited(&rcfw->pdev->dev,
+			     "QPLIB: async batch timed out, %d pending",
+			     atomic_read(&batch->pending));
+	return -ETIMEDOUT;
+done:
+	return atomic_read(&batch->failed) ? -EIO : 0;
+}
+
 static void bnxt_re_add_perf_stats(struct bnxt_qplib_rcfw *rcfw,
 		struct bnxt_qplib_crsqe *crsqe)
 {
-	u32 latency_msec, dest_stats_id;
-	u64 *dest_stats_ptr = NULL;
+	struct bnxt_qplib_rcfw_lat_hist *hist;
+	u64 latency_usec;
+	int row, idx;
 
-	latency_msec = jiffies_to_msecs(rcfw->cmdq.last_seen -
-				crsqe->send_timestamp);
-	if (latency_msec/1000 < RCFW_MAX_LATENCY_SEC_SLAB_INDEX)
-		rcfw->rcfw_lat_slab_sec[latency_msec/1000]++;
+	latency_usec = div_u64(ktime_get_ns() - crsqe->send_ts_ns,
+			       NSEC_PER_USEC);
+	if (latency_usec / USEC_PER_SEC < RCFW_MAX_LATENCY_SEC_SLAB_INDEX)
+		rcfw->rcfw_lat_slab_sec[latency_usec / USEC_PER_SEC]++;
 
 	if (!rcfw->sp_perf_stats_enabled)
 		return;
 
-	if (latency_msec < RCFW_MAX_LATENCY_MSEC_SLAB_INDEX)
-		rcfw->rcfw_lat_slab_msec[latency_msec]++;
+	row = crsqe->opcode;
+	if (row == CMDQ_BASE_OPCODE_MODIFY_QP &&
+	    crsqe->requested_qp_state == IB_QPS_ERR)
+		row = RCFW_LAT_HIST_QP_MODIFY_ERR;
+	else if (row > CMDQ_BASE_OPCODE_LAST)
+		return;
 
-	switch (crsqe->opcode) {
-	case CMDQ_BASE_OPCODE_CREATE_QP:
-		dest_stats_id = rcfw->qp_create_stats_id++;
-		dest_stats_id = dest_stats_id % RCFW_MAX_STAT_INDEX;
-		dest_stats_ptr = &rcfw->qp_create_stats[dest_stats_id];
-		break;
-	case CMDQ_BASE_OPCODE_DESTROY_QP:
-		dest_stats_id = rcfw->qp_destroy_stats_id++;
-		dest_stats_id = dest_stats_id % RCFW_MAX_STAT_INDEX;
-		dest_stats_ptr = &rcfw->qp_destroy_stats[dest_stats_id];
-		break;
-	case CMDQ_BASE_OPCODE_REGISTER_MR:
-		dest_stats_id = rcfw->mr_create_stats_id++;
-		dest_stats_id = dest_stats_id % RCFW_MAX_STAT_INDEX;
-		dest_stats_ptr = &rcfw->mr_create_stats[dest_stats_id];
-		break;
-	case CMDQ_BASE_OPCODE_DEREGISTER_MR:
-	case CMDQ_BASE_OPCODE_DEALLOCATE_KEY:
-		dest_stats_id = rcfw->mr_destroy_stats_id++;
-		dest_stats_id = dest_stats_id % RCFW_MAX_STAT_INDEX;
-		dest_stats_ptr = &rcfw->mr_destroy_stats[dest_stats_id];
-		break;
-	case CMDQ_BASE_OPCODE_MODIFY_QP:
-		if (crsqe->requested_qp_state != IB_QPS_ERR)
+	idx = latency_usec ? ilog2(latency_usec) + 1 : 0;
+	idx = min_t(int, idx, RCFW_LAT_HIST_BUCKETS - 1);
+	/* Called with cmdq hwq lock held, so no preemption here */
+	hist = this_cpu_ptr(rcfw->lat_hist);
+	hist->bucket[row][idx]++;
+	hist->sum_us[row] += latency_usec;
+}
+
+/*
+ * Fold the per-CPU histograms of @row into @bucket, which must hold
+ * RCFW_LAT_HIST_BUCKETS entries. Returns the number of samples.
+ */
+u64 bnxt_qplib_rcfw_lat_read(struct bnxt_qplib_rcfw *rcfw, int row,
+			     u64 *bucket, u64 *sum_us)
+{
+	struct bnxt_qplib_rcfw_lat_hist *hist;
+	u64 count = 0;
+	int cpu, i;
+
+	memset(bucket, 0, sizeof(*bucket) * RCFW_LAT_HIST_BUCKETS);
+	*sum_us = 0;
+	if (!rcfw->sp_perf_stats_enabled)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		hist = per_cpu_ptr(rcfw->lat_hist, cpu);
+		for (i = 0; i < RCFW_LAT_HIST_BUCKETS; i++) {
+			bucket[i] += hist->bucket[row][i];
+			count += hist->bucket[row][i];
+		}
+		*sum_us += hist->sum_us[row];
+	}
+
+	return count;
+}
+
+/* Upper bound in usec of the bucket holding the @permille percentile */
+u64 bnxt_qplib_rcfw_lat_pct(u64 *bucket, u64 count, u32 permille)
+{
+	u64 target, seen = 0;
+	int i;
+
+	if (!count)
+		return 0;
+
+	target = DIV_ROUND_UP_ULL(count * permille, 1000);
+	for (i = 0; i < RCFW_LAT_HIST_BUCKETS - 1; i++) {
+		seen += bucket[i];
+		if (seen >= target)
 			break;
-		dest_stats_id = rcfw->qp_modify_stats_id++;
-		dest_stats_id = dest_stats_id % RCFW_MAX_STAT_INDEX;
-		dest_stats_ptr = &rcfw->qp_modify_stats[dest_stats_id];
-		break;
-	default:
-		break;
 	}
-	if (dest_stats_ptr)
-		*dest_stats_ptr = max_t(unsigned long,
-				(rcfw->cmdq.last_seen - crsqe->send_timestamp), 1);
 
+	return 1ULL << i;
+}
+
+void bnxt_qplib_rcfw_lat_clear(struct bnxt_qplib_rcfw *rcfw)
+{
+	int cpu;
+
+	if (!rcfw->sp_perf_stats_enabled)
+		return;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(rcfw->lat_hist, cpu), 0,
+		       sizeof(struct bnxt_qplib_rcfw_lat_hist));
 }
 
 /* Completions */
 static int bnxt_qplib_process_qp_event(struct bnxt_qplib_rcfw *rcfw,
-				       struct creq_qp_event *event,
-				       u32 *num_wait)
+				       struct creq_qp_event *event)
 {
 	struct bnxt_qplib_hwq *cmdq_hwq = &rcfw->cmdq.hwq;
 	struct creq_cq_error_notification *cqerr;
@@ -705,8 +1305,10 @@ static int bnxt_qplib_process_qp_event(struct bnxt_qplib_rcfw *rcfw,
 	u16 cookie, blocked = 0;
 	struct pci_dev *pdev;
 	bool is_waiter_alive;
+	bool is_async;
 	unsigned long flags;
-	u32 wait_cmds = 0;
+	bool wake = false;
+	int lane;
 	u32 xid, qp_idx;
 	u32 req_size;
 	int rc = 0;
@@ -778,7 +1380,13 @@ static int bnxt_qplib_process_qp_event(struct bnxt_qplib_rcfw *rcfw,
 				jiffies_to_msecs(rcfw->cmdq.last_seen -
 						 crsqe->send_timestamp),
 				crsqe->free_slots);
+			/* Async owners still wait for a callback */
+			lane = bnxt_qplib_rcfw_get_lane(crsqe->opcode);
+			is_async = __complete_async(rcfw, crsqe, event,
+						    -ETIMEDOUT);
 			spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+			if (is_async)
+				__release_lane(rcfw, lane);
 			return rc;
 		}
 
@@ -794,17 +1402,23 @@ static int bnxt_qplib_process_qp_event(struct bnxt_qplib_rcfw *rcfw,
 				 */
 				smp_wmb();
 			}
-			if (!blocked)
-				wait_cmds++;
+			if (!blocked && !crsqe->is_async)
+				wake = true;
 		}
 
 		req_size = crsqe->req_size;
 		is_waiter_alive = crsqe->is_waiter_alive;
+		lane = bnxt_qplib_rcfw_get_lane(crsqe->opcode);
+		is_async = __complete_async(rcfw, crsqe, event,
+					    event->status ? -EIO : 0);
 
 		crsqe->req_size = 0;
 		if (!crsqe->is_waiter_alive)
 			crsqe->resp = NULL;
 		crsqe->is_in_used = false;
+		/* Only the sender of this cookie sleeps on it */
+		if (wake)
+			complete(&crsqe->done);
 		/* Consumer is updated so that __send_message_no_waiter
 		 * can never see queue full.
 		 * It is safe since we are still holding cmdq_hwq->lock.
@@ -830,8 +1444,9 @@ static int bnxt_qplib_process_qp_event(struct bnxt_qplib_rcfw *rcfw,
 					      event);
 
 		spin_unlock_irqrestore(&cmdq_hwq->lock, flags);
+		if (is_async)
+			__release_lane(rcfw, lane);
 	}
-	*num_wait += wait_cmds;
 	return rc;
 }
 
@@ -857,7 +1472,6 @@ static void bnxt_qplib_service_creq(
 	struct creq_base *creqe;
 	struct pci_dev *pdev;
 	unsigned long flags;
-	u32 num_wakeup = 0;
 	int rc;
 
 	pdev = rcfw->pdev;
@@ -878,12 +1492,12 @@ static void bnxt_qplib_service_creq(
 		dma_rmb();
 		type = creqe->type & CREQ_BASE_TYPE_MASK;
 		rcfw->cmdq.last_seen = jiffies;
+		trace_bnxt_qplib_creq_event(creqe);
 
 		switch (type) {
 		case CREQ_BASE_TYPE_QP_EVENT:
 			bnxt_qplib_process_qp_event
-				(rcfw,(struct creq_qp_event *)creqe,
-				 &num_wakeup);
+				(rcfw,(struct creq_qp_event *)creqe);
 			creq->stats.creq_qp_event_processed++;
 			break;
 		case CREQ_BASE_TYPE_FUNC_EVENT:
@@ -911,13 +1525,7 @@ static void bnxt_qplib_service_creq(
 		/* No completions received during this poll. Enable interrupt now */
 		bnxt_qplib_ring_nq_db(&creq->creq_db.dbinfo, res->cctx, true);
 		creq->stats.creq_arm_count++;
-		dev_dbg(&pdev->dev, "QPLIB: Num of Func (0x%llx) ",
-			creq->stats.creq_func_event_processed);
-		dev_dbg(&pdev->dev, "QPLIB: QP (0x%llx) events processed",
-			creq->stats.creq_qp_event_processed);
-		dev_dbg(&pdev->dev, "QPLIB: Armed:%#llx resched:%#llx ",
-			creq->stats.creq_arm_count,
-			creq->stats.creq_tasklet_schedule_count);
+		trace_bnxt_qplib_creq_service(0, true);
 	} else if (creq->requested) {
 		/*
 		 * To reduce the number of interrupts from HW,
@@ -928,10 +1536,10 @@ static void bnxt_qplib_service_creq(
 		bnxt_qplib_ring_nq_db(&creq->creq_db.dbinfo, res->cctx, false);
 		tasklet_schedule(&creq->creq_tasklet);
 		creq->stats.creq_tasklet_schedule_count++;
+		trace_bnxt_qplib_creq_service(CREQ_ENTRY_POLL_BUDGET - budget,
+					      false);
 	}
 	spin_unlock_irqrestore(&creq_hwq->lock, flags);
-	if (num_wakeup)
-		wake_up_nr(&rcfw->cmdq.waitq, num_wakeup);
 }
 
 static irqreturn_t bnxt_qplib_creq_irq(int irq, void *dev_instance)
@@ -1071,25 +1679,198 @@ skip_ctx_setup:
 	return 0;
 }
 
+static const u32 bnxt_qplib_sbuf_class_size[BNXT_QPLIB_SBUF_MAX] = {
+	[BNXT_QPLIB_SBUF_SMALL] = BNXT_QPLIB_SBUF_SMALL_SIZE,
+	[BNXT_QPLIB_SBUF_LARGE] = BNXT_QPLIB_SBUF_LARGE_SIZE,
+};
+
+static struct bnxt_qplib_rcfw_sbuf *
+__alloc_sbuf(struct bnxt_qplib_rcfw *rcfw, u32 size, gfp_t gfp)
+{
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
+
+	sbuf = kzalloc(sizeof(*sbuf), gfp);
+	if (!sbuf)
+		return NULL;
+	sbuf->alloc_size = size;
+	sbuf->sb = dma_zalloc_coherent(&rcfw->pdev->dev, size,
+				       &sbuf->dma_addr, gfp);
+	if (!sbuf->sb) {
+		kfree(sbuf);
+		return NULL;
+	}
+	INIT_LIST_HEAD(&sbuf->list);
+	return sbuf;
+}
+
+static void __free_sbuf(struct bnxt_qplib_rcfw *rcfw,
+			struct bnxt_qplib_rcfw_sbuf *sbuf)
+{
+	dma_free_coherent(&rcfw->pdev->dev, sbuf->alloc_size,
+			  sbuf->sb, sbuf->dma_addr);
+	kfree(sbuf);
+}
+
+/**
+ * bnxt_qplib_rcfw_alloc_sbuf   -	Get a side buffer for a query command
+ * @rcfw:         rcfw channel instance of rdev
+ * @size:         size of the response structure the firmware will fill
+ *
+ * Served from the preallocated pool when a buffer of a fitting class is
+ * free, otherwise falls back to a fresh coherent allocation. The buffer
+ * is always returned zeroed with @size rounded up to CMDQE units.
+ *
+ * Returns NULL on allocation failure.
+ */
+struct bnxt_qplib_rcfw_sbuf *bnxt_qplib_rcfw_alloc_sbuf(
+				struct bnxt_qplib_rcfw *rcfw,
+				u32 size)
+{
+	struct bnxt_qplib_sbuf_pool *pool = &rcfw->sbuf_pool;
+	struct bnxt_qplib_rcfw_sbuf *sbuf = NULL;
+	unsigned long flags;
+	int i;
+
+	size = ALIGN(size, BNXT_QPLIB_CMDQE_UNITS);
+	spin_lock_irqsave(&pool->lock, flags);
+	for (i = 0; i < BNXT_QPLIB_SBUF_MAX; i++) {
+		if (size > bnxt_qplib_sbuf_class_size[i])
+			continue;
+		sbuf = list_first_entry_or_null(&pool->free[i],
+						struct bnxt_qplib_rcfw_sbuf,
+						list);
+		if (sbuf) {
+			list_del_init(&sbuf->list);
+			break;
+		}
+	}
+	if (sbuf)
+		pool->hit++;
+	else
+		pool->miss++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (sbuf) {
+		memset(sbuf->sb, 0, size);
+	} else {
+		sbuf = __alloc_sbuf(rcfw, size, GFP_KERNEL);
+		if (!sbuf)
+			return NULL;
+	}
+	sbuf->size = size;
+	return sbuf;
+}
+
+/**
+ * bnxt_qplib_rcfw_free_sbuf   -	Release a side buffer
+ * @rcfw:         rcfw channel instance of rdev
+ * @sbuf:         buffer returned by bnxt_qplib_rcfw_alloc_sbuf()
+ *
+ * Pooled buffers go back to their class list. Once a firmware stall has
+ * been detected the firmware may still DMA into an abandoned buffer, so
+ * pooled buffers are dropped instead of being handed out again. A buffer
+ * whose own command timed out is orphaned, it may be written at any time.
+ */
+void bnxt_qplib_rcfw_free_sbuf(struct bnxt_qplib_rcfw *rcfw,
+			       struct bnxt_qplib_rcfw_sbuf *sbuf)
+{
+	struct bnxt_qplib_sbuf_pool *pool = &rcfw->sbuf_pool;
+	unsigned long flags;
+	int i;
+
+	if (!sbuf)
+		return;
+	if (sbuf->fw_owned) {
+		bnxt_qplib_rcfw_orphan_sbuf(rcfw, sbuf);
+		return;
+	}
+	if (!sbuf->pooled ||
+	    test_bit(FIRMWARE_STALL_DETECTED, &rcfw->cmdq.flags)) {
+		__free_sbuf(rcfw, sbuf);
+		return;
+	}
+	for (i = 0; i < BNXT_QPLIB_SBUF_MAX; i++)
+		if (sbuf->alloc_size == bnxt_qplib_sbuf_class_size[i])
+			break;
+	spin_lock_irqsave(&pool->lock, flags);
+	list_add(&sbuf->list, &pool->free[i]);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+/**
+ * bnxt_qplib_rcfw_orphan_sbuf   -	Drop a side buffer firmware may still own
+ * @rcfw:         rcfw channel instance of rdev
+ * @sbuf:         buffer of a command that timed out
+ *
+ * A command that timed out is still outstanding in firmware, which can
+ * DMA its response at any later point. The buffer is parked until the
+ * channel is freed rather than returned to the pool or the allocator.
+ */
+void bnxt_qplib_rcfw_orphan_sbuf(struct bnxt_qplib_rcfw *rcfw,
+				 struct bnxt_qplib_rcfw_sbuf *sbuf)
+{
+	struct bnxt_qplib_sbuf_pool *pool = &rcfw->sbuf_pool;
+	unsigned long flags;
+
+	if (!sbuf)
+		return;
+	spin_lock_irqsave(&pool->lock, flags);
+	list_add(&sbuf->list, &pool->orphaned);
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
+static void bnxt_qplib_free_sbuf_pool(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_sbuf_pool *pool = &rcfw->sbuf_pool;
+	struct bnxt_qplib_rcfw_sbuf *sbuf, *tmp;
+	int i;
+
+	for (i = 0; i < BNXT_QPLIB_SBUF_MAX; i++) {
+		list_for_each_entry_safe(sbuf, tmp, &pool->free[i], list) {
+			list_del(&sbuf->list);
+			__free_sbuf(rcfw, sbuf);
+		}
+	}
+	list_for_each_entry_safe(sbuf, tmp, &pool->orphaned, list) {
+		list_del(&sbuf->list);
+		__free_sbuf(rcfw, sbuf);
+	}
+}
+
+static void bnxt_qplib_alloc_sbuf_pool(struct bnxt_qplib_rcfw *rcfw)
+{
+	struct bnxt_qplib_sbuf_pool *pool = &rcfw->sbuf_pool;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
+	int i, j;
+
+	spin_lock_init(&pool->lock);
+	pool->hit = 0;
+	pool->miss = 0;
+	INIT_LIST_HEAD(&pool->orphaned);
+	/* A short pool only costs misses, the slow path still works */
+	for (i = 0; i < BNXT_QPLIB_SBUF_MAX; i++) {
+		INIT_LIST_HEAD(&pool->free[i]);
+		for (j = 0; j < BNXT_QPLIB_SBUF_POOL_DEPTH; j++) {
+			sbuf = __alloc_sbuf(rcfw, bnxt_qplib_sbuf_class_size[i],
+					    GFP_KERNEL);
+			if (!sbuf)
+				break;
+			sbuf->pooled = true;
+			list_add(&sbuf->list, &pool->free[i]);
+		}
+	}
+}
+
 void bnxt_qplib_free_rcfw_channel(struct bnxt_qplib_res *res)
 {
 	struct bnxt_qplib_rcfw *rcfw = res->rcfw;
 
-	vfree(rcfw->rcfw_lat_slab_msec);
-	rcfw->rcfw_lat_slab_msec = NULL;
-	vfree(rcfw->qp_create_stats);
-	rcfw->qp_create_stats = NULL;
-	vfree(rcfw->qp_destroy_stats);
-	rcfw->qp_destroy_stats = NULL;
-	vfree(rcfw->mr_create_stats);
-	rcfw->mr_create_stats = NULL;
-	vfree(rcfw->mr_destroy_stats);
-	rcfw->mr_destroy_stats = NULL;
-	vfree(rcfw->qp_modify_stats);
-	rcfw->qp_modify_stats = NULL;
+	bnxt_qplib_free_sbuf_pool(rcfw);
 	rcfw->sp_perf_stats_enabled = false;
+	free_percpu(rcfw->lat_hist);
+	rcfw->lat_hist = NULL;
 
-	kfree(rcfw->crsqe_tbl);
+	vfree(rcfw->crsqe_tbl);
 	rcfw->crsqe_tbl = NULL;
 
 	bnxt_qplib_free_hwq(res, &rcfw->cmdq.hwq);
@@ -1104,6 +1885,7 @@ int bnxt_qplib_alloc_rcfw_channel(struct bnxt_qplib_res *res)
 	struct bnxt_qplib_sg_info sginfo = {};
 	struct bnxt_qplib_cmdq_ctx *cmdq;
 	struct bnxt_qplib_creq_ctx *creq;
+	int i;
 
 	rcfw->pdev = res->pdev;
 	rcfw->res = res;
@@ -1135,32 +1917,24 @@ int bnxt_qplib_alloc_rcfw_channel(struct bnxt_qplib_res *res)
 		goto fail_free_creq_hwq;
 	}
 
-	rcfw->crsqe_tbl = kcalloc(cmdq->hwq.max_elements,
-			sizeof(*rcfw->crsqe_tbl), GFP_KERNEL);
+	/* Each crsqe carries its own completion, too big for kcalloc */
+	rcfw->crsqe_tbl = vzalloc(cmdq->hwq.max_elements *
+				  sizeof(*rcfw->crsqe_tbl));
 	if (!rcfw->crsqe_tbl) {
 		dev_err(&rcfw->pdev->dev,
 			"QPLIB: HW channel CRSQ allocation failed");
 		goto fail_free_cmdq_hwq;
 	}
+	for (i = 0; i < cmdq->hwq.max_elements; i++)
+		init_completion(&rcfw->crsqe_tbl[i].done);
 
 	rcfw->max_timeout = res->cctx->hwrm_cmd_max_timeout;
 
-	rcfw->sp_perf_stats_enabled = false;
-	rcfw->rcfw_lat_slab_msec = vzalloc(sizeof(u32) *
-					   RCFW_MAX_LATENCY_MSEC_SLAB_INDEX);
-	rcfw->qp_create_stats = vzalloc(sizeof(u64) * RCFW_MAX_STAT_INDEX);
-	rcfw->qp_destroy_stats = vzalloc(sizeof(u64) * RCFW_MAX_STAT_INDEX);
-	rcfw->mr_create_stats = vzalloc(sizeof(u64) * RCFW_MAX_STAT_INDEX);
-	rcfw->mr_destroy_stats = vzalloc(sizeof(u64) * RCFW_MAX_STAT_INDEX);
-	rcfw->qp_modify_stats = vzalloc(sizeof(u64) * RCFW_MAX_STAT_INDEX);
-
-	if (rcfw->rcfw_lat_slab_msec &&
-	    rcfw->qp_create_stats &&
-	    rcfw->qp_destroy_stats &&
-	    rcfw->mr_create_stats &&
-	    rcfw->mr_destroy_stats &&
-	    rcfw->qp_modify_stats)
-		rcfw->sp_perf_stats_enabled = true;
+	/* Perf stats are optional, run without them if this fails */
+	rcfw->lat_hist = alloc_percpu(struct bnxt_qplib_rcfw_lat_hist);
+	rcfw->sp_perf_stats_enabled = !!rcfw->lat_hist;
+
+	bnxt_qplib_alloc_sbuf_pool(rcfw);
 
 	return 0;
 fail_free_cmdq_hwq:
@@ -1338,8 +2112,7 @@ static int bnxt_qplib_map_creq_db(struct bnxt_qplib_rcfw *rcfw, u32 reg_offt)
 	creq_db->dbinfo.xid = rcfw->creq.ring_id;
 	creq_db->dbinfo.seed = rcfw->creq.ring_id;
 	creq_db->dbinfo.flags = 0;
-	spin_lock_init(&creq_db->dbinfo.lock);
-	creq_db->dbinfo.shadow_key = BNXT_QPLIB_DBR_KEY_INVALID;
+	bnxt_qplib_init_db_keys(&creq_db->dbinfo);
 	creq_db->dbinfo.res = rcfw->res;
 
 	return 0;
@@ -1382,7 +2155,6 @@ int bnxt_qplib_enable_rcfw_channel(struct bnxt_qplib_rcfw *rcfw,
 	/* Clear to defaults */
 	cmdq->seq_num = 0;
 	set_bit(FIRMWARE_FIRST_FLAG, &cmdq->flags);
-	init_waitqueue_head(&cmdq->waitq);
 
 	creq->stats.creq_qp_event_processed = 0;
 	creq->stats.creq_func_event_processed = 0;
@@ -1411,8 +2183,14 @@ int bnxt_qplib_enable_rcfw_channel(struct bnxt_qplib_rcfw *rcfw,
 	rcfw->curr_shadow_qd = min_not_zero(cmdq_shadow_qd,
 					    (unsigned int)RCFW_CMD_NON_BLOCKING_SHADOW_QD);
 	sema_init(&rcfw->rcfw_inflight, rcfw->curr_shadow_qd);
+	/* Background commands share the slots above, never all of them */
+	rcfw->bg_shadow_qd = clamp_t(unsigned int, rcfw->curr_shadow_qd / 2,
+				     1, RCFW_CMD_BG_SHADOW_QD);
+	atomic_set(&rcfw->bg_inflight, 0);
+	atomic_set(&rcfw->crit_waiters, 0);
 	dev_dbg(&rcfw->pdev->dev,
-		"Perf Debug: shadow qd %d", rcfw->curr_shadow_qd);
+		"Perf Debug: shadow qd %d bg %d", rcfw->curr_shadow_qd,
+		rcfw->bg_shadow_qd);
 	bnxt_qplib_start_rcfw(rcfw);
 
 	return 0;
@@ -38,6 +38,7 @@
 #define __BNXT_QPLIB_RCFW_H__
 
 #include <linux/semaphore.h>
+#include <linux/completion.h>
 #include "qplib_tlv.h"
 
 #define RCFW_CMDQ_TRIG_VAL		1
@@ -51,8 +52,6 @@
 #define RCFW_DBR_PCI_BAR_REGION		2
 #define RCFW_DBR_BASE_PAGE_SHIFT	12
 #define RCFW_MAX_LATENCY_SEC_SLAB_INDEX	128
-#define RCFW_MAX_LATENCY_MSEC_SLAB_INDEX	3000
-#define RCFW_MAX_STAT_INDEX	0x3FFFF
 #define	RCFW_FW_STALL_MAX_TIMEOUT	40
 
 extern unsigned int cmdq_shadow_qd;
@@ -72,6 +71,10 @@ static inline void bnxt_qplib_rcfw_cmd_prep(void *r, u8 opcode, u8 cmd_size)
 
 /* Shadow queue depth for non blocking command */
 #define RCFW_CMD_NON_BLOCKING_SHADOW_QD	64
+/* Background lane share of the non-blocking shadow queue depth */
+#define RCFW_CMD_BG_SHADOW_QD		8
+/* Max time a background command yields to critical ones */
+#define RCFW_BG_MAX_DEFER_MS		20
 #define RCFW_CMD_DEV_ERR_CHECK_TIME_MS	1000 /* 1 Second time out*/
 #define RCFW_ERR_RETRY_COUNT		(RCFW_CMD_WAIT_TIME_MS / RCFW_CMD_DEV_ERR_CHECK_TIME_MS)
 
@@ -142,25 +145,101 @@ static inline u32 bnxt_qplib_set_cmd_slots(struct cmdq_base *req)
 #define CREQ_ENTRY_POLL_BUDGET		8
 
 typedef int (*aeq_handler_t)(struct bnxt_qplib_rcfw *, void *, void *);
+/*
+ * Completion callback of an async rcfw command. Called with the cmdq
+ * lock held, normally from the CREQ service context, so it must not
+ * sleep or post rcfw commands. @status is 0, -EIO if firmware failed
+ * the command, or -ETIMEDOUT if the rcfw channel stalled; @event is
+ * NULL in the last case when no completion was seen.
+ */
+typedef void (*bnxt_qplib_rcfw_cb_t)(struct bnxt_qplib_rcfw *rcfw, void *ctx,
+				     struct creq_qp_event *event, int status);
 
 struct bnxt_qplib_crsqe {
 	struct creq_qp_event	*resp;
+	bnxt_qplib_rcfw_cb_t	cb;
+	void			*cb_ctx;
 	u32			req_size;
 	bool			is_waiter_alive;
 	bool			is_internal_cmd;
 	bool			is_in_used;
+	/* Holds an rcfw_inflight slot until completion */
+	bool			is_async;
+	/* Wakes the sender sleeping in __wait_for_resp() */
+	struct completion	done;
 
 	/* Free slots at the time of submission */
 	u32			free_slots;
 	unsigned long		send_timestamp;
+	/* ktime_get_ns() at post, for the latency histogram */
+	u64			send_ts_ns;
 	u8			opcode;
 	u8			requested_qp_state;
 };
 
+/*
+ * Per-CPU command latency histogram, one row per CMDQ opcode. Bucket 0
+ * counts completions under 1 usec, bucket i those in [2^(i-1), 2^i)
+ * usec, and the last bucket everything slower.
+ */
+#define RCFW_LAT_HIST_BUCKETS		24
+/* Extra row for MODIFY_QP to the error state */
+#define RCFW_LAT_HIST_QP_MODIFY_ERR	(CMDQ_BASE_OPCODE_LAST + 1)
+#define RCFW_LAT_HIST_ROWS		(CMDQ_BASE_OPCODE_LAST + 2)
+
+struct bnxt_qplib_rcfw_lat_hist {
+	u64	sum_us[RCFW_LAT_HIST_ROWS];
+	u32	bucket[RCFW_LAT_HIST_ROWS][RCFW_LAT_HIST_BUCKETS];
+};
+
+enum bnxt_qplib_rcfw_lane {
+	BNXT_QPLIB_RCFW_LANE_CRIT,
+	BNXT_QPLIB_RCFW_LANE_BG,
+	BNXT_QPLIB_RCFW_LANE_MAX
+};
+
+struct bnxt_qplib_rcfw_lane_stats {
+	atomic64_t	sent;
+	/* Had to sleep for a shadow queue slot */
+	atomic64_t	waited;
+	/* Background only: yielded to critical commands */
+	atomic64_t	deferred;
+	/* Background only: stopped yielding at RCFW_BG_MAX_DEFER_MS */
+	atomic64_t	starved;
+};
+
 struct bnxt_qplib_rcfw_sbuf {
 	void *sb;
 	dma_addr_t dma_addr;
 	u32 size;
+	/* Pool bookkeeping, see bnxt_qplib_rcfw_alloc_sbuf() */
+	struct list_head list;
+	u32 alloc_size;
+	bool pooled;
+	/* Set when its sync command timed out, see bnxt_qplib_rcfw_free_sbuf() */
+	bool fw_owned;
+};
+
+/*
+ * Side buffer pool classes. Small covers QUERY_FUNC/QP/SRQ/CC, large
+ * covers the QUERY_ROCE_STATS* and extended CC side buffers.
+ */
+#define BNXT_QPLIB_SBUF_SMALL_SIZE	256
+#define BNXT_QPLIB_SBUF_LARGE_SIZE	1024
+#define BNXT_QPLIB_SBUF_POOL_DEPTH	4
+enum bnxt_qplib_sbuf_class {
+	BNXT_QPLIB_SBUF_SMALL,
+	BNXT_QPLIB_SBUF_LARGE,
+	BNXT_QPLIB_SBUF_MAX
+};
+
+struct bnxt_qplib_sbuf_pool {
+	spinlock_t		lock;
+	struct list_head	free[BNXT_QPLIB_SBUF_MAX];
+	/* Buffers of timed out commands, freed with the channel */
+	struct list_head	orphaned;
+	u64			hit;
+	u64			miss;
 };
 
 #define BNXT_QPLIB_OOS_COUNT_MASK 0xFFFFFFFF
@@ -178,10 +257,11 @@ struct bnxt_qplib_cmdq_mbox {
 struct bnxt_qplib_cmdq_ctx {
 	struct bnxt_qplib_hwq		hwq;
 	struct bnxt_qplib_cmdq_mbox	cmdq_mbox;
-	wait_queue_head_t		waitq;
 	unsigned long			flags;
 	unsigned long			last_seen;
 	u32				seq_num;
+	/* Commands copied into the CMDQ but not yet rung, under hwq lock */
+	u32				db_deferred;
 };
 
 struct bnxt_qplib_creq_db {
@@ -220,17 +300,7 @@ struct bnxt_qplib_rcfw {
 	u32	rcfw_lat_slab_sec[RCFW_MAX_LATENCY_SEC_SLAB_INDEX];
 
 	/* Slow path Perf Stats */
-	u32	*rcfw_lat_slab_msec;
-	u64	*qp_create_stats;
-	u64	*qp_destroy_stats;
-	u64	*qp_modify_stats;
-	u64	*mr_create_stats;
-	u64	*mr_destroy_stats;
-	u32	qp_create_stats_id;
-	u32	qp_destroy_stats_id;
-	u32	qp_modify_stats_id;
-	u32	mr_create_stats_id;
-	u32	mr_destroy_stats_id;
+	struct bnxt_qplib_rcfw_lat_hist __percpu *lat_hist;
 	bool	sp_perf_stats_enabled;
 	/* odd place to have following members. */
 	bool init_oos_stats;
@@ -245,7 +315,18 @@ struct bnxt_qplib_rcfw {
 	u32 cmdq_full_dbg;
 	struct semaphore rcfw_inflight;
 	unsigned int	curr_shadow_qd;
+	/* Background commands holding rcfw_inflight slots */
+	atomic_t	bg_inflight;
+	unsigned int	bg_shadow_qd;
+	/* Critical lane senders waiting for a slot */
+	atomic_t	crit_waiters;
+	struct bnxt_qplib_rcfw_lane_stats lane_stats[BNXT_QPLIB_RCFW_LANE_MAX];
+	struct bnxt_qplib_sbuf_pool sbuf_pool;
 	atomic_t timeout_send;
+	u64 async_sent;
+	u64 async_cancelled;
+	u64 bulk_db_count;
+	u64 bulk_cmd_count;
 };
 
 struct bnxt_qplib_cmdqmsg {
@@ -257,6 +338,18 @@ struct bnxt_qplib_cmdqmsg {
 	u8			block;
 	/* TBD - xid can be used in future for generic tracking */
 	u8			qp_state;
+	/* Async completion, see bnxt_qplib_rcfw_send_message_async() */
+	bnxt_qplib_rcfw_cb_t	cb;
+	void			*cb_ctx;
+	/* Async only: leave the doorbell to bnxt_qplib_rcfw_flush_db() */
+	bool			defer_db;
+};
+
+/* A group of async commands waited on together */
+struct bnxt_qplib_rcfw_batch {
+	atomic_t		pending;
+	atomic_t		failed;
+	struct completion	done;
 };
 
 static inline void bnxt_qplib_fill_cmdqmsg(struct bnxt_qplib_cmdqmsg *msg,
@@ -287,8 +380,31 @@ struct bnxt_qplib_rcfw_sbuf *bnxt_qplib_rcfw_alloc_sbuf(
 				u32 size);
 void bnxt_qplib_rcfw_free_sbuf(struct bnxt_qplib_rcfw *rcfw,
 				struct bnxt_qplib_rcfw_sbuf *sbuf);
+void bnxt_qplib_rcfw_orphan_sbuf(struct bnxt_qplib_rcfw *rcfw,
+				 struct bnxt_qplib_rcfw_sbuf *sbuf);
 int bnxt_qplib_rcfw_send_message(struct bnxt_qplib_rcfw *rcfw,
 				 struct bnxt_qplib_cmdqmsg *msg);
+int bnxt_qplib_rcfw_send_message_async(struct bnxt_qplib_rcfw *rcfw,
+				       struct bnxt_qplib_cmdqmsg *msg);
+int bnxt_qplib_rcfw_send_message_bulk(struct bnxt_qplib_rcfw *rcfw,
+				      struct bnxt_qplib_cmdqmsg *msgs, int num);
+void bnxt_qplib_rcfw_wake_waiters(struct bnxt_qplib_rcfw *rcfw);
+void bnxt_qplib_rcfw_flush_db(struct bnxt_qplib_rcfw *rcfw);
+int bnxt_qplib_rcfw_cancel_async(struct bnxt_qplib_rcfw *rcfw, void *ctx);
+void bnxt_qplib_rcfw_batch_init(struct bnxt_qplib_rcfw_batch *batch);
+int bnxt_qplib_rcfw_batch_submit(struct bnxt_qplib_rcfw *rcfw,
+				 struct bnxt_qplib_rcfw_batch *batch,
+				 struct bnxt_qplib_cmdqmsg *msg);
+int bnxt_qplib_rcfw_batch_submit_bulk(struct bnxt_qplib_rcfw *rcfw,
+				      struct bnxt_qplib_rcfw_batch *batch,
+				      struct bnxt_qplib_cmdqmsg *msgs, int num);
+int bnxt_qplib_rcfw_batch_wait(struct bnxt_qplib_rcfw *rcfw,
+			       struct bnxt_qplib_rcfw_batch *batch);
+
+u64 bnxt_qplib_rcfw_lat_read(struct bnxt_qplib_rcfw *rcfw, int row,
+			     u64 *bucket, u64 *sum_us);
+u64 bnxt_qplib_rcfw_lat_pct(u64 *bucket, u64 count, u32 permille);
+void bnxt_qplib_rcfw_lat_clear(struct bnxt_qplib_rcfw *rcfw);
 
 int bnxt_qplib_deinit_rcfw(struct bnxt_qplib_rcfw *rcfw);
 int bnxt_qplib_init_rcfw(struct bnxt_qplib_rcfw *rcfw, int is_virtfn);
@@ -66,7 +66,13 @@ static void __free_pbl(struct bnxt_qplib_res *res,
 	int i;
 
 	pdev = res->pdev;
-	if (is_umem == false) {
+	if (is_umem == false && pbl->contig) {
+		dma_free_coherent(&pdev->dev,
+				  (size_t)pbl->pg_count * pbl->pg_size,
+				  pbl->pg_arr[0], pbl->pg_map_arr[0]);
+		for (i = 0; i < pbl->pg_count; i++)
+			pbl->pg_arr[i] = NULL;
+	} else if (is_umem == false) {
 		for (i = 0; i < pbl->pg_count; i++) {
 			if (pbl->pg_arr[i]) {
 				dma_free_coherent(&pdev->dev, pbl->pg_size,
@@ -92,6 +98,7 @@ static void __free_pbl(struct bnxt_qplib_res *res,
 	}
 	pbl->pg_count = 0;
 	pbl->pg_size = 0;
+	pbl->contig = false;
 }
 
 #if !defined(HAVE_RDMA_UMEM_FOR_EACH_DMA_BLOCK) && !defined(HAVE_FOR_EACH_SG_DMA_PAGE)
@@ -179,6 +186,34 @@ static int bnxt_qplib_fill_user_dma_pages(struct bnxt_qplib_pbl *pbl,
 	return rc;
 }
 
+/*
+ * Back the whole PBL with one DMA chunk carved into pg_size pages. The
+ * PBL handed to HW looks the same, but the CPU sees one linear ring.
+ * The chunk is aligned to its own size order, so every slice stays
+ * pg_size aligned.
+ */
+static int __alloc_pbl_contig(struct bnxt_qplib_res *res,
+			      struct bnxt_qplib_pbl *pbl, u32 npages)
+{
+	size_t size = (size_t)npages * pbl->pg_size;
+	dma_addr_t map;
+	void *va;
+	u32 i;
+
+	va = dma_zalloc_coherent(&res->pdev->dev, size, &map,
+				 GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+	if (!va)
+		return -ENOMEM;
+	for (i = 0; i < npages; i++) {
+		pbl->pg_arr[i] = va + (size_t)i * pbl->pg_size;
+		pbl->pg_map_arr[i] = map + (size_t)i * pbl->pg_size;
+	}
+	pbl->pg_count = npages;
+	pbl->contig = true;
+
+	return 0;
+}
+
 static int __alloc_pbl(struct bnxt_qplib_res *res, struct bnxt_qplib_pbl *pbl,
 		       struct bnxt_qplib_sg_info *sginfo)
 {
@@ -202,11 +237,17 @@ static int __alloc_pbl(struct bnxt_qplib_res *res, struct bnxt_qplib_pbl *pbl,
 	}
 	pbl->pg_count = 0;
 	pbl->pg_size = sginfo->pgsize;
+	pbl->contig = false;
 #ifndef HAVE_RDMA_UMEM_FOR_EACH_DMA_BLOCK
 	if (!sginfo->sghead) {
 #else
 	if (!sginfo->umem) {
 #endif
+		if (sginfo->npages > 1 &&
+		    (u64)sginfo->npages * pbl->pg_size <=
+		    BNXT_QPLIB_HWQ_CONTIG_MAX &&
+		    !__alloc_pbl_contig(res, pbl, sginfo->npages))
+			return 0;
 		for (i = 0; i < sginfo->npages; i++) {
 			pbl->pg_arr[i] = dma_zalloc_coherent(&pdev->dev,
 							     pbl->pg_size,
@@ -251,6 +292,7 @@ void bnxt_qplib_free_hwq(struct bnxt_qplib_res *res,
 	hwq->element_size = 0;
 	hwq->prod = hwq->cons = 0;
 	hwq->cp_bit = 0;
+	hwq->qe_base = NULL;
 }
 
 /* All HWQs are power of 2 in size */
@@ -466,6 +508,13 @@ done:
 		lvl = hwq->level - 1;
 	hwq->pbl_ptr = hwq->pbl[lvl].pg_arr;
 	hwq->pbl_dma_ptr = hwq->pbl[lvl].pg_map_arr;
+	/* get_qe() skips the page walk when the ring is one linear VA */
+	hwq->qe_base = NULL;
+	if (!hwq->is_user && !hwq_attr->sginfo->nopte &&
+	    (hwq->pbl[lvl].contig || hwq->pbl[lvl].pg_count == 1)) {
+		hwq->qe_base = hwq->pbl_ptr[0];
+		hwq->qe_shift = ilog2(stride);
+	}
 	spin_lock_init(&hwq->lock);
 
 	return 0;
@@ -803,14 +852,38 @@ free_tbl:
 static void bnxt_qplib_cleanup_sgid_tbl(struct bnxt_qplib_res *res,
 					struct bnxt_qplib_sgid_tbl *sgid_tbl)
 {
-	int i;
+	struct bnxt_qplib_rcfw_batch batch;
+	int i, rc;
 
+	/* The whole table is reset below, so just post DELETE_GID for
+	 * every programmed entry back to back and wait once.
+	 */
+	bnxt_qplib_rcfw_batch_init(&batch);
 	for (i = 0; i < sgid_tbl->max; i++) {
-		if (memcmp(&sgid_tbl->tbl[i], &bnxt_qplib_gid_zero,
-			   sizeof(bnxt_qplib_gid_zero)))
-			bnxt_qplib_del_sgid(sgid_tbl, &sgid_tbl->tbl[i].gid,
-					    sgid_tbl->tbl[i].vlan_id, true);
+		struct bnxt_qplib_cmdqmsg msg = {};
+		struct cmdq_delete_gid req = {};
+
+		if (!memcmp(&sgid_tbl->tbl[i], &bnxt_qplib_gid_zero,
+			    sizeof(bnxt_qplib_gid_zero)) ||
+		    sgid_tbl->hw_id[i] == 0xFFFF)
+			continue;
+		bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_DELETE_GID,
+					 sizeof(req));
+		req.gid_index = cpu_to_le16(sgid_tbl->hw_id[i]);
+		bnxt_qplib_fill_cmdqmsg(&msg, &req, NULL, NULL, sizeof(req),
+					0, 0);
+		rc = bnxt_qplib_rcfw_batch_submit(res->rcfw, &batch, &msg);
+		if (rc) {
+			dev_dbg(&res->pdev->dev,
+				"QPLIB: DELETE_GID hw_id 0x%x not sent rc = %d",
+				sgid_tbl->hw_id[i], rc);
+			break;
+		}
 	}
+	rc = bnxt_qplib_rcfw_batch_wait(res->rcfw, &batch);
+	if (rc)
+		dev_dbg(&res->pdev->dev,
+			"QPLIB: SGID table cleanup rc = %d", rc);
 	memset(sgid_tbl->tbl, 0, sizeof(*sgid_tbl->tbl) * sgid_tbl->max);
 	memset(sgid_tbl->hw_id, -1, sizeof(u16) * sgid_tbl->max);
 	memset(sgid_tbl->vlan, 0, sizeof(u8) * sgid_tbl->max);
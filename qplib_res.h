@@ -201,6 +201,8 @@ enum bnxt_qplib_hwq_type {
 #define MAX_PBL_LVL_1_PGS		(PAGE_SIZE / sizeof(u64))
 #define MAX_PBL_LVL_1_PGS_SHIFT		ilog2(MAX_PBL_LVL_1_PGS)
 #define MAX_PDL_LVL_SHIFT		ilog2(MAX_PBL_LVL_1_PGS)
+/* Kernel rings up to this size are tried as one DMA chunk first */
+#define BNXT_QPLIB_HWQ_CONTIG_MAX	(4UL << 20)
 
 enum bnxt_qplib_pbl_lvl {
 	PBL_LVL_0,
@@ -237,6 +239,8 @@ struct bnxt_qplib_pbl {
 	u32				pg_size;
 	void				**pg_arr;
 	dma_addr_t			*pg_map_arr;
+	/* pg_arr[] are slices of a single DMA allocation */
+	bool				contig;
 };
 
 struct bnxt_qplib_sg_info {
@@ -283,6 +287,9 @@ struct bnxt_qplib_hwq {
 	u64				*pad_pg;
 	u32				pad_stride;
 	u32				pad_pgofft;
+	/* Linear VA of element 0 when the leaf pages are contiguous */
+	void				*qe_base;
+	u8				qe_shift;
 };
 
 struct bnxt_qplib_db_info {
@@ -294,9 +301,11 @@ struct bnxt_qplib_db_info {
 	u32			max_slot;
 	u32			flags;
 	u8			toggle;
-	spinlock_t		lock;
-	u64			shadow_key;
-	u64			shadow_key_arm_ena;
+	/* Last key written, replayed by DB drop recovery */
+	atomic64_t		shadow_key;
+	atomic64_t		shadow_key_arm_ena;
+	/* Replays in flight, doorbell writers wait them out */
+	atomic_t		replay;
 	/* DB copy Thor2 recovery */
 	__le64			*dbc; /* offset 0 of the DB copy block */
 	int			ktbl_idx;
@@ -515,6 +524,8 @@ static inline void *bnxt_qplib_get_qe(struct bnxt_qplib_hwq *hwq,
 {
 	u32 pg_num, pg_idx;
 
+	if (likely(hwq->qe_base && !pg))
+		return hwq->qe_base + ((size_t)indx << hwq->qe_shift);
 	pg_num = (indx / hwq->qe_ppg);
 	pg_idx = (indx % hwq->qe_ppg);
 	if (pg)
@@ -522,6 +533,11 @@ static inline void *bnxt_qplib_get_qe(struct bnxt_qplib_hwq *hwq,
 	return (void *)(hwq->pbl_ptr[pg_num] + hwq->element_size * pg_idx);
 }
 
+static inline const char *bnxt_qplib_hwq_mode_str(struct bnxt_qplib_hwq *hwq)
+{
+	return hwq->qe_base ? "linear" : "pbl";
+}
+
 static inline void bnxt_qplib_hwq_incr_prod(struct bnxt_qplib_db_info *dbinfo,
 					    struct bnxt_qplib_hwq *hwq, u32 cnt)
 {
@@ -769,23 +785,43 @@ static inline void bnxt_re_hdbr_db_copy(struct bnxt_qplib_db_info *info, u64 key
 	wmb(); /* Sync DB copy before it is written into HW */
 }
 
+/* Kernel WQE push is built only if the HSI has the push doorbell types */
+#if defined(DBC_DBC_TYPE_PUSH_START) && defined(DBC_DBC_TYPE_PUSH_END)
+#define BNXT_QPLIB_KQ_PUSH
+#endif
+
 #define BNXT_QPLIB_INIT_DBHDR(xid, type, indx, toggle)				\
 	(((u64)(((xid) & DBC_DBC_XID_MASK) | DBC_DBC_PATH_ROCE |	\
 	    (type) | BNXT_QPLIB_DBR_VALID) << 32) | (indx) |	\
 	    (((u32)(toggle)) << (BNXT_QPLIB_DBR_TOGGLE_SHIFT)))
 
-static inline void bnxt_qplib_write_db(struct bnxt_qplib_db_info *info,
-				       u64 key, void __iomem *db,
-				       u64 *shadow_key)
+/*
+ * Doorbells are lock free. Writers of one shadow key are serialized by
+ * their caller (queue lock or the NQ/CREQ tasklet). A writer publishes
+ * the key, then checks for a replay in flight and waits it out before
+ * ringing, while bnxt_qplib_replay_db() announces itself before it reads
+ * the key. With a full barrier on both sides either the replay reads the
+ * writer's key or the writer rings after the replay, so the device never
+ * sees a key older than one it has already been given.
+ */
+static inline void __bnxt_qplib_write_db(struct bnxt_qplib_db_info *info,
+					 u64 key, u64 db_key, void __iomem *db,
+					 atomic64_t *shadow_key)
 {
-	unsigned long flags;
-
-	spin_lock_irqsave(&info->lock, flags);
 	bnxt_qplib_do_pacing(info);
-	*shadow_key = key;
+	atomic64_set(shadow_key, key);
 	bnxt_re_hdbr_db_copy(info, key);
-	writeq(key, db);
-	spin_unlock_irqrestore(&info->lock, flags);
+	smp_mb(); /* shadow key store before the replay check */
+	while (atomic_read_acquire(&info->replay))
+		cpu_relax();
+	writeq(db_key, db);
+}
+
+static inline void bnxt_qplib_write_db(struct bnxt_qplib_db_info *info,
+				       u64 key, void __iomem *db,
+				       atomic64_t *shadow_key)
+{
+	__bnxt_qplib_write_db(info, key, key, db, shadow_key);
 }
 
 static inline void __replay_writeq(u64 key, void __iomem *db)
@@ -799,18 +835,27 @@ static inline void bnxt_qplib_replay_db(struct bnxt_qplib_db_info *info,
 				        bool is_arm_ena)
 
 {
+	void __iomem *db = is_arm_ena ? info->priv_db : info->db;
+	atomic64_t *shadow_key = is_arm_ena ? &info->shadow_key_arm_ena :
+					      &info->shadow_key;
 	unsigned long flags;
 
-	if (!spin_trylock_irqsave(&info->lock, flags))
-		return;
-
 	bnxt_qplib_do_pacing(info);
-	if (is_arm_ena)
-		__replay_writeq(info->shadow_key_arm_ena, info->priv_db);
-	else
-		__replay_writeq(info->shadow_key, info->db);
+	/* Writers of this doorbell spin until we are done, keep it short */
+	local_irq_save(flags);
+	atomic_inc(&info->replay);
+	smp_mb__after_atomic(); /* announce before reading the shadow key */
+	__replay_writeq(atomic64_read(shadow_key), db);
+	wmb(); /* replayed doorbell out before writers may ring again */
+	atomic_dec(&info->replay);
+	local_irq_restore(flags);
+}
 
-	spin_unlock_irqrestore(&info->lock, flags);
+static inline void bnxt_qplib_init_db_keys(struct bnxt_qplib_db_info *info)
+{
+	atomic64_set(&info->shadow_key, BNXT_QPLIB_DBR_KEY_INVALID);
+	atomic64_set(&info->shadow_key_arm_ena, BNXT_QPLIB_DBR_KEY_INVALID);
+	atomic_set(&info->replay, 0);
 }
 
 static inline void bnxt_qplib_ring_db(struct bnxt_qplib_db_info *info,
@@ -832,19 +877,41 @@ static inline void bnxt_qplib_ring_db(struct bnxt_qplib_db_info *info,
 	bnxt_qplib_write_db(info, key, info->db, &info->shadow_key);
 }
 
-static inline void bnxt_qplib_ring_prod_db(struct bnxt_qplib_db_info *info,
-					   u32 type)
+static inline u64 bnxt_qplib_prod_db_key(struct bnxt_qplib_db_info *info,
+					 u32 type)
 {
-	u64 key = 0;
 	u32 indx;
 
 	indx = (((info->hwq->prod / info->max_slot) & DBC_DBC_INDEX_MASK) |
 		((info->flags & BNXT_QPLIB_FLAG_EPOCH_PROD_MASK) <<
 		 BNXT_QPLIB_DB_EPOCH_PROD_SHIFT));
-	key = BNXT_QPLIB_INIT_DBHDR(info->xid, type, indx, 0);
+	return BNXT_QPLIB_INIT_DBHDR(info->xid, type, indx, 0);
+}
+
+static inline void bnxt_qplib_ring_prod_db(struct bnxt_qplib_db_info *info,
+					   u32 type)
+{
+	u64 key = bnxt_qplib_prod_db_key(info, type);
+
 	bnxt_qplib_write_db(info, key, info->db, &info->shadow_key);
 }
 
+#ifdef BNXT_QPLIB_KQ_PUSH
+/*
+ * Close a WQE push with PUSH_END for the current SQ producer index. The
+ * shadow key keeps the plain SQ doorbell, a replay must not end a push
+ * a second time. Returns the SQ key the push published.
+ */
+static inline u64 bnxt_qplib_ring_push_end_db(struct bnxt_qplib_db_info *info)
+{
+	u64 key = bnxt_qplib_prod_db_key(info, DBC_DBC_TYPE_SQ);
+	u64 end_key = bnxt_qplib_prod_db_key(info, DBC_DBC_TYPE_PUSH_END);
+
+	__bnxt_qplib_write_db(info, key, end_key, info->db, &info->shadow_key);
+	return key;
+}
+#endif
+
 static inline void bnxt_qplib_armen_db(struct bnxt_qplib_db_info *info,
 				       u32 type)
 {
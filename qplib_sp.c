@@ -89,7 +89,7 @@ int bnxt_qplib_get_dev_attr(struct bnxt_qplib_rcfw *rcfw)
 	struct creq_query_func_resp resp = {};
 	struct bnxt_qplib_cmdqmsg msg = {};
 	struct creq_query_func_resp_sb *sb;
-	struct bnxt_qplib_rcfw_sbuf sbuf;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
 	struct bnxt_qplib_dev_attr *attr;
 	struct bnxt_qplib_chip_ctx *cctx;
 	struct cmdq_query_func req = {};
@@ -104,15 +104,13 @@ int bnxt_qplib_get_dev_attr(struct bnxt_qplib_rcfw *rcfw)
 	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_QUERY_FUNC,
 				 sizeof(req));
 
-	sbuf.size = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb)
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, sizeof(*sb));
+	if (!sbuf)
 		return -ENOMEM;
 
-	sb = sbuf.sb;
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
+	sb = sbuf->sb;
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
 				sizeof(resp), 0);
 	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
 	if (rc)
@@ -221,8 +219,7 @@ int bnxt_qplib_get_dev_attr(struct bnxt_qplib_rcfw *rcfw)
 
 	attr->is_atomic = bnxt_qplib_is_atomic_cap(rcfw);
 bail:
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 	return rc;
 }
 
@@ -991,7 +988,7 @@ int bnxt_qplib_query_cc_param(struct bnxt_qplib_res *res,
 	struct creq_query_roce_cc_resp_sb *sb;
 	struct bnxt_qplib_cmdqmsg msg = {};
 	struct cmdq_query_roce_cc req = {};
-	struct bnxt_qplib_rcfw_sbuf sbuf;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
 	size_t resp_size;
 	int rc;
 
@@ -1005,14 +1002,12 @@ int bnxt_qplib_query_cc_param(struct bnxt_qplib_res *res,
 	} else {
 		resp_size = sizeof(*sb);
 	}
-	sbuf.size = ALIGN(resp_size, BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb)
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, resp_size);
+	if (!sbuf)
 		return -ENOMEM;
 
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
 				sizeof(resp), 0);
 	rc = bnxt_qplib_rcfw_send_message(res->rcfw, &msg);
 	if (rc) {
@@ -1021,7 +1016,7 @@ int bnxt_qplib_query_cc_param(struct bnxt_qplib_res *res,
 		goto out;
 	}
 
-	ext_sb = sbuf.sb;
+	ext_sb = sbuf->sb;
 	sb = _is_chip_gen_p5_p7(res->cctx) ? &ext_sb->base_sb :
 		(struct creq_query_roce_cc_resp_sb *)ext_sb;
 
@@ -1052,33 +1047,15 @@ int bnxt_qplib_query_cc_param(struct bnxt_qplib_res *res,
 						&ext_sb->gen2_sb);
 	}
 out:
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 	return rc;
 }
 
-int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
-				    struct bnxt_qplib_roce_stats *stats,
-				    struct bnxt_qplib_query_stats_info *sinfo)
+static void bnxt_qplib_prep_roce_stats(struct cmdq_query_roce_stats *req,
+				       struct bnxt_qplib_query_stats_info *sinfo)
 {
-	struct creq_query_roce_stats_resp resp = {};
-	struct creq_query_roce_stats_resp_sb *sb;
-	struct cmdq_query_roce_stats req = {};
-	struct bnxt_qplib_cmdqmsg msg = {};
-	struct bnxt_qplib_rcfw_sbuf sbuf;
- 	u16 cmd_flags = 0;
+	u16 cmd_flags = 0;
 	u32 fn_id = 0;
-	int rc = 0;
-
-	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_QUERY_ROCE_STATS,
-				 sizeof(req));
-
-	sbuf.size = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb)
-		return -ENOMEM;
-	sb = sbuf.sb;
 
 	if (sinfo->function_id != 0xFFFFFFFF) {
 		cmd_flags = CMDQ_QUERY_ROCE_STATS_FLAGS_FUNCTION_ID;
@@ -1093,21 +1070,18 @@ int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
 		}
 	}
 
-	req.flags = cpu_to_le16(cmd_flags);
-	req.function_id = cpu_to_le32(fn_id);
+	req->flags = cpu_to_le16(cmd_flags);
+	req->function_id = cpu_to_le32(fn_id);
 
 	if (sinfo->collection_id != 0xFF) {
 		cmd_flags |= CMDQ_QUERY_ROCE_STATS_FLAGS_COLLECTION_ID;
-		req.collection_id = sinfo->collection_id;
+		req->collection_id = sinfo->collection_id;
 	}
+}
 
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
-				sizeof(resp), 0);
-	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
-	if (rc)
-		goto bail;
-	/* Extract the context from the side buffer */
+static void bnxt_qplib_copy_roce_stats(struct bnxt_qplib_roce_stats *stats,
+				       struct creq_query_roce_stats_resp_sb *sb)
+{
 	stats->to_retransmits = le64_to_cpu(sb->to_retransmits);
 	stats->seq_err_naks_rcvd = le64_to_cpu(sb->seq_err_naks_rcvd);
 	stats->max_retry_exceeded = le64_to_cpu(sb->max_retry_exceeded);
@@ -1148,6 +1122,42 @@ int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
 	stats->res_tx_pci_err = le64_to_cpu(sb->res_tx_pci_err);
 	stats->res_rx_pci_err = le64_to_cpu(sb->res_rx_pci_err);
 
+	stats->active_qp_count_p0 = le64_to_cpu(sb->active_qp_count_p0);
+	stats->active_qp_count_p1 = le64_to_cpu(sb->active_qp_count_p1);
+	stats->active_qp_count_p2 = le64_to_cpu(sb->active_qp_count_p2);
+	stats->active_qp_count_p3 = le64_to_cpu(sb->active_qp_count_p3);
+}
+
+int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
+				    struct bnxt_qplib_roce_stats *stats,
+				    struct bnxt_qplib_query_stats_info *sinfo)
+{
+	struct creq_query_roce_stats_resp resp = {};
+	struct creq_query_roce_stats_resp_sb *sb;
+	struct cmdq_query_roce_stats req = {};
+	struct bnxt_qplib_cmdqmsg msg = {};
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
+	int rc = 0;
+
+	bnxt_qplib_rcfw_cmd_prep(&req, CMDQ_BASE_OPCODE_QUERY_ROCE_STATS,
+				 sizeof(req));
+
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, sizeof(*sb));
+	if (!sbuf)
+		return -ENOMEM;
+	sb = sbuf->sb;
+
+	bnxt_qplib_prep_roce_stats(&req, sinfo);
+
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
+				sizeof(resp), 0);
+	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
+	if (rc)
+		goto bail;
+	/* Extract the context from the side buffer */
+	bnxt_qplib_copy_roce_stats(stats, sb);
+
 	if (!rcfw->init_oos_stats) {
 		rcfw->oos_prev = le64_to_cpu(sb->res_oos_drop_count);
 		rcfw->init_oos_stats = true;
@@ -1157,17 +1167,114 @@ int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
 					     BNXT_QPLIB_OOS_COUNT_MASK;
 		rcfw->oos_prev = le64_to_cpu(sb->res_oos_drop_count);
 	}
-
-	stats->active_qp_count_p0 = le64_to_cpu(sb->active_qp_count_p0);
-	stats->active_qp_count_p1 = le64_to_cpu(sb->active_qp_count_p1);
-	stats->active_qp_count_p2 = le64_to_cpu(sb->active_qp_count_p2);
-	stats->active_qp_count_p3 = le64_to_cpu(sb->active_qp_count_p3);
 bail:
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 	return rc;
 }
 
+/**
+ * bnxt_qplib_get_roce_error_stats_bulk   -	QUERY_ROCE_STATS for many functions
+ * @rcfw:         rcfw channel instance of rdev
+ * @stats:        per function output, @num entries
+ * @sinfo:        per function query info, @num entries
+ * @rcs:          per function result, 0 when @stats[i] was filled
+ * @num:          number of functions
+ *
+ * All queries go out through the async batch API with one CMDQ doorbell
+ * per group of free shadow queue slots and are waited for once. Being
+ * QUERY_ROCE_STATS they go on the background lane. Their side buffers
+ * are carved out of a single one, which is orphaned rather than freed
+ * if the batch times out.
+ * res_oos_drop_count is reported as read from firmware, the delta
+ * tracking done for the PF's own query does not apply here.
+ *
+ * Returns the number of functions filled or a negative errno.
+ */
+int bnxt_qplib_get_roce_error_stats_bulk(struct bnxt_qplib_rcfw *rcfw,
+					 struct bnxt_qplib_roce_stats *stats,
+					 struct bnxt_qplib_query_stats_info *sinfo,
+					 int *rcs, int num)
+{
+	struct creq_query_roce_stats_resp *resps = NULL;
+	struct creq_query_roce_stats_resp_sb *sb;
+	struct bnxt_qplib_rcfw_sbuf *sbufs = NULL;
+	struct cmdq_query_roce_stats *reqs = NULL;
+	struct bnxt_qplib_cmdqmsg *msgs = NULL;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
+	struct bnxt_qplib_rcfw_batch batch;
+	int i, posted, rc, filled = 0;
+	u32 stride;
+
+	if (!num)
+		return 0;
+
+	stride = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, stride * num);
+	reqs = kcalloc(num, sizeof(*reqs), GFP_KERNEL);
+	resps = kcalloc(num, sizeof(*resps), GFP_KERNEL);
+	sbufs = kcalloc(num, sizeof(*sbufs), GFP_KERNEL);
+	msgs = kcalloc(num, sizeof(*msgs), GFP_KERNEL);
+	if (!sbuf || !reqs || !resps || !sbufs || !msgs) {
+		filled = -ENOMEM;
+		goto free;
+	}
+
+	for (i = 0; i < num; i++) {
+		bnxt_qplib_rcfw_cmd_prep(&reqs[i],
+					 CMDQ_BASE_OPCODE_QUERY_ROCE_STATS,
+					 sizeof(reqs[i]));
+		bnxt_qplib_prep_roce_stats(&reqs[i], &sinfo[i]);
+		sbufs[i].sb = sbuf->sb + i * stride;
+		sbufs[i].dma_addr = sbuf->dma_addr + i * stride;
+		sbufs[i].size = stride;
+		reqs[i].resp_size = stride / BNXT_QPLIB_CMDQE_UNITS;
+		bnxt_qplib_fill_cmdqmsg(&msgs[i], &reqs[i], &resps[i],
+					&sbufs[i], sizeof(reqs[i]),
+					sizeof(resps[i]), 0);
+		rcs[i] = -EAGAIN;
+	}
+
+	bnxt_qplib_rcfw_batch_init(&batch);
+	posted = bnxt_qplib_rcfw_batch_submit_bulk(rcfw, &batch, msgs, num);
+	/* Always wait, it drops the bias taken by batch_init */
+	rc = bnxt_qplib_rcfw_batch_wait(rcfw, &batch);
+	if (rc == -ETIMEDOUT) {
+		/* Cancelled commands may still DMA into the side buffer */
+		bnxt_qplib_rcfw_orphan_sbuf(rcfw, sbuf);
+		sbuf = NULL;
+	}
+	if (posted < 0) {
+		filled = posted;
+		goto free;
+	}
+
+	for (i = 0; i < posted; i++) {
+		if (resps[i].event !=
+		    CREQ_QUERY_ROCE_STATS_RESP_EVENT_QUERY_ROCE_STATS) {
+			rcs[i] = -ETIMEDOUT;
+			continue;
+		}
+		if (resps[i].status) {
+			rcs[i] = -EIO;
+			continue;
+		}
+		sb = sbufs[i].sb;
+		bnxt_qplib_copy_roce_stats(&stats[i], sb);
+		stats[i].res_oos_drop_count =
+			le64_to_cpu(sb->res_oos_drop_count) &
+			BNXT_QPLIB_OOS_COUNT_MASK;
+		rcs[i] = 0;
+		filled++;
+	}
+free:
+	kfree(msgs);
+	kfree(sbufs);
+	kfree(resps);
+	kfree(reqs);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
+	return filled;
+}
+
 int bnxt_qplib_set_link_aggr_mode(struct bnxt_qplib_res *res,
 				  u8 aggr_mode, u8 member_port_map,
 				  u8 active_port_map, bool aggr_en,
@@ -1215,24 +1322,22 @@ int bnxt_qplib_qext_stat(struct bnxt_qplib_rcfw *rcfw, u32 fid,
 	struct creq_query_roce_stats_ext_resp_sb *sb;
 	struct cmdq_query_roce_stats_ext req = {};
 	struct bnxt_qplib_cmdqmsg msg = {};
-	struct bnxt_qplib_rcfw_sbuf sbuf;
+	struct bnxt_qplib_rcfw_sbuf *sbuf;
 	int rc;
 
-	sbuf.size = ALIGN(sizeof(*sb), BNXT_QPLIB_CMDQE_UNITS);
-	sbuf.sb = dma_zalloc_coherent(&rcfw->pdev->dev, sbuf.size,
-				       &sbuf.dma_addr, GFP_KERNEL);
-	if (!sbuf.sb) {
+	sbuf = bnxt_qplib_rcfw_alloc_sbuf(rcfw, sizeof(*sb));
+	if (!sbuf) {
 		dev_err(&rcfw->pdev->dev,
 			"QPLIB: SP: QUERY_ROCE_STATS_EXT alloc sb failed");
 		return -ENOMEM;
 	}
-	sb = sbuf.sb;
+	sb = sbuf->sb;
 
 	bnxt_qplib_rcfw_cmd_prep(&req,
 			CMDQ_QUERY_ROCE_STATS_EXT_OPCODE_QUERY_ROCE_STATS,
 			sizeof(req));
-	req.resp_size = sbuf.size / BNXT_QPLIB_CMDQE_UNITS;
-	req.resp_addr = cpu_to_le64(sbuf.dma_addr);
+	req.resp_size = sbuf->size / BNXT_QPLIB_CMDQE_UNITS;
+	req.resp_addr = cpu_to_le64(sbuf->dma_addr);
 	req.flags = cpu_to_le16(CMDQ_QUERY_ROCE_STATS_EXT_FLAGS_FUNCTION_ID);
 	if (_is_chip_p7(rcfw->res->cctx) && rcfw->res->is_vf) {
 		if (sinfo->vf_valid)
@@ -1245,7 +1350,7 @@ int bnxt_qplib_qext_stat(struct bnxt_qplib_rcfw *rcfw, u32 fid,
 		req.function_id = cpu_to_le32(fid);
 	}
 
-	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, &sbuf, sizeof(req),
+	bnxt_qplib_fill_cmdqmsg(&msg, &req, &resp, sbuf, sizeof(req),
 				sizeof(resp), 0);
 	rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
 	if (rc)
@@ -1282,7 +1387,6 @@ int bnxt_qplib_qext_stat(struct bnxt_qplib_rcfw *rcfw, u32 fid,
 	estat->rx_dcn_payload_cut = le64_to_cpu(sb->rx_dcn_payload_cut);
 	estat->te_bypassed = le64_to_cpu(sb->te_bypassed);
 bail:
-	dma_free_coherent(&rcfw->pdev->dev, sbuf.size,
-				  sbuf.sb, sbuf.dma_addr);
+	bnxt_qplib_rcfw_free_sbuf(rcfw, sbuf);
 	return rc;
 }
@@ -462,6 +462,10 @@ int bnxt_qplib_set_link_aggr_mode(struct bnxt_qplib_res *res,
 int bnxt_qplib_get_roce_error_stats(struct bnxt_qplib_rcfw *rcfw,
 				    struct bnxt_qplib_roce_stats *stats,
 				    struct bnxt_qplib_query_stats_info *sinfo);
+int bnxt_qplib_get_roce_error_stats_bulk(struct bnxt_qplib_rcfw *rcfw,
+					 struct bnxt_qplib_roce_stats *stats,
+					 struct bnxt_qplib_query_stats_info *sinfo,
+					 int *rcs, int num);
 int bnxt_qplib_qext_stat(struct bnxt_qplib_rcfw *rcfw, u32 fid,
 			 struct bnxt_qplib_ext_stat *estat,
 			 struct bnxt_qplib_query_stats_info *sinfo);
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2015-2024, Broadcom. All rights reserved.  The term
+ * Broadcom refers to Broadcom Inc. and/or its subsidiaries.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Description: Fast path and CREQ tracepoints
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bnxt_re
+
+#if !defined(__BNXT_QPLIB_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __BNXT_QPLIB_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(bnxt_qplib_post_send,
+	TP_PROTO(const struct bnxt_qplib_qp *qp,
+		 const struct bnxt_qplib_swq *swq, u32 wqe_idx),
+	TP_ARGS(qp, swq, wqe_idx),
+	TP_STRUCT__entry(
+		__field(u32, qp_id)
+		__field(u32, wqe_idx)
+		__field(u64, wr_id)
+		__field(u8, type)
+		__field(u8, flags)
+		__field(u8, slots)
+		__field(u32, psn)
+		__field(u32, prod)
+	),
+	TP_fast_assign(
+		__entry->qp_id = qp->id;
+		__entry->wqe_idx = wqe_idx;
+		__entry->wr_id = swq->wr_id;
+		__entry->type = swq->type;
+		__entry->flags = swq->flags;
+		__entry->slots = swq->slots;
+		__entry->psn = swq->start_psn;
+		__entry->prod = qp->sq.hwq.prod;
+	),
+	TP_printk("qp=0x%x wqe_idx=%u wr_id=0x%llx type=0x%x flags=0x%x slots=%u psn=0x%x prod=0x%x",
+		  __entry->qp_id, __entry->wqe_idx, __entry->wr_id,
+		  __entry->type, __entry->flags, __entry->slots,
+		  __entry->psn, __entry->prod)
+);
+
+TRACE_EVENT(bnxt_qplib_post_recv,
+	TP_PROTO(const struct bnxt_qplib_qp *qp,
+		 const struct bnxt_qplib_swq *swq, u32 wqe_idx),
+	TP_ARGS(qp, swq, wqe_idx),
+	TP_STRUCT__entry(
+		__field(u32, qp_id)
+		__field(u32, wqe_idx)
+		__field(u64, wr_id)
+		__field(u8, slots)
+		__field(u32, prod)
+	),
+	TP_fast_assign(
+		__entry->qp_id = qp->id;
+		__entry->wqe_idx = wqe_idx;
+		__entry->wr_id = swq->wr_id;
+		__entry->slots = swq->slots;
+		__entry->prod = qp->rq.hwq.prod;
+	),
+	TP_printk("qp=0x%x wqe_idx=%u wr_id=0x%llx slots=%u prod=0x%x",
+		  __entry->qp_id, __entry->wqe_idx, __entry->wr_id,
+		  __entry->slots, __entry->prod)
+);
+
+TRACE_EVENT(bnxt_qplib_poll_cqe,
+	TP_PROTO(const struct bnxt_qplib_cq *cq,
+		 const struct bnxt_qplib_qp *qp,
+		 u64 wr_id, u8 type, u8 opcode, u8 status),
+	TP_ARGS(cq, qp, wr_id, type, opcode, status),
+	TP_STRUCT__entry(
+		__field(u32, cq_id)
+		__field(u32, qp_id)
+		__field(u64, wr_id)
+		__field(u8, type)
+		__field(u8, opcode)
+		__field(u8, status)
+	),
+	TP_fast_assign(
+		__entry->cq_id = cq->id;
+		__entry->qp_id = qp->id;
+		__entry->wr_id = wr_id;
+		__entry->type = type;
+		__entry->opcode = opcode;
+		__entry->status = status;
+	),
+	TP_printk("cq=0x%x qp=0x%x wr_id=0x%llx type=0x%x opcode=0x%x status=0x%x",
+		  __entry->cq_id, __entry->qp_id, __entry->wr_id,
+		  __entry->type, __entry->opcode, __entry->status)
+);
+
+TRACE_EVENT(bnxt_qplib_ring_db,
+	TP_PROTO(const struct bnxt_qplib_db_info *info, u32 type),
+	TP_ARGS(info, type),
+	TP_STRUCT__entry(
+		__field(u32, xid)
+		__field(u32, type)
+		__field(u32, prod)
+		__field(u32, cons)
+	),
+	TP_fast_assign(
+		__entry->xid = info->xid;
+		__entry->type = type;
+		__entry->prod = info->hwq->prod;
+		__entry->cons = info->hwq->cons;
+	),
+	TP_printk("xid=0x%x type=0x%x prod=0x%x cons=0x%x",
+		  __entry->xid, __entry->type, __entry->prod, __entry->cons)
+);
+
+TRACE_EVENT(bnxt_qplib_nq_event,
+	TP_PROTO(const struct bnxt_qplib_nq *nq, u32 type, u64 handle),
+	TP_ARGS(nq, type, handle),
+	TP_STRUCT__entry(
+		__field(u16, ring_id)
+		__field(u32, type)
+		__field(u64, handle)
+	),
+	TP_fast_assign(
+		__entry->ring_id = nq->ring_id;
+		__entry->type = type;
+		__entry->handle = handle;
+	),
+	TP_printk("nq=%u type=0x%x handle=0x%llx",
+		  __entry->ring_id, __entry->type, __entry->handle)
+);
+
+TRACE_EVENT(bnxt_qplib_nq_service,
+	TP_PROTO(const struct bnxt_qplib_nq *nq, int budget, u32 polled,
+		 bool more),
+	TP_ARGS(nq, budget, polled, more),
+	TP_STRUCT__entry(
+		__field(u16, ring_id)
+		__field(int, budget)
+		__field(u32, polled)
+		__field(bool, more)
+	),
+	TP_fast_assign(
+		__entry->ring_id = nq->ring_id;
+		__entry->budget = budget;
+		__entry->polled = polled;
+		__entry->more = more;
+	),
+	TP_printk("nq=%u budget=%d polled=%u more=%d",
+		  __entry->ring_id, __entry->budget, __entry->polled,
+		  __entry->more)
+);
+
+TRACE_EVENT(bnxt_qplib_creq_event,
+	TP_PROTO(const struct creq_base *creqe),
+	TP_ARGS(creqe),
+	TP_STRUCT__entry(
+		__field(u8, type)
+		__field(u8, event)
+	),
+	TP_fast_assign(
+		__entry->type = creqe->type & CREQ_BASE_TYPE_MASK;
+		__entry->event = creqe->event;
+	),
+	TP_printk("type=0x%x event=0x%x", __entry->type, __entry->event)
+);
+
+TRACE_EVENT(bnxt_qplib_creq_service,
+	TP_PROTO(u32 polled, bool armed),
+	TP_ARGS(polled, armed),
+	TP_STRUCT__entry(
+		__field(u32, polled)
+		__field(bool, armed)
+	),
+	TP_fast_assign(
+		__entry->polled = polled;
+		__entry->armed = armed;
+	),
+	TP_printk("polled=%u armed=%d", __entry->polled, __entry->armed)
+);
+
+#endif /* __BNXT_QPLIB_TRACE_H__ */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE qplib_trace
+#include <trace/define_trace.h>
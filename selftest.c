@@ -0,0 +1,1576 @@
+/*
+ * Copyright (c) 2015-2024, Broadcom. All rights reserved.  The term
+ * Broadcom refers to Broadcom Inc. and/or its subsidiaries.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Description: Fast path self tests and microbenchmarks
+ */
+
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/perf_event.h>
+#include <linux/workqueue.h>
+
+#include "bnxt_re.h"
+#include "selftest.h"
+
+#ifdef CONFIG_BNXT_RE_SELFTEST
+
+#define BNXT_RE_ST_LOG_SIZE	PAGE_SIZE
+#define BNXT_RE_ST_QPN		0xfffff
+#define BNXT_RE_ST_SQ_MAX_SGE	6
+
+/* Serializes test runs and the report buffers */
+static DEFINE_MUTEX(bnxt_re_st_mutex);
+
+struct bnxt_re_st_log {
+	char	*buf;
+	size_t	len;
+};
+
+struct bnxt_re_selftest {
+	const char	*name;
+	const char	*usage;
+	int		(*run)(struct bnxt_re_dev *rdev, char *args,
+			       struct bnxt_re_st_log *log);
+};
+
+static __printf(2, 3)
+void bnxt_re_st_printf(struct bnxt_re_st_log *log, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	log->len += vscnprintf(log->buf + log->len,
+			       BNXT_RE_ST_LOG_SIZE - log->len, fmt, args);
+	va_end(args);
+}
+
+/*
+ * A kernel CQ in host memory plus an RC QP that never reaches the HW.
+ * The test writes CQEs into the ring the way the chip would and then
+ * polls them back through the verbs layer, so everything between the
+ * CQE valid bit and the ib_wc is exercised without any traffic.
+ */
+struct bnxt_re_st_cq {
+	struct bnxt_re_cq	cq;
+	struct bnxt_re_qp	qp;
+	u32			depth;
+	u32			nswqe;
+};
+
+static void bnxt_re_st_cq_free(struct bnxt_re_dev *rdev,
+			       struct bnxt_re_st_cq *st)
+{
+	bnxt_qplib_free_hwq(&rdev->qplib_res, &st->cq.qplib_cq.hwq);
+	kfree(st->cq.cql);
+	kfree(st->qp.qplib_qp.sq.swq);
+	kfree(st->qp.qplib_qp.rq.swq);
+	kfree(st);
+}
+
+static int bnxt_re_st_q_init(struct bnxt_qplib_q *q, u32 nswqe)
+{
+	u32 i;
+
+	q->swq = kcalloc(nswqe, sizeof(*q->swq), GFP_KERNEL);
+	if (!q->swq)
+		return -ENOMEM;
+	q->max_wqe = nswqe;
+	q->max_sw_wqe = nswqe;
+	q->hwq.depth = nswqe;
+	for (i = 0; i < nswqe; i++) {
+		q->swq[i].wr_id = i;
+		q->swq[i].type = BNXT_QPLIB_SWQE_TYPE_SEND;
+		q->swq[i].flags = SQ_SEND_FLAGS_SIGNAL_COMP;
+		q->swq[i].slots = 1;
+		q->swq[i].next_idx = (i + 1) % nswqe;
+		q->swq[i].push_slot = BNXT_QPLIB_PUSH_SLOT_NONE;
+	}
+	return 0;
+}
+
+static struct bnxt_re_st_cq *bnxt_re_st_cq_alloc(struct bnxt_re_dev *rdev,
+						 u32 ncqe, u32 budget)
+{
+	struct bnxt_qplib_hwq_attr hwq_attr = {};
+	struct bnxt_qplib_cq *qcq;
+	struct bnxt_re_st_cq *st;
+	int rc;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return NULL;
+	/* One spare slot keeps the entry after the last CQE invalid */
+	st->depth = roundup_pow_of_two(ncqe + 1);
+	st->nswqe = ncqe + 1;
+
+	st->cq.rdev = rdev;
+	spin_lock_init(&st->cq.cq_lock);
+	st->cq.max_cql = budget;
+	st->cq.cql = kcalloc(budget, sizeof(*st->cq.cql), GFP_KERNEL);
+	if (!st->cq.cql)
+		goto fail;
+
+	qcq = &st->cq.qplib_cq;
+	qcq->max_wqe = st->depth;
+	qcq->sginfo.pgsize = PAGE_SIZE;
+	qcq->sginfo.pgshft = PAGE_SHIFT;
+	qcq->fp_lock = &st->cq.cq_lock;
+	/* Never ring the consumer doorbell of a CQ the chip does not own */
+	qcq->db_thresh = U32_MAX;
+	spin_lock_init(&qcq->flush_lock);
+	INIT_LIST_HEAD(&qcq->sqf_head);
+	INIT_LIST_HEAD(&qcq->rqf_head);
+	hwq_attr.res = &rdev->qplib_res;
+	hwq_attr.depth = st->depth;
+	hwq_attr.stride = sizeof(struct cq_base);
+	hwq_attr.type = HWQ_TYPE_QUEUE;
+	hwq_attr.sginfo = &qcq->sginfo;
+	rc = bnxt_qplib_alloc_init_hwq(&qcq->hwq, &hwq_attr);
+	if (rc)
+		goto fail;
+
+	st->qp.rdev = rdev;
+	st->qp.scq = &st->cq;
+	st->qp.rcq = &st->cq;
+	st->qp.qplib_qp.id = BNXT_RE_ST_QPN;
+	st->qp.qplib_qp.type = CMDQ_CREATE_QP_TYPE_RC;
+	st->qp.qplib_qp.cctx = rdev->chip_ctx;
+	st->qp.qplib_qp.scq = qcq;
+	st->qp.qplib_qp.rcq = qcq;
+	if (bnxt_re_st_q_init(&st->qp.qplib_qp.sq, st->nswqe) ||
+	    bnxt_re_st_q_init(&st->qp.qplib_qp.rq, st->nswqe))
+		goto fail;
+	return st;
+fail:
+	bnxt_re_st_cq_free(rdev, st);
+	return NULL;
+}
+
+/*
+ * Rewind the CQ and both work queues and post @ncqe completions,
+ * alternating SQ (REQ) and RQ (RES_RC) CQEs with the phase the CQ
+ * expects for its first pass.
+ */
+static void bnxt_re_st_cq_fill(struct bnxt_re_st_cq *st, u32 ncqe)
+{
+	struct bnxt_qplib_qp *qp = &st->qp.qplib_qp;
+	struct bnxt_qplib_cq *qcq = &st->cq.qplib_cq;
+	u32 i, sq_cons = 0, rq_idx = 0;
+	struct cq_res_rc *rc;
+	struct cq_req *req;
+
+	qcq->hwq.cons = 0;
+	qcq->dbinfo.flags = 0;
+	qcq->db_pending = 0;
+	qp->sq.swq_last = 0;
+	qp->sq.hwq.cons = 0;
+	qp->rq.swq_last = 0;
+	qp->rq.hwq.cons = 0;
+
+	for (i = 0; i < st->depth; i++) {
+		req = bnxt_qplib_get_qe(&qcq->hwq, i, NULL);
+		memset(req, 0, sizeof(struct cq_base));
+		if (i >= ncqe)
+			continue;
+		if (i & 1) {
+			rc = (struct cq_res_rc *)req;
+			rc->length = cpu_to_le32(64);
+			rc->qp_handle = cpu_to_le64((unsigned long)qp);
+			rc->srq_or_rq_wr_id = cpu_to_le32(rq_idx++);
+			rc->cqe_type_toggle = CQ_BASE_CQE_TYPE_RES_RC |
+					      CQ_BASE_TOGGLE;
+		} else {
+			req->qp_handle = cpu_to_le64((unsigned long)qp);
+			req->sq_cons_idx = cpu_to_le16(++sq_cons);
+			req->cqe_type_toggle = CQ_BASE_CQE_TYPE_REQ |
+					       CQ_BASE_TOGGLE;
+		}
+	}
+	/* CQEs must be visible before the valid bits are polled */
+	wmb();
+}
+
+/* Drain the CQ @budget entries at a time; returns the time taken */
+static u64 bnxt_re_st_cq_drain(struct bnxt_re_st_cq *st, struct ib_wc *wc,
+			       u32 budget, bool direct, u32 *polled)
+{
+	unsigned long flags;
+	u64 start, end;
+	int n;
+
+	*polled = 0;
+	spin_lock_irqsave(&st->cq.cq_lock, flags);
+	start = ktime_get_ns();
+	do {
+		n = __bnxt_re_poll_cq(&st->cq, budget, wc + *polled, direct);
+		*polled += n;
+	} while (n);
+	end = ktime_get_ns();
+	spin_unlock_irqrestore(&st->cq.cq_lock, flags);
+	return end - start;
+}
+
+static bool bnxt_re_st_wc_equal(struct ib_wc *a, struct ib_wc *b)
+{
+	return a->wr_id == b->wr_id && a->status == b->status &&
+	       a->opcode == b->opcode && a->byte_len == b->byte_len &&
+	       a->wc_flags == b->wc_flags && a->src_qp == b->src_qp &&
+	       a->qp == b->qp && a->vendor_err == b->vendor_err;
+}
+
+/*
+ * poll_cq [<cqes> [<budget> [<rounds>]]]
+ * Time draining <cqes> completions through the staged (CQL) poll and
+ * the direct poll, and check both report the same work completions.
+ */
+static int bnxt_re_st_poll_cq(struct bnxt_re_dev *rdev, char *args,
+			      struct bnxt_re_st_log *log)
+{
+	u32 ncqe = 4096, budget = 16, rounds = 64;
+	u64 ns[2] = {}, per_cqe;
+	struct bnxt_re_st_cq *st;
+	struct ib_wc *wc[2];
+	u32 i, r, polled;
+	int mode, rc = 0;
+
+	sscanf(args, "%u %u %u", &ncqe, &budget, &rounds);
+	if (!ncqe || ncqe > 65536 || !budget || budget > ncqe ||
+	    !rounds || rounds > 4096)
+		return -EINVAL;
+	/* The legacy chips need the WA 9060 phantom WQE handshake */
+	if (!_is_chip_gen_p5_p7(rdev->chip_ctx))
+		return -EOPNOTSUPP;
+
+	st = bnxt_re_st_cq_alloc(rdev, ncqe, budget);
+	wc[0] = vzalloc(ncqe * sizeof(struct ib_wc));
+	wc[1] = vzalloc(ncqe * sizeof(struct ib_wc));
+	if (!st || !wc[0] || !wc[1]) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	for (r = 0; r < rounds; r++) {
+		for (mode = 0; mode < 2; mode++) {
+			bnxt_re_st_cq_fill(st, ncqe);
+			ns[mode] += bnxt_re_st_cq_drain(st, wc[mode], budget,
+							mode, &polled);
+			if (polled != ncqe) {
+				bnxt_re_st_printf(log,
+						  "%s poll: %u of %u completions\n",
+						  mode ? "direct" : "staged",
+						  polled, ncqe);
+				rc = -EIO;
+				goto out;
+			}
+		}
+	}
+
+	for (i = 0; i < ncqe; i++) {
+		if (wc[1][i].wr_id != i / 2 ||
+		    !bnxt_re_st_wc_equal(&wc[0][i], &wc[1][i])) {
+			bnxt_re_st_printf(log,
+					  "wc %u mismatch: staged wr_id %llu opcode %d direct wr_id %llu opcode %d\n",
+					  i, wc[0][i].wr_id, wc[0][i].opcode,
+					  wc[1][i].wr_id, wc[1][i].opcode);
+			rc = -EIO;
+			goto out;
+		}
+	}
+
+	bnxt_re_st_printf(log, "cqes %u budget %u rounds %u\n",
+			  ncqe, budget, rounds);
+	for (mode = 0; mode < 2; mode++) {
+		per_cqe = div_u64(ns[mode] * 1000, (u64)ncqe * rounds);
+		bnxt_re_st_printf(log, "%-6s %llu.%03llu ns/cqe\n",
+				  mode ? "direct" : "staged",
+				  div_u64(per_cqe, 1000), per_cqe % 1000);
+	}
+out:
+	vfree(wc[1]);
+	vfree(wc[0]);
+	if (st)
+		bnxt_re_st_cq_free(rdev, st);
+	return rc;
+}
+
+/*
+ * cq_prefetch [<k> [<budget>]]
+ * Sweep CQ depths 64..64K and time a full drain with no lookahead and
+ * with a lookahead of <k> CQEs, about 1M CQEs per depth and setting.
+ */
+static int bnxt_re_st_cq_prefetch(struct bnxt_re_dev *rdev, char *args,
+				  struct bnxt_re_st_log *log)
+{
+	u32 k = 8, budget = 16, depth, ncqe, rounds, r, polled, pf;
+	u64 ns[2], per_cqe;
+	struct bnxt_re_st_cq *st;
+	struct ib_wc *wc;
+	int rc = 0;
+	int mode;
+
+	sscanf(args, "%u %u", &k, &budget);
+	if (!k || k > BNXT_RE_CQ_PREFETCH_MAX || !budget || budget > 63)
+		return -EINVAL;
+	if (!_is_chip_gen_p5_p7(rdev->chip_ctx))
+		return -EOPNOTSUPP;
+
+	wc = vzalloc(65536 * sizeof(struct ib_wc));
+	if (!wc)
+		return -ENOMEM;
+
+	for (depth = 64; depth <= 65536; depth *= 4) {
+		ncqe = depth - 1;
+		rounds = max_t(u32, 1, (1 << 20) / ncqe);
+		st = bnxt_re_st_cq_alloc(rdev, ncqe, budget);
+		if (!st) {
+			rc = -ENOMEM;
+			break;
+		}
+		ns[0] = 0;
+		ns[1] = 0;
+		for (r = 0; r < rounds && !rc; r++) {
+			for (mode = 0; mode < 2; mode++) {
+				pf = mode ? min_t(u32, k, st->depth - 1) : 0;
+				st->cq.qplib_cq.prefetch = pf;
+				bnxt_re_st_cq_fill(st, ncqe);
+				ns[mode] += bnxt_re_st_cq_drain(st, wc, budget,
+								false, &polled);
+				if (polled != ncqe) {
+					bnxt_re_st_printf(log,
+							  "depth %u k %u: %u of %u completions\n",
+							  depth, pf, polled, ncqe);
+					rc = -EIO;
+					break;
+				}
+			}
+		}
+		bnxt_re_st_cq_free(rdev, st);
+		if (rc)
+			break;
+		for (mode = 0; mode < 2; mode++) {
+			per_cqe = div_u64(ns[mode] * 1000, (u64)ncqe * rounds);
+			bnxt_re_st_printf(log,
+					  "depth %5u k %2u %llu.%03llu ns/cqe\n",
+					  depth, mode ? k : 0,
+					  div_u64(per_cqe, 1000), per_cqe % 1000);
+		}
+	}
+	vfree(wc);
+	return rc;
+}
+
+static u64 bnxt_re_st_get_qe_walk(struct bnxt_qplib_hwq *hwq, u32 rounds,
+				  unsigned long *sum)
+{
+	unsigned long acc = 0;
+	u64 start;
+	u32 r, i;
+
+	start = ktime_get_ns();
+	for (r = 0; r < rounds; r++)
+		for (i = 0; i < hwq->depth; i++)
+			acc += (unsigned long)bnxt_qplib_get_qe(hwq, i, NULL);
+	*sum = acc;
+	return ktime_get_ns() - start;
+}
+
+/*
+ * get_qe [<depth> [<rounds>]]
+ * Allocate a kernel ring of <depth> CQE sized slots, check that the
+ * linear lookup agrees with the PBL walk for every slot and time both.
+ */
+static int bnxt_re_st_get_qe(struct bnxt_re_dev *rdev, char *args,
+			     struct bnxt_re_st_log *log)
+{
+	struct bnxt_qplib_hwq_attr hwq_attr = {};
+	struct bnxt_qplib_sg_info sginfo = {};
+	u32 depth = 4096, rounds = 256, i;
+	struct bnxt_qplib_hwq hwq = {};
+	unsigned long sum[2];
+	u64 ns[2], per_qe;
+	void *base, *qe;
+	int mode, rc;
+
+	sscanf(args, "%u %u", &depth, &rounds);
+	if (!depth || depth > 65536 || !rounds || rounds > 4096)
+		return -EINVAL;
+
+	sginfo.pgsize = PAGE_SIZE;
+	sginfo.pgshft = PAGE_SHIFT;
+	hwq_attr.res = &rdev->qplib_res;
+	hwq_attr.depth = depth;
+	hwq_attr.stride = sizeof(struct cq_base);
+	hwq_attr.type = HWQ_TYPE_QUEUE;
+	hwq_attr.sginfo = &sginfo;
+	rc = bnxt_qplib_alloc_init_hwq(&hwq, &hwq_attr);
+	if (rc)
+		return rc;
+
+	bnxt_re_st_printf(log, "depth %u pages %u level %u mode %s\n",
+			  hwq.depth, hwq.pbl[PBL_LVL_0].pg_count, hwq.level,
+			  bnxt_qplib_hwq_mode_str(&hwq));
+	base = hwq.qe_base;
+	if (!base) {
+		ns[1] = bnxt_re_st_get_qe_walk(&hwq, rounds, &sum[1]);
+		per_qe = div_u64(ns[1] * 1000, (u64)hwq.depth * rounds);
+		bnxt_re_st_printf(log, "pbl    %llu.%03llu ns/qe\n",
+				  div_u64(per_qe, 1000), per_qe % 1000);
+		goto out;
+	}
+
+	for (i = 0; i < hwq.depth; i++) {
+		qe = bnxt_qplib_get_qe(&hwq, i, NULL);
+		hwq.qe_base = NULL;
+		if (qe != bnxt_qplib_get_qe(&hwq, i, NULL)) {
+			bnxt_re_st_printf(log, "slot %u: linear %p pbl %p\n",
+					  i, qe, bnxt_qplib_get_qe(&hwq, i, NULL));
+			rc = -EIO;
+		}
+		hwq.qe_base = base;
+		if (rc)
+			goto out;
+	}
+
+	/* Same ring both times, only the lookup differs */
+	for (mode = 0; mode < 2; mode++) {
+		hwq.qe_base = mode ? NULL : base;
+		ns[mode] = bnxt_re_st_get_qe_walk(&hwq, rounds, &sum[mode]);
+	}
+	hwq.qe_base = base;
+	if (sum[0] != sum[1]) {
+		bnxt_re_st_printf(log, "linear and pbl walks differ\n");
+		rc = -EIO;
+		goto out;
+	}
+	for (mode = 0; mode < 2; mode++) {
+		per_qe = div_u64(ns[mode] * 1000, (u64)hwq.depth * rounds);
+		bnxt_re_st_printf(log, "%-6s %llu.%03llu ns/qe\n",
+				  mode ? "pbl" : "linear",
+				  div_u64(per_qe, 1000), per_qe % 1000);
+	}
+out:
+	bnxt_qplib_free_hwq(&rdev->qplib_res, &hwq);
+	return rc;
+}
+
+static void bnxt_re_st_prep_query_version(struct bnxt_qplib_cmdqmsg *msg,
+					  struct cmdq_query_version *req,
+					  struct creq_query_version_resp *resp)
+{
+	memset(msg, 0, sizeof(*msg));
+	bnxt_qplib_rcfw_cmd_prep(req, CMDQ_BASE_OPCODE_QUERY_VERSION,
+				 sizeof(*req));
+	bnxt_qplib_fill_cmdqmsg(msg, req, resp, NULL, sizeof(*req),
+				sizeof(*resp), 0);
+}
+
+static void bnxt_re_st_print_rate(struct bnxt_re_st_log *log,
+				  const char *mode, u32 ncmd, u64 ns, u64 dbs)
+{
+	bnxt_re_st_printf(log, "%-6s %llu cmds/s %llu doorbells\n", mode,
+			  div64_u64((u64)ncmd * NSEC_PER_SEC, max_t(u64, ns, 1)),
+			  dbs);
+}
+
+/*
+ * rcfw_batch [<cmds>]
+ * Send <cmds> QUERY_VERSION commands to firmware one at a time and then
+ * as one async batch sharing doorbells, and report commands per second.
+ * QUERY_VERSION has no side effects, so this is safe on a live device.
+ */
+static int bnxt_re_st_rcfw_batch(struct bnxt_re_dev *rdev, char *args,
+				 struct bnxt_re_st_log *log)
+{
+	struct bnxt_qplib_rcfw *rcfw = &rdev->rcfw;
+	struct creq_query_version_resp resp;
+	struct bnxt_qplib_rcfw_batch batch;
+	struct cmdq_query_version req;
+	struct bnxt_qplib_cmdqmsg msg;
+	u64 start, ns, dbs;
+	u32 ncmd = 1024, i;
+	int rc = 0, wait_rc;
+
+	sscanf(args, "%u", &ncmd);
+	if (!ncmd || ncmd > 65536)
+		return -EINVAL;
+
+	start = ktime_get_ns();
+	for (i = 0; i < ncmd; i++) {
+		bnxt_re_st_prep_query_version(&msg, &req, &resp);
+		rc = bnxt_qplib_rcfw_send_message(rcfw, &msg);
+		if (rc)
+			return rc;
+	}
+	bnxt_re_st_print_rate(log, "sync", ncmd, ktime_get_ns() - start,
+			      ncmd);
+
+	dbs = rcfw->bulk_db_count;
+	bnxt_qplib_rcfw_batch_init(&batch);
+	start = ktime_get_ns();
+	for (i = 0; i < ncmd && !rc; i++) {
+		/* Copied into the CMDQ, the stack copy can be reused */
+		bnxt_re_st_prep_query_version(&msg, &req, NULL);
+		rc = bnxt_qplib_rcfw_batch_submit(rcfw, &batch, &msg);
+	}
+	/* Always wait, it drops the bias taken by batch_init */
+	wait_rc = bnxt_qplib_rcfw_batch_wait(rcfw, &batch);
+	ns = ktime_get_ns() - start;
+	if (rc || wait_rc)
+		return rc ? rc : wait_rc;
+	bnxt_re_st_print_rate(log, "batch", ncmd, ns,
+			      rcfw->bulk_db_count - dbs);
+
+	return 0;
+}
+
+/*
+ * Deferred doorbells must reach firmware even when their sender blocks
+ * for a shadow queue slot before it ever calls batch_wait: the slots it
+ * waits for are held by its own unrung commands. Submit <cmds> deferred
+ * QUERY_VERSIONs, several shadow queue depths' worth, without waiting.
+ */
+static int bnxt_re_st_rcfw_defer_flush(struct bnxt_re_dev *rdev, u32 ncmd,
+				       struct bnxt_re_st_log *log)
+{
+	struct bnxt_qplib_rcfw_lane_stats *stats;
+	struct bnxt_qplib_rcfw *rcfw = &rdev->rcfw;
+	struct bnxt_qplib_rcfw_batch batch;
+	struct cmdq_query_version req;
+	struct bnxt_qplib_cmdqmsg msg;
+	u64 waited, dbs, start, ns;
+	int rc = 0, wait_rc;
+	u32 i;
+
+	stats = &rcfw->lane_stats[BNXT_QPLIB_RCFW_LANE_CRIT];
+	waited = atomic64_read(&stats->waited);
+	dbs = rcfw->bulk_db_count;
+	bnxt_qplib_rcfw_batch_init(&batch);
+	start = ktime_get_ns();
+	for (i = 0; i < ncmd && !rc; i++) {
+		bnxt_re_st_prep_query_version(&msg, &req, NULL);
+		rc = bnxt_qplib_rcfw_batch_submit(rcfw, &batch, &msg);
+	}
+	/* Rung before batch_wait, by the sender waiting for its slots */
+	dbs = rcfw->bulk_db_count - dbs;
+	wait_rc = bnxt_qplib_rcfw_batch_wait(rcfw, &batch);
+	ns = ktime_get_ns() - start;
+	waited = atomic64_read(&stats->waited) - waited;
+	bnxt_re_st_printf(log,
+			  "defer  %u cmds shadow qd %u: %llu slot waits, %llu doorbells flushed by waiters, %llu us\n",
+			  i, rcfw->curr_shadow_qd, waited, dbs,
+			  div_u64(ns, NSEC_PER_USEC));
+	if (rc || wait_rc)
+		return rc ? rc : wait_rc;
+	/* A sender that slept on a slot must have rung its own commands */
+	if (waited && !dbs)
+		return -EIO;
+	return 0;
+}
+
+/*
+ * Move <qps> kernel RC QPs from INIT to ERR with one MODIFY_QP batch,
+ * as bnxt_re_stop_user_qps_nonfatal() does, and check each QP's state
+ * in firmware afterwards.
+ */
+static int bnxt_re_st_rcfw_err_batch(struct bnxt_re_dev *rdev, u32 nqp,
+				     struct bnxt_re_st_log *log)
+{
+	struct ib_qp_init_attr init_attr = {};
+	struct bnxt_qplib_rcfw_batch batch;
+	struct bnxt_qplib_qp *qpl_qp, *tmp;
+	struct ib_qp_attr attr = {};
+	struct ib_qp **qps = NULL;
+	struct ib_cq *cq = NULL;
+	struct ib_pd *pd;
+	u32 i, made = 0, in_err = 0;
+	int rc = 0, wait_rc;
+	u64 start, ns;
+
+	tmp = kzalloc(sizeof(*tmp), GFP_KERNEL);
+	qps = kcalloc(nqp, sizeof(*qps), GFP_KERNEL);
+	if (!tmp || !qps) {
+		rc = -ENOMEM;
+		goto free;
+	}
+	pd = ib_alloc_pd(&rdev->ibdev, 0);
+	if (IS_ERR(pd)) {
+		rc = PTR_ERR(pd);
+		goto free;
+	}
+	cq = ib_alloc_cq(&rdev->ibdev, NULL, 64, 0, IB_POLL_DIRECT);
+	if (IS_ERR(cq)) {
+		rc = PTR_ERR(cq);
+		cq = NULL;
+		goto dealloc_pd;
+	}
+
+	init_attr.send_cq = cq;
+	init_attr.recv_cq = cq;
+	init_attr.cap.max_send_wr = 16;
+	init_attr.cap.max_recv_wr = 16;
+	init_attr.cap.max_send_sge = 1;
+	init_attr.cap.max_recv_sge = 1;
+	init_attr.sq_sig_type = IB_SIGNAL_REQ_WR;
+	init_attr.qp_type = IB_QPT_RC;
+	attr.qp_state = IB_QPS_INIT;
+	attr.port_num = 1;
+	for (made = 0; made < nqp; made++) {
+		qps[made] = ib_create_qp(pd, &init_attr);
+		if (IS_ERR(qps[made])) {
+			rc = PTR_ERR(qps[made]);
+			break;
+		}
+		rc = ib_modify_qp(qps[made], &attr,
+				  IB_QP_STATE | IB_QP_PKEY_INDEX |
+				  IB_QP_PORT | IB_QP_ACCESS_FLAGS);
+		if (rc) {
+			made++;
+			break;
+		}
+	}
+	if (rc)
+		goto destroy;
+
+	bnxt_qplib_rcfw_batch_init(&batch);
+	start = ktime_get_ns();
+	for (i = 0; i < nqp && !rc; i++) {
+		qpl_qp = &to_bnxt_re(qps[i], struct bnxt_re_qp, ib_qp)->qplib_qp;
+		rc = bnxt_qplib_modify_qp_err_async(&rdev->qplib_res, qpl_qp,
+						    &batch);
+	}
+	wait_rc = bnxt_qplib_rcfw_batch_wait(&rdev->rcfw, &batch);
+	ns = ktime_get_ns() - start;
+	if (rc || wait_rc) {
+		rc = rc ? rc : wait_rc;
+		goto destroy;
+	}
+
+	for (i = 0; i < nqp; i++) {
+		qpl_qp = &to_bnxt_re(qps[i], struct bnxt_re_qp, ib_qp)->qplib_qp;
+		qpl_qp->state = CMDQ_MODIFY_QP_NEW_STATE_ERR;
+		qpl_qp->cur_qp_state = CMDQ_MODIFY_QP_NEW_STATE_ERR;
+		memset(tmp, 0, sizeof(*tmp));
+		tmp->id = qpl_qp->id;
+		if (!bnxt_qplib_query_qp(&rdev->qplib_res, tmp) &&
+		    tmp->state == CMDQ_MODIFY_QP_NEW_STATE_ERR)
+			in_err++;
+	}
+	bnxt_re_st_printf(log, "err    %u qps batched to ERR, %u in ERR in FW, %llu us\n",
+			  nqp, in_err, div_u64(ns, NSEC_PER_USEC));
+	if (in_err != nqp)
+		rc = -EIO;
+destroy:
+	while (made--)
+		if (!IS_ERR(qps[made]))
+			ib_destroy_qp(qps[made]);
+	if (cq)
+		ib_free_cq(cq);
+dealloc_pd:
+	ib_dealloc_pd(pd);
+free:
+	kfree(qps);
+	kfree(tmp);
+	return rc;
+}
+
+/*
+ * rcfw_defer [<cmds> [<qps>]]
+ * Run the deferred doorbell flush check with <cmds> commands (default
+ * four shadow queue depths) and the MODIFY_QP to ERR batch on <qps>
+ * kernel QPs.
+ */
+static int bnxt_re_st_rcfw_defer(struct bnxt_re_dev *rdev, char *args,
+				 struct bnxt_re_st_log *log)
+{
+	u32 ncmd = 4 * rdev->rcfw.curr_shadow_qd, nqp = 64;
+	int rc;
+
+	sscanf(args, "%u %u", &ncmd, &nqp);
+	if (!ncmd || ncmd > 65536 || !nqp || nqp > 1024)
+		return -EINVAL;
+
+	rc = bnxt_re_st_rcfw_defer_flush(rdev, ncmd, log);
+	if (rc)
+		return rc;
+	return bnxt_re_st_rcfw_err_batch(rdev, nqp, log);
+}
+
+struct bnxt_re_st_sender {
+	struct bnxt_qplib_rcfw	*rcfw;
+	struct completion	*start;
+	struct completion	done;
+	u32			ncmd;
+	u64			sum_ns;
+	u64			max_ns;
+	int			rc;
+};
+
+static int bnxt_re_st_sender_fn(void *data)
+{
+	struct bnxt_re_st_sender *snd = data;
+	struct creq_query_version_resp resp;
+	struct cmdq_query_version req;
+	struct bnxt_qplib_cmdqmsg msg;
+	u64 start, ns;
+	u32 i;
+
+	wait_for_completion(snd->start);
+	for (i = 0; i < snd->ncmd; i++) {
+		bnxt_re_st_prep_query_version(&msg, &req, &resp);
+		start = ktime_get_ns();
+		snd->rc = bnxt_qplib_rcfw_send_message(snd->rcfw, &msg);
+		ns = ktime_get_ns() - start;
+		if (snd->rc)
+			break;
+		snd->sum_ns += ns;
+		snd->max_ns = max(snd->max_ns, ns);
+	}
+	complete(&snd->done);
+
+	return 0;
+}
+
+/*
+ * rcfw_contend [<senders> [<cmds>]]
+ * Start <senders> threads that each send <cmds> synchronous
+ * QUERY_VERSION commands at the same time, and report the aggregate
+ * rate and the per command latency every sender saw. Exercises the
+ * per cookie wakeup of __wait_for_resp() under contention.
+ */
+static int bnxt_re_st_rcfw_contend(struct bnxt_re_dev *rdev, char *args,
+				   struct bnxt_re_st_log *log)
+{
+	u32 nsnd = 64, ncmd = 256, started, i;
+	u64 begin, ns, sum_ns = 0, max_ns = 0;
+	struct bnxt_re_st_sender *snd;
+	struct task_struct *task;
+	DECLARE_COMPLETION_ONSTACK(start);
+	int rc = 0;
+
+	sscanf(args, "%u %u", &nsnd, &ncmd);
+	if (!nsnd || nsnd > 1024 || !ncmd || ncmd > 65536)
+		return -EINVAL;
+
+	snd = vzalloc(nsnd * sizeof(*snd));
+	if (!snd)
+		return -ENOMEM;
+
+	for (started = 0; started < nsnd; started++) {
+		snd[started].rcfw = &rdev->rcfw;
+		snd[started].start = &start;
+		snd[started].ncmd = ncmd;
+		init_completion(&snd[started].done);
+		task = kthread_run(bnxt_re_st_sender_fn, &snd[started],
+				   "bnxt_re_st%u", started);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			break;
+		}
+	}
+
+	begin = ktime_get_ns();
+	complete_all(&start);
+	for (i = 0; i < started; i++)
+		wait_for_completion(&snd[i].done);
+	ns = ktime_get_ns() - begin;
+	if (rc)
+		goto out;
+
+	for (i = 0; i < nsnd; i++) {
+		if (snd[i].rc) {
+			rc = snd[i].rc;
+			goto out;
+		}
+		sum_ns += snd[i].sum_ns;
+		max_ns = max(max_ns, snd[i].max_ns);
+	}
+	bnxt_re_st_printf(log, "senders %u cmds %u\n", nsnd, ncmd);
+	bnxt_re_st_printf(log, "%llu cmds/s avg %llu ns max %llu ns\n",
+			  div64_u64((u64)nsnd * ncmd * NSEC_PER_SEC,
+				    max_t(u64, ns, 1)),
+			  div64_u64(sum_ns, (u64)nsnd * ncmd), max_ns);
+out:
+	vfree(snd);
+	return rc;
+}
+
+/*
+ * A doorbell backed by host memory: one writer rings increasing SQ
+ * indices through bnxt_qplib_write_db() while replayers hammer
+ * bnxt_qplib_replay_db() and the monitor checks that the value in the
+ * "register" never goes back.
+ */
+struct bnxt_re_st_db {
+	struct bnxt_qplib_db_info	info;
+	struct bnxt_qplib_res		res;
+	struct completion		*start;
+	u64				*reg;
+	u32				nring;
+	bool				stop;
+};
+
+struct bnxt_re_st_db_thread {
+	struct bnxt_re_st_db	*db;
+	struct completion	done;
+	u64			count;
+};
+
+static int bnxt_re_st_db_writer_fn(void *data)
+{
+	struct bnxt_re_st_db_thread *thr = data;
+	struct bnxt_re_st_db *db = thr->db;
+	u64 key;
+	u32 i;
+
+	wait_for_completion(db->start);
+	for (i = 1; i <= db->nring; i++) {
+		key = BNXT_QPLIB_INIT_DBHDR(db->info.xid, DBC_DBC_TYPE_SQ, i, 0);
+		bnxt_qplib_write_db(&db->info, key, db->info.db,
+				    &db->info.shadow_key);
+		thr->count++;
+	}
+	WRITE_ONCE(db->stop, true);
+	complete(&thr->done);
+
+	return 0;
+}
+
+static int bnxt_re_st_db_replay_fn(void *data)
+{
+	struct bnxt_re_st_db_thread *thr = data;
+	struct bnxt_re_st_db *db = thr->db;
+
+	wait_for_completion(db->start);
+	while (!READ_ONCE(db->stop)) {
+		bnxt_qplib_replay_db(&db->info, false);
+		thr->count++;
+	}
+	complete(&thr->done);
+
+	return 0;
+}
+
+/*
+ * db_replay [<rings> [<replayers>]]
+ * Race <rings> doorbells against <replayers> threads replaying the
+ * same doorbell, as DB drop recovery does, and fail if the doorbell
+ * ever moved to an older index or did not end on the last one.
+ */
+static int bnxt_re_st_db_replay(struct bnxt_re_dev *rdev, char *args,
+				struct bnxt_re_st_log *log)
+{
+	u32 nring = 1 << 20, nrep = 4, started, i, idx, last = 0;
+	struct bnxt_re_st_db_thread *thr;
+	u64 replays = 0, samples = 0, back = 0;
+	DECLARE_COMPLETION_ONSTACK(start);
+	struct task_struct *task;
+	struct bnxt_re_st_db *db;
+	int rc = 0;
+
+	sscanf(args, "%u %u", &nring, &nrep);
+	if (!nring || nring > DBC_DBC_INDEX_MASK || !nrep || nrep > 64)
+		return -EINVAL;
+
+	db = kzalloc(sizeof(*db), GFP_KERNEL);
+	thr = vzalloc((nrep + 1) * sizeof(*thr));
+	if (!db || !thr) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	db->reg = kzalloc(sizeof(*db->reg), GFP_KERNEL);
+	if (!db->reg) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	/* No pacing data and no DB copy, only the shadow key and the write */
+	db->info.res = &db->res;
+	db->info.db = (void __iomem *)db->reg;
+	db->info.xid = BNXT_RE_ST_QPN;
+	bnxt_qplib_init_db_keys(&db->info);
+	db->start = &start;
+	db->nring = nring;
+
+	for (started = 0; started <= nrep; started++) {
+		thr[started].db = db;
+		init_completion(&thr[started].done);
+		task = kthread_run(started ? bnxt_re_st_db_replay_fn :
+					     bnxt_re_st_db_writer_fn,
+				   &thr[started], "bnxt_re_st%u", started);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			WRITE_ONCE(db->stop, true);
+			break;
+		}
+	}
+
+	complete_all(&start);
+	while (!READ_ONCE(db->stop)) {
+		idx = READ_ONCE(*db->reg) & DBC_DBC_INDEX_MASK;
+		if (idx < last)
+			back++;
+		last = idx;
+		samples++;
+		cond_resched();
+	}
+	for (i = 0; i < started; i++)
+		wait_for_completion(&thr[i].done);
+	if (rc)
+		goto out;
+
+	for (i = 1; i <= nrep; i++)
+		replays += thr[i].count;
+	idx = READ_ONCE(*db->reg) & DBC_DBC_INDEX_MASK;
+	bnxt_re_st_printf(log, "rings %u replayers %u replays %llu samples %llu\n",
+			  nring, nrep, replays, samples);
+	if (back || idx != nring) {
+		bnxt_re_st_printf(log, "went back %llu times, ended on %u\n",
+				  back, idx);
+		rc = -EIO;
+	}
+out:
+	if (db)
+		kfree(db->reg);
+	kfree(db);
+	vfree(thr);
+	return rc;
+}
+
+static int bnxt_re_st_cq_depth_check(struct ib_cq *ib_cq, int cqe,
+				     const char *op, struct bnxt_re_st_log *log)
+{
+	struct bnxt_re_cq *cq = to_bnxt_re(ib_cq, struct bnxt_re_cq, ib_cq);
+	struct bnxt_qplib_cq *qcq = &cq->qplib_cq;
+
+	bnxt_re_st_printf(log, "%s cqe %d reported %d depth %u db_thresh %u\n",
+			  op, cqe, ib_cq->cqe, qcq->hwq.max_elements,
+			  qcq->db_thresh);
+	if (ib_cq->cqe < cqe ||
+	    ib_cq->cqe + qcq->db_thresh > qcq->hwq.max_elements)
+		return -EIO;
+	return 0;
+}
+
+/*
+ * cq_depth [<cqe>]
+ * Create a kernel CQ of <cqe> entries with the current cq_db_thresh
+ * knobs and resize it to twice that, checking that the depth reported
+ * to the consumer covers what it asked for and leaves the deferred
+ * doorbell pad out.
+ */
+static int bnxt_re_st_cq_depth(struct bnxt_re_dev *rdev, char *args,
+			       struct bnxt_re_st_log *log)
+{
+	struct ib_cq *ib_cq;
+	int cqe = 1024;
+	int rc;
+
+	sscanf(args, "%d", &cqe);
+	if (cqe < 1 || cqe > rdev->dev_attr->max_cq_wqes / 2)
+		return -EINVAL;
+
+	ib_cq = ib_alloc_cq(&rdev->ibdev, NULL, cqe, 0, IB_POLL_DIRECT);
+	if (IS_ERR(ib_cq))
+		return PTR_ERR(ib_cq);
+	rc = bnxt_re_st_cq_depth_check(ib_cq, cqe, "create", log);
+	if (rc)
+		goto out;
+	rc = ib_resize_cq(ib_cq, cqe * 2);
+	if (rc)
+		goto out;
+	rc = bnxt_re_st_cq_depth_check(ib_cq, cqe * 2, "resize", log);
+out:
+	ib_free_cq(ib_cq);
+	return rc;
+}
+
+/*
+ * An RC QP in RTS whose SQ lives in host memory. WQEs are built into
+ * the ring exactly as for the chip, no doorbell is ever rung.
+ */
+struct bnxt_re_st_sq {
+	struct bnxt_qplib_qp	qp;
+	struct bnxt_qplib_sge	sge[BNXT_RE_ST_SQ_MAX_SGE];
+	struct bnxt_qplib_swqe	wqe;
+	u32			batch;
+};
+
+static void bnxt_re_st_sq_free(struct bnxt_re_dev *rdev,
+			       struct bnxt_re_st_sq *st)
+{
+	bnxt_qplib_free_hwq(&rdev->qplib_res, &st->qp.sq.hwq);
+	kfree(st->qp.sq.swq);
+	kfree(st);
+}
+
+static struct bnxt_re_st_sq *bnxt_re_st_sq_alloc(struct bnxt_re_dev *rdev,
+						 u32 nsge, u32 batch)
+{
+	struct bnxt_qplib_hwq_attr hwq_attr = {};
+	struct bnxt_qplib_q *sq;
+	struct bnxt_re_st_sq *st;
+	u32 i;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return NULL;
+	st->batch = batch;
+	st->qp.id = BNXT_RE_ST_QPN;
+	st->qp.type = CMDQ_CREATE_QP_TYPE_RC;
+	st->qp.state = CMDQ_MODIFY_QP_NEW_STATE_RTS;
+	st->qp.cur_qp_state = CMDQ_MODIFY_QP_NEW_STATE_RTS;
+	st->qp.wqe_mode = BNXT_QPLIB_WQE_MODE_VARIABLE;
+	st->qp.cctx = rdev->chip_ctx;
+	st->qp.mtu = 4096;
+	sq = &st->qp.sq;
+	if (bnxt_re_st_q_init(sq, batch + 1))
+		goto fail;
+	sq->dbinfo.max_slot = 1;
+	sq->dbinfo.hwq = &sq->hwq;
+	/* Header slots plus one per SGE for each WQE, and room to spare */
+	hwq_attr.res = &rdev->qplib_res;
+	hwq_attr.depth = roundup_pow_of_two((batch + 1) * (nsge + 2));
+	hwq_attr.stride = sizeof(struct sq_sge);
+	hwq_attr.type = HWQ_TYPE_QUEUE;
+	hwq_attr.sginfo = &sq->sginfo;
+	sq->sginfo.pgsize = PAGE_SIZE;
+	sq->sginfo.pgshft = PAGE_SHIFT;
+	if (bnxt_qplib_alloc_init_hwq(&sq->hwq, &hwq_attr))
+		goto fail;
+
+	for (i = 0; i < nsge; i++) {
+		st->sge[i].addr = 0x1000 * (i + 1);
+		st->sge[i].lkey = 0x100;
+		st->sge[i].size = 64;
+	}
+	st->wqe.type = BNXT_QPLIB_SWQE_TYPE_SEND;
+	st->wqe.flags = BNXT_QPLIB_SWQE_FLAGS_SIGNAL_COMP;
+	st->wqe.sg_list = st->sge;
+	st->wqe.num_sge = nsge;
+	return st;
+fail:
+	bnxt_re_st_sq_free(rdev, st);
+	return NULL;
+}
+
+static u64 bnxt_re_st_insn_read(struct perf_event *ev)
+{
+	u64 enabled, running;
+
+	return ev ? perf_event_read_value(ev, &enabled, &running) : 0;
+}
+
+/*
+ * Post @nwr sends through @post in batches of st->batch, rewinding the
+ * SQ between batches. Instructions (when @ev counts them) and time are
+ * taken per batch so the rewind is left out.
+ */
+static int bnxt_re_st_post_run(struct bnxt_re_st_sq *st,
+			       int (*post)(struct bnxt_qplib_qp *qp,
+					   struct bnxt_qplib_swqe *wqe),
+			       u32 nwr, struct perf_event *ev,
+			       u64 *insn, u64 *ns)
+{
+	struct bnxt_qplib_q *sq = &st->qp.sq;
+	u32 done, n, i;
+	u64 c0, t0;
+	int rc;
+
+	*insn = 0;
+	*ns = 0;
+	for (done = 0; done < nwr; done += n) {
+		sq->hwq.prod = 0;
+		sq->hwq.cons = 0;
+		sq->swq_start = 0;
+		sq->dbinfo.flags = 0;
+		n = min(st->batch, nwr - done);
+		c0 = bnxt_re_st_insn_read(ev);
+		t0 = ktime_get_ns();
+		for (i = 0; i < n; i++) {
+			st->wqe.wr_id = i;
+			rc = post(&st->qp, &st->wqe);
+			if (rc)
+				return rc;
+		}
+		*ns += ktime_get_ns() - t0;
+		*insn += bnxt_re_st_insn_read(ev) - c0;
+	}
+	return 0;
+}
+
+/*
+ * post_send [<wrs> [<sges>]]
+ * Post <wrs> RC sends of <sges> SGEs each through the QP's post_send
+ * fast path and through bnxt_qplib_post_send_generic(), and report
+ * kernel instructions and ns per WR for each. Instructions need a
+ * hardware PMU, without one only the time is reported.
+ */
+static int bnxt_re_st_post_send(struct bnxt_re_dev *rdev, char *args,
+				struct bnxt_re_st_log *log)
+{
+	struct perf_event_attr attr = {
+		.type		= PERF_TYPE_HARDWARE,
+		.size		= sizeof(attr),
+		.config		= PERF_COUNT_HW_INSTRUCTIONS,
+		.exclude_user	= 1,
+		.exclude_hv	= 1,
+	};
+	u32 nwr = 1 << 20, nsge = 1;
+	struct perf_event *ev;
+	struct bnxt_re_st_sq *st;
+	u64 insn, ns;
+	int rc;
+
+	sscanf(args, "%u %u", &nwr, &nsge);
+	if (!nwr || !nsge || nsge > BNXT_RE_ST_SQ_MAX_SGE)
+		return -EINVAL;
+
+	st = bnxt_re_st_sq_alloc(rdev, nsge, 256);
+	if (!st)
+		return -ENOMEM;
+	bnxt_qplib_set_post_send(&st->qp);
+
+	ev = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	if (IS_ERR(ev)) {
+		bnxt_re_st_printf(log, "no instruction counter (%ld)\n",
+				  PTR_ERR(ev));
+		ev = NULL;
+	}
+
+	rc = bnxt_re_st_post_run(st, st->qp.post_send, nwr, ev, &insn, &ns);
+	if (rc)
+		goto out;
+	bnxt_re_st_printf(log, "fast    wrs %u sges %u insn/wr %llu ns/wr %llu\n",
+			  nwr, nsge, div_u64(insn, nwr), div_u64(ns, nwr));
+	rc = bnxt_re_st_post_run(st, bnxt_qplib_post_send_generic, nwr, ev,
+				 &insn, &ns);
+	if (rc)
+		goto out;
+	bnxt_re_st_printf(log, "generic wrs %u sges %u insn/wr %llu ns/wr %llu\n",
+			  nwr, nsge, div_u64(insn, nwr), div_u64(ns, nwr));
+out:
+	if (ev)
+		perf_event_release_kernel(ev);
+	bnxt_re_st_sq_free(rdev, st);
+	return rc;
+}
+
+/*
+ * Lock statistics of one posting thread, counted the way lockstat does:
+ * every acquisition, the ones that found the lock taken, and the time
+ * spent waiting for those.
+ */
+struct bnxt_re_st_lock_thread {
+	struct bnxt_re_st_sq	*st;
+	spinlock_t		*lock;
+	struct completion	*start;
+	struct completion	done;
+	struct bnxt_qplib_swqe	wqe;
+	bool			nested;
+	u32			nwr;
+	u64			acq;
+	u64			contended;
+	u64			wait_ns;
+	int			rc;
+};
+
+static unsigned long bnxt_re_st_lock(struct bnxt_re_st_lock_thread *thr,
+				     spinlock_t *lock)
+{
+	unsigned long flags;
+	u64 t0;
+
+	thr->acq++;
+	if (spin_trylock_irqsave(lock, flags))
+		return flags;
+	thr->contended++;
+	t0 = ktime_get_ns();
+	spin_lock_irqsave(lock, flags);
+	thr->wait_ns += ktime_get_ns() - t0;
+	return flags;
+}
+
+static int bnxt_re_st_lock_fn(void *data)
+{
+	struct bnxt_re_st_lock_thread *thr = data;
+	struct bnxt_qplib_qp *qp = &thr->st->qp;
+	unsigned long flags, hwq_flags = 0;
+	u32 i;
+
+	wait_for_completion(thr->start);
+	for (i = 0; i < thr->nwr && !thr->rc; i++) {
+		flags = bnxt_re_st_lock(thr, thr->lock);
+		/* The removed ENABLE_FP_SPINLOCK scheme, hwq lock inside */
+		if (thr->nested)
+			hwq_flags = bnxt_re_st_lock(thr, &qp->sq.hwq.lock);
+		/* Retire everything posted so far, the SQ never fills */
+		qp->sq.hwq.cons = qp->sq.hwq.prod;
+		thr->wqe.wr_id = i;
+		thr->rc = bnxt_qplib_post_send(qp, &thr->wqe);
+		if (thr->nested)
+			spin_unlock_irqrestore(&qp->sq.hwq.lock, hwq_flags);
+		spin_unlock_irqrestore(thr->lock, flags);
+	}
+	complete(&thr->done);
+
+	return 0;
+}
+
+static int bnxt_re_st_post_lock_run(struct bnxt_re_st_sq *st, bool nested,
+				    u32 nthr, u32 nwr,
+				    struct bnxt_re_st_lock_thread *thr,
+				    struct bnxt_re_st_log *log)
+{
+	u64 acq = 0, contended = 0, wait_ns = 0, ns;
+	DECLARE_COMPLETION_ONSTACK(start);
+	struct task_struct *task;
+	spinlock_t lock;
+	u32 started, i;
+	int rc = 0;
+
+	spin_lock_init(&lock);
+	st->qp.sq.fp_lock = &lock;
+	memset(thr, 0, nthr * sizeof(*thr));
+	for (started = 0; started < nthr; started++) {
+		thr[started].st = st;
+		thr[started].lock = &lock;
+		thr[started].start = &start;
+		thr[started].wqe = st->wqe;
+		thr[started].nested = nested;
+		thr[started].nwr = nwr;
+		init_completion(&thr[started].done);
+		task = kthread_run(bnxt_re_st_lock_fn, &thr[started],
+				   "bnxt_re_st%u", started);
+		if (IS_ERR(task)) {
+			rc = PTR_ERR(task);
+			break;
+		}
+	}
+
+	ns = ktime_get_ns();
+	complete_all(&start);
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&thr[i].done);
+		if (!rc)
+			rc = thr[i].rc;
+		acq += thr[i].acq;
+		contended += thr[i].contended;
+		wait_ns += thr[i].wait_ns;
+	}
+	ns = ktime_get_ns() - ns;
+	st->qp.sq.fp_lock = NULL;
+	if (rc)
+		return rc;
+
+	bnxt_re_st_printf(log,
+			  "%-7s threads %u wrs %u acq/wr %llu contended %llu%% wait ns/wr %llu ns/wr %llu\n",
+			  nested ? "nested" : "single", nthr, nthr * nwr,
+			  div_u64(acq, nthr * nwr),
+			  div64_u64(contended * 100, acq),
+			  div_u64(wait_ns, nthr * nwr),
+			  div_u64(ns, nthr * nwr));
+	return 0;
+}
+
+/*
+ * post_lock [<threads> [<wrs>]]
+ * <threads> threads post <wrs> sends each to one host memory QP, first
+ * under the verbs SQ lock alone, then with the qplib hwq lock nested
+ * inside as ENABLE_FP_SPINLOCK used to do, and report lockstat style
+ * acquisitions, contention and wait time per WR for both.
+ */
+static int bnxt_re_st_post_lock(struct bnxt_re_dev *rdev, char *args,
+				struct bnxt_re_st_log *log)
+{
+	u32 nthr = num_online_cpus(), nwr = 1 << 18;
+	struct bnxt_re_st_lock_thread *thr;
+	struct bnxt_re_st_sq *st;
+	int rc;
+
+	sscanf(args, "%u %u", &nthr, &nwr);
+	if (!nthr || nthr > 64 || !nwr || nwr > (1U << 24))
+		return -EINVAL;
+
+	st = bnxt_re_st_sq_alloc(rdev, 1, 256);
+	thr = vzalloc(nthr * sizeof(*thr));
+	if (!st || !thr) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	bnxt_qplib_set_post_send(&st->qp);
+
+	rc = bnxt_re_st_post_lock_run(st, false, nthr, nwr, thr, log);
+	if (!rc)
+		rc = bnxt_re_st_post_lock_run(st, true, nthr, nwr, thr, log);
+out:
+	vfree(thr);
+	if (st)
+		bnxt_re_st_sq_free(rdev, st);
+	return rc;
+}
+
+struct bnxt_re_st_nq_place {
+	struct bnxt_re_dev	*rdev;
+	struct bnxt_qplib_nq	**nq;
+	u32			ncq;
+	int			vector;
+};
+
+/* Runs on a CPU of the node under test, like a ULP creating its CQs */
+static long bnxt_re_st_nq_place_fn(void *data)
+{
+	struct bnxt_re_st_nq_place *p = data;
+	u32 i;
+
+	for (i = 0; i < p->ncq; i++)
+		p->nq[i] = bnxt_re_get_nq(p->rdev, p->vector);
+	return 0;
+}
+
+static void bnxt_re_st_nq_place_put(struct bnxt_re_st_nq_place *p)
+{
+	u32 i;
+
+	for (i = 0; i < p->ncq; i++)
+		if (p->nq[i])
+			bnxt_re_put_nq(p->rdev, p->nq[i]);
+}
+
+/*
+ * nq_place [<cqs>]
+ * From one CPU of every node, place <cqs> CQs with comp_vector 0 and
+ * check that they all land on NQs local to that node, spread by load.
+ * Then ask for a local NQ by comp_vector and report whether it was
+ * honored.
+ */
+static int bnxt_re_st_nq_place(struct bnxt_re_dev *rdev, char *args,
+			       struct bnxt_re_st_log *log)
+{
+	struct bnxt_re_st_nq_place p = { .rdev = rdev };
+	const struct cpumask *node_mask;
+	u32 ncq = 64, i, nlocal, on_local;
+	u32 picks[BNXT_RE_MAX_MSIX];
+	struct bnxt_qplib_nq *nq;
+	int node, num_nq, pref;
+	u32 lo, hi;
+	int rc = 0;
+	long idx;
+	int cpu;
+
+	sscanf(args, "%u", &ncq);
+	if (!ncq || ncq > 4096)
+		return -EINVAL;
+	num_nq = rdev->nqr->num_msix - 1;
+	p.nq = vzalloc(ncq * sizeof(*p.nq));
+	if (!p.nq)
+		return -ENOMEM;
+
+	for_each_node_with_cpus(node) {
+		node_mask = cpumask_of_node(node);
+		cpu = cpumask_first_and(node_mask, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			continue;
+		nlocal = 0;
+		pref = -1;
+		memset(picks, 0, sizeof(picks));
+		for (i = 0; i < num_nq; i++) {
+			if (!cpumask_intersects(&rdev->nqr->nq[i].mask,
+						node_mask))
+				continue;
+			nlocal++;
+			if (pref < 0 && i)
+				pref = i;
+		}
+
+		p.ncq = ncq;
+		p.vector = 0;
+		work_on_cpu(cpu, bnxt_re_st_nq_place_fn, &p);
+		on_local = 0;
+		for (i = 0; i < ncq; i++) {
+			if (!p.nq[i])
+				continue;
+			idx = p.nq[i] - rdev->nqr->nq;
+			picks[idx]++;
+			if (cpumask_intersects(&p.nq[i]->mask, node_mask))
+				on_local++;
+		}
+		lo = U32_MAX;
+		hi = 0;
+		for (i = 0; i < num_nq; i++) {
+			if (nlocal &&
+			    !cpumask_intersects(&rdev->nqr->nq[i].mask,
+						node_mask))
+				continue;
+			lo = min(lo, picks[i]);
+			hi = max(hi, picks[i]);
+		}
+		bnxt_re_st_nq_place_put(&p);
+		bnxt_re_st_printf(log,
+				  "node %d cpu %d: %u local nqs, %u of %u cqs local, picks per nq %u..%u\n",
+				  node, cpu, nlocal, on_local, ncq, lo, hi);
+		if (nlocal && on_local != ncq) {
+			rc = -EIO;
+			break;
+		}
+
+		if (pref < 0)
+			continue;
+		p.ncq = 1;
+		p.vector = pref;
+		work_on_cpu(cpu, bnxt_re_st_nq_place_fn, &p);
+		nq = p.nq[0];
+		bnxt_re_st_printf(log, "node %d: comp_vector %d -> nq %ld\n",
+				  node, pref, nq ? (long)(nq - rdev->nqr->nq) : -1L);
+		bnxt_re_st_nq_place_put(&p);
+	}
+	vfree(p.nq);
+	return rc;
+}
+
+static const struct bnxt_re_selftest bnxt_re_selftests[] = {
+	{ "poll_cq", "[cqes [budget [rounds]]]", bnxt_re_st_poll_cq },
+	{ "rcfw_batch", "[cmds]", bnxt_re_st_rcfw_batch },
+	{ "rcfw_defer", "[cmds [qps]]", bnxt_re_st_rcfw_defer },
+	{ "rcfw_contend", "[senders [cmds]]", bnxt_re_st_rcfw_contend },
+	{ "db_replay", "[rings [replayers]]", bnxt_re_st_db_replay },
+	{ "cq_depth", "[cqe]", bnxt_re_st_cq_depth },
+	{ "post_send", "[wrs [sges]]", bnxt_re_st_post_send },
+	{ "post_lock", "[threads [wrs]]", bnxt_re_st_post_lock },
+	{ "cq_prefetch", "[k [budget]]", bnxt_re_st_cq_prefetch },
+	{ "get_qe", "[depth [rounds]]", bnxt_re_st_get_qe },
+	{ "nq_place", "[cqs]", bnxt_re_st_nq_place },
+};
+
+static ssize_t bnxt_re_selftest_read(struct file *file, char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	struct bnxt_re_dev *rdev = file->private_data;
+	ssize_t rc = 0;
+	int i;
+
+	mutex_lock(&bnxt_re_st_mutex);
+	if (rdev->selftest_log) {
+		rc = simple_read_from_buffer(ubuf, count, ppos,
+					     rdev->selftest_log,
+					     strlen(rdev->selftest_log));
+		goto out;
+	}
+	/* Nothing run yet, list the tests instead */
+	if (!*ppos) {
+		char buf[512];
+		size_t len = 0;
+
+		for (i = 0; i < ARRAY_SIZE(bnxt_re_selftests); i++)
+			len += scnprintf(buf + len, sizeof(buf) - len,
+					 "%s %s\n", bnxt_re_selftests[i].name,
+					 bnxt_re_selftests[i].usage);
+		rc = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+	}
+out:
+	mutex_unlock(&bnxt_re_st_mutex);
+	return rc;
+}
+
+static ssize_t bnxt_re_selftest_write(struct file *file,
+				      const char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	struct bnxt_re_dev *rdev = file->private_data;
+	const struct bnxt_re_selftest *test = NULL;
+	struct bnxt_re_st_log log = {};
+	char buf[64] = {};
+	char *args;
+	size_t len;
+	int i, rc;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+
+	args = strim(buf);
+	len = strcspn(args, " ");
+	for (i = 0; i < ARRAY_SIZE(bnxt_re_selftests); i++) {
+		if (strlen(bnxt_re_selftests[i].name) == len &&
+		    !strncmp(args, bnxt_re_selftests[i].name, len)) {
+			test = &bnxt_re_selftests[i];
+			break;
+		}
+	}
+	if (!test)
+		return -EINVAL;
+	args += len;
+
+	mutex_lock(&bnxt_re_st_mutex);
+	if (!rdev->selftest_log) {
+		rdev->selftest_log = kzalloc(BNXT_RE_ST_LOG_SIZE, GFP_KERNEL);
+		if (!rdev->selftest_log) {
+			mutex_unlock(&bnxt_re_st_mutex);
+			return -ENOMEM;
+		}
+	}
+	log.buf = rdev->selftest_log;
+	bnxt_re_st_printf(&log, "%s:\n", test->name);
+	rc = test->run(rdev, args, &log);
+	bnxt_re_st_printf(&log, "%s: %s (%d)\n", test->name,
+			  rc ? "FAIL" : "PASS", rc);
+	mutex_unlock(&bnxt_re_st_mutex);
+
+	return rc ? rc : count;
+}
+
+static const struct file_operations bnxt_re_selftest_ops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.read		= bnxt_re_selftest_read,
+	.write		= bnxt_re_selftest_write,
+	.llseek		= default_llseek,
+};
+
+void bnxt_re_selftest_add_dbg(struct bnxt_re_dev *rdev)
+{
+	rdev->selftest = debugfs_create_file("selftest", 0600,
+					     rdev->pdev_debug_dir, rdev,
+					     &bnxt_re_selftest_ops);
+}
+
+void bnxt_re_selftest_rem_dbg(struct bnxt_re_dev *rdev)
+{
+	debugfs_remove(rdev->selftest);
+	rdev->selftest = NULL;
+	mutex_lock(&bnxt_re_st_mutex);
+	kfree(rdev->selftest_log);
+	rdev->selftest_log = NULL;
+	mutex_unlock(&bnxt_re_st_mutex);
+}
+#endif
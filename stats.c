@@ -383,7 +383,9 @@ int bnxt_re_get_device_stats(struct bnxt_re_dev *rdev)
 		if (bnxt_ext_stats_supported(rdev->chip_ctx, rdev->dev_attr->dev_cap_flags,
 					     rdev->is_virtfn))
 			rc = bnxt_re_get_ext_stat(rdev);
-		else if (!_is_chip_gen_p5_p7(rdev->chip_ctx))
+		/* The only place the CFA flow counters are read */
+		if (!rc && (rdev->is_virtfn ||
+			    !_is_ext_stats_supported(rdev->dev_attr->dev_cap_flags)))
 			rc = bnxt_re_get_qos_stats(rdev);
 
 		if (rc && rc != -ENOMEM)
@@ -408,3 +410,163 @@ int bnxt_re_get_device_stats(struct bnxt_re_dev *rdev)
 
 	return rc;
 }
+
+static bool bnxt_re_stats_fresh(struct bnxt_re_dev *rdev)
+{
+	unsigned long tstamp = READ_ONCE(rdev->stats.refresh_tstamp);
+	u32 max_stale_ms = READ_ONCE(rdev->stats.stats_max_stale_ms);
+
+	return tstamp && max_stale_ms &&
+	       time_before(jiffies, tstamp + msecs_to_jiffies(max_stale_ms));
+}
+
+/* Caller holds refresh_lock */
+static void bnxt_re_publish_stats_snap(struct bnxt_re_dev *rdev)
+{
+	write_seqlock(&rdev->stats.snap_lock);
+	rdev->stats.snap.dstat = rdev->stats.dstat;
+	rdev->stats.snap.cnps = rdev->stats.cnps;
+	rdev->stats.snap.generation = rdev->stats.cache_refreshes;
+	write_sequnlock(&rdev->stats.snap_lock);
+}
+
+/**
+ * bnxt_re_refresh_device_stats - Bring the cached device stats up to date
+ * @rdev: device whose stats are read
+ * @force: query FW even if the cached copy is still fresh
+ *
+ * bnxt_re_worker refreshes rdev->stats.dstat on the stats_query_sec
+ * cadence. Readers only go to FW when the copy is older than
+ * stats_max_stale_ms, and concurrent readers of a stale copy share a
+ * single refresh. A successful refresh republishes stats.snap, which
+ * readers that do not hold refresh_lock copy under stats.snap_lock.
+ */
+int bnxt_re_refresh_device_stats(struct bnxt_re_dev *rdev, bool force)
+{
+	int rc = 0;
+
+	if (!force && bnxt_re_stats_fresh(rdev)) {
+		atomic64_inc(&rdev->stats.cache_hits);
+		return 0;
+	}
+
+	mutex_lock(&rdev->stats.refresh_lock);
+	/* Somebody else may have refreshed while we waited for the lock */
+	if (!force && bnxt_re_stats_fresh(rdev)) {
+		atomic64_inc(&rdev->stats.cache_hits);
+		goto unlock;
+	}
+	rc = bnxt_re_get_device_stats(rdev);
+	rdev->stats.cache_refreshes++;
+	if (!rc) {
+		bnxt_re_publish_stats_snap(rdev);
+		WRITE_ONCE(rdev->stats.refresh_tstamp, jiffies ? : 1);
+	}
+unlock:
+	mutex_unlock(&rdev->stats.refresh_lock);
+	return rc;
+}
+
+static int bnxt_re_resize_vf_stats(struct bnxt_re_vf_stats *vfs, u16 num_vfs)
+{
+	struct bnxt_qplib_query_stats_info *sinfo;
+	struct bnxt_qplib_roce_stats *tbl;
+	int *rcs;
+	int i;
+
+	tbl = kcalloc(num_vfs, sizeof(*tbl), GFP_KERNEL);
+	sinfo = kcalloc(num_vfs, sizeof(*sinfo), GFP_KERNEL);
+	rcs = kcalloc(num_vfs, sizeof(*rcs), GFP_KERNEL);
+	if (!tbl || !sinfo || !rcs) {
+		kfree(rcs);
+		kfree(sinfo);
+		kfree(tbl);
+		return -ENOMEM;
+	}
+	for (i = 0; i < num_vfs; i++) {
+		sinfo[i].function_id = i;
+		sinfo[i].collection_id = 0xFF;
+		sinfo[i].vf_valid = true;
+		rcs[i] = -ENODATA;
+	}
+
+	kfree(vfs->rcs);
+	kfree(vfs->sinfo);
+	kfree(vfs->tbl);
+	vfs->tbl = tbl;
+	vfs->sinfo = sinfo;
+	vfs->rcs = rcs;
+	vfs->num_vfs = num_vfs;
+	vfs->filled = 0;
+	vfs->tstamp = 0;
+	return 0;
+}
+
+/**
+ * bnxt_re_sweep_vf_stats - Collect RoCE stats of every enabled VF
+ * @rdev: PF device
+ * @force: sweep even if the last one is younger than stats_max_stale_ms
+ *
+ * All per VF QUERY_ROCE_STATS commands are pipelined on the CMDQ instead
+ * of being issued one round trip at a time. Results land in
+ * rdev->stats.vfs, which the caller reads under vfs.lock.
+ */
+int bnxt_re_sweep_vf_stats(struct bnxt_re_dev *rdev, bool force)
+{
+	struct bnxt_re_vf_stats *vfs = &rdev->stats.vfs;
+	u16 num_vfs;
+	u64 start;
+	int rc = 0;
+
+	if (rdev->is_virtfn)
+		return -EOPNOTSUPP;
+	if (!test_bit(BNXT_RE_FLAG_ISSUE_ROCE_STATS, &rdev->flags))
+		return -EOPNOTSUPP;
+
+	num_vfs = pci_num_vf(rdev->en_dev->pdev);
+	mutex_lock(&vfs->lock);
+	if (num_vfs != vfs->num_vfs) {
+		rc = bnxt_re_resize_vf_stats(vfs, num_vfs);
+		if (rc)
+			goto unlock;
+	}
+	if (!num_vfs)
+		goto unlock;
+	if (!force && vfs->tstamp && rdev->stats.stats_max_stale_ms &&
+	    time_before(jiffies, vfs->tstamp +
+			msecs_to_jiffies(rdev->stats.stats_max_stale_ms)))
+		goto unlock;
+
+	start = ktime_get_ns();
+	rc = bnxt_qplib_get_roce_error_stats_bulk(&rdev->rcfw, vfs->tbl,
+						  vfs->sinfo, vfs->rcs,
+						  num_vfs);
+	vfs->last_sweep_us = div_u64(ktime_get_ns() - start, NSEC_PER_USEC);
+	vfs->max_sweep_us = max(vfs->max_sweep_us, vfs->last_sweep_us);
+	vfs->sweeps++;
+	if (rc < 0)
+		goto unlock;
+	vfs->filled = rc;
+	vfs->tstamp = jiffies;
+	rc = 0;
+unlock:
+	mutex_unlock(&vfs->lock);
+	return rc;
+}
+
+void bnxt_re_free_vf_stats(struct bnxt_re_dev *rdev)
+{
+	struct bnxt_re_vf_stats *vfs = &rdev->stats.vfs;
+
+	mutex_lock(&vfs->lock);
+	kfree(vfs->rcs);
+	kfree(vfs->sinfo);
+	kfree(vfs->tbl);
+	vfs->rcs = NULL;
+	vfs->sinfo = NULL;
+	vfs->tbl = NULL;
+	vfs->num_vfs = 0;
+	vfs->filled = 0;
+	vfs->tstamp = 0;
+	mutex_unlock(&vfs->lock);
+}
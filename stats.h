@@ -160,6 +160,29 @@ struct bnxt_re_res_cntrs {
 	atomic_t max_pd_count;
 };
 
+/* Per VF RoCE stats filled by one bnxt_re_sweep_vf_stats() pass */
+struct bnxt_re_vf_stats {
+	struct mutex			lock;
+	struct bnxt_qplib_roce_stats	*tbl;
+	struct bnxt_qplib_query_stats_info *sinfo;
+	/* Per entry query result, 0 when tbl[i] is valid */
+	int				*rcs;
+	u16				num_vfs;
+	u16				filled;
+	unsigned long			tstamp;
+	u64				sweeps;
+	u64				last_sweep_us;
+	u64				max_sweep_us;
+};
+
+/* Copy of dstat/cnps handed to lockless readers */
+struct bnxt_re_stats_snap {
+	struct bnxt_re_rstat		dstat;
+	struct bnxt_re_cc_stat		cnps;
+	/* cache_refreshes count this copy was published at */
+	u64				generation;
+};
+
 struct bnxt_re_device_stats {
 	struct bnxt_re_rstat            dstat;
 	struct bnxt_re_res_cntrs        rsors;
@@ -173,8 +196,29 @@ struct bnxt_re_device_stats {
 	 * decide whether to issue the command to FW.
 	 */
 	u32				stats_query_counter;
+	/* Readers are served from dstat while it is younger than
+	 * stats_max_stale_ms, 0 means always query FW.
+	 */
+	u32				stats_max_stale_ms;
+	unsigned long			refresh_tstamp;
+	/* Serializes FW refreshes of dstat */
+	struct mutex			refresh_lock;
+	/* dstat is rebuilt across several FW commands, readers that do
+	 * not take refresh_lock use snap, republished after each refresh.
+	 */
+	seqlock_t			snap_lock;
+	struct bnxt_re_stats_snap	snap;
+	atomic64_t			cache_hits;
+	u64				cache_refreshes;
+	struct bnxt_re_vf_stats		vfs;
+	/* SQ doorbells coalesced away and flushes issued by the timer */
+	atomic64_t			sq_db_saved;
+	atomic64_t			sq_db_timer_flush;
 };
 
+#define BNXT_RE_STATS_MAX_STALE_MS_DEF	2000
+#define BNXT_RE_STATS_MAX_STALE_MS_MAX	60000
+
 static inline u64 bnxt_re_get_cfa_stat_mask(struct bnxt_qplib_chip_ctx *cctx,
 					    bool type)
 {
@@ -228,4 +272,7 @@ static inline void bnxt_re_clear_rsors_stat(struct bnxt_re_res_cntrs *rsors)
 
 int bnxt_re_get_device_stats(struct bnxt_re_dev *rdev);
 int bnxt_re_get_qos_stats(struct bnxt_re_dev *rdev);
+int bnxt_re_refresh_device_stats(struct bnxt_re_dev *rdev, bool force);
+int bnxt_re_sweep_vf_stats(struct bnxt_re_dev *rdev, bool force);
+void bnxt_re_free_vf_stats(struct bnxt_re_dev *rdev);
 #endif /* __STATS_H__ */